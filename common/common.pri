@@ -1,6 +1,13 @@
-SOURCES += $$PWD/logging.cpp
+SOURCES += $$PWD/logging.cpp \
+           $$PWD/sharedring.cpp \
+           $$PWD/valuepatch.cpp
 
 HEADERS += $$PWD/logging.h \
-           $$PWD/sconnect.h
+           $$PWD/sconnect.h \
+           $$PWD/sharedring.h \
+           $$PWD/valuepatch.h
 
 INCLUDEPATH += $$PWD
+
+# shm_open
+LIBS += -lrt
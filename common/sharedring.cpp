@@ -0,0 +1,418 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "sharedring.h"
+#include "logging.h"
+
+#include <QDataStream>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+// Layout of the shared memory: the header, MaxKeys entries of the key
+// directory, and the slots.  The writer and the readers are on the
+// same machine, so everything is in the native byte order.
+
+static const quint32 RingMagic = 0x434b5231; // "CKR1"
+static const quint32 RingVersion = 1;
+static const quint32 KeyNameSize = 128; ///< Bytes per directory entry, including the terminating 0
+static const quint32 OversizedValue = 0xffffffff; ///< Slot length of a value which didn't fit
+
+struct SharedRingHeader
+{
+    quint32 magic;
+    quint32 version;
+    quint32 slotCount;
+    quint32 slotSize;
+    quint32 maxKeys;
+    volatile quint32 keyCount; ///< Number of entries in the key directory
+    volatile quint32 head; ///< Number of records published, wraps around
+    quint32 reserved[9];
+};
+
+struct SharedRingSlot
+{
+    volatile quint32 seq; ///< 2n+1 while record n is written, 2n+2 when it's complete
+    quint32 keyIndex;
+    quint64 timestamp;
+    quint32 length; ///< Bytes of serialized value, or OversizedValue
+    quint32 reserved;
+    // followed by slotSize bytes of serialized value
+};
+
+// The writer and the readers are in different processes, so
+// QAtomicInt doesn't help here; the accesses to the volatile fields
+// are ordered with full barriers instead.
+static inline void memoryBarrier()
+{
+    __sync_synchronize();
+}
+
+static size_t slotStride(quint32 slotSize)
+{
+    return (sizeof(SharedRingSlot) + slotSize + 7) & ~size_t(7);
+}
+
+static size_t ringSize(quint32 slotCount, quint32 slotSize, quint32 maxKeys)
+{
+    return sizeof(SharedRingHeader) + size_t(maxKeys) * KeyNameSize +
+        size_t(slotCount) * slotStride(slotSize);
+}
+
+static char *keyEntry(const SharedRingHeader *header, quint32 index)
+{
+    return (char *) header + sizeof(SharedRingHeader) + size_t(index) * KeyNameSize;
+}
+
+static SharedRingSlot *slotAt(const SharedRingHeader *header, quint32 record)
+{
+    return (SharedRingSlot *) ((char *) header + sizeof(SharedRingHeader) +
+                               size_t(header->maxKeys) * KeyNameSize +
+                               (record & (header->slotCount - 1)) * slotStride(header->slotSize));
+}
+
+static char *slotData(const SharedRingSlot *slot)
+{
+    return (char *) slot + sizeof(SharedRingSlot);
+}
+
+/*!
+  \class SharedRingWriter
+
+  \brief Publishes property values into a ring buffer in POSIX shared
+  memory, for SharedRingReader instances in other processes.
+
+  The ring has a fixed number of fixed size slots, and one writer.
+  Each slot is guarded by a sequence number which is odd while the
+  writer is filling the slot, so the readers never lock anything: they
+  copy a slot and check that its sequence number didn't change
+  meanwhile.  A reader which falls more than a full ring behind loses
+  records and is told so.
+
+  The keys are stored once, in a directory in front of the slots, and
+  the records refer to them by index.  A value which doesn't fit in a
+  slot is published as a marker which tells the readers to fetch the
+  value in some other way.
+*/
+
+SharedRingWriter::SharedRingWriter()
+    : header(0), mappedSize(0), nextRecord(0)
+{
+}
+
+/// Unmaps and removes the shared memory object.  Readers which have
+/// it mapped can go on reading, but no new records arrive.
+SharedRingWriter::~SharedRingWriter()
+{
+    if (header) {
+        munmap(header, mappedSize);
+        shm_unlink(myName.toLocal8Bit().constData());
+    }
+}
+
+/// Creates the shared memory object \a name (like "/contextkit-1234")
+/// holding a ring of \a slotCount slots, each of which can hold a
+/// serialized value of \a slotSize bytes.  Returns true on success.
+/// The object is readable only by the processes of the same user, and
+/// it's not created if an object with the same name exists already.
+bool SharedRingWriter::create(const QString &name, quint32 slotCount, quint32 slotSize)
+{
+    if (header) {
+        contextWarning() << "Shared ring already created:" << myName;
+        return false;
+    }
+    if (slotCount == 0 || (slotCount & (slotCount - 1)) != 0) {
+        contextCritical() << "The number of slots in a shared ring must be a power of two, not" << slotCount;
+        return false;
+    }
+
+    const QByteArray path = name.toLocal8Bit();
+    int fd = shm_open(path.constData(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        contextCritical() << "Cannot create shared memory" << name << ":" << strerror(errno);
+        return false;
+    }
+    const size_t size = ringSize(slotCount, slotSize, MaxKeys);
+    void *mapped = MAP_FAILED;
+    // The new object is zero filled.
+    if (ftruncate(fd, size) == 0)
+        mapped = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        contextCritical() << "Cannot map shared memory" << name << ":" << strerror(errno);
+        ::close(fd);
+        shm_unlink(path.constData());
+        return false;
+    }
+    ::close(fd);
+
+    header = static_cast<SharedRingHeader *>(mapped);
+    header->version = RingVersion;
+    header->slotCount = slotCount;
+    header->slotSize = slotSize;
+    header->maxKeys = MaxKeys;
+    memoryBarrier();
+    header->magic = RingMagic;
+
+    mappedSize = size;
+    myName = name;
+    nextRecord = 0;
+    return true;
+}
+
+/// Returns the name of the shared memory object, or an empty string
+/// if create() hasn't succeeded.
+QString SharedRingWriter::name() const
+{
+    return myName;
+}
+
+/// Adds \a key to the key directory, unless it's there already.
+/// Returns false if the key cannot be published through the ring: the
+/// directory is full or the key is too long.
+bool SharedRingWriter::addKey(const QString &key)
+{
+    if (header == 0)
+        return false;
+    if (keyIndexes.contains(key))
+        return true;
+
+    const QByteArray utf8 = key.toUtf8();
+    const quint32 index = keyIndexes.size();
+    if (index >= MaxKeys || quint32(utf8.size()) >= KeyNameSize)
+        return false;
+
+    // The entry is complete before the readers can see it.
+    memcpy(keyEntry(header, index), utf8.constData(), utf8.size());
+    memoryBarrier();
+    header->keyCount = index + 1;
+    keyIndexes.insert(key, index);
+    return true;
+}
+
+/// Publishes \a value of \a key, set at \a timestamp.  The key must
+/// have been added with addKey().  If the serialized value doesn't fit
+/// in a slot, the readers are told to fetch it in some other way, and
+/// false is returned.
+bool SharedRingWriter::publish(const QString &key, const QVariant &value, quint64 timestamp)
+{
+    QHash<QString, quint32>::const_iterator it = keyIndexes.constFind(key);
+    if (header == 0 || it == keyIndexes.constEnd())
+        return false;
+
+    encoded.clear();
+    QDataStream stream(&encoded, QIODevice::WriteOnly);
+    // Fixed, so that the Qt 4 and Qt 5 versions of the libraries
+    // understand each other.
+    stream.setVersion(QDataStream::Qt_4_6);
+    stream << value;
+    const bool fits = quint32(encoded.size()) <= header->slotSize;
+
+    SharedRingSlot *slot = slotAt(header, nextRecord);
+    const quint32 seq = nextRecord * 2;
+    slot->seq = seq + 1;
+    memoryBarrier();
+    slot->keyIndex = it.value();
+    slot->timestamp = timestamp;
+    if (fits) {
+        slot->length = encoded.size();
+        memcpy(slotData(slot), encoded.constData(), encoded.size());
+    }
+    else
+        slot->length = OversizedValue;
+    memoryBarrier();
+    slot->seq = seq + 2;
+    ++nextRecord;
+    memoryBarrier();
+    header->head = nextRecord;
+    return fits;
+}
+
+/*!
+  \class SharedRingReader
+
+  \brief Reads the values published by a SharedRingWriter of another
+  process.
+
+  The ring is mapped read only.  poll() returns the records published
+  since the previous call.  Right after open() it returns all the
+  records still in the ring; those can be older than values received
+  in some other way, so the caller should compare the time stamps.
+*/
+
+SharedRingReader::SharedRingReader()
+    : header(0), mappedSize(0), nextRecord(0)
+{
+}
+
+SharedRingReader::~SharedRingReader()
+{
+    close();
+}
+
+/// Maps the ring created by a SharedRingWriter as \a name.  Returns
+/// true on success.
+bool SharedRingReader::open(const QString &name)
+{
+    close();
+
+    int fd = shm_open(name.toLocal8Bit().constData(), O_RDONLY, 0);
+    if (fd < 0) {
+        contextWarning() << "Cannot open shared memory" << name << ":" << strerror(errno);
+        return false;
+    }
+    struct stat info;
+    void *mapped = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && size_t(info.st_size) >= sizeof(SharedRingHeader))
+        mapped = mmap(0, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        contextWarning() << "Cannot map shared memory" << name;
+        return false;
+    }
+
+    const SharedRingHeader *ring = static_cast<const SharedRingHeader *>(mapped);
+    if (ring->magic != RingMagic || ring->version != RingVersion ||
+        ring->slotCount == 0 || (ring->slotCount & (ring->slotCount - 1)) != 0 ||
+        ringSize(ring->slotCount, ring->slotSize, ring->maxKeys) > size_t(info.st_size)) {
+        contextWarning() << "Shared memory" << name << "is not a compatible ring";
+        munmap(mapped, info.st_size);
+        return false;
+    }
+
+    header = ring;
+    mappedSize = info.st_size;
+    myName = name;
+    // Start from the oldest record still in the ring.
+    const quint32 head = header->head;
+    nextRecord = head > header->slotCount ? head - header->slotCount : 0;
+    return true;
+}
+
+/// Unmaps the ring.
+void SharedRingReader::close()
+{
+    if (header)
+        munmap(const_cast<SharedRingHeader *>(header), mappedSize);
+    header = 0;
+    mappedSize = 0;
+    myName.clear();
+    keyNames.clear();
+}
+
+/// Returns true if a ring is mapped.
+bool SharedRingReader::isOpen() const
+{
+    return header != 0;
+}
+
+/// Returns the name of the mapped ring, or an empty string.
+QString SharedRingReader::name() const
+{
+    return myName;
+}
+
+/// Appends the records published since the last call to \a records,
+/// oldest first.  The keys of the values which were too big for the
+/// ring, or which couldn't be read, are appended to \a staleKeys.
+/// Returns false if records were lost because the writer overwrote
+/// them before we got to them; then the value of any key can be
+/// stale.
+bool SharedRingReader::poll(QList<SharedRingRecord> &records, QStringList &staleKeys)
+{
+    if (header == 0)
+        return true;
+
+    const quint32 head = header->head;
+    memoryBarrier();
+    bool complete = true;
+    if (head - nextRecord > header->slotCount) {
+        // The writer has lapped us.
+        nextRecord = head - header->slotCount;
+        complete = false;
+    }
+
+    QByteArray data;
+    for (; nextRecord != head; ++nextRecord) {
+        const SharedRingSlot *slot = slotAt(header, nextRecord);
+        const quint32 seq = nextRecord * 2 + 2;
+        if (slot->seq != seq) {
+            complete = false;
+            continue;
+        }
+        memoryBarrier();
+        const quint32 keyIndex = slot->keyIndex;
+        const quint64 timestamp = slot->timestamp;
+        const quint32 length = slot->length;
+        if (length <= header->slotSize)
+            data = QByteArray(slotData(slot), length);
+        memoryBarrier();
+        if (slot->seq != seq) {
+            // Overwritten while we were copying it.
+            complete = false;
+            continue;
+        }
+
+        const QString key = keyName(keyIndex);
+        if (key.isEmpty())
+            continue;
+        if (length > header->slotSize) {
+            staleKeys << key;
+            continue;
+        }
+
+        SharedRingRecord record;
+        record.key = key;
+        record.timestamp = timestamp;
+        QDataStream stream(data);
+        stream.setVersion(QDataStream::Qt_4_6);
+        stream >> record.value;
+        if (stream.status() != QDataStream::Ok) {
+            staleKeys << key;
+            continue;
+        }
+        records << record;
+    }
+    return complete;
+}
+
+/// Returns the key at \a index of the key directory, reading the new
+/// entries of the directory when needed.  Returns an empty string for
+/// an invalid index.
+QString SharedRingReader::keyName(quint32 index)
+{
+    if (index >= quint32(keyNames.size())) {
+        quint32 count = header->keyCount;
+        memoryBarrier();
+        if (count > header->maxKeys)
+            count = header->maxKeys;
+        for (quint32 i = keyNames.size(); i < count; ++i) {
+            const char *entry = keyEntry(header, i);
+            keyNames << QString::fromUtf8(entry, qstrnlen(entry, KeyNameSize));
+        }
+        if (index >= quint32(keyNames.size()))
+            return QString();
+    }
+    return keyNames.at(index);
+}
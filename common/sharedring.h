@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef SHAREDRING_H
+#define SHAREDRING_H
+
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QVector>
+
+struct SharedRingHeader;
+struct SharedRingSlot;
+
+/// One value read from a SharedRingReader.
+struct SharedRingRecord
+{
+    QString key;
+    QVariant value;
+    quint64 timestamp;
+};
+
+class SharedRingWriter
+{
+public:
+    SharedRingWriter();
+    ~SharedRingWriter();
+
+    bool create(const QString &name,
+                quint32 slotCount = DefaultSlotCount,
+                quint32 slotSize = DefaultSlotSize);
+    QString name() const;
+    bool addKey(const QString &key);
+    bool publish(const QString &key, const QVariant &value, quint64 timestamp);
+
+    static const quint32 DefaultSlotCount = 256; ///< Must be a power of two
+    static const quint32 DefaultSlotSize = 232; ///< Bytes of serialized value per slot
+    static const quint32 MaxKeys = 256; ///< Size of the key directory
+
+private:
+    Q_DISABLE_COPY(SharedRingWriter)
+
+    QString myName; ///< Name of the shared memory object, empty if not created
+    SharedRingHeader *header; ///< The mapped ring, or 0
+    size_t mappedSize; ///< Size of the mapping
+    quint32 nextRecord; ///< Number of the next record to publish
+    QHash<QString, quint32> keyIndexes; ///< Keys in the directory -> index
+    QByteArray encoded; ///< Buffer for serializing the values
+};
+
+class SharedRingReader
+{
+public:
+    SharedRingReader();
+    ~SharedRingReader();
+
+    bool open(const QString &name);
+    void close();
+    bool isOpen() const;
+    QString name() const;
+    bool poll(QList<SharedRingRecord> &records, QStringList &staleKeys);
+
+private:
+    Q_DISABLE_COPY(SharedRingReader)
+
+    QString keyName(quint32 index);
+
+    QString myName; ///< Name of the shared memory object, empty if not open
+    const SharedRingHeader *header; ///< The mapped ring, or 0
+    size_t mappedSize; ///< Size of the mapping
+    quint32 nextRecord; ///< Number of the next record to read
+    QVector<QString> keyNames; ///< The part of the key directory read so far
+};
+
+#endif
@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "valuepatch.h"
+
+#include <QStringList>
+
+/*!
+  \class ValuePatch
+  \brief Describes the change of a map or a list value as a patch.
+
+  A patch turns one version of a value into a later version.  Sending
+  only the elements which changed is much cheaper than sending the
+  whole value, when the value is a big map or list and only a few of
+  its elements change at a time.
+
+  The patch is a list: the version it applies to, the version it
+  results in, and the list of operations.  Each operation is a list
+  too, starting with the code of the operation.  A map is patched by
+  setting and removing its entries, a list by setting its elements by
+  index, truncating it and appending to it.  Only the top level of the
+  value is patched; a changed element is sent whole.
+
+  A patch starting with the Reset operation carries the whole value,
+  and applies to any version.  make() returns such a patch when the
+  value cannot be patched, or when the patch wouldn't be smaller than
+  the value.
+
+  All of the patch is made of types D-Bus can carry: lists, strings,
+  integers and the values of the elements.
+*/
+
+/// Returns the patch turning \a from, at \a baseVersion, into \a to,
+/// at \a version.
+QVariant ValuePatch::make(const QVariant &from, const QVariant &to,
+                          quint64 baseVersion, quint64 version)
+{
+    QVariantList ops;
+
+    if (from.type() == QVariant::Map && to.type() == QVariant::Map) {
+        const QVariantMap oldMap = from.toMap();
+        const QVariantMap newMap = to.toMap();
+        for (QVariantMap::const_iterator it = oldMap.constBegin(); it != oldMap.constEnd(); ++it)
+            if (!newMap.contains(it.key()))
+                ops << QVariant(QVariantList() << int(Remove) << it.key());
+        for (QVariantMap::const_iterator it = newMap.constBegin(); it != newMap.constEnd(); ++it) {
+            QVariantMap::const_iterator old = oldMap.constFind(it.key());
+            if (old == oldMap.constEnd() || old.value() != it.value() ||
+                old.value().type() != it.value().type())
+                ops << QVariant(QVariantList() << int(Set) << it.key() << it.value());
+        }
+        if (ops.size() * 2 > newMap.size())
+            return reset(to, version);
+    }
+    else if (from.type() == QVariant::List && to.type() == QVariant::List) {
+        const QVariantList oldList = from.toList();
+        const QVariantList newList = to.toList();
+        const int common = qMin(oldList.size(), newList.size());
+        for (int i = 0; i < common; ++i)
+            if (oldList.at(i) != newList.at(i) || oldList.at(i).type() != newList.at(i).type())
+                ops << QVariant(QVariantList() << int(Set) << i << newList.at(i));
+        if (newList.size() < oldList.size())
+            ops << QVariant(QVariantList() << int(Resize) << newList.size());
+        for (int i = common; i < newList.size(); ++i)
+            ops << QVariant(QVariantList() << int(Append) << newList.at(i));
+        if (ops.size() * 2 > newList.size())
+            return reset(to, version);
+    }
+    else
+        return reset(to, version);
+
+    return QVariantList() << baseVersion << version << QVariant(ops);
+}
+
+/// Returns the patch replacing any version with \a value, at \a
+/// version.
+QVariant ValuePatch::reset(const QVariant &value, quint64 version)
+{
+    QVariantList maybe;
+    if (!value.isNull())
+        maybe << value;
+    QVariantList op;
+    op << int(Reset) << QVariant(maybe);
+    return QVariantList() << version << version << QVariant(QVariantList() << QVariant(op));
+}
+
+/// Returns the patch doing \a first and then \a second.
+QVariant ValuePatch::compose(const QVariant &first, const QVariant &second)
+{
+    const QVariantList p1 = first.toList();
+    const QVariantList p2 = second.toList();
+    if (p1.size() != 3 || p2.size() != 3)
+        return second;
+    const QVariantList ops2 = p2.at(2).toList();
+    if (!ops2.isEmpty() && ops2.at(0).toList().value(0).toInt() == Reset)
+        return second;
+    return QVariantList() << p1.at(0) << p2.at(1) << QVariant(p1.at(2).toList() + ops2);
+}
+
+/// The value being patched, unpacked once for all the operations.
+struct PatchTarget
+{
+    explicit PatchTarget(const QVariant &value) { load(value); }
+
+    void load(const QVariant &value)
+    {
+        type = value.type();
+        other = QVariant();
+        map.clear();
+        list.clear();
+        if (type == QVariant::Map)
+            map = value.toMap();
+        else if (type == QVariant::List)
+            list = value.toList();
+        else
+            other = value;
+    }
+
+    QVariant value() const
+    {
+        if (type == QVariant::Map)
+            return map;
+        if (type == QVariant::List)
+            return list;
+        return other;
+    }
+
+    QVariant::Type type;
+    QVariant other; ///< The value, if it is neither a map nor a list
+    QVariantMap map;
+    QVariantList list;
+};
+
+/// Applies \a patch to \a value, which is at \a version.  On success,
+/// \a value and \a version are updated.  The patch doesn't apply if
+/// it's for an older version (Stale) or if it's for a version we
+/// don't have (Mismatch); the caller then needs to get the whole value
+/// again.
+ValuePatch::Result ValuePatch::apply(const QVariant &patch, QVariant &value, quint64 &version)
+{
+    const QVariantList p = patch.toList();
+    if (p.size() != 3)
+        return Malformed;
+    const quint64 baseVersion = p.at(0).toULongLong();
+    const quint64 newVersion = p.at(1).toULongLong();
+    const QVariantList ops = p.at(2).toList();
+
+    const bool isReset = !ops.isEmpty() && ops.at(0).toList().value(0).toInt() == Reset;
+    if (isReset) {
+        if (newVersion < version)
+            return Stale;
+    }
+    else {
+        // An empty patch from our version only refreshes the time
+        // stamp.
+        if (newVersion < version || (newVersion == version && !ops.isEmpty()))
+            return Stale;
+        if (baseVersion != version)
+            return Mismatch;
+    }
+
+    PatchTarget target(value);
+    Q_FOREACH (const QVariant &op, ops)
+        if (!applyOp(op.toList(), target))
+            return Malformed;
+    value = target.value();
+    version = newVersion;
+    return Applied;
+}
+
+/// Applies one operation of a patch to \a target.  Returns false if
+/// the operation doesn't fit the value.
+bool ValuePatch::applyOp(const QVariantList &op, PatchTarget &target)
+{
+    if (op.isEmpty())
+        return false;
+
+    switch (op.at(0).toInt()) {
+    case Reset: {
+        const QVariantList maybe = op.value(1).toList();
+        target.load(maybe.isEmpty() ? QVariant() : maybe.at(0));
+        return true;
+    }
+    case Set:
+        if (op.size() != 3)
+            return false;
+        if (target.type == QVariant::Map) {
+            target.map.insert(op.at(1).toString(), op.at(2));
+            return true;
+        }
+        if (target.type == QVariant::List) {
+            const int index = op.at(1).toInt();
+            if (index < 0 || index >= target.list.size())
+                return false;
+            target.list[index] = op.at(2);
+            return true;
+        }
+        return false;
+    case Remove:
+        if (op.size() != 2 || target.type != QVariant::Map)
+            return false;
+        target.map.remove(op.at(1).toString());
+        return true;
+    case Resize: {
+        if (op.size() != 2 || target.type != QVariant::List)
+            return false;
+        const int size = op.at(1).toInt();
+        if (size < 0 || size > target.list.size())
+            return false;
+        target.list.erase(target.list.begin() + size, target.list.end());
+        return true;
+    }
+    case Append:
+        if (op.size() != 2 || target.type != QVariant::List)
+            return false;
+        target.list << op.at(1);
+        return true;
+    default:
+        return false;
+    }
+}
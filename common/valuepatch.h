@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef VALUEPATCH_H
+#define VALUEPATCH_H
+
+#include <QVariant>
+
+struct PatchTarget;
+
+class ValuePatch
+{
+public:
+    static QVariant make(const QVariant &from, const QVariant &to,
+                         quint64 baseVersion, quint64 version);
+    static QVariant reset(const QVariant &value, quint64 version);
+    static QVariant compose(const QVariant &first, const QVariant &second);
+
+    /// Result of apply()
+    enum Result {
+        Applied, ///< The value was patched
+        Stale, ///< The patch is older than the value; nothing changed
+        Mismatch, ///< The patch is for a version we don't have; resync
+        Malformed ///< Not a patch
+    };
+    static Result apply(const QVariant &patch, QVariant &value, quint64 &version);
+
+    /// The operations in a patch
+    enum Op {
+        Set, ///< [Set, key or index, value]: add or replace an element
+        Remove, ///< [Remove, key]: remove an element of a map
+        Resize, ///< [Resize, size]: truncate a list
+        Append, ///< [Append, value]: append to a list
+        Reset ///< [Reset, Maybe_Variant]: replace the whole value
+    };
+
+private:
+    static bool applyOp(const QVariantList &op, PatchTarget &target);
+};
+
+#endif
@@ -15,10 +15,13 @@
 #include <QtDBus/QtDBus>
 
 #define PROPERTY "org.maemo.contextkit.Property"
+#define SERVICE "org.maemo.contextkit.Service"
+#define SERVICE_PATH "/org/maemo/contextkit"
 
 CommandWatcher::CommandWatcher(int commandfd, QObject *parent) :
     QObject(parent), commandfd(commandfd), out(stdout), changedSignalReceived(false)
 {
+    qDBusRegisterMetaType<QList<quint64> >();
     fcntl(commandfd, F_SETFL, O_NONBLOCK);
     commandNotifier = new QSocketNotifier(commandfd, QSocketNotifier::Read, this);
     sconnect(commandNotifier, SIGNAL(activated(int)), this, SLOT(onActivated()));
@@ -53,6 +56,7 @@ void CommandWatcher::help()
         qDebug() << "  get NAME KEY                    - get value of a key (long name) for a known NAME";
         qDebug() << "  subscribe NAME KEY              - subscribe to KEY for a known NAME";
         qDebug() << "  unsubscribe NAME KEY            - unsubscribe from KEY for a known NAME";
+        qDebug() << "  batchsubscribe NAME KEY...      - subscribe to all KEYs with one call for a known NAME";
         qDebug() << "  resetsignalstatus               - forget any previously received ValueChanged signals";
         qDebug() << "  waitforchanged TIMEOUT          - wait until the ValueChanged signal arrives over DBus";
         qDebug() << "Any prefix of a command can be used as an abbreviation";
@@ -97,6 +101,13 @@ void CommandWatcher::interpret(const QString& command)
             }
             else
                 out << "Error: wrong number of parameters" << endl;
+        } else if (QString("batchsubscribe").startsWith(commandName)) {
+            if (args.size() >= 2) {
+                QString name = args.takeFirst();
+                callBatchSubscribe(name, args);
+            }
+            else
+                out << "Error: wrong number of parameters" << endl;
         } else if (QString("get").startsWith(commandName)) {
             if (args.size() == 2) {
                 callGet(args[0], args[1]);
@@ -191,6 +202,41 @@ void CommandWatcher::callSubscribe(const QString& name, const QString& key)
     out << "Subscribe returned: " << describeValue(reply.argumentAt<0>(), reply.argumentAt<1>()) << endl;
 }
 
+void CommandWatcher::callBatchSubscribe(const QString& name, const QStringList& keys)
+{
+    // Call org.maemo.contextkit.Service.Subscribe synchronously
+    if (connectionMap.contains(name) == false) {
+        out << "Error: Invalid name" << name << endl;
+        return;
+    }
+    QPair<QString, QString> connData = connectionMap[name];
+    QDBusConnection connection = getConnection(connData.first);
+
+    QDBusMessage msg = QDBusMessage::createMethodCall(connData.second,
+                                                      SERVICE_PATH,
+                                                      SERVICE,
+                                                      "Subscribe");
+    msg << keys;
+    QDBusPendingCall pc = connection.asyncCall(msg);
+    pc.waitForFinished();
+    QDBusPendingReply<QStringList, QVariantList, QList<quint64> > reply = pc;
+    if (reply.isError()) {
+        out << "Subscribe error: " << reply.reply().errorName() << endl;
+        return;
+    }
+    QStringList subscribedKeys = reply.argumentAt<0>();
+    QVariantList values = reply.argumentAt<1>();
+    QList<quint64> timestamps = reply.argumentAt<2>();
+    out << "Subscribe returned:";
+    for (int i = 0; i < subscribedKeys.size() && i < values.size() && i < timestamps.size(); ++i) {
+        // Each value is an av wrapped in a variant
+        QList<QVariant> value;
+        values.at(i).value<QDBusArgument>() >> value;
+        out << " " << subscribedKeys.at(i) << "=" << describeValue(value, timestamps.at(i));
+    }
+    out << endl;
+}
+
 void CommandWatcher::callUnsubscribe(const QString& name, const QString& key)
 {
     // Call Unsubscribe synchronously
@@ -7,6 +7,11 @@
 #include <QTextStream>
 #include <QStringList>
 #include <QDBusMessage>
+#include <QMetaType>
+
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+Q_DECLARE_METATYPE(QList<quint64>)
+#endif
 
 class QSocketNotifier;
 
@@ -25,6 +30,7 @@ private:
     // Processing commands
     void callGet(const QString& name, const QString& key);
     void callSubscribe(const QString& name, const QString& key);
+    void callBatchSubscribe(const QString& name, const QStringList& keys);
     void callUnsubscribe(const QString& name, const QString& key);
     void resetSignalStatus();
     void waitForChanged(int timeout);
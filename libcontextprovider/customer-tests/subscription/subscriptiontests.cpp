@@ -273,6 +273,30 @@ void SubscriptionTests::multiSubscribe()
     QCOMPARE(actual2.simplified(), expected.simplified());
 }
 
+void SubscriptionTests::batchSubscribe()
+{
+    // Check that the initialization went well.
+    // Doing this only in init() is not enough; doesn't stop the test case.
+    QVERIFY(clientStarted);
+
+    QSignalSpy intItemFirst(test_int, SIGNAL(firstSubscriberAppeared(const QString&)));
+    QSignalSpy doubleItemFirst(test_double, SIGNAL(firstSubscriberAppeared(const QString&)));
+
+    test_int->setValue(567);
+
+    // Ask the client to subscribe to 2 known keys and 1 unknown key
+    // with one call.
+    QString actual = writeToClient("batchsubscribe service1 Test.Int Test.Double Test.Nonexistent\n");
+
+    // Expected result: the known keys are subscribed to and their
+    // values returned; the unknown key is left out.
+    QString expected("Subscribe returned: Test.Int=int:567 Test.Double=Unknown");
+    QCOMPARE(actual.simplified(), expected.simplified());
+
+    QCOMPARE(intItemFirst.count(), 1);
+    QCOMPARE(doubleItemFirst.count(), 1);
+}
+
 void SubscriptionTests::illegalUnsubscribe()
 {
     // Check that the initialization went well.
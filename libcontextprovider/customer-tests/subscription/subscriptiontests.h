@@ -35,6 +35,7 @@ private Q_SLOTS:
     void subscriberNotifications();
 
     void multiSubscribe();
+    void batchSubscribe();
     void illegalUnsubscribe();
 
     void clientExits();
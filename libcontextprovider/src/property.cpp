@@ -112,6 +112,16 @@ void Property::setValue(const QVariant &v)
     priv->setValue(v);
 }
 
+/// Lets the changes of the property be sent as patches: only the
+/// entries of a map, or the elements of a list, which changed are
+/// sent to the subscribers which support it, instead of the whole
+/// value.  Enable this for big map and list values of which only a
+/// few elements change at a time.
+void Property::setDeltaEncoding(bool enabled)
+{
+    priv->setDeltaEncoding(enabled);
+}
+
 /// Returns the current value of the property. The returned QVariant is invalid
 /// if the key value is undetermined or the Property is invalid.
 QVariant Property::value()
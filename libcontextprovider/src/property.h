@@ -51,6 +51,7 @@ public:
     void setValue(const QVariant &v);
     QVariant value();
     void unsetValue();
+    void setDeltaEncoding(bool enabled);
 
 private:
     PropertyPrivate *priv; ///< Private implementation
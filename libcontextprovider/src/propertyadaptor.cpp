@@ -23,6 +23,7 @@
 #include "logging.h"
 #include "sconnect.h"
 #include "propertyprivate.h"
+#include "servicebackend.h"
 #include <QDBusConnection>
 
 namespace ContextProvider {
@@ -36,13 +37,18 @@ namespace ContextProvider {
     subscribed or unsubscribed accordingly.
 
     PropertyAdaptor also listens to values sent by other providers on
-    D-Bus and notifies the PropertyPrivate about them.
+    D-Bus and notifies the PropertyPrivate about them.  The ValueChanged
+    signal is always sent at least once, even if all the clients get
+    the changes some other way, so that the other providers of the key
+    hear about us; the ServiceAdaptor of each of them starts listening
+    to our ValuesChanged signals then.
 */
 
 /// Constructor. Creates new adaptor for the given manager with the given
 /// dbus connection. The connection \a conn is not retained.
 PropertyAdaptor::PropertyAdaptor(PropertyPrivate* propertyPrivate, QDBusConnection *conn)
-    : QDBusAbstractAdaptor(propertyPrivate), propertyPrivate(propertyPrivate), connection(conn)
+    : QDBusAbstractAdaptor(propertyPrivate), propertyPrivate(propertyPrivate), connection(conn),
+      announced(false)
 {
     // Start listening to the QDBusServiceWathcer, to know when our client has
     // exited.
@@ -51,13 +57,13 @@ PropertyAdaptor::PropertyAdaptor(PropertyPrivate* propertyPrivate, QDBusConnecti
     serviceWatcher.setConnection(*conn);
 
     sconnect(propertyPrivate, SIGNAL(valueChanged(const QVariantList&, const quint64&)),
-             this, SIGNAL(ValueChanged(const QVariantList&, const quint64&)));
+             this, SLOT(onPropertyValueChanged(const QVariantList&, const quint64&)));
 
     // Start listening to ValueChanged signals. We only listen to the
     // same bus we're on: that means if the same property is provided
     // both on session and on system bus, overhearing won't work.
     connection->connect("", objectPath(), DBUS_INTERFACE, "ValueChanged",
-                        this, SLOT(onValueChanged(QVariantList, quint64)));
+                        this, SLOT(onValueChanged(QVariantList, quint64, QDBusMessage)));
 }
 
 /// Implementation of the D-Bus method Subscribe
@@ -65,10 +71,47 @@ void PropertyAdaptor::Subscribe(const QDBusMessage &msg, QVariantList& values, q
 {
     contextDebug() << "Subscribe called";
 
+    subscribeClient(msg.service());
+
+    // Construct the return values
+    Get(values, timestamp);
+}
+
+/// Implementation of the D-Bus method Unsubscribe
+void PropertyAdaptor::Unsubscribe(const QDBusMessage &msg)
+{
+    contextDebug() << "Unsubscribe called";
+
+    unsubscribeClient(msg.service());
+}
+
+/// Records that \a client (a D-Bus service name) is subscribed to the
+/// property.  Used by the Subscribe method of both this adaptor and
+/// the ServiceAdaptor.  The \a delivery tells how the client gets the
+/// changes of the property: in our ValueChanged signal, in the
+/// ValuesChanged signal of the service on the bus or on the direct
+/// connection of the client, or through the shared memory ring of the
+/// service.  With \a delta, the clients getting the ValuesChanged
+/// signal get patches in the ValuesPatched signal instead, if the
+/// property has delta encoding enabled.
+void PropertyAdaptor::subscribeClient(const QString &client, Delivery delivery, bool delta)
+{
+    batchClients.remove(client);
+    sharedClients.remove(client);
+    directClients.remove(client);
+    deltaClients.remove(client);
+    if (delivery == ValuesChangedDelivery)
+        batchClients.insert(client);
+    else if (delivery == SharedRingDelivery)
+        sharedClients.insert(client);
+    else if (delivery == DirectDelivery)
+        directClients.insert(client);
+    if (delta && propertyPrivate->deltaEncoding &&
+        (delivery == ValuesChangedDelivery || delivery == DirectDelivery))
+        deltaClients.insert(client);
+
     // Store the information of the subscription. For each property, we record
     // which clients have subscribed.
-    QString client = msg.service();
-
     if (clientServiceNames.contains(client) == false) {
         clientServiceNames.insert(client);
         if (clientServiceNames.size() == 1) {
@@ -83,17 +126,15 @@ void PropertyAdaptor::Subscribe(const QDBusMessage &msg, QVariantList& values, q
     // provider is not running (e.g., during boot), the subscriber might send 2
     // Subscribe calls: one of them before the provider is running, and the
     // other when it notices that the provider has started.
-
-    // Construct the return values
-    Get(values, timestamp);
 }
 
-/// Implementation of the D-Bus method Unsubscribe
-void PropertyAdaptor::Unsubscribe(const QDBusMessage &msg)
+/// Records that \a client is no longer subscribed to the property.
+void PropertyAdaptor::unsubscribeClient(const QString &client)
 {
-    contextDebug() << "Unsubscribe called";
-    QString client = msg.service();
-
+    batchClients.remove(client);
+    sharedClients.remove(client);
+    directClients.remove(client);
+    deltaClients.remove(client);
     if (clientServiceNames.remove(client)) {
         if (clientServiceNames.size() == 0) {
             propertyPrivate->setUnsubscribed();
@@ -120,16 +161,104 @@ void PropertyAdaptor::Get(QVariantList& values, quint64& timestamp)
 }
 
 /// Called when a ValueChanged signal is overheard on D-Bus. Command
-/// PropertyPrivate to update its overheard value.
-void PropertyAdaptor::onValueChanged(QVariantList values, quint64 timestamp)
+/// PropertyPrivate to update its overheard value.  If the sender is a
+/// provider we didn't know about, the service starts overhearing its
+/// ValuesChanged signals, and we tell it about us by sending our
+/// current value.
+void PropertyAdaptor::onValueChanged(QVariantList values, quint64 timestamp, const QDBusMessage &msg)
 {
+    if (propertyPrivate->serviceBackend->overhear(msg.service())) {
+        QVariantList current;
+        quint64 currentTimestamp;
+        Get(current, currentTimestamp);
+        Q_EMIT ValueChanged(current, currentTimestamp);
+        announced = true;
+    }
     propertyPrivate->updateOverheardValue(values, timestamp);
 }
 
+/// Called when the PropertyPrivate has a new value for the
+/// clients.  The value is sent in our ValueChanged signal if some
+/// client subscribed through this adaptor, queued for the
+/// ValuesChanged signal of the service if some client subscribed
+/// through the ServiceAdaptor, and published in the shared ring of
+/// the service if some client reads it from there.  The clients
+/// connected directly get it on their own connections.  The clients
+/// taking patches get a patch from their previous value instead of
+/// the value.
+void PropertyAdaptor::onPropertyValueChanged(const QVariantList &values, const quint64 &timestamp)
+{
+    ServiceBackend *serviceBackend = propertyPrivate->serviceBackend;
+    const QString &key = propertyPrivate->key;
+
+    if (clientServiceNames.size() > batchClients.size() + sharedClients.size() + directClients.size() ||
+        !announced) {
+        Q_EMIT ValueChanged(values, timestamp);
+        announced = true;
+    }
+
+    QVariant patch;
+    if (!deltaClients.isEmpty())
+        patch = propertyPrivate->patch();
+
+    if (batchClients.size() > 0) {
+        int patched = 0;
+        Q_FOREACH (const QString &client, deltaClients)
+            if (batchClients.contains(client))
+                ++patched;
+        if (patched < batchClients.size())
+            serviceBackend->queueValueChanged(key, values, timestamp);
+        if (patched > 0)
+            serviceBackend->queuePatch(key, patch, timestamp);
+    }
+    Q_FOREACH (const QString &client, directClients) {
+        if (deltaClients.contains(client))
+            serviceBackend->queueDirectPatch(client, key, patch, timestamp);
+        else
+            serviceBackend->queueDirectValueChanged(client, key, values, timestamp);
+    }
+    if (sharedClients.size() > 0)
+        serviceBackend->publishShared(key, values, timestamp);
+}
+
+/// Called when the shared ring of the service goes away.  The clients
+/// which read the changes from there get them in the ValuesChanged
+/// signal of the service instead, on the bus or on their direct
+/// connection; they listen to it anyway, for the keys which don't fit
+/// in the ring.
+void PropertyAdaptor::stopSharing()
+{
+    Q_FOREACH (const QString &client, sharedClients) {
+        if (propertyPrivate->serviceBackend->isDirectClient(client))
+            directClients.insert(client);
+        else
+            batchClients.insert(client);
+    }
+    sharedClients.clear();
+}
+
+/// Called when the delta encoding of the property is disabled.  The
+/// clients which got patches get the whole value from now on.
+void PropertyAdaptor::stopDeltas()
+{
+    deltaClients.clear();
+}
+
+/// Returns the version of the current value, for the clients taking
+/// patches, or 0 if the property has delta encoding disabled.
+quint64 PropertyAdaptor::deltaVersion() const
+{
+    return propertyPrivate->deltaVersion();
+}
+
 /// Called when the DBusServiceWatcher signals that one of our clients has
 /// exited D-Bus.
 void PropertyAdaptor::onClientExited(const QString& busName)
 {
+    batchClients.remove(busName);
+    sharedClients.remove(busName);
+    directClients.remove(busName);
+    deltaClients.remove(busName);
     if (clientServiceNames.remove(busName) && clientServiceNames.size() == 0) {
         propertyPrivate->setUnsubscribed();
     }
@@ -162,6 +291,10 @@ void PropertyAdaptor::forgetClients()
     foreach(const QString& client, clientServiceNames)
         serviceWatcher.removeWatchedService(client);
     clientServiceNames.clear();
+    batchClients.clear();
+    sharedClients.clear();
+    directClients.clear();
+    deltaClients.clear();
     propertyPrivate->setUnsubscribed();
 }
 
@@ -45,6 +45,19 @@ public:
     QString objectPath() const;
     void forgetClients();
 
+    /// How a subscribed client gets the changes of the property.
+    enum Delivery {
+        ValueChangedDelivery, ///< Our ValueChanged signal
+        ValuesChangedDelivery, ///< The ValuesChanged signal of the service
+        SharedRingDelivery, ///< The shared memory ring of the service
+        DirectDelivery ///< The ValuesChanged signal on the direct connection of the client
+    };
+    void subscribeClient(const QString &client, Delivery delivery = ValueChangedDelivery, bool delta = false);
+    void stopSharing();
+    void stopDeltas();
+    quint64 deltaVersion() const;
+    void unsubscribeClient(const QString &client);
+
 public Q_SLOTS:
     void Subscribe(const QDBusMessage& msg, QVariantList& values, quint64& timestamp);
     void Unsubscribe(const QDBusMessage& msg);
@@ -55,13 +68,19 @@ Q_SIGNALS:
 
 private Q_SLOTS:
     void onClientExited(const QString&);
-    void onValueChanged(QVariantList values, quint64 timestamp);
+    void onValueChanged(QVariantList values, quint64 timestamp, const QDBusMessage &msg);
+    void onPropertyValueChanged(const QVariantList &values, const quint64 &timestamp);
 
 private:
     PropertyPrivate *propertyPrivate; ///< The managed object.
     QDBusConnection *connection; ///< The connection to operate on.
     QSet<QString> clientServiceNames; ///< List of all subscribed clients (recognized by D-Bus service name)
+    QSet<QString> batchClients; ///< Clients subscribed through ServiceAdaptor; they get ValuesChanged
+    QSet<QString> sharedClients; ///< Clients reading the changes from the shared ring of the service
+    QSet<QString> directClients; ///< Clients connected to the service directly
+    QSet<QString> deltaClients; ///< Clients of the ValuesChanged signal which take patches instead
     QDBusServiceWatcher serviceWatcher; ///< For watching clients exiting D-Bus
+    bool announced; ///< If our ValueChanged signal has been sent at least once
 
 };
 
@@ -21,9 +21,11 @@
 
 #include "propertyprivate.h"
 #include "servicebackend.h"
+#include "propertyadaptor.h"
 #include "logging.h"
 #include "sconnect.h"
 #include "loggingfeatures.h"
+#include "valuepatch.h"
 #include <time.h>
 
 namespace ContextProvider {
@@ -45,7 +47,8 @@ QHash<QPair<ServiceBackend*,QString>, PropertyPrivate*> PropertyPrivate::propert
 PropertyPrivate::PropertyPrivate(ServiceBackend* serviceBackend, const QString &key, QObject *parent)
     : QObject(parent), refCount(0), serviceBackend(serviceBackend),
       key(key), value(QVariant()),  timestamp(currentTimestamp()), subscribed(false),
-      emittedValue(value), emittedTimestamp(timestamp), overheard(false)
+      emittedValue(value), emittedTimestamp(timestamp), overheard(false),
+      deltaEncoding(false), version(1), previousValue(value), previousVersion(version)
 {
     // Associate the property to the service backend
     serviceBackend->addProperty(key, this);
@@ -93,6 +96,14 @@ void PropertyPrivate::emitValue()
         emittedValue.type() == value.type())
         return;
 
+    // Only needed for making patches
+    if (deltaEncoding)
+        previousValue = emittedValue;
+    previousVersion = version;
+    if (emittedValue != value ||
+        emittedValue.isNull() != value.isNull() ||
+        emittedValue.type() != value.type())
+        ++version;
     emittedValue = value;
     emittedTimestamp = timestamp;
     overheard = false;
@@ -110,6 +121,38 @@ void PropertyPrivate::emitValue()
     Q_EMIT valueChanged(values, timestamp);
 }
 
+/// Enables or disables sending the changes as patches to the clients
+/// which can apply them (see ValuePatch).  Worth it for big map and
+/// list values of which only a few elements change at a time.  When
+/// disabled, the clients get the whole value again on each change.
+void PropertyPrivate::setDeltaEncoding(bool enabled)
+{
+    if (enabled == deltaEncoding)
+        return;
+    deltaEncoding = enabled;
+    previousValue = enabled ? emittedValue : QVariant();
+    previousVersion = version;
+
+    // The clients which got patches get the whole value from now on.
+    PropertyAdaptor *adaptor = serviceBackend->propertyAdaptor(key);
+    if (!enabled && adaptor)
+        adaptor->stopDeltas();
+}
+
+/// Returns the version of the value the clients get with Get, if the
+/// changes are sent as patches; 0 otherwise.
+quint64 PropertyPrivate::deltaVersion() const
+{
+    return deltaEncoding ? version : 0;
+}
+
+/// Returns the patch from the value emitted before the last emission
+/// to the last one.
+QVariant PropertyPrivate::patch() const
+{
+    return ValuePatch::make(previousValue, emittedValue, previousVersion, version);
+}
+
 /// Set the PropertyPrivate to subscribed state. If it was in the
 /// unsubscribed state, the firstSubscriberAppeared signal is
 /// emitted. (Property transmits the signal forward.)
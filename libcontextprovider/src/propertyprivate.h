@@ -43,6 +43,9 @@ public:
     void updateOverheardValue(const QVariantList&, const quint64&);
     void setSubscribed();
     void setUnsubscribed();
+    void setDeltaEncoding(bool enabled);
+    quint64 deltaVersion() const;
+    QVariant patch() const;
 
 Q_SIGNALS:
     void valueChanged(const QVariantList& values, const quint64& timestamp);
@@ -64,6 +67,11 @@ private:
     quint64 emittedTimestamp; ///< Time when the emittedValue was emitted.
     bool overheard; ///< True if provider overheard a value over D-Bus (must be different and more recent than emitted)
 
+    bool deltaEncoding; ///< The changes can be sent as patches, see setDeltaEncoding()
+    quint64 version; ///< Incremented whenever emittedValue changes
+    QVariant previousValue; ///< emittedValue before the last emission
+    quint64 previousVersion; ///< Version of previousValue
+
     /// Map of PropertyPrivate instances
     static QHash<QPair<ServiceBackend*, QString>, PropertyPrivate*> propertyPrivateMap;
 
@@ -262,6 +262,43 @@ void Service::setValue(const QString &key, const QVariant &val)
     backend->setValue(key, val);
 }
 
+/// Publish the changes of the properties also in shared memory.  The
+/// subscribers using the \c contextkit-shm plugin read them from
+/// there, and use D-Bus only for subscribing.  This is meant for
+/// properties which change very often, like sensor readings.  Returns
+/// false if the shared memory cannot be created; the properties are
+/// still provided over D-Bus then.
+bool Service::enableSharedMemory()
+{
+    return backend->enableSharedMemory();
+}
+
+/// Stop publishing the changes in shared memory.  The subscribers
+/// reading them from there get them over D-Bus from now on.
+void Service::disableSharedMemory()
+{
+    backend->disableSharedMemory();
+}
+
+/// Accept direct D-Bus connections from the subscribers, on a private
+/// socket advertised on the bus.  The subscribers using the \c
+/// contextkit-direct plugin subscribe and get the changes there,
+/// without the bus daemon relaying every message; the bus is only
+/// used for finding the socket and for noticing the subscribers
+/// exiting.  Returns false if the socket cannot be created; the
+/// properties are still provided over the bus then.
+bool Service::enableDirectConnections()
+{
+    return backend->enableDirectConnections();
+}
+
+/// Stop accepting direct connections.  The subscribers already
+/// connected keep their connections.
+void Service::disableDirectConnections()
+{
+    backend->disableDirectConnections();
+}
+
 /// Set (override) the QDBusConnection used by the
 /// Service. Deprecated; use constructor with QDBusConnection
 /// parameter instead.
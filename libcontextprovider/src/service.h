@@ -55,6 +55,12 @@ public:
     void setValue(const QString &key, const QVariant &val);
     void setConnection(const QDBusConnection &connection);
 
+    bool enableSharedMemory();
+    void disableSharedMemory();
+
+    bool enableDirectConnections();
+    void disableDirectConnections();
+
 private:
     ServiceBackend *backend; ///< Private implementation of the Service
 
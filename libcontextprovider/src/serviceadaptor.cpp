@@ -0,0 +1,388 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "serviceadaptor.h"
+#include "servicebackend.h"
+#include "propertyadaptor.h"
+#include "propertyprivate.h"
+#include "sharedring.h"
+#include "valuepatch.h"
+#include "logging.h"
+#include <QDBusMetaType>
+#include <QDBusArgument>
+#include <QDBusConnectionInterface>
+#include <QDBusReply>
+#include <QDBusError>
+#include <unistd.h>
+
+namespace ContextProvider {
+
+/*!
+    \class ServiceAdaptor
+    \brief A D-Bus adaptor implementing org.maemo.contextkit.Service
+
+    ServiceAdaptor represents the whole ServiceBackend on D-Bus, at
+    SERVICE_DBUS_PATH.  It lets a client subscribe to and unsubscribe
+    from many properties with a single method call, instead of calling
+    org.maemo.contextkit.Property.Subscribe on each of them.
+
+    The subscriptions made through it are the same as the ones made
+    through the PropertyAdaptor of each property: the clients can mix
+    the two interfaces freely.  The difference is in how the changes
+    are delivered: the clients subscribed through ServiceAdaptor get
+    them in the ValuesChanged signal, which carries all the properties
+    changed during one iteration of the event loop.  The clients
+    subscribed with SubscribeDelta get the changes of the properties
+    with delta encoding enabled in the ValuesPatched signal instead, as
+    patches made by ValuePatch.
+
+    Like PropertyAdaptor, ServiceAdaptor also listens to the
+    ValuesChanged signals of other providers and notifies the
+    PropertyPrivate objects about the overheard values.  It listens
+    only to the providers which PropertyAdaptor has heard providing
+    some of our keys, not to every provider on the bus.
+
+    If the service accepts direct connections, each of them gets a
+    ServiceAdaptor of its own, which sends its ValuesChanged signals
+    only to the client on that connection.
+*/
+
+/// Constructor.  The adaptor is a child of \a serviceBackend and is
+/// exported when the backend is registered at SERVICE_DBUS_PATH.
+ServiceAdaptor::ServiceAdaptor(ServiceBackend *serviceBackend)
+    : QDBusAbstractAdaptor(serviceBackend), serviceBackend(serviceBackend), direct(false)
+{
+    qDBusRegisterMetaType<QList<quint64> >();
+
+    senderWatcher.setConnection(serviceBackend->connection);
+    senderWatcher.setWatchMode(QDBusServiceWatcher::WatchForUnregistration);
+    sconnect(&senderWatcher, SIGNAL(serviceUnregistered(const QString&)),
+             this, SLOT(onSenderExited(const QString&)));
+}
+
+/// Constructs the adaptor serving one direct connection to \a
+/// serviceBackend.  The adaptor is a child of \a peerObject, which is
+/// registered at SERVICE_DBUS_PATH on the direct connection.  The
+/// client on the other end is known after it calls Identify.
+ServiceAdaptor::ServiceAdaptor(QObject *peerObject, ServiceBackend *serviceBackend)
+    : QDBusAbstractAdaptor(peerObject), serviceBackend(serviceBackend), direct(true)
+{
+    qDBusRegisterMetaType<QList<quint64> >();
+}
+
+/// Implementation of the D-Bus method Subscribe.  Subscribes the
+/// caller to all of the \a keys this service provides.  The
+/// subscribed keys are returned in \a subscribedKeys, together with
+/// their current values and time stamps at the same positions of \a
+/// values and \a timestamps.  Each element of \a values is a list,
+/// empty if the value is unknown, just like the return value of
+/// org.maemo.contextkit.Property.Subscribe.  Keys not provided by this
+/// service are left out of \a subscribedKeys.
+void ServiceAdaptor::Subscribe(const QStringList &keys, const QDBusMessage &msg,
+                               QStringList &subscribedKeys, QVariantList &values,
+                               QList<quint64> &timestamps)
+{
+    contextDebug() << "Subscribe called for" << keys.size() << "keys";
+    subscribe(keys, msg, false, false, subscribedKeys, values, 0, timestamps);
+}
+
+/// Implementation of the D-Bus method SubscribeDelta.  Like
+/// Subscribe, but the changes of the keys with delta encoding (see
+/// Property::setDeltaEncoding()) are sent to the caller as patches, in
+/// the ValuesPatched signal.  The version of each value is returned
+/// at the same position of \a versions, 0 for the keys which are
+/// sent whole in the ValuesChanged signal.
+void ServiceAdaptor::SubscribeDelta(const QStringList &keys, const QDBusMessage &msg,
+                                    QStringList &subscribedKeys, QVariantList &values,
+                                    QList<quint64> &versions, QList<quint64> &timestamps)
+{
+    contextDebug() << "SubscribeDelta called for" << keys.size() << "keys";
+    subscribe(keys, msg, false, true, subscribedKeys, values, &versions, timestamps);
+}
+
+/// Implementation of the D-Bus method SubscribeShared.  Like
+/// Subscribe, but the caller reads the changes from the shared memory
+/// ring whose name is returned in \a ringName, instead of getting them
+/// in the ValuesChanged signal.  If the service doesn't publish its
+/// changes in shared memory, \a ringName is empty.  The changes of the
+/// keys which don't fit in the ring still come in the ValuesChanged
+/// signal.  For values too big for a slot of the ring, the ring only
+/// tells the caller to call SubscribeShared again; calling it for
+/// already subscribed keys is fine, and returns the current values.
+/// The ring is readable only by our own user, so the callers running
+/// as other users get an empty \a ringName and are subscribed like in
+/// Subscribe.
+void ServiceAdaptor::SubscribeShared(const QStringList &keys, const QDBusMessage &msg,
+                                     QString &ringName, QStringList &subscribedKeys,
+                                     QVariantList &values, QList<quint64> &timestamps)
+{
+    contextDebug() << "SubscribeShared called for" << keys.size() << "keys";
+    const QString caller = client(msg);
+    const bool shared = serviceBackend->sharedRing != 0 && sameUser(caller);
+    if (shared)
+        ringName = serviceBackend->sharedRing->name();
+    subscribe(keys, msg, shared, false, subscribedKeys, values, 0, timestamps);
+}
+
+/// Returns true if \a client, a name on our bus, belongs to a process
+/// running as the same user as we do.
+bool ServiceAdaptor::sameUser(const QString &client) const
+{
+    if (client.isEmpty())
+        return false;
+    QDBusReply<uint> uid = serviceBackend->connection.interface()->serviceUid(client);
+    if (!uid.isValid()) {
+        contextWarning() << "Cannot get the user of" << client << ":" << uid.error().message();
+        return false;
+    }
+    return uid.value() == getuid();
+}
+
+/// Replies to \a msg with an AccessDenied error carrying \a message,
+/// instead of the normal reply of the method.
+void ServiceAdaptor::refuse(const QDBusMessage &msg, const QString &message)
+{
+    QDBusConnection connection = direct ? QDBusConnection(parent()->objectName())
+                                        : serviceBackend->connection;
+    msg.setDelayedReply(true);
+    connection.send(msg.createErrorReply(QDBusError::AccessDenied, message));
+}
+
+/// Subscribes the sender of \a msg to \a keys, for the Subscribe
+/// methods.  If \a shared is true, the changes are delivered through
+/// the shared ring of the service, whenever the key fits in.  The
+/// rest are sent in our ValuesChanged signal, on the bus or on our
+/// direct connection; if \a delta is true, as patches in our
+/// ValuesPatched signal whenever the key has delta encoding.  The
+/// versions of the values are returned in \a versions, if given.  On
+/// a direct connection whose client hasn't identified itself, the
+/// call fails with an error.
+void ServiceAdaptor::subscribe(const QStringList &keys, const QDBusMessage &msg, bool shared, bool delta,
+                               QStringList &subscribedKeys, QVariantList &values,
+                               QList<quint64> *versions, QList<quint64> &timestamps)
+{
+    const QString client = this->client(msg);
+    if (client.isEmpty()) {
+        contextWarning() << "Subscribe on a direct connection before Identify";
+        refuse(msg, "Identify first");
+        return;
+    }
+    PropertyAdaptor::Delivery delivery = direct ? PropertyAdaptor::DirectDelivery
+                                                : PropertyAdaptor::ValuesChangedDelivery;
+    Q_FOREACH (const QString &key, keys) {
+        PropertyAdaptor *adaptor = serviceBackend->propertyAdaptor(key);
+        if (adaptor == 0) {
+            contextDebug() << "Client" << client << "subscribed to unknown property" << key;
+            continue;
+        }
+        if (shared && serviceBackend->sharedRing->addKey(key))
+            adaptor->subscribeClient(client, PropertyAdaptor::SharedRingDelivery);
+        else
+            adaptor->subscribeClient(client, delivery, delta);
+
+        QVariantList value;
+        quint64 timestamp;
+        adaptor->Get(value, timestamp);
+        subscribedKeys << key;
+        values << QVariant(value);
+        timestamps << timestamp;
+        if (versions)
+            *versions << adaptor->deltaVersion();
+    }
+}
+
+/// Implementation of the D-Bus method Unsubscribe.  Unsubscribes the
+/// caller from all of the \a keys.
+void ServiceAdaptor::Unsubscribe(const QStringList &keys, const QDBusMessage &msg)
+{
+    contextDebug() << "Unsubscribe called for" << keys.size() << "keys";
+
+    Q_FOREACH (const QString &key, keys) {
+        PropertyAdaptor *adaptor = serviceBackend->propertyAdaptor(key);
+        if (adaptor)
+            adaptor->unsubscribeClient(client(msg));
+    }
+}
+
+/// Implementation of the D-Bus method GetDirectAddress.  Returns the
+/// address where the clients can connect to the service directly,
+/// without going through the bus daemon, or an empty string if the
+/// service doesn't accept direct connections.  The caller gets a
+/// \a token to give in Identify, proving that it's the owner of its
+/// bus name.
+QString ServiceAdaptor::GetDirectAddress(const QDBusMessage &msg, QString &token)
+{
+    if (direct)
+        return QString();
+    QString address = serviceBackend->directAddress();
+    if (!address.isEmpty())
+        token = serviceBackend->directToken(msg.service());
+    return token.isEmpty() ? QString() : address;
+}
+
+/// Implementation of the D-Bus method Identify.  Called by the client
+/// on a direct connection, before subscribing, to tell its unique
+/// name on the bus, together with the \a token it got for that name
+/// from GetDirectAddress.  The subscriptions are recorded for that
+/// name, and dropped when it leaves the bus, just like for the clients
+/// on the bus.  A name without the right token is refused with an
+/// error, so nobody can take over the subscriptions of another client.
+void ServiceAdaptor::Identify(const QString &client, const QString &token, const QDBusMessage &msg)
+{
+    if (!direct) {
+        contextWarning() << "Identify called on the bus by" << client;
+        return;
+    }
+    if (!directClient.isEmpty() || !serviceBackend->addDirectClient(client, token, this)) {
+        contextWarning() << "Refused direct connection identifying as" << client;
+        refuse(msg, "Wrong token for " + client);
+        return;
+    }
+    contextDebug() << "Direct connection identified as" << client;
+    directClient = client;
+}
+
+/// Returns the client which sent \a msg: its name on the bus, or, on
+/// a direct connection, the name it gave in Identify.
+QString ServiceAdaptor::client(const QDBusMessage &msg) const
+{
+    return direct ? directClient : msg.service();
+}
+
+/// Queue the change of \a key to \a values and \a timestamp to be
+/// sent in our ValuesChanged signal.  All the changes queued during
+/// one iteration of the event loop are sent in one signal; if the
+/// same key changes several times, only the latest value is sent.
+void ServiceAdaptor::queueValueChanged(const QString &key, const QVariantList &values, quint64 timestamp)
+{
+    if (changedKeys.isEmpty() && patchedKeys.isEmpty())
+        QMetaObject::invokeMethod(this, "emitValuesChanged", Qt::QueuedConnection);
+    if (!changedValues.contains(key))
+        changedKeys << key;
+    changedValues.insert(key, qMakePair(values, timestamp));
+}
+
+/// Queue the \a patch of \a key, made at \a timestamp, to be sent in
+/// our ValuesPatched signal, together with the other changes of this
+/// iteration of the event loop.  If the key is patched several times,
+/// the patches are composed.
+void ServiceAdaptor::queuePatch(const QString &key, const QVariant &patch, quint64 timestamp)
+{
+    if (changedKeys.isEmpty() && patchedKeys.isEmpty())
+        QMetaObject::invokeMethod(this, "emitValuesChanged", Qt::QueuedConnection);
+    QHash<QString, QPair<QVariant, quint64> >::iterator queued = patches.find(key);
+    if (queued == patches.end()) {
+        patchedKeys << key;
+        patches.insert(key, qMakePair(patch, timestamp));
+    }
+    else
+        *queued = qMakePair(ValuePatch::compose(queued->first, patch), timestamp);
+}
+
+/// Drops the changes queued by queueValueChanged() and queuePatch()
+/// without sending them.
+void ServiceAdaptor::clearQueue()
+{
+    changedKeys.clear();
+    changedValues.clear();
+    patchedKeys.clear();
+    patches.clear();
+}
+
+/// Sends the changes queued by queueValueChanged() in the
+/// ValuesChanged signal, and the patches queued by queuePatch() in
+/// the ValuesPatched signal.  Each element of the values is a list,
+/// empty if the value is unknown.
+void ServiceAdaptor::emitValuesChanged()
+{
+    QStringList keys = changedKeys;
+    QVariantList values;
+    QList<quint64> timestamps;
+    Q_FOREACH (const QString &key, changedKeys) {
+        const QPair<QVariantList, quint64> &change = changedValues[key];
+        values << QVariant(change.first);
+        timestamps << change.second;
+    }
+
+    QStringList patchKeys = patchedKeys;
+    QVariantList patchValues;
+    QList<quint64> patchTimestamps;
+    Q_FOREACH (const QString &key, patchedKeys) {
+        const QPair<QVariant, quint64> &change = patches[key];
+        patchValues << change.first;
+        patchTimestamps << change.second;
+    }
+    clearQueue();
+
+    if (!keys.isEmpty())
+        Q_EMIT ValuesChanged(keys, values, timestamps);
+    if (!patchKeys.isEmpty())
+        Q_EMIT ValuesPatched(patchKeys, patchValues, patchTimestamps);
+}
+
+/// Starts listening to the ValuesChanged signals of \a sender, a
+/// unique name of another provider of some of our keys, for
+/// overhearing.  Only the providers of the same keys are listened to,
+/// so that the providers don't wake up for the changes of each other.
+/// Returns true if we didn't listen to \a sender already.
+bool ServiceAdaptor::overhear(const QString &sender)
+{
+    if (direct || sender.isEmpty() || sender == serviceBackend->connection.baseService() ||
+        senderWatcher.watchedServices().contains(sender))
+        return false;
+    contextDebug() << "Overhearing the ValuesChanged signals of" << sender;
+    senderWatcher.addWatchedService(sender);
+    serviceBackend->connection.connect(sender, SERVICE_DBUS_PATH, SERVICE_DBUS_INTERFACE, "ValuesChanged",
+                                       this, SLOT(onValuesChanged(QStringList, QVariantList, QList<quint64>)));
+    return true;
+}
+
+/// Called when a provider we overhear leaves the bus.  Stops listening
+/// to its signals.
+void ServiceAdaptor::onSenderExited(const QString &sender)
+{
+    senderWatcher.removeWatchedService(sender);
+    serviceBackend->connection.disconnect(sender, SERVICE_DBUS_PATH, SERVICE_DBUS_INTERFACE, "ValuesChanged",
+                                          this, SLOT(onValuesChanged(QStringList, QVariantList, QList<quint64>)));
+}
+
+/// Called when a ValuesChanged signal is overheard on D-Bus.  Command
+/// the PropertyPrivate objects of the keys we provide to update their
+/// overheard values.
+void ServiceAdaptor::onValuesChanged(QStringList keys, QVariantList values, QList<quint64> timestamps)
+{
+    if (values.size() != keys.size() || timestamps.size() != keys.size())
+        return;
+    for (int i = 0; i < keys.size(); ++i) {
+        PropertyPrivate *property = serviceBackend->properties.value(keys.at(i), 0);
+        if (property == 0)
+            continue;
+        QVariantList value;
+        const QVariant &v = values.at(i);
+        if (v.userType() == qMetaTypeId<QDBusArgument>())
+            v.value<QDBusArgument>() >> value;
+        else
+            value = v.toList();
+        property->updateOverheardValue(value, timestamps.at(i));
+    }
+}
+
+} // namespace ContextProvider
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef SERVICEADAPTOR_H
+#define SERVICEADAPTOR_H
+
+#include <QObject>
+#include <QDBusAbstractAdaptor>
+#include <QDBusMessage>
+#include <QStringList>
+#include <QVariant>
+#include <QList>
+#include <QMetaType>
+#include <QHash>
+#include <QPair>
+#include <QDBusServiceWatcher>
+
+#define SERVICE_DBUS_INTERFACE "org.maemo.contextkit.Service"
+#define SERVICE_DBUS_PATH "/org/maemo/contextkit"
+
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+Q_DECLARE_METATYPE(QList<quint64>)
+#endif
+
+namespace ContextProvider {
+
+class ServiceBackend;
+
+class ServiceAdaptor: public QDBusAbstractAdaptor
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.maemo.contextkit.Service")
+
+public:
+    explicit ServiceAdaptor(ServiceBackend *serviceBackend);
+    ServiceAdaptor(QObject *peerObject, ServiceBackend *serviceBackend);
+    void queueValueChanged(const QString &key, const QVariantList &values, quint64 timestamp);
+    void queuePatch(const QString &key, const QVariant &patch, quint64 timestamp);
+    void clearQueue();
+    bool overhear(const QString &sender);
+
+public Q_SLOTS:
+    void Subscribe(const QStringList &keys, const QDBusMessage &msg,
+                   QStringList &subscribedKeys, QVariantList &values, QList<quint64> &timestamps);
+    void SubscribeDelta(const QStringList &keys, const QDBusMessage &msg,
+                        QStringList &subscribedKeys, QVariantList &values,
+                        QList<quint64> &versions, QList<quint64> &timestamps);
+    void SubscribeShared(const QStringList &keys, const QDBusMessage &msg, QString &ringName,
+                         QStringList &subscribedKeys, QVariantList &values, QList<quint64> &timestamps);
+    void Unsubscribe(const QStringList &keys, const QDBusMessage &msg);
+    QString GetDirectAddress(const QDBusMessage &msg, QString &token);
+    void Identify(const QString &client, const QString &token, const QDBusMessage &msg);
+
+Q_SIGNALS:
+    void ValuesChanged(const QStringList &keys, const QVariantList &values, const QList<quint64> &timestamps);
+    void ValuesPatched(const QStringList &keys, const QVariantList &patches, const QList<quint64> &timestamps);
+
+private Q_SLOTS:
+    void onValuesChanged(QStringList keys, QVariantList values, QList<quint64> timestamps);
+    void emitValuesChanged();
+    void onSenderExited(const QString &sender);
+
+private:
+    QString client(const QDBusMessage &msg) const;
+    bool sameUser(const QString &client) const;
+    void refuse(const QDBusMessage &msg, const QString &message);
+    void subscribe(const QStringList &keys, const QDBusMessage &msg, bool shared, bool delta,
+                   QStringList &subscribedKeys, QVariantList &values,
+                   QList<quint64> *versions, QList<quint64> &timestamps);
+
+    ServiceBackend *serviceBackend; ///< The backend whose properties we subscribe to
+    bool direct; ///< Exported on a direct connection instead of the bus
+    QString directClient; ///< Bus name of the client on the direct connection
+    QDBusServiceWatcher senderWatcher; ///< Watches the providers whose ValuesChanged we overhear
+
+    /// Changes waiting to be sent in one ValuesChanged signal; the
+    /// latest value for each key, in the order the keys first changed.
+    QStringList changedKeys;
+    QHash<QString, QPair<QVariantList, quint64> > changedValues;
+
+    /// Patches waiting to be sent in one ValuesPatched signal; the
+    /// patches of a key are composed into one.
+    QStringList patchedKeys;
+    QHash<QString, QPair<QVariant, quint64> > patches;
+};
+
+} // namespace ContextProvider
+
+#endif
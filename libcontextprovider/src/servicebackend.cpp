@@ -22,11 +22,18 @@
 #include "servicebackend.h"
 #include "propertyprivate.h"
 #include "propertyadaptor.h"
+#include "serviceadaptor.h"
 #include "logging.h"
 #include "sconnect.h"
+#include "sharedring.h"
 #include "loggingfeatures.h"
 
 #include <QDBusError>
+#include <QDBusServer>
+#include <QFile>
+#include <QSet>
+#include <unistd.h>
+#include <sys/time.h>
 
 namespace ContextProvider {
 
@@ -52,8 +59,14 @@ ServiceBackend *ServiceBackend::defaultServiceBackend;
 ServiceBackend::ServiceBackend(QDBusConnection connection) :
     refCount(0),
     connection(connection),
-    busName("")  // shared connection
+    busName(""),  // shared connection
+    serviceAdaptor(new ServiceAdaptor(this)),
+    sharedRing(0),
+    directServer(0)
 {
+    directWatcher.setConnection(connection);
+    sconnect(&directWatcher, SIGNAL(serviceUnregistered(const QString&)),
+             this, SLOT(onDirectClientExited(const QString&)));
     contextDebug() << F_SERVICE_BACKEND << "Creating new ServiceBackend for" << busName;
 }
 
@@ -63,8 +76,14 @@ ServiceBackend::ServiceBackend(QDBusConnection connection) :
 ServiceBackend::ServiceBackend(QDBusConnection connection, const QString &busName) :
     refCount(0),
     connection(connection),
-    busName(busName)  // private connection
+    busName(busName),  // private connection
+    serviceAdaptor(new ServiceAdaptor(this)),
+    sharedRing(0),
+    directServer(0)
 {
+    directWatcher.setConnection(connection);
+    sconnect(&directWatcher, SIGNAL(serviceUnregistered(const QString&)),
+             this, SLOT(onDirectClientExited(const QString&)));
     contextDebug() << F_SERVICE_BACKEND << "Creating new ServiceBackend for" << busName;
 }
 
@@ -75,6 +94,7 @@ ServiceBackend::~ServiceBackend()
 {
     contextDebug() << F_SERVICE_BACKEND << F_DESTROY << "Destroying Service";
     stop();
+    delete sharedRing;
 
     if (properties.size() > 0) {
         contextCritical() << F_SERVICE_BACKEND << "Destroying a Service object "
@@ -130,6 +150,278 @@ bool ServiceBackend::registerProperty(const QString& key, PropertyPrivate* prope
     return true;
 }
 
+/// Register this object, carrying the ServiceAdaptor, at
+/// SERVICE_DBUS_PATH.  Returns true if succeeded, false if failed.
+bool ServiceBackend::registerServiceObject()
+{
+    QObject *registered = connection.objectRegisteredAt(SERVICE_DBUS_PATH);
+    if (registered == this)
+        return true;
+    if (registered != 0) {
+        // Another ServiceBackend shares the connection and has already
+        // claimed the path; its clients keep using the per-property
+        // interface.
+        contextWarning() << F_SERVICE_BACKEND << "Object path" << SERVICE_DBUS_PATH << "already in use";
+        return true;
+    }
+
+    if (!connection.registerObject(SERVICE_DBUS_PATH, this)) {
+        contextCritical() << F_SERVICE_BACKEND << "Failed to register the Service object";
+        contextCritical() << F_SERVICE_BACKEND << "Error:" << connection.lastError();
+        return false;
+    }
+    return true;
+}
+
+/// Returns the PropertyAdaptor of the property \a key, or 0 if this
+/// service doesn't provide \a key.
+PropertyAdaptor* ServiceBackend::propertyAdaptor(const QString &key) const
+{
+    if (!properties.contains(key))
+        return 0;
+    return createdAdaptors.value(key, 0);
+}
+
+/// Queue the change of \a key to \a values and \a timestamp to be
+/// sent in the ValuesChanged signal of the service on the bus.
+void ServiceBackend::queueValueChanged(const QString &key, const QVariantList &values, quint64 timestamp)
+{
+    serviceAdaptor->queueValueChanged(key, values, timestamp);
+}
+
+/// Starts overhearing the ValuesChanged signals of \a sender, another
+/// provider of some of our keys.  Returns true if we didn't overhear
+/// it already.
+bool ServiceBackend::overhear(const QString &sender)
+{
+    return serviceAdaptor->overhear(sender);
+}
+
+/// Queue the \a patch of \a key, made at \a timestamp, to be sent in
+/// the ValuesPatched signal of the service on the bus.
+void ServiceBackend::queuePatch(const QString &key, const QVariant &patch, quint64 timestamp)
+{
+    serviceAdaptor->queuePatch(key, patch, timestamp);
+}
+
+/// Queue the change of \a key to \a values and \a timestamp to be
+/// sent in the ValuesChanged signal on the direct connection of \a
+/// client.
+void ServiceBackend::queueDirectValueChanged(const QString &client, const QString &key,
+                                             const QVariantList &values, quint64 timestamp)
+{
+    ServiceAdaptor *peer = directClients.value(client, 0);
+    if (peer)
+        peer->queueValueChanged(key, values, timestamp);
+}
+
+/// Queue the \a patch of \a key, made at \a timestamp, to be sent in
+/// the ValuesPatched signal on the direct connection of \a client.
+void ServiceBackend::queueDirectPatch(const QString &client, const QString &key,
+                                      const QVariant &patch, quint64 timestamp)
+{
+    ServiceAdaptor *peer = directClients.value(client, 0);
+    if (peer)
+        peer->queuePatch(key, patch, timestamp);
+}
+
+/// Starts accepting direct D-Bus connections from the clients, on a
+/// private socket whose address is returned by the GetDirectAddress
+/// method of org.maemo.contextkit.Service.  The clients connected
+/// directly call Subscribe and get the ValuesChanged signals without
+/// going through the bus daemon; the bus is only used for finding the
+/// address and for noticing when the clients exit.  Returns true if
+/// the socket is available.
+bool ServiceBackend::enableDirectConnections()
+{
+    if (directServer)
+        return true;
+
+    QDBusServer *server = new QDBusServer(QString("unix:tmpdir=/tmp"), this);
+    if (!server->isConnected()) {
+        contextWarning() << F_SERVICE_BACKEND << "Cannot listen to direct connections:" << server->lastError();
+        delete server;
+        return false;
+    }
+    sconnect(server, SIGNAL(newConnection(const QDBusConnection&)),
+             this, SLOT(onNewPeer(const QDBusConnection&)));
+    contextDebug() << F_SERVICE_BACKEND << "Accepting direct connections at" << server->address();
+    directServer = server;
+    return true;
+}
+
+/// Closes the socket for direct connections.  The clients already
+/// connected keep their connections until they leave the bus or the
+/// service is stopped.
+void ServiceBackend::disableDirectConnections()
+{
+    if (directServer == 0)
+        return;
+    delete directServer;
+    directServer = 0;
+}
+
+/// Returns the address of the socket for direct connections, or an
+/// empty string if they are not enabled.
+QString ServiceBackend::directAddress() const
+{
+    return directServer ? directServer->address() : QString();
+}
+
+/// Returns a new random token for \a client, a unique name on the
+/// bus, which asks for the address of our direct connections.  The
+/// client proves that it owns the name by giving the token in
+/// Identify on the direct connection: the bus daemon makes sure that
+/// only the owner of the name gets the reply carrying it.  Returns an
+/// empty string if no token can be made.
+QString ServiceBackend::directToken(const QString &client)
+{
+    QFile random("/dev/urandom");
+    QByteArray bytes;
+    if (random.open(QIODevice::ReadOnly))
+        bytes = random.read(16);
+    if (bytes.size() != 16) {
+        contextWarning() << F_SERVICE_BACKEND << "Cannot make a token for direct connections";
+        return QString();
+    }
+    // Watch the client already now, so that the token is forgotten
+    // when it leaves the bus without connecting.
+    if (!directTokens.contains(client) && !directClients.contains(client))
+        directWatcher.addWatchedService(client);
+    QString token = QString::fromLatin1(bytes.toHex());
+    directTokens.insert(client, token);
+    return token;
+}
+
+/// Returns true if \a client is connected to us directly.
+bool ServiceBackend::isDirectClient(const QString &client) const
+{
+    return directClients.contains(client);
+}
+
+/// Called when a client connects to us directly.  Registers a new
+/// object carrying its own ServiceAdaptor on the connection.
+void ServiceBackend::onNewPeer(const QDBusConnection &peer)
+{
+    QDBusConnection connection(peer);
+    QObject *peerObject = new QObject(this);
+    peerObject->setObjectName(connection.name());
+    new ServiceAdaptor(peerObject, this);
+    if (!connection.registerObject(SERVICE_DBUS_PATH, peerObject)) {
+        contextWarning() << F_SERVICE_BACKEND << "Cannot register the Service object on a direct connection";
+        delete peerObject;
+        QDBusConnection::disconnectFromPeer(connection.name());
+        return;
+    }
+    peerObjects << peerObject;
+}
+
+/// Records that the direct connection of \a peer belongs to \a
+/// client, a unique name on the bus, if \a token is the one given to
+/// the client by directToken().  An older direct connection of the
+/// same client is closed.  Returns false, and records nothing, if the
+/// token is wrong.  Each token can be used once.
+bool ServiceBackend::addDirectClient(const QString &client, const QString &token, ServiceAdaptor *peer)
+{
+    QHash<QString, QString>::iterator expected = directTokens.find(client);
+    if (token.isEmpty() || expected == directTokens.end() || expected.value() != token)
+        return false;
+    directTokens.erase(expected);
+
+    ServiceAdaptor *old = directClients.value(client, 0);
+    if (old == peer)
+        return true;
+    if (old)
+        dropPeer(old->parent());
+    directClients.insert(client, peer);
+    return true;
+}
+
+/// Called when a client connected to us directly leaves the bus.  Its
+/// subscriptions are dropped by the PropertyAdaptor objects; we close
+/// the direct connection.
+void ServiceBackend::onDirectClientExited(const QString &client)
+{
+    directWatcher.removeWatchedService(client);
+    directTokens.remove(client);
+    ServiceAdaptor *peer = directClients.take(client);
+    if (peer)
+        dropPeer(peer->parent());
+}
+
+/// Closes the direct connection served by \a peerObject.
+void ServiceBackend::dropPeer(QObject *peerObject)
+{
+    QString name = peerObject->objectName();
+    QDBusConnection(name).unregisterObject(SERVICE_DBUS_PATH);
+    QDBusConnection::disconnectFromPeer(name);
+    peerObjects.removeAll(peerObject);
+    delete peerObject;
+}
+
+/// Closes all the direct connections.
+void ServiceBackend::dropPeers()
+{
+    QSet<QString> watched = directClients.keys().toSet() + directTokens.keys().toSet();
+    Q_FOREACH (const QString &client, watched)
+        directWatcher.removeWatchedService(client);
+    directClients.clear();
+    directTokens.clear();
+    Q_FOREACH (QObject *peerObject, peerObjects)
+        dropPeer(peerObject);
+}
+
+/// Starts publishing the changes in a ring in shared memory, for the
+/// clients which subscribe with the SubscribeShared method of
+/// org.maemo.contextkit.Service.  Meant for properties which change
+/// too often for D-Bus, like sensor readings; D-Bus is then only used
+/// for the subscriptions.  Returns true if the ring is available.
+bool ServiceBackend::enableSharedMemory()
+{
+    if (sharedRing)
+        return true;
+
+    // The time makes the name unique even if a crashed process with
+    // the same pid left its ring behind.
+    static int ringCount = 0;
+    struct timeval now;
+    gettimeofday(&now, 0);
+    QString name = QString("/contextkit-%1-%2-%3%4").arg(getpid()).arg(++ringCount)
+        .arg(now.tv_sec, 0, 16).arg(now.tv_usec, 5, 16, QChar('0'));
+    SharedRingWriter *ring = new SharedRingWriter();
+    if (!ring->create(name)) {
+        delete ring;
+        return false;
+    }
+    contextDebug() << F_SERVICE_BACKEND << "Publishing changes in shared memory" << name;
+    sharedRing = ring;
+    return true;
+}
+
+/// Removes the shared memory ring.  The clients reading it get the
+/// changes in the ValuesChanged signal from now on.
+void ServiceBackend::disableSharedMemory()
+{
+    if (sharedRing == 0)
+        return;
+    Q_FOREACH (PropertyAdaptor* adaptor, createdAdaptors)
+        adaptor->stopSharing();
+    delete sharedRing;
+    sharedRing = 0;
+}
+
+/// Publishes the change of \a key to \a values and \a timestamp in
+/// the shared memory ring.  An unknown value is published as a null
+/// QVariant.
+void ServiceBackend::publishShared(const QString &key, const QVariantList &values, quint64 timestamp)
+{
+    if (sharedRing == 0)
+        return;
+    if (!sharedRing->publish(key, values.isEmpty() ? QVariant() : values.at(0), timestamp))
+        // The readers fetch the value with SubscribeShared.
+        contextDebug() << F_SERVICE_BACKEND << "Value of" << key << "doesn't fit in the shared ring";
+}
+
 /// Start the Service again after it has been stopped. In the case of
 /// shared connection, the objects will be registered to D-Bus. In the
 /// case of non-shared connection, also the service name will be
@@ -146,6 +438,10 @@ bool ServiceBackend::start()
         }
     }
 
+    if (!registerServiceObject()) {
+        return false;
+    }
+
     // Register the service name over D-Bus
     if (!sharedConnection()) {
         if (!connection.registerService(busName)) {
@@ -177,6 +473,13 @@ void ServiceBackend::stop()
         adaptor->forgetClients();
         connection.unregisterObject(adaptor->objectPath());
     }
+
+    if (connection.objectRegisteredAt(SERVICE_DBUS_PATH) == this)
+        connection.unregisterObject(SERVICE_DBUS_PATH);
+
+    // The clients will resubscribe and get the current values
+    serviceAdaptor->clearQueue();
+    dropPeers();
 }
 
 /// Sets the ServiceBackend object as the default one to use when
@@ -29,12 +29,17 @@
 #include <QHash>
 #include <QVariant>
 #include <QSet>
+#include <QList>
+#include <QDBusServiceWatcher>
 
 class ServiceBackendUnitTest;
+class SharedRingWriter;
+class QDBusServer;
 
 namespace ContextProvider {
 
 class PropertyAdaptor;
+class ServiceAdaptor;
 class PropertyPrivate;
 
 class ServiceBackend : public QObject
@@ -58,6 +63,26 @@ public:
     void ref();
     void unref();
 
+    PropertyAdaptor* propertyAdaptor(const QString &key) const;
+    void queueValueChanged(const QString &key, const QVariantList &values, quint64 timestamp);
+    void queuePatch(const QString &key, const QVariant &patch, quint64 timestamp);
+    bool overhear(const QString &sender);
+
+    bool enableSharedMemory();
+    void disableSharedMemory();
+    void publishShared(const QString &key, const QVariantList &values, quint64 timestamp);
+
+    bool enableDirectConnections();
+    void disableDirectConnections();
+    QString directAddress() const;
+    QString directToken(const QString &client);
+    bool addDirectClient(const QString &client, const QString &token, ServiceAdaptor *peer);
+    bool isDirectClient(const QString &client) const;
+    void queueDirectValueChanged(const QString &client, const QString &key,
+                                 const QVariantList &values, quint64 timestamp);
+    void queueDirectPatch(const QString &client, const QString &key,
+                          const QVariant &patch, quint64 timestamp);
+
     static ServiceBackend* instance(QDBusConnection connection);
     static ServiceBackend* instance(QDBusConnection::BusType busType,
                                     const QString &busName,
@@ -65,9 +90,17 @@ public:
     static ServiceBackend *defaultServiceBackend;
     friend class ::ServiceBackendUnitTest;
     friend class Service;
+    friend class ServiceAdaptor;
+
+private Q_SLOTS:
+    void onNewPeer(const QDBusConnection &peer);
+    void onDirectClientExited(const QString &client);
 
 private:
     bool registerProperty(const QString& key, PropertyPrivate* property);
+    bool registerServiceObject();
+    void dropPeer(QObject *peerObject);
+    void dropPeers();
 
     int refCount; ///< Number of Service objects using this as their backend
 
@@ -88,6 +121,35 @@ private:
     /// Adaptors for property objects. According to Qt documentation,
     /// adaptors should not be deleted.
     QHash<QString, PropertyAdaptor*> createdAdaptors;
+
+    /// Adaptor implementing the multi-key org.maemo.contextkit.Service
+    /// interface on this object.
+    ServiceAdaptor *serviceAdaptor;
+
+    /// Ring in shared memory where the changes are published for the
+    /// clients which subscribed with SubscribeShared; 0 if disabled.
+    SharedRingWriter *sharedRing;
+
+    /// Socket accepting direct connections from the clients; 0 if
+    /// disabled.
+    QDBusServer *directServer;
+
+    /// Objects registered on the direct connections, each carrying
+    /// the ServiceAdaptor of its connection.  The name of the object
+    /// is the name of the connection.
+    QList<QObject*> peerObjects;
+
+    /// The ServiceAdaptor of the direct connection of each client
+    /// which has identified itself.
+    QHash<QString, ServiceAdaptor*> directClients;
+
+    /// The tokens given by GetDirectAddress to the clients which
+    /// haven't identified themselves on a direct connection yet.
+    QHash<QString, QString> directTokens;
+
+    /// For closing the direct connections of the clients exiting the
+    /// bus
+    QDBusServiceWatcher directWatcher;
 };
 
 } // end namespace
@@ -16,7 +16,8 @@ HEADERS = \
     listeners.h \
     context_provider.h \
     servicebackend.h \
-    propertyadaptor.h
+    propertyadaptor.h \
+    serviceadaptor.h
 
 
 SOURCES = \
@@ -27,7 +28,8 @@ SOURCES = \
     contextc.cpp \
     listeners.cpp \
     servicebackend.cpp \
-    propertyadaptor.cpp
+    propertyadaptor.cpp \
+    serviceadaptor.cpp
 
 equals(QT_MAJOR_VERSION, 4): libcp.path = /usr/include/contextprovider
 equals(QT_MAJOR_VERSION, 5): libcp.path = /usr/include/contextprovider5
@@ -0,0 +1,4 @@
+include(../../test.pri)
+TARGET = deliveryunittest
+
+SOURCES = deliveryunittest.cpp
@@ -0,0 +1,327 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "service.h"
+#include "property.h"
+#include "serviceadaptor.h"
+#include "sharedring.h"
+
+#include <QtTest/QtTest>
+#include <QtCore>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusError>
+#include <QDBusMetaType>
+#include <QDBusArgument>
+
+using namespace ContextProvider;
+
+#define SERVICE_NAME "org.maemo.contextkit.testdelivery"
+#define PROPERTY_INTERFACE "org.maemo.contextkit.Property"
+
+/// Records the change signals a client of the service gets.
+class Listener : public QObject
+{
+    Q_OBJECT
+
+public:
+    Listener() : batches(0), perKey(0) {}
+    void clear() { batched.clear(); batchedValues.clear(); batches = 0; perKey = 0; }
+
+    QStringList batched; ///< The keys in the ValuesChanged signals
+    QVariantList batchedValues; ///< Their values, at the same positions
+    int batches; ///< The number of ValuesChanged signals
+    int perKey; ///< The number of ValueChanged signals
+
+public Q_SLOTS:
+    void onValuesChanged(const QStringList &keys, const QVariantList &values,
+                         const QList<quint64> &timestamps)
+    {
+        Q_UNUSED(timestamps);
+        ++batches;
+        batched << keys;
+        // Each value is a list, empty if the value is unknown.
+        Q_FOREACH (const QVariant &value, values) {
+            QVariantList list;
+            if (value.userType() == qMetaTypeId<QDBusArgument>())
+                value.value<QDBusArgument>() >> list;
+            else
+                list = value.toList();
+            batchedValues << (list.isEmpty() ? QVariant() : list.at(0));
+        }
+    }
+
+    void onValueChanged(const QVariantList &values, quint64 timestamp)
+    {
+        Q_UNUSED(values);
+        Q_UNUSED(timestamp);
+        ++perKey;
+    }
+};
+
+class DeliveryUnitTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    DeliveryUnitTest() : service(0), client("") {}
+
+private Q_SLOTS:
+    // Init and cleanup helper functions
+    void initTestCase();
+    void cleanupTestCase();
+    void init();
+    void cleanup();
+
+    // Tests
+    void batched();
+    void coalesced();
+    void perKey();
+    void shared();
+    void direct();
+
+private:
+    QDBusMessage call(QDBusConnection connection, const QString &service,
+                      const QString &method, const QVariantList &args = QVariantList());
+    void listen(QDBusConnection connection, const QString &service, Listener *listener);
+    static bool waitFor(const QStringList &keys, const QString &key);
+
+    Service *service;
+    QDBusConnection client;
+    Listener listener;
+};
+
+void DeliveryUnitTest::initTestCase()
+{
+    qDBusRegisterMetaType<QList<quint64> >();
+    service = new Service(QDBusConnection::SessionBus, SERVICE_NAME);
+}
+
+void DeliveryUnitTest::cleanupTestCase()
+{
+    delete service;
+}
+
+// Before each test: a new client, with no subscriptions
+void DeliveryUnitTest::init()
+{
+    client = QDBusConnection::connectToBus(QDBusConnection::SessionBus, "deliveryclient");
+    QVERIFY(client.isConnected());
+    listener.clear();
+    listen(client, SERVICE_NAME, &listener);
+}
+
+// After each test
+void DeliveryUnitTest::cleanup()
+{
+    client = QDBusConnection("");
+    QDBusConnection::disconnectFromBus("deliveryclient");
+}
+
+/// Calls \a method of org.maemo.contextkit.Service of \a service on
+/// \a connection, and waits for the reply.  The service is served by
+/// the event loop of this thread.  On a direct connection, \a service
+/// is empty.
+QDBusMessage DeliveryUnitTest::call(QDBusConnection connection, const QString &service,
+                                    const QString &method, const QVariantList &args)
+{
+    QDBusMessage msg = QDBusMessage::createMethodCall(service, SERVICE_DBUS_PATH,
+                                                      SERVICE_DBUS_INTERFACE, method);
+    msg.setArguments(args);
+    return connection.call(msg, QDBus::BlockWithGui);
+}
+
+/// Makes \a listener record the ValuesChanged signals of \a service
+/// coming on \a connection.
+void DeliveryUnitTest::listen(QDBusConnection connection, const QString &service, Listener *listener)
+{
+    QVERIFY(connection.connect(service, SERVICE_DBUS_PATH, SERVICE_DBUS_INTERFACE, "ValuesChanged",
+                               listener,
+                               SLOT(onValuesChanged(QStringList, QVariantList, QList<quint64>))));
+}
+
+/// Waits for \a key to appear in \a keys.
+bool DeliveryUnitTest::waitFor(const QStringList &keys, const QString &key)
+{
+    for (int i = 0; i < 200 && !keys.contains(key); ++i)
+        QTest::qWait(10);
+    return keys.contains(key);
+}
+
+void DeliveryUnitTest::batched()
+{
+    // Setup:
+    Property property(*service, "Test.Batched");
+    QVERIFY(client.connect(SERVICE_NAME, "/org/maemo/contextkit/Test/Batched", PROPERTY_INTERFACE,
+                           "ValueChanged", &listener, SLOT(onValueChanged(QVariantList, quint64))));
+    QDBusMessage reply = call(client, SERVICE_NAME, "Subscribe", QVariantList() << QStringList("Test.Batched"));
+    QCOMPARE(reply.type(), QDBusMessage::ReplyMessage);
+    // The first change is sent in ValueChanged too, for the other
+    // providers of the key
+    property.setValue(1);
+    QVERIFY(waitFor(listener.batched, "Test.Batched"));
+    QTest::qWait(50);
+    listener.clear();
+
+    // Test:
+    property.setValue(2);
+
+    // Expected results:
+    // The change comes in ValuesChanged only
+    QVERIFY(waitFor(listener.batched, "Test.Batched"));
+    QTest::qWait(50);
+    QCOMPARE(listener.perKey, 0);
+}
+
+void DeliveryUnitTest::coalesced()
+{
+    // Setup:
+    Property first(*service, "Test.First");
+    Property second(*service, "Test.Second");
+    QDBusMessage reply = call(client, SERVICE_NAME, "Subscribe",
+                              QVariantList() << QVariant(QStringList() << "Test.First" << "Test.Second"));
+    QCOMPARE(reply.type(), QDBusMessage::ReplyMessage);
+
+    // Test:
+    // Several changes during one iteration of the event loop
+    first.setValue(1);
+    second.setValue("a");
+    first.setValue(2);
+    first.setValue(3);
+
+    // Expected results:
+    // They come in one ValuesChanged signal, with the latest value of
+    // each key, in the order the keys first changed
+    QVERIFY(waitFor(listener.batched, "Test.Second"));
+    QTest::qWait(50);
+    QCOMPARE(listener.batches, 1);
+    QCOMPARE(listener.batched, QStringList() << "Test.First" << "Test.Second");
+    QCOMPARE(listener.batchedValues, QVariantList() << QVariant(3) << QVariant("a"));
+}
+
+void DeliveryUnitTest::perKey()
+{
+    // Setup:
+    Property property(*service, "Test.PerKey");
+    QVERIFY(client.connect(SERVICE_NAME, "/org/maemo/contextkit/Test/PerKey", PROPERTY_INTERFACE,
+                           "ValueChanged", &listener, SLOT(onValueChanged(QVariantList, quint64))));
+    QDBusMessage msg = QDBusMessage::createMethodCall(SERVICE_NAME, "/org/maemo/contextkit/Test/PerKey",
+                                                      PROPERTY_INTERFACE, "Subscribe");
+    QCOMPARE(client.call(msg, QDBus::BlockWithGui).type(), QDBusMessage::ReplyMessage);
+
+    // Test:
+    property.setValue(1);
+
+    // Expected results:
+    // The change comes in ValueChanged only
+    for (int i = 0; i < 200 && listener.perKey == 0; ++i)
+        QTest::qWait(10);
+    QCOMPARE(listener.perKey, 1);
+    QTest::qWait(50);
+    QVERIFY(!listener.batched.contains("Test.PerKey"));
+}
+
+void DeliveryUnitTest::shared()
+{
+    // Setup:
+    Property property(*service, "Test.Shared");
+    QVERIFY(service->enableSharedMemory());
+    QDBusMessage reply = call(client, SERVICE_NAME, "SubscribeShared", QVariantList() << QStringList("Test.Shared"));
+    QCOMPARE(reply.type(), QDBusMessage::ReplyMessage);
+    QString ringName = reply.arguments().at(0).toString();
+    QVERIFY(!ringName.isEmpty());
+    SharedRingReader reader;
+    QVERIFY(reader.open(ringName));
+
+    // Test:
+    property.setValue(42);
+
+    // Expected results:
+    // The change is published in the ring, not in ValuesChanged
+    QList<SharedRingRecord> records;
+    QStringList staleKeys;
+    QVERIFY(reader.poll(records, staleKeys));
+    QCOMPARE(records.size(), 1);
+    QCOMPARE(records.at(0).key, QString("Test.Shared"));
+    QCOMPARE(records.at(0).value, QVariant(42));
+    QTest::qWait(50);
+    QVERIFY(!listener.batched.contains("Test.Shared"));
+
+    // Test:
+    // The ring goes away
+    reader.close();
+    service->disableSharedMemory();
+    property.setValue(43);
+
+    // Expected results:
+    // The client gets the changes in ValuesChanged instead
+    QVERIFY(waitFor(listener.batched, "Test.Shared"));
+}
+
+void DeliveryUnitTest::direct()
+{
+    // Setup:
+    Property property(*service, "Test.Direct");
+    QVERIFY(service->enableDirectConnections());
+    QDBusMessage reply = call(client, SERVICE_NAME, "GetDirectAddress");
+    QCOMPARE(reply.type(), QDBusMessage::ReplyMessage);
+    QString address = reply.arguments().at(0).toString();
+    QString token = reply.arguments().at(1).toString();
+    QVERIFY(!address.isEmpty());
+    QVERIFY(!token.isEmpty());
+    QDBusConnection peer = QDBusConnection::connectToPeer(address, "deliverypeer");
+    QVERIFY(peer.isConnected());
+    Listener peerListener;
+    listen(peer, "", &peerListener);
+
+    // Test:
+    // Subscribe before identifying, and identify with a wrong token
+    QDBusMessage early = call(peer, "", "Subscribe", QVariantList() << QStringList("Test.Direct"));
+    QDBusMessage wrong = call(peer, "", "Identify", QVariantList() << client.baseService() << "0123");
+
+    // Expected results:
+    // Both are refused with an error
+    QCOMPARE(early.type(), QDBusMessage::ErrorMessage);
+    QCOMPARE(early.errorName(), QDBusError::errorString(QDBusError::AccessDenied));
+    QCOMPARE(wrong.type(), QDBusMessage::ErrorMessage);
+    QCOMPARE(wrong.errorName(), QDBusError::errorString(QDBusError::AccessDenied));
+
+    // Test:
+    // Identify with the right token and subscribe
+    QCOMPARE(call(peer, "", "Identify", QVariantList() << client.baseService() << token).type(),
+             QDBusMessage::ReplyMessage);
+    QCOMPARE(call(peer, "", "Subscribe", QVariantList() << QStringList("Test.Direct")).type(),
+             QDBusMessage::ReplyMessage);
+    property.setValue(1);
+
+    // Expected results:
+    // The change comes on the direct connection, not on the bus
+    QVERIFY(waitFor(peerListener.batched, "Test.Direct"));
+    QTest::qWait(50);
+    QVERIFY(!listener.batched.contains("Test.Direct"));
+
+    peer = QDBusConnection("");
+    QDBusConnection::disconnectFromPeer("deliverypeer");
+    service->disableDirectConnections();
+}
+
+#include "deliveryunittest.moc"
+QTEST_MAIN(DeliveryUnitTest);
@@ -3,5 +3,6 @@ SUBDIRS = property \
     contextgroup \
     contextc \
     service \
-    servicebackend
+    servicebackend \
+    delivery
 
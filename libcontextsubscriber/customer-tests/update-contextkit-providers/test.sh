@@ -7,6 +7,7 @@ export CONTEXT_PROVIDERS=./
 clean() {
     `rm -f *.actual`
     `rm -f *.cdb`
+    `rm -f *.flat`
 }
 
 # compare file $1 to $2 and display diff if different
@@ -45,6 +46,12 @@ checkperm() {
         clean
         exit 128
     fi
+    if [ "-rw-r--r--" != "`ls -l cache.flat | cut -c 1-10`" ] ; then
+        echo "Permissions of cache.flat are not 0644!"
+        ls -l cache.flat
+        clean
+        exit 128
+    fi
 }
 
 BASEDIR=`dirname $0`
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef ATOMICS_H
+#define ATOMICS_H
+
+#include <QAtomicInt>
+#include <QAtomicPointer>
+
+namespace ContextSubscriber {
+
+// Qt 4 doesn't have plain acquire loads and release stores, only
+// read-modify-write operations with the given ordering, so emulate them
+// with those.  On Qt 5 these are the real thing.
+
+template <typename T>
+inline T* loadAcquire(const QAtomicPointer<T> &p)
+{
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+    return const_cast<QAtomicPointer<T>&>(p).fetchAndAddAcquire(0);
+#else
+    return p.loadAcquire();
+#endif
+}
+
+template <typename T>
+inline void storeRelease(QAtomicPointer<T> &p, T *value)
+{
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+    p.fetchAndStoreRelease(value);
+#else
+    p.storeRelease(value);
+#endif
+}
+
+inline int loadAcquire(const QAtomicInt &i)
+{
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+    return const_cast<QAtomicInt&>(i).fetchAndAddAcquire(0);
+#else
+    return i.loadAcquire();
+#endif
+}
+
+inline void storeRelease(QAtomicInt &i, int value)
+{
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+    i.fetchAndStoreRelease(value);
+#else
+    i.storeRelease(value);
+#endif
+}
+
+} // end namespace
+
+#endif
@@ -43,6 +43,11 @@
     destruction but can be also closed manually.
 
     Reading from a closed reader will return empty strings.
+
+    tiny-cdb maps the database file to memory when it's opened, and
+    the records are read from the mapping: rawValueForKey() returns the
+    serialized value without copying it, and the values are decoded
+    straight from the mapping, only the ones asked for.
 */
 
 /// Constructs a new CDBReader reading from cdb database at \a dbpath
@@ -114,36 +119,67 @@ QVariantList CDBReader::valuesForKey(const QString &key) const
     struct cdb_find cdbf;
     cdb_findinit(&cdbf, (struct cdb*) cdb, kval, klen);
 
-    QVariant valVariant;
-    char* val;
-    QByteArray valArray;
-    QDataStream ds;
-    QBuffer buffer;
-    ds.setDevice(&buffer);
-
     while(cdb_findnext(&cdbf) > 0) {
         unsigned int vpos = cdb_datapos((struct cdb*) cdb);
         unsigned int vlen = cdb_datalen((struct cdb*) cdb);
-        val = (char*) cdb_get((struct cdb*) cdb, vlen, vpos);
-        buffer.close();
-        valArray.setRawData(val, vlen);
-        buffer.setBuffer(&valArray);
-        buffer.open(QBuffer::ReadOnly);
-        ds >> valVariant;
-        list << valVariant;
+        list << decode((const char*) cdb_get((struct cdb*) cdb, vlen, vpos), vlen);
     }
 
     return list;
 }
 
 /// Returns a value for the given \a key.
-/// First value is returned if there are many values for one key.
+/// First value is returned if there are many values for one key; the
+/// others are not decoded.
 /// \param key The key name in the database.
 QVariant CDBReader::valueForKey(const QString &key) const
 {
-    QVariantList ret = valuesForKey(key);
-    if (ret.size() == 0) return QVariant();
-    return ret[0];
+    QByteArray raw = rawValueForKey(key);
+    if (raw.isNull()) return QVariant();
+    return decode(raw.constData(), raw.size());
+}
+
+/// Returns the first value for the given \a key as it's stored in the
+/// database, serialized with QDataStream, or a null QByteArray if
+/// there is none.  The returned array refers to the memory mapped
+/// database and is valid only until the reader is closed or reopened.
+QByteArray CDBReader::rawValueForKey(const QString &key) const
+{
+    if (! cdb)
+        return QByteArray();
+
+    QByteArray utf8Data = key.toUtf8();
+    if (cdb_find((struct cdb*) cdb, utf8Data.constData(), utf8Data.size()) <= 0)
+        return QByteArray();
+
+    unsigned int vpos = cdb_datapos((struct cdb*) cdb);
+    unsigned int vlen = cdb_datalen((struct cdb*) cdb);
+    return QByteArray::fromRawData((const char*) cdb_get((struct cdb*) cdb, vlen, vpos), vlen);
+}
+
+/// Deserializes the value of \a length bytes at \a data, without
+/// copying the bytes first.
+QVariant CDBReader::decode(const char *data, unsigned int length)
+{
+    if (!data)
+        return QVariant();
+
+    const QByteArray view = QByteArray::fromRawData(data, length);
+    QDataStream ds(view);
+    QVariant value;
+    ds >> value;
+    return value;
+}
+
+/// Returns true if the database has any value for the given key.
+/// Cheaper than valuesForKey(), as nothing is decoded.
+bool CDBReader::contains(const QString &key) const
+{
+    if (! cdb)
+        return false;
+
+    QByteArray utf8Data = key.toUtf8();
+    return cdb_find((struct cdb*) cdb, utf8Data.constData(), utf8Data.size()) > 0;
 }
 
 /// Returns the current state of the reader. Reader is not readable if
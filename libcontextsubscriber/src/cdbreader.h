@@ -40,10 +40,14 @@ public:
     void reopen();
     QVariantList valuesForKey(const QString &key) const;
     QVariant valueForKey(const QString &key) const;
+    bool contains(const QString &key) const;
+    QByteArray rawValueForKey(const QString &key) const;
     bool isReadable();
     int fileDescriptor() const;
 
 private:
+    static QVariant decode(const char *data, unsigned int length);
+
     QString path; ///< Path pointing to the database.
     void *cdb; ///< Cdb library object used for reading.
     int fd; ///< A file descriptor to the database.
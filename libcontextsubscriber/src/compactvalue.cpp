@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "compactvalue.h"
+
+#include <string.h>
+#include <new>
+
+namespace ContextSubscriber {
+
+/// Constructs a CompactValue holding \a value.  Null values of a
+/// specific type, like QVariant(QVariant::Int), are not the same as an
+/// invalid QVariant, so they are kept as they are.
+CompactValue::CompactValue(const QVariant &value)
+    : length(0)
+{
+    if (!value.isValid()) {
+        tag = Null;
+        return;
+    }
+    if (value.isNull()) {
+        tag = Variant;
+        new (data.variant) QVariant(value);
+        return;
+    }
+    switch (value.type()) {
+    case QVariant::Bool:
+        tag = Bool;
+        data.b = value.toBool();
+        break;
+    case QVariant::Int:
+        tag = Int;
+        data.i = value.toInt();
+        break;
+    case QVariant::UInt:
+        tag = UInt;
+        data.u = value.toUInt();
+        break;
+    case QVariant::LongLong:
+        tag = LongLong;
+        data.i = value.toLongLong();
+        break;
+    case QVariant::ULongLong:
+        tag = ULongLong;
+        data.u = value.toULongLong();
+        break;
+    case QVariant::Double:
+        tag = Double;
+        data.d = value.toDouble();
+        break;
+    case QVariant::String: {
+        const QString string = value.toString();
+        if (string.size() <= MaxInlineString) {
+            tag = String;
+            length = string.size();
+            memcpy(data.chars, string.utf16(), length * sizeof(ushort));
+            break;
+        }
+    } // fall through
+    default:
+        tag = Variant;
+        new (data.variant) QVariant(value);
+        break;
+    }
+}
+
+CompactValue::CompactValue(const CompactValue &other)
+{
+    assign(other);
+}
+
+CompactValue::~CompactValue()
+{
+    clear();
+}
+
+CompactValue &CompactValue::operator=(const CompactValue &other)
+{
+    if (this != &other) {
+        clear();
+        assign(other);
+    }
+    return *this;
+}
+
+/// Copies \a other into this value, which holds nothing.
+void CompactValue::assign(const CompactValue &other)
+{
+    tag = other.tag;
+    length = other.length;
+    if (tag == Variant)
+        new (data.variant) QVariant(*other.variant());
+    else
+        memcpy(&data, &other.data, sizeof(data));
+}
+
+/// Destroys the QVariant if we hold one.
+void CompactValue::clear()
+{
+    if (tag == Variant)
+        variant()->~QVariant();
+    tag = Null;
+}
+
+/// Returns the value as a QVariant.  For inline strings this allocates.
+QVariant CompactValue::toVariant() const
+{
+    switch (tag) {
+    case Bool:
+        return QVariant(data.b);
+    case Int:
+        return QVariant(int(data.i));
+    case UInt:
+        return QVariant(uint(data.u));
+    case LongLong:
+        return QVariant(qlonglong(data.i));
+    case ULongLong:
+        return QVariant(qulonglong(data.u));
+    case Double:
+        return QVariant(data.d);
+    case String:
+        return QVariant(QString(reinterpret_cast<const QChar *>(data.chars), length));
+    case Variant:
+        return *variant();
+    default:
+        return QVariant();
+    }
+}
+
+/// Returns true if the two values are the same, including their type.
+/// Values of different types are never equal, unlike QVariants, where
+/// QVariant(QVariant::Int) == QVariant(0).  Doubles are compared
+/// bitwise, so a NaN equals itself and doesn't cause endless updates.
+bool CompactValue::operator==(const CompactValue &other) const
+{
+    if (tag != other.tag)
+        return false;
+    switch (tag) {
+    case Null:
+        return true;
+    case Bool:
+        return data.b == other.data.b;
+    case Int:
+    case LongLong:
+        return data.i == other.data.i;
+    case UInt:
+    case ULongLong:
+        return data.u == other.data.u;
+    case Double:
+        return memcmp(&data.d, &other.data.d, sizeof(double)) == 0;
+    case String:
+        return length == other.length &&
+            memcmp(data.chars, other.data.chars, length * sizeof(ushort)) == 0;
+    default: {
+        const QVariant &mine = *variant();
+        const QVariant &theirs = *other.variant();
+        return mine == theirs &&
+            mine.isNull() == theirs.isNull() &&
+            mine.type() == theirs.type();
+    }
+    }
+}
+
+} // end namespace
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef COMPACTVALUE_H
+#define COMPACTVALUE_H
+
+#include "timedvalue.h"
+
+#include <QVariant>
+#include <QString>
+
+namespace ContextSubscriber {
+
+/*!
+  \class CompactValue
+
+  \brief Holds a property value in the form the subscriber passes
+  around and compares internally.
+
+  Most values are booleans, numbers and short strings.  These are kept
+  inline, tagged with their type, so copying them does not touch the
+  heap and comparing them is a tag check and a compare of the payload.
+  Everything else is kept in a QVariant.  toVariant() creates the
+  QVariant which is handed out through the public API.
+*/
+class CompactValue
+{
+public:
+    CompactValue() : tag(Null), length(0)
+        { }
+    CompactValue(const QVariant &value);
+    CompactValue(const CompactValue &other);
+    ~CompactValue();
+    CompactValue &operator=(const CompactValue &other);
+
+    /// Returns true if there is no value, like QVariant::isNull().
+    bool isNull() const
+        { return tag == Null || (tag == Variant && variant()->isNull()); }
+    /// Returns true if the value is stored inline.
+    bool isInline() const
+        { return tag != Variant; }
+    QVariant toVariant() const;
+
+    bool operator==(const CompactValue &other) const;
+    bool operator!=(const CompactValue &other) const
+        { return !(*this == other); }
+
+    /// The longest string which is stored inline.
+    static const int MaxInlineString = 11;
+
+private:
+    enum Tag { Null, Bool, Int, UInt, LongLong, ULongLong, Double,
+               String, Variant };
+
+    QVariant *variant()
+        { return reinterpret_cast<QVariant *>(data.variant); }
+    const QVariant *variant() const
+        { return reinterpret_cast<const QVariant *>(data.variant); }
+    void assign(const CompactValue &other);
+    void clear();
+
+    quint8 tag; ///< One of Tag
+    quint8 length; ///< Number of characters of an inline string
+    union {
+        bool b;
+        qint64 i;
+        quint64 u;
+        double d;
+        ushort chars[MaxInlineString];
+        char variant[sizeof(QVariant)];
+        void *align; ///< Aligns the QVariant
+    } data;
+};
+
+/// A CompactValue together with the time it was received, the
+/// internal counterpart of TimedValue.
+struct TimedCompactValue
+{
+    quint64 time;
+    CompactValue value;
+
+    TimedCompactValue() : time(0)
+        { }
+    TimedCompactValue(const TimedValue &timed)
+        : time(timed.time), value(timed.value)
+        { }
+};
+
+} // end namespace
+
+#endif
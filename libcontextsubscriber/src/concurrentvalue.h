@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef CONCURRENTVALUE_H
+#define CONCURRENTVALUE_H
+
+#include "atomics.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+
+namespace ContextSubscriber {
+
+/*!
+  \class ConcurrentValue
+
+  \brief Holds a value which is written by one thread at a time and
+  read by any number of threads without waiting.
+
+  A seqlock doesn't work for values like QVariant: a reader racing
+  with the writer could copy a half-overwritten QVariant and touch its
+  already freed shared data.  So this uses the left-right scheme
+  instead: there are two instances of the value, and readers always
+  copy the one which the writer is not touching.  Readers announce
+  themselves on one of two read indicators; the writer flips the
+  readers over to the fresh instance and waits for the indicators to
+  drain before it overwrites the stale one.
+
+  Reads are two atomic increments and a copy, and never block.  Writes
+  are serialized by a mutex and yield until the readers of the old
+  instance are gone, which takes no longer than a copy of \c T.
+*/
+template <typename T>
+class ConcurrentValue
+{
+public:
+    ConcurrentValue() : leftRight(0), versionIndex(0)
+        { }
+
+    /// Returns a copy of the current value.  Wait-free.
+    T read() const
+        {
+            const int version = loadAcquire(versionIndex);
+            readIndicators[version].ref();
+            T result = instances[loadAcquire(leftRight)];
+            readIndicators[version].deref();
+            return result;
+        }
+
+    /// Replaces the current value with \a value.
+    void write(const T &value)
+        {
+            QMutexLocker locker(&writeLock);
+            const int current = loadAcquire(leftRight);
+            instances[1 - current] = value;
+            leftRight.fetchAndStoreOrdered(1 - current);
+
+            // New readers go to the fresh instance now; wait for the
+            // ones which might still be reading the stale one.
+            const int previousVersion = loadAcquire(versionIndex);
+            waitForReaders(1 - previousVersion);
+            versionIndex.fetchAndStoreOrdered(1 - previousVersion);
+            waitForReaders(previousVersion);
+
+            instances[current] = value;
+        }
+
+private:
+    Q_DISABLE_COPY(ConcurrentValue)
+
+    void waitForReaders(int version) const
+        {
+            while (loadAcquire(readIndicators[version]) != 0)
+                QThread::yieldCurrentThread();
+        }
+
+    T instances[2];
+    QAtomicInt leftRight; ///< Index of the instance the readers copy
+    QAtomicInt versionIndex; ///< Index of the read indicator new readers use
+    mutable QAtomicInt readIndicators[2]; ///< Number of readers per version
+    QMutex writeLock; ///< Serializes the writers
+};
+
+} // end namespace
+
+#endif
@@ -25,10 +25,14 @@
 #include "sconnect.h"
 #include "propertyhandle.h"
 #include "safedbuspendingcallwatcher.h"
+#include "sharedring.h"
+#include "valuepatch.h"
+#include "valuedecoder.h"
 #include <QStringList>
 #include <QDBusPendingCall>
 #include <QTimer>
 #include <QDBusPendingReply>
+#include <QDBusMetaType>
 
 /// Creates a new instance, the service to connect to has to be passed
 /// in \c constructionString in the format <tt>[session|dbus]:servicename</tt>.
@@ -52,6 +56,66 @@ ContextSubscriber::IProviderPlugin* contextKitPluginFactory(QString construction
     return 0;
 }
 
+/// Creates a new instance which reads the changes from the shared
+/// memory of the provider, see ContextKitPlugin::setSharedMemory().
+/// The format of \c constructionString is
+/// <tt>[session|system]:servicename[:interval]</tt>, where the
+/// optional interval is the polling interval in milliseconds.
+ContextSubscriber::IProviderPlugin* contextKitSharedPluginFactory(QString constructionString)
+{
+    QStringList constr = constructionString.split(":");
+    int interval = 10;
+    if (constr.size() == 3) {
+        bool ok;
+        interval = constr.takeLast().toInt(&ok);
+        if (!ok || interval <= 0) {
+            contextCritical() << "Bad polling interval for contextkit-shm plugin:" << constructionString;
+            return 0;
+        }
+    }
+    if (constr.size() != 2) {
+        contextCritical() << "Bad syntax for contextkit-shm plugin:" << constructionString;
+        return 0;
+    }
+    if (constr[0] != "session" && constr[0] != "system") {
+        contextCritical() << "Unknown bus type: " << constructionString;
+        return 0;
+    }
+
+    ContextSubscriber::ContextKitPlugin* ret =
+        new ContextSubscriber::ContextKitPlugin(constr[0] == "session" ?
+                                                QDBusConnection::sessionBus() :
+                                                QDBusConnection::systemBus(),
+                                                constr[1]);
+    ret->setSharedMemory(interval);
+    return ret;
+}
+
+/// Creates a new instance which connects to the provider directly
+/// when the provider lets it, see
+/// ContextKitPlugin::setDirectConnection().  The format of \c
+/// constructionString is <tt>[session|system]:servicename</tt>.
+ContextSubscriber::IProviderPlugin* contextKitDirectPluginFactory(QString constructionString)
+{
+    QStringList constr = constructionString.split(":");
+    if (constr.size() != 2) {
+        contextCritical() << "Bad syntax for contextkit-direct plugin:" << constructionString;
+        return 0;
+    }
+    if (constr[0] != "session" && constr[0] != "system") {
+        contextCritical() << "Unknown bus type: " << constructionString;
+        return 0;
+    }
+
+    ContextSubscriber::ContextKitPlugin* ret =
+        new ContextSubscriber::ContextKitPlugin(constr[0] == "session" ?
+                                                QDBusConnection::sessionBus() :
+                                                QDBusConnection::systemBus(),
+                                                constr[1]);
+    ret->setDirectConnection(true);
+    return ret;
+}
+
 namespace ContextSubscriber {
 
 /*!
@@ -63,7 +127,11 @@ static const char managerIName[] = "org.freedesktop.ContextKit.Manager";
 static const char subscriberIName[] = "org.freedesktop.ContextKit.Subscriber";
 static const char managerPath[] = "/org/freedesktop/ContextKit/Manager";
 static const char propertyIName[] = "org.maemo.contextkit.Property";
+static const char serviceIName[] = "org.maemo.contextkit.Service";
+static const char servicePath[] = "/org/maemo/contextkit";
 static const char corePrefix[] = "/org/maemo/contextkit/";
+/// The longest interval the polling of an idle ring backs off to
+static const int maxRingInterval = 500;
 
 /// Converts a key name to a protocol level object path.  There is a
 /// distinction, because core properties have the form
@@ -77,7 +145,16 @@ QString ContextKitPlugin::keyToPath(QString key)
     if (key.startsWith("/"))
         return key;
 
-    return corePrefix + key.replace('.', '/').replace(QRegExp("[^A-Za-z0-9_/]"), "_");
+    QChar *c = key.data();
+    for (QChar *end = c + key.size(); c != end; ++c) {
+        ushort u = c->unicode();
+        if (u == '.')
+            *c = QLatin1Char('/');
+        else if (!((u >= 'A' && u <= 'Z') || (u >= 'a' && u <= 'z') ||
+                   (u >= '0' && u <= '9') || u == '_' || u == '/'))
+            *c = QLatin1Char('_');
+    }
+    return QLatin1String(corePrefix) + key;
 }
 
 /// Creates subscriber and manager interface, tries to get a
@@ -90,8 +167,23 @@ ContextKitPlugin::ContextKitPlugin(const QDBusConnection bus, const QString& bus
       connection(new QDBusConnection(bus)),
       busName(busName),
       newProtocol(true),
-      defaultNewProtocol(true)
+      defaultNewProtocol(true),
+      batchSupport(BatchUnknown),
+      valueChangedConnected(false),
+      valuesChangedConnected(false),
+      valuesPatchedConnected(false),
+      ring(0),
+      ringTimer(0),
+      ringInterval(0),
+      sharedUnsupported(false),
+      deltaUnsupported(false),
+      directWanted(false),
+      peer(0),
+      pendingPeer(0),
+      addressWatcher(0),
+      identifyWatcher(0)
 {
+    qDBusRegisterMetaType<QList<quint64> >();
     reset();
     // Notice if the provider on the dbus comes and goes
     sconnect(providerListener, SIGNAL(nameAppeared()),
@@ -110,6 +202,37 @@ void ContextKitPlugin::setDefaultNewProtocol(bool s) {
     defaultNewProtocol = s;
 }
 
+/// Makes the plugin subscribe with SubscribeShared, and read the
+/// changes from the shared memory ring of the provider while some key
+/// is subscribed.  The ring is polled every \a pollInterval
+/// milliseconds while it has changes for us; while it's idle, the
+/// interval is doubled at each poll up to half a second, so that an
+/// idle process isn't woken up needlessly.  D-Bus is only used for the
+/// subscriptions, and for the keys which the provider doesn't publish
+/// in the ring.  Used by the contextkit-shm plugin.
+void ContextKitPlugin::setSharedMemory(int pollInterval)
+{
+    if (ring == 0) {
+        ring = new SharedRingReader();
+        ringTimer = new QTimer(this);
+        sconnect(ringTimer, SIGNAL(timeout()),
+                 this, SLOT(pollRing()));
+    }
+    ringInterval = pollInterval;
+    ringTimer->setInterval(pollInterval);
+}
+
+/// Makes the plugin ask the provider for the address of its direct
+/// connections (see ContextProvider::Service::enableDirectConnections())
+/// whenever the provider appears, and move the subscriptions there if
+/// it gets one.  The Subscribe calls and the ValuesChanged signals
+/// then bypass the bus daemon; the bus is still used for noticing the
+/// provider coming and going.  Used by the contextkit-direct plugin.
+void ContextKitPlugin::setDirectConnection(bool direct)
+{
+    directWanted = direct;
+}
+
 void ContextKitPlugin::reset()
 {
     delete(subscriberInterface);
@@ -117,9 +240,26 @@ void ContextKitPlugin::reset()
     delete(managerInterface);
     managerInterface = 0;
     newProtocol = defaultNewProtocol;
+    // The provider might have been replaced by one with a different
+    // version of the protocol.
+    batchSupport = BatchUnknown;
     // Disconnect the ValueChanged signal for all keys (object paths)
-    connection->disconnect(busName, "", propertyIName, "ValueChanged",
-                           this, SLOT(onNewValueChanged(QList<QVariant>,quint64,QDBusMessage)));
+    setMatchRules(false, false, false);
+    // A new instance of the provider has a new address.
+    delete addressWatcher;
+    addressWatcher = 0;
+    delete identifyWatcher;
+    identifyWatcher = 0;
+    dropPeer();
+    // A new instance of the provider has a new ring.
+    if (ring) {
+        ring->close();
+        ringTimer->stop();
+    }
+    sharedUnsupported = false;
+    deliveredTimes.clear();
+    deltaUnsupported = false;
+    deltaBases.clear();
 }
 
 /// Gets a new subscriber interface from manager when the provider
@@ -198,11 +338,145 @@ void ContextKitPlugin::useNewProtocol()
     if (providerListener->isServicePresent() == DBusNameListener::NotPresent)
         return;
 
+    if (directWanted)
+        // We might be handling the result of an async call; see
+        // subscribe().
+        QMetaObject::invokeMethod(this, "requestDirectAddress", Qt::QueuedConnection);
+
     // Ready to try out new protocol. Ready should not be queued,
     // because otherwise ready and failed might get reordered.
     Q_EMIT ready();
 }
 
+/// Asks the provider for the address of its direct connections.  The
+/// subscriptions are made on the bus meanwhile.
+void ContextKitPlugin::requestDirectAddress()
+{
+    if (!directWanted || !newProtocol || peer || pendingPeer || addressWatcher)
+        return;
+
+    QDBusMessage msg = QDBusMessage::createMethodCall(busName,
+                                                      servicePath,
+                                                      serviceIName,
+                                                      "GetDirectAddress");
+    addressWatcher = new QDBusPendingCallWatcher(connection->asyncCall(msg), this);
+    sconnect(addressWatcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
+             this, SLOT(onDirectAddress(QDBusPendingCallWatcher*)));
+}
+
+/// Called when the GetDirectAddress call returns.  If the provider
+/// gave an address, connects to it and identifies us there.  The
+/// subscriptions stay on the bus until the provider accepts us, see
+/// onIdentified().
+void ContextKitPlugin::onDirectAddress(QDBusPendingCallWatcher *watcher)
+{
+    QDBusPendingReply<QString, QString> reply = *watcher;
+    watcher->deleteLater();
+    addressWatcher = 0;
+
+    if (reply.isError() || reply.value().isEmpty()) {
+        contextDebug() << "Provider" << busName << "doesn't accept direct connections";
+        return;
+    }
+
+    if (!connectToPeer(reply.value()))
+        return;
+
+    // Tell the provider who we are, so that it forgets our
+    // subscriptions when we leave the bus.  The token proves that
+    // the name is ours.
+    QDBusMessage msg = QDBusMessage::createMethodCall(QString(),
+                                                      servicePath,
+                                                      serviceIName,
+                                                      "Identify");
+    msg << connection->baseService() << reply.argumentAt<1>();
+    identifyWatcher = new QDBusPendingCallWatcher(pendingPeer->asyncCall(msg), this);
+    sconnect(identifyWatcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
+             this, SLOT(onIdentified(QDBusPendingCallWatcher*)));
+}
+
+/// Called when the Identify call on the direct connection returns.
+/// If the provider accepted us, subscribes to all our keys again on
+/// the direct connection: subscribing with the same bus name moves
+/// the subscriptions, and the provider sends the changes to us only
+/// there from then on.  If it refused us, the connection is closed,
+/// and the keys stay subscribed on the bus, where nothing was missed.
+void ContextKitPlugin::onIdentified(QDBusPendingCallWatcher *watcher)
+{
+    QDBusPendingReply<> reply = *watcher;
+    watcher->deleteLater();
+    identifyWatcher = 0;
+
+    if (reply.isError()) {
+        contextWarning() << "Provider" << busName << "refused the direct connection:"
+                         << reply.error().message();
+        dropPeer();
+        return;
+    }
+
+    // The match rules are on the bus; the signals sent there before
+    // the subscriptions move are not needed, the new Subscribe call
+    // returns the current values.
+    setMatchRules(false, false, false);
+    peer = pendingPeer;
+    pendingPeer = 0;
+    contextDebug() << "Connected directly to" << busName;
+    // Only providers implementing org.maemo.contextkit.Service have
+    // direct connections.
+    batchSupport = BatchSupported;
+
+    Q_FOREACH (const QString& key, keyPaths.keys())
+        pendingKeys.insert(key);
+    updateMatchRules();
+    // We are handling the result of an async call; see subscribe().
+    QMetaObject::invokeMethod(this, "flushPendingKeys", Qt::QueuedConnection);
+}
+
+/// Opens the direct connection to \a address.  Returns false if the
+/// provider cannot be reached there; the bus is used then.
+bool ContextKitPlugin::connectToPeer(const QString& address)
+{
+    static int peerCount = 0;
+    QString name = QString("contextkit-direct-%1").arg(++peerCount);
+    QDBusConnection direct = QDBusConnection::connectToPeer(address, name);
+    if (!direct.isConnected()) {
+        contextWarning() << "Cannot connect directly to" << busName << ":" << direct.lastError().message();
+        QDBusConnection::disconnectFromPeer(name);
+        return false;
+    }
+    pendingPeer = new QDBusConnection(direct);
+    return true;
+}
+
+/// Closes the direct connection to the provider, if any, whether it's
+/// in use or still waiting for the reply of Identify.
+void ContextKitPlugin::dropPeer()
+{
+    QDBusConnection *direct = peer ? peer : pendingPeer;
+    if (direct == 0)
+        return;
+    QString name = direct->name();
+    delete direct;
+    peer = 0;
+    pendingPeer = 0;
+    QDBusConnection::disconnectFromPeer(name);
+}
+
+/// Returns the connection for org.maemo.contextkit.Service: the
+/// direct connection to the provider if we have one, the bus
+/// otherwise.
+QDBusConnection *ContextKitPlugin::serviceConnection() const
+{
+    return peer ? peer : connection;
+}
+
+/// Returns the service name to use on serviceConnection(); there are
+/// no names on a direct connection.
+QString ContextKitPlugin::serviceName() const
+{
+    return peer ? QString() : busName;
+}
+
 /// Signals the Provider that the Subscribe call (old protocol) is finished.
 void ContextKitPlugin::onDBusSubscribeFinished(QList<QString> keys)
 {
@@ -220,99 +494,395 @@ void ContextKitPlugin::onDBusSubscribeFailed(QList<QString> keys, QString error)
 /// Forwards the subscribe request to the wire.
 void ContextKitPlugin::subscribe(QSet<QString> keys)
 {
-    if (newProtocol)
-        Q_FOREACH (const QString& key, keys) {
-            // Queue calling the Subscribe asynchronously. Don't
-            // create the async call here: Qt will deadlock if we
-            // create an async call while handling the results of the
-            // previous async call. (We emit "ready" when handling
-            // GetSubscriber. "Ready" is not queued, and the above
-            // layer can call subscribe when handling it.)
-            pendingKeys.insert(key);
-            QMetaObject::invokeMethod(this, "newSubscribe", Qt::QueuedConnection, Q_ARG(QString, key));
-        }
+    if (newProtocol) {
+        // Queue calling the Subscribe asynchronously. Don't create
+        // the async call here: Qt will deadlock if we create an async
+        // call while handling the results of the previous async
+        // call. (We emit "ready" when handling GetSubscriber. "Ready"
+        // is not queued, and the above layer can call subscribe when
+        // handling it.)  All the keys pending when the queued call
+        // executes are subscribed to with one D-Bus call.
+        pendingKeys.unite(keys);
+        QMetaObject::invokeMethod(this, "flushPendingKeys", Qt::QueuedConnection);
+    }
     else {
         subscriberInterface->subscribe(keys);
     }
 }
 
-void ContextKitPlugin::newSubscribe(const QString& key)
+/// Subscribes to all the pending keys.  If the provider implements
+/// org.maemo.contextkit.Service (or we don't know yet), this is done
+/// with one Subscribe call for all of them; otherwise each key is
+/// subscribed to separately.
+void ContextKitPlugin::flushPendingKeys()
 {
-    if (pendingKeys.contains(key) == false) {
-        // this key was already handled, probably because
-        // waitForSubscriptionAndBlock forced the subscription to happen.
+    if (pendingKeys.isEmpty()) {
+        // already handled by an earlier flush or by
+        // blockUntilSubscribed
         return;
     }
-    pendingKeys.remove(key);
 
-    QString objectPath = keyToPath(key);
-    // Store the "object path -> key" mapping so that we can transform
-    // back when a valueChanged signal comes over D-Bus. (Note the
-    // special character transformation.)
-    objectPathToKey[objectPath] = key;
+    if (batchSupport == BatchUnsupported) {
+        while (pendingKeys.size() > 0)
+            newSubscribe(*(pendingKeys.constBegin()));
+        return;
+    }
 
-    QDBusPendingCall pc = connection->asyncCall(QDBusMessage::createMethodCall(busName,
-                                                                               objectPath,
-                                                                               propertyIName,
-                                                                               "Subscribe"));
+    QStringList keys = pendingKeys.toList();
+    pendingKeys.clear();
+    Q_FOREACH (const QString& key, keys)
+        registerKey(key);
+
+    // The patches of the delta encoding don't go to the shared ring.
+    PendingBatchSubscribeWatcher::Method method = PendingBatchSubscribeWatcher::Subscribe;
+    const char *methodName = "Subscribe";
+    if (ring != 0 && !sharedUnsupported) {
+        method = PendingBatchSubscribeWatcher::SubscribeShared;
+        methodName = "SubscribeShared";
+    }
+    else if (!deltaUnsupported) {
+        method = PendingBatchSubscribeWatcher::SubscribeDelta;
+        methodName = "SubscribeDelta";
+    }
+    QDBusMessage msg = QDBusMessage::createMethodCall(serviceName(),
+                                                      servicePath,
+                                                      serviceIName,
+                                                      methodName);
+    msg << keys;
+    QDBusPendingCall pc = serviceConnection()->asyncCall(msg);
+
+    PendingBatchSubscribeWatcher *pbsw = new PendingBatchSubscribeWatcher(pc, keys, method, this);
+    Q_FOREACH (const QString& key, keys)
+        pendingWatchers.insert(key, pbsw);
+    connectWatcher(pbsw);
+    sconnect(pbsw,
+             SIGNAL(batchSupported()),
+             this,
+             SLOT(onBatchSupported()));
+    sconnect(pbsw,
+             SIGNAL(batchUnsupported(QStringList, bool)),
+             this,
+             SLOT(onBatchUnsupported(const QStringList&, bool)));
+    if (method == PendingBatchSubscribeWatcher::SubscribeShared)
+        sconnect(pbsw,
+                 SIGNAL(ringOffered(QString)),
+                 this,
+                 SLOT(onRingOffered(const QString&)));
+    if (method == PendingBatchSubscribeWatcher::SubscribeDelta)
+        sconnect(pbsw,
+                 SIGNAL(deltaBase(QString, QVariant, quint64)),
+                 this,
+                 SLOT(onDeltaBase(const QString&, const QVariant&, quint64)));
+}
+
+/// Called when a batched Subscribe call succeeds; from now on also
+/// the unsubscriptions are batched, and the changes arrive in the
+/// ValuesChanged signal of the service.
+void ContextKitPlugin::onBatchSupported()
+{
+    batchSupport = BatchSupported;
+    updateMatchRules();
+}
+
+/// Called when the provider turns out not to implement
+/// org.maemo.contextkit.Service, or, if \a methodOnly, only the
+/// SubscribeShared or SubscribeDelta method of it.  The \a keys of
+/// the failed call are subscribed to again, with Subscribe or one by
+/// one.
+void ContextKitPlugin::onBatchUnsupported(const QStringList& keys, bool methodOnly)
+{
+    if (methodOnly && ring && !sharedUnsupported) {
+        contextDebug() << "Provider" << busName << "doesn't support shared memory";
+        sharedUnsupported = true;
+    }
+    else if (methodOnly && !deltaUnsupported) {
+        contextDebug() << "Provider" << busName << "doesn't support delta encoding";
+        deltaUnsupported = true;
+    }
+    else {
+        contextDebug() << "Provider" << busName << "doesn't support batched subscriptions";
+        batchSupport = BatchUnsupported;
+        updateMatchRules();
+    }
+    Q_FOREACH (const QString& key, keys) {
+        pendingWatchers.remove(key);
+        pendingKeys.insert(key);
+    }
+    // We are handling the result of an async call; see subscribe().
+    QMetaObject::invokeMethod(this, "flushPendingKeys", Qt::QueuedConnection);
+}
+
+/// Starts dispatching the ValueChanged signals of the object of \a
+/// key, and returns the object path.
+QString ContextKitPlugin::registerKey(const QString& key)
+{
+    QString objectPath = keyPaths.value(key);
+    if (objectPath.isEmpty()) {
+        objectPath = keyToPath(key);
+        // Store the "object path -> key" mapping so that we can
+        // transform back when a valueChanged signal comes over
+        // D-Bus. (Note the special character transformation.)
+        pathToKey.insert(objectPath, key);
+        keyPaths.insert(key, objectPath);
+    }
+    updateMatchRules();
+    return objectPath;
+}
+
+/// Stops dispatching the ValueChanged signals of the object of \a
+/// key, and returns the object path.
+QString ContextKitPlugin::unregisterKey(const QString& key)
+{
+    QString objectPath = keyPaths.take(key);
+    deliveredTimes.remove(key);
+    deltaBases.remove(key);
+    if (objectPath.isEmpty())
+        objectPath = keyToPath(key);
+    else
+        pathToKey.remove(objectPath);
+
+    updateMatchRules();
+    return objectPath;
+}
+
+/// Installs or removes the match rules for the change signals of
+/// the provider, depending on whether we have subscribed keys and
+/// whether the provider sends the per-key ValueChanged or the batched
+/// ValuesChanged signal to us.  While we don't know yet, both are
+/// listened to.  The ValuesPatched signal is listened to while we
+/// have keys taking patches.
+void ContextKitPlugin::updateMatchRules()
+{
+    bool subscribed = !pathToKey.isEmpty();
+    setMatchRules(subscribed && batchSupport != BatchSupported,
+                  subscribed && batchSupport != BatchUnsupported,
+                  !deltaBases.isEmpty());
+    updateRingTimer();
+}
+
+/// Polls the shared memory ring while it's open and we have
+/// subscribed keys.
+void ContextKitPlugin::updateRingTimer()
+{
+    if (ring == 0)
+        return;
+    if (ring->isOpen() && !pathToKey.isEmpty()) {
+        if (!ringTimer->isActive())
+            ringTimer->start(ringInterval);
+    }
+    else
+        ringTimer->stop();
+}
+
+/// Called when SubscribeShared returns the \a name of the shared
+/// memory ring of the provider.  An empty name means that the
+/// provider sends the changes in the ValuesChanged signal instead.
+void ContextKitPlugin::onRingOffered(const QString& name)
+{
+    if (name.isEmpty() || (ring->isOpen() && ring->name() == name))
+        return;
+
+    if (!ring->open(name)) {
+        // The provider will publish our changes in the ring; get them
+        // over D-Bus instead.
+        contextWarning() << "Cannot read the shared memory of" << busName << ", falling back to D-Bus";
+        sharedUnsupported = true;
+        Q_FOREACH (const QString& key, keyPaths.keys())
+            pendingKeys.insert(key);
+        // We are handling the result of an async call; see subscribe().
+        QMetaObject::invokeMethod(this, "flushPendingKeys", Qt::QueuedConnection);
+        return;
+    }
+    contextDebug() << "Reading the changes of" << busName << "from" << name;
+    updateRingTimer();
+}
+
+/// Delivers the records published in the shared memory ring since the
+/// last poll.  The keys whose values couldn't be delivered through the
+/// ring are subscribed to again, which returns their current values.
+/// Backs the polling off while there is nothing for us in the ring,
+/// see setSharedMemory().
+void ContextKitPlugin::pollRing()
+{
+    QList<SharedRingRecord> records;
+    QStringList staleKeys;
+    if (!ring->poll(records, staleKeys)) {
+        contextDebug() << "Lost changes from the shared memory of" << busName;
+        staleKeys = keyPaths.keys();
+    }
 
-    // connect to dbus value changes too, but only for this key
-    connection->connect(busName, objectPath, propertyIName, "ValueChanged",
+    bool idle = staleKeys.isEmpty();
+    Q_FOREACH (const SharedRingRecord& record, records) {
+        // Also the keys subscribed to by the other clients of the
+        // provider are in the ring.
+        if (keyPaths.contains(record.key)) {
+            deliverValue(record.key, TimedValue(record.value, record.timestamp));
+            idle = false;
+        }
+    }
+    if (idle) {
+        int interval = qMin(ringTimer->interval() * 2, qMax(ringInterval, maxRingInterval));
+        if (interval != ringTimer->interval())
+            ringTimer->setInterval(interval);
+    }
+    else if (ringTimer->interval() != ringInterval)
+        ringTimer->setInterval(ringInterval);
+
+    Q_FOREACH (const QString& key, staleKeys)
+        if (keyPaths.contains(key) && !pendingWatchers.contains(key))
+            pendingKeys.insert(key);
+    if (!pendingKeys.isEmpty())
+        flushPendingKeys();
+}
+
+/// Forwards \a value of \a key to the upper layer.  When the shared
+/// memory ring or a direct connection is used, values older than the
+/// last one delivered for the key are dropped: a SubscribeShared reply
+/// can arrive after a newer value was read from the ring, and the ring
+/// can hold records older than the reply.  Likewise, the reply of a
+/// Subscribe call made on the bus can arrive after the newer values
+/// sent on the direct connection.
+void ContextKitPlugin::deliverValue(const QString& key, const TimedValue& value)
+{
+    if ((ring && !sharedUnsupported) || peer) {
+        quint64 &last = deliveredTimes[key];
+        if (value.time < last)
+            return;
+        last = value.time;
+    }
+    Q_EMIT valueChanged(key, value);
+}
+
+/// Installs or removes the match rule for the ValueChanged signals
+/// (\a perKey), for the ValuesChanged signal (\a batched) and for the
+/// ValuesPatched signal (\a patched).  The
+/// rules match all the objects of the provider: one rule per provider
+/// instead of one per key keeps the work of the bus daemon
+/// independent of the number of subscriptions.  The rules are on
+/// serviceConnection().
+void ContextKitPlugin::setMatchRules(bool perKey, bool batched, bool patched)
+{
+    QDBusConnection *bus = serviceConnection();
+    const QString service = serviceName();
+
+    if (perKey && !valueChangedConnected) {
+        valueChangedConnected =
+            bus->connect(service, "", propertyIName, "ValueChanged",
+                         this,
+                         SLOT(onNewValueChanged(QList<QVariant>,quint64,QDBusMessage)));
+    }
+    else if (!perKey && valueChangedConnected) {
+        bus->disconnect(service, "", propertyIName, "ValueChanged",
                         this,
                         SLOT(onNewValueChanged(QList<QVariant>,quint64,QDBusMessage)));
+        valueChangedConnected = false;
+    }
 
-    PendingSubscribeWatcher *psw = new PendingSubscribeWatcher(pc, key, this);
-    pendingWatchers.insert(key, psw);
-    sconnect(psw,
+    if (batched && !valuesChangedConnected) {
+        valuesChangedConnected =
+            bus->connect(service, servicePath, serviceIName, "ValuesChanged",
+                         this,
+                         SLOT(onNewValuesChanged(QStringList,QVariantList,QList<quint64>)));
+    }
+    else if (!batched && valuesChangedConnected) {
+        bus->disconnect(service, servicePath, serviceIName, "ValuesChanged",
+                        this,
+                        SLOT(onNewValuesChanged(QStringList,QVariantList,QList<quint64>)));
+        valuesChangedConnected = false;
+    }
+
+    if (patched && !valuesPatchedConnected) {
+        valuesPatchedConnected =
+            bus->connect(service, servicePath, serviceIName, "ValuesPatched",
+                         this,
+                         SLOT(onNewValuesPatched(QStringList,QVariantList,QList<quint64>)));
+    }
+    else if (!patched && valuesPatchedConnected) {
+        bus->disconnect(service, servicePath, serviceIName, "ValuesPatched",
+                        this,
+                        SLOT(onNewValuesPatched(QStringList,QVariantList,QList<quint64>)));
+        valuesPatchedConnected = false;
+    }
+}
+
+/// Forwards the results of a pending Subscribe call.  \a watcher is
+/// either a PendingSubscribeWatcher or a PendingBatchSubscribeWatcher.
+void ContextKitPlugin::connectWatcher(QDBusPendingCallWatcher *watcher)
+{
+    sconnect(watcher,
              SIGNAL(subscribeFinished(QString)),
              this,
              SIGNAL(subscribeFinished(QString)));
-    sconnect(psw,
+    sconnect(watcher,
              SIGNAL(subscribeFailed(QString,QString)),
              this,
              SIGNAL(subscribeFailed(QString,QString)));
-    sconnect(psw,
+    sconnect(watcher,
              SIGNAL(valueChanged(QString,TimedValue)),
              this,
-             SIGNAL(valueChanged(QString,TimedValue)));
-    sconnect(psw,
+             SLOT(deliverValue(const QString&,const TimedValue&)));
+    sconnect(watcher,
              SIGNAL(subscribeFinished(QString)),
              this,
              SLOT(removePendingWatcher(const QString&)));
-    sconnect(psw,
+    sconnect(watcher,
              SIGNAL(subscribeFailed(QString,QString)),
              this,
              SLOT(removePendingWatcher(const QString&)));
-    sconnect(psw,
+    sconnect(watcher,
              SIGNAL(providerNotPresent()),
              this,
              SLOT(onProviderDisappeared()));
+}
 
+void ContextKitPlugin::newSubscribe(const QString& key)
+{
+    if (pendingKeys.contains(key) == false) {
+        // this key was already handled, probably because
+        // waitForSubscriptionAndBlock forced the subscription to happen.
+        return;
+    }
+    pendingKeys.remove(key);
+
+    QString objectPath = registerKey(key);
+
+    QDBusPendingCall pc = connection->asyncCall(QDBusMessage::createMethodCall(busName,
+                                                                               objectPath,
+                                                                               propertyIName,
+                                                                               "Subscribe"));
+
+    PendingSubscribeWatcher *psw = new PendingSubscribeWatcher(pc, key, this);
+    pendingWatchers.insert(key, psw);
+    connectWatcher(psw);
 }
 
 
 /// Forwards the unsubscribe request to the wire.
 void ContextKitPlugin::unsubscribe(QSet<QString> keys)
 {
-    if (newProtocol)
-        Q_FOREACH (QString key, keys) {
-            QString objectPath = keyToPath(key);
-            objectPathToKey.remove(objectPath);
-	    QDBusPendingCall unsubscribeCall = connection->asyncCall(QDBusMessage::createMethodCall(busName,
-                                                                 objectPath,
-                                                                 propertyIName,
-                                                                 "Unsubscribe"));
-
-	    SafeDBusPendingCallWatcher *watcher = new SafeDBusPendingCallWatcher(unsubscribeCall, this);
-
-            // disconnect the ValueChanged signal for this key
-            connection->disconnect(busName, objectPath,
-                                   propertyIName, "ValueChanged",
-                                   this,
-                                   SLOT(onNewValueChanged(QList<QVariant>,quint64,QDBusMessage)));
+    if (newProtocol) {
+        Q_FOREACH (const QString& key, keys) {
+            QString objectPath = unregisterKey(key);
 
+            if (batchSupport != BatchSupported) {
+                QDBusPendingCall unsubscribeCall =
+                    connection->asyncCall(QDBusMessage::createMethodCall(busName,
+                                                                         objectPath,
+                                                                         propertyIName,
+                                                                         "Unsubscribe"));
+                new SafeDBusPendingCallWatcher(unsubscribeCall, this);
+            }
+        }
 
+        if (batchSupport == BatchSupported) {
+            QDBusMessage msg = QDBusMessage::createMethodCall(serviceName(),
+                                                              servicePath,
+                                                              serviceIName,
+                                                              "Unsubscribe");
+            msg << QStringList(keys.toList());
+            new SafeDBusPendingCallWatcher(serviceConnection()->asyncCall(msg), this);
         }
+    }
     else
         subscriberInterface->unsubscribe(keys);
 }
@@ -320,75 +890,103 @@ void ContextKitPlugin::unsubscribe(QSet<QString> keys)
 /// Forwards value changes from the wire to the upper layer (Provider).
 void ContextKitPlugin::onDBusValuesChanged(QMap<QString, QVariant> values)
 {
-    Q_FOREACH (const QString& key, values.keys())
-        Q_EMIT valueChanged(key, values[key]);
-}
-
-// QDBus doesn't unmarshall non-basic types inside QVariants (since it cannot
-// know the intention), but leaves them as QDBusArguments.  Here we walk the
-// structure and unpack lists and maps.
-QVariant demarshallValue(const QVariant &v)
-{
-    if (v.userType() != qMetaTypeId<QDBusArgument>())
-        return v;
-    const QDBusArgument &dba = v.value<QDBusArgument>();
-    switch (dba.currentType()) {
-    case QDBusArgument::ArrayType: {
-        QVariantList vl;
-        dba.beginArray();
-        while (!dba.atEnd()) {
-            QVariant v;
-            dba >> v;
-            vl << demarshallValue(v);
-        }
-        dba.endArray();
-        return QVariant(vl);
-        break;
-    }
-    case QDBusArgument::MapType: {
-        dba.beginMap();
-        QVariantMap vm;
-        while (!dba.atEnd()) {
-            QString k;
-            QVariant v;
-            dba.beginMapEntry();
-            dba >> k >> v;
-            dba.endMapEntry();
-            v = demarshallValue(v);
-            vm.insert(k, v);
-        }
-        dba.endMap();
-        return QVariant(vm);
-        break;
+    QMap<QString, QVariant>::const_iterator it;
+    for (it = values.constBegin(); it != values.constEnd(); ++it)
+        Q_EMIT valueChanged(it.key(), ValueDecoder::decodeAny(it.value()));
+}
+
+void ContextKitPlugin::onNewValueChanged(QList<QVariant> value,
+                                         quint64 timestamp,
+                                         QDBusMessage message)
+{
+    QHash<QString, QString>::const_iterator it = pathToKey.constFind(message.path());
+    if (it != pathToKey.constEnd())
+        Q_EMIT valueChanged(it.value(),
+                            TimedValue(value.isEmpty() ? QVariant() : ValueDecoder::decodeAny(value.at(0)),
+                                       timestamp));
+    // Otherwise the signal is for a key subscribed to by some other
+    // client of the same provider; the match rule doesn't filter on
+    // the object path.
+}
+
+/// Forwards the changes carried by one ValuesChanged signal to the
+/// upper layer, back to back, so that the keys changed together by
+/// the provider are seen changing together.
+void ContextKitPlugin::onNewValuesChanged(QStringList keys,
+                                          QVariantList values,
+                                          QList<quint64> timestamps)
+{
+    if (values.size() != keys.size() || timestamps.size() != keys.size()) {
+        contextWarning() << "Malformed ValuesChanged from" << busName;
+        return;
     }
-    default:
-        // Shouldn't reach this.
-        contextWarning() << "got something unexpected: QDBusArgument of type"
-                         << dba.currentType();
-        return QVariant();
-        break;
+    for (int i = 0; i < keys.size(); ++i) {
+        // Signals for keys subscribed to only by other clients of the
+        // provider are ignored.
+        if (!keyPaths.contains(keys.at(i)))
+            continue;
+        // Each value is a Maybe_Variant (av), wrapped in a variant.
+        deliverValue(keys.at(i),
+                     TimedValue(ValueDecoder::decodeMaybe(values.at(i)), timestamps.at(i)));
     }
 }
 
-static TimedValue createTimedValue(const QList<QVariant> value, quint64 time)
+/// Records the \a value and \a version of \a key returned by
+/// SubscribeDelta; the patches of the key are applied to it.  A \a
+/// version of 0 means that the key is not patched.  Keys unsubscribed
+/// from while the call was pending are not patched either.
+void ContextKitPlugin::onDeltaBase(const QString& key, const QVariant& value, quint64 version)
 {
-    if (value.size() == 0)
-        return TimedValue(QVariant(), time);
+    if (version == 0 || !keyPaths.contains(key))
+        deltaBases.remove(key);
     else
-        return TimedValue(demarshallValue(value.at(0)), time);
+        deltaBases.insert(key, qMakePair(value, version));
+    updateMatchRules();
 }
 
-void ContextKitPlugin::onNewValueChanged(QList<QVariant> value,
-                                         quint64 timestamp,
-                                         QDBusMessage message)
+/// Applies the patches carried by one ValuesPatched signal to the
+/// values of our keys, and forwards the results to the upper layer.
+/// If a patch doesn't apply to the value we have, the key is
+/// subscribed to again, which returns the whole value.
+void ContextKitPlugin::onNewValuesPatched(QStringList keys,
+                                          QVariantList patches,
+                                          QList<quint64> timestamps)
 {
-    if (objectPathToKey.contains(message.path())) {
-        Q_EMIT valueChanged(objectPathToKey[message.path()],
-                          createTimedValue(value, timestamp));
+    if (patches.size() != keys.size() || timestamps.size() != keys.size()) {
+        contextWarning() << "Malformed ValuesPatched from" << busName;
+        return;
     }
-    else {
-        contextWarning() << "Unrecognized key" << message.path();
+    bool resync = false;
+    for (int i = 0; i < keys.size(); ++i) {
+        // Patches for keys of other clients, for keys we have
+        // unsubscribed from, or for keys whose SubscribeDelta hasn't
+        // returned yet, are ignored.
+        if (!keyPaths.contains(keys.at(i)))
+            continue;
+        QHash<QString, QPair<QVariant, quint64> >::iterator base = deltaBases.find(keys.at(i));
+        if (base == deltaBases.end())
+            continue;
+
+        switch (ValuePatch::apply(ValueDecoder::decodeAny(patches.at(i)),
+                                  base->first, base->second)) {
+        case ValuePatch::Applied:
+            deliverValue(keys.at(i), TimedValue(base->first, timestamps.at(i)));
+            break;
+        case ValuePatch::Stale:
+            break;
+        case ValuePatch::Mismatch:
+        case ValuePatch::Malformed:
+            contextDebug() << "Cannot patch" << keys.at(i) << ", getting the whole value";
+            deltaBases.erase(base);
+            if (!pendingWatchers.contains(keys.at(i))) {
+                pendingKeys.insert(keys.at(i));
+                resync = true;
+            }
+            break;
+        }
     }
+    if (resync)
+        QMetaObject::invokeMethod(this, "flushPendingKeys", Qt::QueuedConnection);
 }
 
 void ContextKitPlugin::blockUntilReady()
@@ -401,13 +999,19 @@ void ContextKitPlugin::blockUntilReady()
 
 void ContextKitPlugin::blockUntilSubscribed(const QString& key)
 {
-    // Force the subscriptions (that were scheduled) to happen now
-    while (newProtocol && pendingKeys.size() > 0) {
-        QString key = *(pendingKeys.constBegin());
-        newSubscribe(key);
-    }
-    if (pendingWatchers.contains(key)) {
-        pendingWatchers.value(key)->waitForFinished();
+    forever {
+        // Force the subscriptions (that were scheduled) to happen now
+        if (newProtocol)
+            flushPendingKeys();
+
+        QDBusPendingCallWatcher *watcher = pendingWatchers.value(key, 0);
+        if (watcher == 0)
+            break;
+        watcher->waitForFinished();
+        // If the batched call wasn't supported, the key is pending
+        // again and the loop subscribes to it with a per-key call.
+        if (pendingWatchers.value(key, 0) == watcher)
+            break;
     }
 }
 
@@ -427,6 +1031,108 @@ PendingSubscribeWatcher::PendingSubscribeWatcher(const QDBusPendingCall &call,
              this, SLOT(deleteLater()));
 }
 
+PendingBatchSubscribeWatcher::PendingBatchSubscribeWatcher(const QDBusPendingCall &call,
+                                                           const QStringList &keys,
+                                                           Method method,
+                                                           QObject * parent) :
+    QDBusPendingCallWatcher(call, parent), keys(keys), method(method)
+{
+    sconnect(this, SIGNAL(finished(QDBusPendingCallWatcher *)),
+             this, SLOT(onFinished()));
+    sconnect(this, SIGNAL(finished(QDBusPendingCallWatcher *)),
+             this, SLOT(deleteLater()));
+}
+
+void PendingBatchSubscribeWatcher::onFinished()
+{
+    QStringList subscribedKeys;
+    QVariantList values;
+    QList<quint64> timestamps;
+    QList<quint64> versions;
+    QString ringName;
+    if (method == SubscribeShared) {
+        QDBusPendingReply<QString, QStringList, QVariantList, QList<quint64> > reply = *this;
+        if (reply.isError()) {
+            emitFailure(reply.error());
+            return;
+        }
+        ringName = reply.argumentAt<0>();
+        subscribedKeys = reply.argumentAt<1>();
+        values = reply.argumentAt<2>();
+        timestamps = reply.argumentAt<3>();
+    }
+    else if (method == SubscribeDelta) {
+        QDBusPendingReply<QStringList, QVariantList, QList<quint64>, QList<quint64> > reply = *this;
+        if (reply.isError()) {
+            emitFailure(reply.error());
+            return;
+        }
+        subscribedKeys = reply.argumentAt<0>();
+        values = reply.argumentAt<1>();
+        versions = reply.argumentAt<2>();
+        timestamps = reply.argumentAt<3>();
+    }
+    else {
+        QDBusPendingReply<QStringList, QVariantList, QList<quint64> > reply = *this;
+        if (reply.isError()) {
+            emitFailure(reply.error());
+            return;
+        }
+        subscribedKeys = reply.argumentAt<0>();
+        values = reply.argumentAt<1>();
+        timestamps = reply.argumentAt<2>();
+    }
+    if (values.size() != subscribedKeys.size() || timestamps.size() != subscribedKeys.size() ||
+        (method == SubscribeDelta && versions.size() != subscribedKeys.size())) {
+        Q_FOREACH (const QString& key, keys)
+            Q_EMIT subscribeFailed(key, "Malformed reply to Subscribe");
+        return;
+    }
+
+    Q_EMIT batchSupported();
+    if (method == SubscribeShared)
+        // Before the values, so that they are compared with the
+        // records of the ring.
+        Q_EMIT ringOffered(ringName);
+    for (int i = 0; i < subscribedKeys.size(); ++i) {
+        // Each value is a Maybe_Variant (av), wrapped in a variant.
+        const TimedValue timedValue(ValueDecoder::decodeMaybe(values.at(i)),
+                                    timestamps.at(i));
+        if (method == SubscribeDelta)
+            Q_EMIT deltaBase(subscribedKeys.at(i), timedValue.value, versions.at(i));
+        Q_EMIT valueChanged(subscribedKeys.at(i), timedValue);
+        Q_EMIT subscribeFinished(subscribedKeys.at(i));
+    }
+    Q_FOREACH (const QString& key, keys)
+        if (!subscribedKeys.contains(key))
+            Q_EMIT subscribeFailed(key, "Key not provided by the service");
+}
+
+/// Signals the failure of the call with \a error.
+void PendingBatchSubscribeWatcher::emitFailure(const QDBusError &error)
+{
+    switch (error.type()) {
+    case QDBusError::UnknownObject:
+    case QDBusError::UnknownInterface:
+        // The provider only speaks the per-key protocol.
+        Q_EMIT batchUnsupported(keys, false);
+        return;
+    case QDBusError::UnknownMethod:
+        // The provider doesn't know SubscribeShared or SubscribeDelta.
+        Q_EMIT batchUnsupported(keys, method != Subscribe);
+        return;
+    case QDBusError::ServiceUnknown:
+        Q_FOREACH (const QString& key, keys)
+            Q_EMIT subscribeFailed(key, error.message());
+        Q_EMIT providerNotPresent();
+        return;
+    default:
+        Q_FOREACH (const QString& key, keys)
+            Q_EMIT subscribeFailed(key, error.message());
+        return;
+    }
+}
+
 void PendingSubscribeWatcher::onFinished()
 {
     QDBusPendingReply<QList<QVariant>, quint64> reply = *this;
@@ -440,8 +1146,9 @@ void PendingSubscribeWatcher::onFinished()
         return;
     }
 
-    Q_EMIT valueChanged(key, createTimedValue(reply.argumentAt<0>(),
-                                            reply.argumentAt<1>()));
+    // The value is a Maybe_Variant, demarshalled into a list already.
+    Q_EMIT valueChanged(key, TimedValue(ValueDecoder::decodeMaybe(reply.argumentAt<0>()),
+                                        reply.argumentAt<1>()));
     Q_EMIT subscribeFinished(key);
 }
 
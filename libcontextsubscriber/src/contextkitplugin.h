@@ -36,11 +36,22 @@
 #include <QVariant>
 #include <QMap>
 #include <QHash>
+#include <QPair>
+#include <QStringList>
+#include <QMetaType>
+
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+Q_DECLARE_METATYPE(QList<quint64>)
+#endif
 
 extern "C" {
     ContextSubscriber::IProviderPlugin* contextKitPluginFactory(QString constructionString);
+    ContextSubscriber::IProviderPlugin* contextKitSharedPluginFactory(QString constructionString);
+    ContextSubscriber::IProviderPlugin* contextKitDirectPluginFactory(QString constructionString);
 }
 
+class QTimer;
+class SharedRingReader;
 namespace ContextSubscriber {
 class PendingSubscribeWatcher : public QDBusPendingCallWatcher
 {
@@ -63,6 +74,42 @@ private:
     QString key;
 };
 
+class PendingBatchSubscribeWatcher : public QDBusPendingCallWatcher
+{
+    Q_OBJECT;
+
+public:
+    /// The method called
+    enum Method {
+        Subscribe,
+        SubscribeShared,
+        SubscribeDelta
+    };
+
+    PendingBatchSubscribeWatcher(const QDBusPendingCall &call,
+                                 const QStringList &keys,
+                                 Method method,
+                                 QObject * parent = 0);
+private Q_SLOTS:
+    void onFinished();
+
+Q_SIGNALS:
+    void subscribeFailed(QString, QString);
+    void valueChanged(QString, TimedValue);
+    void subscribeFinished(QString);
+    void providerNotPresent();
+    void batchSupported();
+    void batchUnsupported(QStringList, bool);
+    void ringOffered(QString);
+    void deltaBase(QString, QVariant, quint64);
+
+private:
+    void emitFailure(const QDBusError &error);
+
+    QStringList keys;
+    Method method;
+};
+
 class ContextKitPlugin : public IProviderPlugin
 {
     Q_OBJECT
@@ -72,6 +119,8 @@ public:
     void subscribe(QSet<QString> keys);
     void unsubscribe(QSet<QString> keys);
     void setDefaultNewProtocol(bool s);
+    void setSharedMemory(int pollInterval);
+    void setDirectConnection(bool direct);
     void blockUntilReady();
     void blockUntilSubscribed(const QString& key);
 
@@ -88,6 +137,12 @@ private Q_SLOTS:
     void onNewValueChanged(QList<QVariant> value,
                            quint64 timestamp,
                            QDBusMessage message);
+    void onNewValuesChanged(QStringList keys,
+                            QVariantList values,
+                            QList<quint64> timestamps);
+    void onNewValuesPatched(QStringList keys,
+                            QVariantList patches,
+                            QList<quint64> timestamps);
     void onDBusValuesChanged(QMap<QString, QVariant> values);
     void onDBusGetSubscriberFinished(QDBusObjectPath objectPath);
     void onDBusGetSubscriberFailed(QDBusError err);
@@ -96,10 +151,30 @@ private Q_SLOTS:
     void onProviderAppeared();
     void onProviderDisappeared();
     void newSubscribe(const QString& key);
+    void flushPendingKeys();
+    void onBatchSupported();
+    void onBatchUnsupported(const QStringList& keys, bool methodOnly);
+    void onDeltaBase(const QString& key, const QVariant& value, quint64 version);
     void removePendingWatcher(const QString& key);
+    void deliverValue(const QString& key, const TimedValue& value);
+    void onRingOffered(const QString& name);
+    void pollRing();
+    void requestDirectAddress();
+    void onDirectAddress(QDBusPendingCallWatcher *watcher);
+    void onIdentified(QDBusPendingCallWatcher *watcher);
 
 private:
     static QString keyToPath(QString key);
+    QString registerKey(const QString& key);
+    QString unregisterKey(const QString& key);
+    void updateMatchRules();
+    void setMatchRules(bool perKey, bool batched, bool patched);
+    void updateRingTimer();
+    void connectWatcher(QDBusPendingCallWatcher *watcher);
+    QDBusConnection *serviceConnection() const;
+    QString serviceName() const;
+    bool connectToPeer(const QString& address);
+    void dropPeer();
 
     void reset();
     void useNewProtocol();
@@ -116,13 +191,49 @@ private:
     bool newProtocol; ///< The current provider on D-Bus speaks the new protocol only.
     bool defaultNewProtocol; ///< Let's only try the new protocol to talk with the provider.
 
-    QHash<QString, QString> objectPathToKey;
-
-    QHash<QString, PendingSubscribeWatcher*> pendingWatchers;
+    /// Whether the provider implements the multi-key
+    /// org.maemo.contextkit.Service interface.
+    enum BatchSupport { BatchUnknown, BatchSupported, BatchUnsupported };
+    BatchSupport batchSupport;
+
+    /// Object path -> key of the subscribed keys.  The ValueChanged
+    /// signals of the provider arrive through one match rule and are
+    /// dispatched with this table.
+    QHash<QString, QString> pathToKey;
+    QHash<QString, QString> keyPaths; ///< The reverse of pathToKey
+    bool valueChangedConnected; ///< The match rule for ValueChanged is installed
+    bool valuesChangedConnected; ///< The match rule for ValuesChanged is installed
+    bool valuesPatchedConnected; ///< The match rule for ValuesPatched is installed
+
+    QHash<QString, QDBusPendingCallWatcher*> pendingWatchers;
     QSet<QString> pendingKeys;
-};
 
-QVariant demarshallValue(const QVariant &v);
+    /// Shared memory ring of the provider, see setSharedMemory(); 0
+    /// if the changes are read from D-Bus only.
+    SharedRingReader *ring;
+    QTimer *ringTimer; ///< Polls the ring while keys are subscribed
+    int ringInterval; ///< The shortest polling interval, see setSharedMemory()
+    bool sharedUnsupported; ///< The provider doesn't implement SubscribeShared
+    /// Time stamp of the last value delivered for the subscribed keys;
+    /// the ring, the direct connection and the replies of the
+    /// Subscribe calls can overtake each other.
+    QHash<QString, quint64> deliveredTimes;
+
+    bool deltaUnsupported; ///< The provider doesn't implement SubscribeDelta
+    /// Key -> the value and its version, for the keys whose changes
+    /// come as patches in the ValuesPatched signal.
+    QHash<QString, QPair<QVariant, quint64> > deltaBases;
+
+    bool directWanted; ///< Connect to the provider directly if it lets us, see setDirectConnection()
+    /// Direct connection to the provider, used instead of the bus for
+    /// org.maemo.contextkit.Service; 0 if not connected.
+    QDBusConnection *peer;
+    /// Direct connection waiting for the reply of Identify; the bus is
+    /// used until the provider accepts it.
+    QDBusConnection *pendingPeer;
+    QDBusPendingCallWatcher *addressWatcher; ///< The pending GetDirectAddress call
+    QDBusPendingCallWatcher *identifyWatcher; ///< The pending Identify call
+};
 
 }
 
@@ -98,12 +98,17 @@
 
 #include "contextproperty.h"
 #include "propertyhandle.h"
+#include "deliverymailbox.h"
+#include "contextsubscriptionwatcher.h"
+#include "contextthread.h"
 #include "sconnect.h"
 #include "logging.h"
 #include "loggingfeatures.h"
 
 #include <QCoreApplication>
+#include <QEvent>
 #include <QThread>
+#include <QTimer>
 
 using namespace ContextSubscriber;
 
@@ -116,12 +121,12 @@ using namespace ContextSubscriber;
 struct ContextPropertyPrivate
 {
     PropertyHandle *handle; ///< The common handle behind this context property
+    DeliveryMailbox *mailbox; ///< Delivers the changes of handle to us
     bool subscribed; ///< True, if we are subscribed to the handle behind us
-    QVariant value; ///< Our knowledge of the value.  Needed because several
-                    /// valueChanged signals might be emitted (queued) by the
-                    /// PropertyHandle before we handle the first one of them,
-                    /// and we need to emit only one valueChanged signal in this
-                    /// class.
+    QVariant value; ///< Our knowledge of the value.  Needed because the
+                    /// value might change back and forth before the mailbox
+                    /// delivers it to us, and we need to emit valueChanged
+                    /// only when it differs from what we emitted last.
 };
 
 /*!
@@ -195,6 +200,19 @@ struct ContextPropertyPrivate
 
    \note See the Qt documentation for \c QThread and related classes
    for more details.
+
+   \section contextthread The context thread
+
+   By default, the subscriptions and the communication with the
+   providers are handled in the event loop of the main thread, so a
+   main thread busy with something else delays the new values of all
+   the properties.  Calling setContextThreadEnabled() (or setting the
+   \c CONTEXT_SUBSCRIBER_THREAD environment variable to 1) before
+   creating the first ContextProperty moves all this work into a
+   private thread of the library.  The valueChanged() signals are
+   still emitted in the threads of the ContextProperty instances, and
+   waitForSubscription() doesn't run the event loop of the main thread
+   anymore.
  */
 
 /// Constructs a new ContextProperty for \a key and subscribes to it.
@@ -206,16 +224,15 @@ ContextProperty::ContextProperty(const QString &key, QObject* parent)
     priv->handle = PropertyHandle::instance(key);
     priv->subscribed = false;
 
-    // We keep the signal from PropertyHandle connected all the time, to update
-    // our cache (priv->value) and emit the valueChanged signal even if this
-    // ContextProperty is not subscribed.
+    // We stay attached to the mailbox all the time, to update our
+    // cache (priv->value) and emit the valueChanged signal even if
+    // this ContextProperty is not subscribed.
 
-    // We create a queued connection, because otherwise we run
-    // the users' valueChanged() handlers with locks and if they do
-    // something fancy (for example unsubscribe) it can cause a
-    // deadlock.
-    sconnect(priv->handle, SIGNAL(valueChanged()), this, SLOT(onValueChanged()),
-             Qt::QueuedConnection);
+    // The mailbox delivers asynchronously, in our thread, because
+    // otherwise we run the users' valueChanged() handlers with locks
+    // and if they do something fancy (for example unsubscribe) it can
+    // cause a deadlock.
+    priv->mailbox = DeliveryMailbox::attach(priv->handle, this);
 
     subscribe();
 }
@@ -224,6 +241,8 @@ ContextProperty::ContextProperty(const QString &key, QObject* parent)
 ContextProperty::~ContextProperty()
 {
     unsubscribe();
+    if (priv->mailbox)
+        priv->mailbox->detach(priv->handle, this);
     delete priv;
 }
 
@@ -250,12 +269,40 @@ QVariant ContextProperty::value(const QVariant &def) const
         return val;
 }
 
+void ContextProperty::onValueChanged()
+{
+    deliver(priv->handle->value());
+}
+
+/// Moves us from the mailbox of our old thread to the one of the new
+/// thread when we are moved with moveToThread().  The event is sent
+/// in the old thread, before the move; the queued call moves with us
+/// and attaches to the mailbox of the new thread from there.
+bool ContextProperty::event(QEvent *event)
+{
+    if (event->type() == QEvent::ThreadChange && priv->mailbox) {
+        priv->mailbox->detach(priv->handle, this);
+        priv->mailbox = 0;
+        QMetaObject::invokeMethod(this, "onThreadChanged", Qt::QueuedConnection);
+    }
+    return QObject::event(event);
+}
+
+/// Attaches to the mailbox of our new thread, and catches up with the
+/// changes made while we were moving.
+void ContextProperty::onThreadChanged()
+{
+    if (priv->mailbox == 0)
+        priv->mailbox = DeliveryMailbox::attach(priv->handle, this);
+    onValueChanged();
+}
+
 // A safety measure to avoid emitting unnecessary signals, see
 // ContextPropertyPrivate::value.
-void ContextProperty::onValueChanged()
+void ContextProperty::deliver(const QVariant &value)
 {
     QVariant oldValue = priv->value;
-    priv->value = priv->handle->value();
+    priv->value = value;
 
     // Emit the valueChanged signal if we haven't emitted a signal for the same
     // value before.
@@ -300,20 +347,49 @@ void ContextProperty::unsubscribe() const
 /// property).  Calling this function while the subscription is not in
 /// progress (because it has completed already or because the property
 /// is currently unsubscribed) does nothing. Calling this function
-/// from a thread which is not the main thread results in busy looping.
+/// from a thread which is not the main thread, or while the context
+/// thread is enabled, blocks the thread until the subscription has
+/// been completed in the background.
 void ContextProperty::waitForSubscription() const
+{
+    waitForSubscriptionTimeout(-1);
+}
+
+/// Like waitForSubscription(), but gives up after \a msecs
+/// milliseconds.  A negative \a msecs means no time limit.  Returns
+/// true if the subscription is complete (or wasn't in progress), and
+/// false if the time ran out.
+bool ContextProperty::waitForSubscriptionTimeout(int msecs) const
 {
     if (!priv->subscribed)
-        return;
+        return true;
+
+    if (QThread::currentThread() != ContextThread::thread())
+        return priv->handle->waitForSubscription(msecs);
 
+    // The timer wakes up the event loop when the time is up.
+    QTimer timer;
+    timer.setSingleShot(true);
+    if (msecs >= 0)
+        timer.start(msecs);
     while (priv->handle->isSubscribePending()) {
-        if (QThread::currentThread() == QCoreApplication::instance()->thread()) {
-            // This is not a busy loop, since the QEventLoop::WaitForMoreEvents flag
-            QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
-        } else {
-            usleep(100000); // 0.1 second
-        }
+        if (msecs >= 0 && !timer.isActive())
+            return false;
+        // This is not a busy loop, since the QEventLoop::WaitForMoreEvents flag
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
     }
+    return true;
+}
+
+/// Subscribes to the context property, if it isn't subscribed
+/// already, and returns a watcher telling when the subscription is
+/// complete, without blocking.  If \a timeout is not negative, the
+/// watcher gives up after \a timeout milliseconds.  The caller owns
+/// the returned watcher.  To wait for many properties at once,
+/// construct a ContextSubscriptionWatcher for all of them.
+ContextSubscriptionWatcher* ContextProperty::subscribeAsync(int timeout) const
+{
+    return new ContextSubscriptionWatcher(const_cast<ContextProperty*>(this), timeout);
 }
 
 /// Suspends the execution of the current thread until subcription is complete
@@ -323,10 +399,12 @@ void ContextProperty::waitForSubscription() const
 /// already or because the property is currently unsubscribed) does nothing.
 /// Calling this function with \a block = true is only allowed for
 /// ContextProperty objects associated with the main thread, and calling this
-/// function is only allowed in the main thread.
+/// function is only allowed in the main thread.  While the context thread is
+/// enabled, \a block is ignored, since the thread waits without running any
+/// event loop anyway.
 void ContextProperty::waitForSubscription(bool block) const
 {
-    if (!block) {
+    if (!block || ContextThread::isEnabled()) {
         waitForSubscription();
         return;
     }
@@ -361,3 +439,22 @@ void ContextProperty::setTypeCheck(bool newTypeCheck)
     PropertyHandle::setTypeCheck(newTypeCheck);
 }
 
+/// Keeps the properties subscribed at their providers for \a msecs
+/// milliseconds after the last ContextProperty for them unsubscribed
+/// or was destroyed.  Subscribing again within that time is
+/// immediate, and the last value is available right away.  Zero (the
+/// default) unsubscribes at once.
+void ContextProperty::setLingerTime(int msecs)
+{
+    PropertyHandle::setLingerTime(msecs);
+}
+
+/// Enables or disables the context thread: a private thread of the
+/// library handling the subscriptions and the communication with the
+/// providers, instead of the main thread.  Has to be called before
+/// creating the first ContextProperty; later calls have no effect.
+void ContextProperty::setContextThreadEnabled(bool enabled)
+{
+    ContextThread::setEnabled(enabled);
+}
+
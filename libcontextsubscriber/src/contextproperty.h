@@ -28,6 +28,11 @@
 
 class ContextPropertyPrivate;
 class ContextPropertyInfo;
+class ContextSubscriptionWatcher;
+
+namespace ContextSubscriber {
+class DeliveryMailbox;
+}
 
 class ContextProperty : public QObject
 {
@@ -49,17 +54,28 @@ public:
 
     void waitForSubscription() const;
     void waitForSubscription(bool block) const;
+    bool waitForSubscriptionTimeout(int msecs) const;
+    ContextSubscriptionWatcher* subscribeAsync(int timeout = -1) const;
 
     static void ignoreCommander();
     static void setTypeCheck(bool typeCheck);
+    static void setContextThreadEnabled(bool enabled);
+    static void setLingerTime(int msecs);
 
 Q_SIGNALS:
     void valueChanged(); ///< Emitted whenever the value of the property changes and the property is subscribed.
 
+protected:
+    bool event(QEvent *event);
+
 private:
+    void deliver(const QVariant &value);
+
     ContextPropertyPrivate *priv;
+    friend class ContextSubscriber::DeliveryMailbox;
 private Q_SLOTS:
     void onValueChanged();
+    void onThreadChanged();
 };
 
 #endif
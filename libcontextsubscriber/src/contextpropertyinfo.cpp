@@ -205,7 +205,8 @@ ContextPropertyInfo::ContextPropertyInfo(const QString &key, QObject *parent)
 
     if (key != "") {
         InfoBackend* infoBackend = InfoBackend::instance();
-        sconnect(infoBackend, SIGNAL(keyChanged(QString)),
+        // Only the changes of our key are delivered to us.
+        sconnect(infoBackend->keyNotifier(keyName), SIGNAL(keyChanged(QString)),
                  this, SLOT(onKeyChanged(QString)));
 
         // Cache only the provider information; that is always needed.
@@ -284,6 +285,18 @@ bool ContextPropertyInfo::deprecated() const
     return infoBackend->keyDeprecated(keyName);
 }
 
+/// Returns how the values from the different providers of the key are
+/// merged into one: \c "newest" takes the value received last, \c
+/// "priority" the value of the first provider in the registry having
+/// one, and \c "first" keeps the value of the provider which had a
+/// value first, as long as it has one.  An empty string means the
+/// default, \c "newest".
+QString ContextPropertyInfo::mergePolicy() const
+{
+    InfoBackend* infoBackend = InfoBackend::instance();
+    return infoBackend->mergePolicyForKey(keyName);
+}
+
 /// DEPRECATED Returns the name of the plugin supplying this property.
 /// This function is deprecated, use providers() instead.
 QString ContextPropertyInfo::plugin() const
@@ -378,17 +391,15 @@ QDBusConnection::BusType ContextPropertyInfo::providerDBusType() const
 
 /* Slots */
 
-/// This slot is connected to the \a keyChanged signal of the
-/// actual infobackend instance. It's executed on every change to any
-/// of the keys. We first check if the data concerns us. Next we
-/// update the cached values and fire the actual signals.
+/// This slot is connected to the \a keyChanged signal of the notifier
+/// of our key in the actual infobackend instance, so it's executed
+/// only when our key changes. We update the cached values and fire the
+/// actual signals.
 void ContextPropertyInfo::onKeyChanged(const QString& key)
 {
+    Q_UNUSED(key);
     QMutexLocker lock(&cacheLock);
 
-    if (key != keyName)
-        return;
-
     // Update caches
     cachedProviders = InfoBackend::instance()->providersForKey(keyName);
 
@@ -52,6 +52,7 @@ public:
     bool declared() const;
     bool provided() const;
     bool deprecated() const;
+    QString mergePolicy() const;
 
     QString providerDBusName() const;
     QDBusConnection::BusType providerDBusType() const;
@@ -25,6 +25,7 @@
 #include "logging.h"
 #include "loggingfeatures.h"
 #include "contextproviderinfo.h"
+#include "pluginloader.h"
 #include <QMutex>
 #include <QMutexLocker>
 #include <QCoreApplication>
@@ -156,6 +157,18 @@ QStringList ContextRegistryInfo::listPlugins() const
     return plugins.toList();
 }
 
+/// Starts loading all the dynamic provider plugins named in the
+/// registry, in a separate thread.  Call this early at startup to get
+/// the plugins loaded while the program initializes itself; the
+/// properties provided through them don't need to wait for the
+/// loading when they are subscribed to.  Walking the registry for the
+/// plugins is done in the separate thread too, so this returns
+/// immediately.
+void ContextRegistryInfo::preloadPlugins() const
+{
+    ContextSubscriber::PluginLoader::preloadRegistry();
+}
+
 /// Returns the name of the currently used registry backend. Ie. "cdb" or "xml".
 QString ContextRegistryInfo::backendName() const
 {
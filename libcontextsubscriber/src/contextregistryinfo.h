@@ -41,6 +41,7 @@ public:
     QStringList listProviders() const;
     QStringList listPlugins() const;
     QString backendName() const;
+    void preloadPlugins() const;
 
 private:
     ContextRegistryInfo() {}; ///< Private constructor. Do not use.
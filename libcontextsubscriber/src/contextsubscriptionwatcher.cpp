@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "contextsubscriptionwatcher.h"
+#include "contextproperty.h"
+#include "propertyhandle.h"
+#include "sconnect.h"
+
+#include <QHash>
+#include <QTimer>
+
+using namespace ContextSubscriber;
+
+/*!
+   \class ContextSubscriptionWatcherPrivate
+
+   \brief The private parts of the ContextSubscriptionWatcher class.
+*/
+
+struct ContextSubscriptionWatcherPrivate
+{
+    /// The properties still subscribing, grouped by their handles
+    QHash<PropertyHandle*, QList<ContextProperty*> > pending;
+    QTimer deadline; ///< Fires when the time given for the subscriptions is up
+    bool finished; ///< True after finished() has been emitted
+    bool timedOut; ///< True if the deadline passed before the subscriptions completed
+};
+
+/*!
+   \class ContextSubscriptionWatcher
+
+   \brief The ContextSubscriptionWatcher class tells when the
+   subscription of one or more ContextProperty objects is complete,
+   without blocking.
+
+   Constructing a watcher subscribes the given properties, and the
+   watcher emits propertySubscribed() for each of them as soon as its
+   subscription is complete (see ContextProperty::waitForSubscription()
+   for what this means), and finished() when all of them are.  The
+   signals are always emitted from the event loop, never from the
+   constructor, so it is safe to connect to them after constructing
+   the watcher.
+
+   \code
+   QList<ContextProperty*> properties;
+   properties << new ContextProperty("Screen.TopEdge")
+              << new ContextProperty("Battery.ChargePercentage");
+   ContextSubscriptionWatcher *watcher = new ContextSubscriptionWatcher(properties, 2000);
+   QObject::connect(watcher, SIGNAL(finished()), this, SLOT(showUi()));
+   \endcode
+
+   If a \c timeout is given, the watcher gives up after that many
+   milliseconds: it emits timedOut() and then finished(), and
+   pendingProperties() tells which properties are still subscribing.
+
+   A watcher has to be used in the thread of its properties.
+*/
+
+/// Constructs a watcher for the subscription of \a property, which is
+/// subscribed if it isn't yet.  If \a timeout is not negative, the
+/// watcher gives up after \a timeout milliseconds.
+ContextSubscriptionWatcher::ContextSubscriptionWatcher(ContextProperty *property, int timeout,
+                                                       QObject *parent)
+    : QObject(parent), priv(new ContextSubscriptionWatcherPrivate)
+{
+    start(QList<ContextProperty*>() << property, timeout);
+}
+
+/// Constructs a watcher for the subscriptions of all the \a
+/// properties, which are subscribed if they aren't yet.  If \a
+/// timeout is not negative, the watcher gives up after \a timeout
+/// milliseconds.
+ContextSubscriptionWatcher::ContextSubscriptionWatcher(const QList<ContextProperty*> &properties,
+                                                       int timeout, QObject *parent)
+    : QObject(parent), priv(new ContextSubscriptionWatcherPrivate)
+{
+    start(properties, timeout);
+}
+
+/// Destroys the watcher.  The properties stay subscribed.
+ContextSubscriptionWatcher::~ContextSubscriptionWatcher()
+{
+    delete priv;
+}
+
+void ContextSubscriptionWatcher::start(const QList<ContextProperty*> &properties, int timeout)
+{
+    priv->finished = false;
+    priv->timedOut = false;
+
+    Q_FOREACH (ContextProperty *property, properties) {
+        property->subscribe();
+        PropertyHandle *handle = PropertyHandle::instance(property->key());
+        QList<ContextProperty*> &list = priv->pending[handle];
+        if (list.isEmpty()) {
+            // Connect before checking the state, so that we can't
+            // miss the completion.  The connection is queued, so that
+            // the slots connected to our signals are not run while
+            // the library holds its locks.
+            sconnect(handle, SIGNAL(subscriptionFinished()),
+                     this, SLOT(onSubscriptionFinished()), Qt::QueuedConnection);
+        }
+        if (!list.contains(property)) {
+            list << property;
+            sconnect(property, SIGNAL(destroyed(QObject*)),
+                     this, SLOT(onPropertyDestroyed(QObject*)));
+        }
+    }
+
+    priv->deadline.setSingleShot(true);
+    sconnect(&priv->deadline, SIGNAL(timeout()), this, SLOT(onTimeout()));
+    if (timeout >= 0)
+        priv->deadline.start(timeout);
+
+    // The subscriptions which are already complete are reported from
+    // the event loop, too.
+    QMetaObject::invokeMethod(this, "checkAll", Qt::QueuedConnection);
+}
+
+/// Returns true if finished() has been emitted.
+bool ContextSubscriptionWatcher::isFinished() const
+{
+    return priv->finished;
+}
+
+/// Returns true if the deadline passed before all the subscriptions
+/// were complete.
+bool ContextSubscriptionWatcher::isTimedOut() const
+{
+    return priv->timedOut;
+}
+
+/// Returns the properties whose subscription is not complete yet.
+QList<ContextProperty*> ContextSubscriptionWatcher::pendingProperties() const
+{
+    QList<ContextProperty*> properties;
+    Q_FOREACH (const QList<ContextProperty*> &list, priv->pending)
+        properties << list;
+    return properties;
+}
+
+void ContextSubscriptionWatcher::checkAll()
+{
+    Q_FOREACH (PropertyHandle *handle, priv->pending.keys())
+        check(handle);
+    if (priv->pending.isEmpty())
+        finish();
+}
+
+void ContextSubscriptionWatcher::onSubscriptionFinished()
+{
+    check(sender());
+    if (priv->pending.isEmpty())
+        finish();
+}
+
+/// Reports the properties of \a handle subscribed if its subscription
+/// is no longer pending.
+void ContextSubscriptionWatcher::check(QObject *handleObject)
+{
+    PropertyHandle *handle = static_cast<PropertyHandle*>(handleObject);
+    if (priv->finished || !priv->pending.contains(handle) || handle->isSubscribePending())
+        return;
+
+    disconnect(handle, SIGNAL(subscriptionFinished()), this, SLOT(onSubscriptionFinished()));
+    Q_FOREACH (ContextProperty *property, priv->pending.take(handle)) {
+        disconnect(property, SIGNAL(destroyed(QObject*)), this, SLOT(onPropertyDestroyed(QObject*)));
+        Q_EMIT propertySubscribed(property);
+    }
+}
+
+void ContextSubscriptionWatcher::onPropertyDestroyed(QObject *property)
+{
+    // Don't touch the half-destroyed property; just forget it.
+    QHash<PropertyHandle*, QList<ContextProperty*> >::iterator it = priv->pending.begin();
+    while (it != priv->pending.end()) {
+        it->removeAll(static_cast<ContextProperty*>(property));
+        if (it->isEmpty()) {
+            disconnect(it.key(), SIGNAL(subscriptionFinished()), this, SLOT(onSubscriptionFinished()));
+            it = priv->pending.erase(it);
+        }
+        else
+            ++it;
+    }
+    if (priv->pending.isEmpty())
+        finish();
+}
+
+void ContextSubscriptionWatcher::onTimeout()
+{
+    if (priv->finished)
+        return;
+    Q_FOREACH (PropertyHandle *handle, priv->pending.keys())
+        disconnect(handle, SIGNAL(subscriptionFinished()), this, SLOT(onSubscriptionFinished()));
+    priv->timedOut = true;
+    Q_EMIT timedOut();
+    finish();
+}
+
+void ContextSubscriptionWatcher::finish()
+{
+    if (priv->finished)
+        return;
+    priv->finished = true;
+    priv->deadline.stop();
+    Q_EMIT finished();
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef CONTEXTSUBSCRIPTIONWATCHER_H
+#define CONTEXTSUBSCRIPTIONWATCHER_H
+
+#include <QObject>
+#include <QList>
+
+class ContextProperty;
+class ContextSubscriptionWatcherPrivate;
+
+class ContextSubscriptionWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ContextSubscriptionWatcher(ContextProperty *property, int timeout = -1,
+                                        QObject *parent = 0);
+    explicit ContextSubscriptionWatcher(const QList<ContextProperty*> &properties, int timeout = -1,
+                                        QObject *parent = 0);
+    virtual ~ContextSubscriptionWatcher();
+
+    bool isFinished() const;
+    bool isTimedOut() const;
+    QList<ContextProperty*> pendingProperties() const;
+
+Q_SIGNALS:
+    void propertySubscribed(ContextProperty *property); ///< Emitted when the subscription of \a property is complete.
+    void timedOut(); ///< Emitted when the deadline passes before all the subscriptions are complete.
+    void finished(); ///< Emitted when all the subscriptions are complete, or after timedOut().
+
+private Q_SLOTS:
+    void onSubscriptionFinished();
+    void onTimeout();
+    void onPropertyDestroyed(QObject *property);
+    void checkAll();
+
+private:
+    void start(const QList<ContextProperty*> &properties, int timeout);
+    void check(QObject *handle);
+    void finish();
+
+    ContextSubscriptionWatcherPrivate *priv;
+};
+
+#endif
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+#include "contextthread.h"
+#include "logging.h"
+
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QCoreApplication>
+#include <stdlib.h>
+#include <string.h>
+
+namespace ContextSubscriber {
+
+/*!
+  \class ContextThread
+
+  \brief Decides which thread the internals of the library live in.
+
+  The \c PropertyHandle, \c Provider and plugin objects, together with
+  their D-Bus traffic, live in the thread returned by \c thread().  By
+  default it is the main thread.  If the dedicated thread was enabled
+  (with \c ContextProperty::setContextThreadEnabled() or by setting
+  the \c CONTEXT_SUBSCRIBER_THREAD environment variable to 1) before
+  the first \c ContextProperty was created, it is a private thread
+  running its own event loop, so that a busy main loop doesn't delay
+  the subscriptions and the value changes.  The values reach the
+  <tt>ContextProperty</tt>s through their \c DeliveryMailbox, in their
+  own threads, in both cases.
+
+  The choice is made when \c thread() is called for the first time and
+  it doesn't change afterwards.
+*/
+
+bool ContextThread::enabled = false;
+bool ContextThread::decided = false;
+QThread* ContextThread::ioThread = 0;
+
+static QMutex contextThreadLock;
+
+/// Requests the dedicated thread to be used (or not).  Has no effect
+/// once the thread has been chosen.
+void ContextThread::setEnabled(bool newEnabled)
+{
+    QMutexLocker locker(&contextThreadLock);
+    if (decided) {
+        if (newEnabled != enabled)
+            contextWarning() << "The context thread has to be chosen before the first ContextProperty is created";
+        return;
+    }
+    enabled = newEnabled;
+}
+
+/// Returns true if the internals live in the dedicated thread.
+bool ContextThread::isEnabled()
+{
+    QMutexLocker locker(&contextThreadLock);
+    decide();
+    return enabled;
+}
+
+/// Returns the thread the internal objects of the library have to be
+/// moved to, starting the dedicated thread if needed.
+QThread* ContextThread::thread()
+{
+    QMutexLocker locker(&contextThreadLock);
+    decide();
+    if (enabled)
+        return ioThread;
+    return QCoreApplication::instance()->thread();
+}
+
+/// Makes the choice of the thread final.  Called with
+/// contextThreadLock held.
+void ContextThread::decide()
+{
+    if (decided)
+        return;
+    decided = true;
+
+    const char *env = getenv("CONTEXT_SUBSCRIBER_THREAD");
+    if (env && strcmp(env, "0") != 0)
+        enabled = true;
+    if (!enabled)
+        return;
+
+    contextDebug() << "Starting the context thread";
+    // QThread::run() runs the event loop of the thread.
+    ioThread = new QThread();
+    ioThread->start();
+    // The event loop of the thread has to be stopped before the
+    // QCoreApplication is gone.
+    qAddPostRoutine(stop);
+}
+
+/// Stops the event loop of the dedicated thread and waits for it.
+void ContextThread::stop()
+{
+    if (!ioThread)
+        return;
+    ioThread->quit();
+    ioThread->wait();
+}
+
+} // end namespace
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+#ifndef CONTEXTTHREAD_H
+#define CONTEXTTHREAD_H
+
+class QThread;
+
+namespace ContextSubscriber {
+
+class ContextThread
+{
+public:
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+    static QThread* thread();
+
+private:
+    static void decide();
+    static void stop();
+
+    static bool enabled; ///< The dedicated thread was requested
+    static bool decided; ///< The choice of thread can't change anymore
+    static QThread *ioThread; ///< The dedicated thread, if it is running
+};
+
+} // end namespace
+
+#endif
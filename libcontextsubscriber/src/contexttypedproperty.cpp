@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "contexttypedproperty.h"
+#include "contextproperty.h"
+#include "sconnect.h"
+
+/*!
+   \class ContextTypedProperty
+
+   \brief A context property with values of the C++ type \a T.
+
+   ContextTypedProperty works like ContextProperty, but instead of
+   handing out a QVariant on every read, it converts each new value to
+   \a T once, when it is delivered, and keeps it.  Reading the value
+   is then just returning a reference, which is especially useful for
+   lists and maps.
+
+   \code
+   ContextBoolProperty onBattery("Battery.OnBattery");
+   ContextMapProperty coords("Location.Coordinates");
+   ...
+   if (onBattery.value())
+       showPosition(coords.value()["latitude"]);
+   \endcode
+
+   The conversions are done by \c ContextValueConversion<T>, which has
+   specializations for the core types of the registry: \c bool, \c
+   int, \c qint64, \c double, \c QString, \c QStringList, \c
+   QVariantList, \c QVariantMap and \c Duration.  Other types are
+   converted with \c qvariant_cast, or you can specialize \c
+   ContextValueConversion for them.
+
+   The same threading rules apply as for ContextProperty.  The
+   underlying ContextProperty is available via property().
+*/
+
+/*!
+   \class ContextTypedPropertyBase
+
+   \brief The part of ContextTypedProperty which doesn't depend on the
+   type.  Don't use it directly.
+*/
+
+/// Constructs a new property for \a key and subscribes to it.  The
+/// constructor of ContextTypedProperty fetches the current value.
+ContextTypedPropertyBase::ContextTypedPropertyBase(const QString &key, QObject *parent)
+    : QObject(parent), myIsNull(true)
+{
+    myProperty = new ContextProperty(key, this);
+    sconnect(myProperty, SIGNAL(valueChanged()),
+             this, SLOT(onValueChanged()));
+}
+
+/// Unsubscribes from the property, if needed, and destroys it.
+ContextTypedPropertyBase::~ContextTypedPropertyBase()
+{
+}
+
+/// Returns the key.
+QString ContextTypedPropertyBase::key() const
+{
+    return myProperty->key();
+}
+
+/// Returns true if the property currently has no value.
+bool ContextTypedPropertyBase::isNull() const
+{
+    return myIsNull;
+}
+
+/// Returns the metadata about this property.
+const ContextPropertyInfo* ContextTypedPropertyBase::info() const
+{
+    return myProperty->info();
+}
+
+/// See ContextProperty::subscribe().
+void ContextTypedPropertyBase::subscribe() const
+{
+    myProperty->subscribe();
+}
+
+/// See ContextProperty::unsubscribe().
+void ContextTypedPropertyBase::unsubscribe() const
+{
+    myProperty->unsubscribe();
+}
+
+/// See ContextProperty::waitForSubscription().  The value is
+/// converted again after the wait, so that value() returns the value
+/// which arrived with the subscription even before the valueChanged()
+/// signal is delivered.
+void ContextTypedPropertyBase::waitForSubscription() const
+{
+    myProperty->waitForSubscription();
+    const_cast<ContextTypedPropertyBase*>(this)->update();
+}
+
+/// Returns the underlying ContextProperty.
+ContextProperty* ContextTypedPropertyBase::property() const
+{
+    return myProperty;
+}
+
+/// Converts the current value of the underlying property.
+void ContextTypedPropertyBase::update()
+{
+    QVariant value = myProperty->value();
+    myIsNull = value.isNull();
+    convert(value);
+}
+
+void ContextTypedPropertyBase::onValueChanged()
+{
+    update();
+    Q_EMIT valueChanged();
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+#ifndef CONTEXTTYPEDPROPERTY_H
+#define CONTEXTTYPEDPROPERTY_H
+
+#include <QObject>
+#include <QString>
+#include <QVariant>
+#include <QStringList>
+#include "duration.h"
+
+class ContextProperty;
+class ContextPropertyInfo;
+
+/// Converts the QVariant values of context properties to \a T.  The
+/// generic version uses qvariant_cast; the core types of the registry
+/// have their own specializations.
+template <typename T>
+struct ContextValueConversion
+{
+    static T convert(const QVariant &value) { return qvariant_cast<T>(value); }
+};
+
+template <>
+struct ContextValueConversion<bool>
+{
+    static bool convert(const QVariant &value) { return value.toBool(); }
+};
+
+template <>
+struct ContextValueConversion<int>
+{
+    static int convert(const QVariant &value) { return value.toInt(); }
+};
+
+template <>
+struct ContextValueConversion<qint64>
+{
+    static qint64 convert(const QVariant &value) { return value.toLongLong(); }
+};
+
+template <>
+struct ContextValueConversion<double>
+{
+    static double convert(const QVariant &value) { return value.toDouble(); }
+};
+
+template <>
+struct ContextValueConversion<QString>
+{
+    static QString convert(const QVariant &value) { return value.toString(); }
+};
+
+template <>
+struct ContextValueConversion<QStringList>
+{
+    static QStringList convert(const QVariant &value) { return value.toStringList(); }
+};
+
+template <>
+struct ContextValueConversion<QVariantList>
+{
+    static QVariantList convert(const QVariant &value) { return value.toList(); }
+};
+
+template <>
+struct ContextValueConversion<QVariantMap>
+{
+    static QVariantMap convert(const QVariant &value) { return value.toMap(); }
+};
+
+template <>
+struct ContextValueConversion<Duration>
+{
+    static Duration convert(const QVariant &value) { return Duration(value.toULongLong()); }
+};
+
+class ContextTypedPropertyBase : public QObject
+{
+    Q_OBJECT
+
+public:
+    virtual ~ContextTypedPropertyBase();
+
+    QString key() const;
+    bool isNull() const;
+    const ContextPropertyInfo* info() const;
+
+    void subscribe() const;
+    void unsubscribe() const;
+    void waitForSubscription() const;
+
+    ContextProperty* property() const;
+
+Q_SIGNALS:
+    void valueChanged(); ///< Emitted after the typed value has changed.
+
+protected:
+    ContextTypedPropertyBase(const QString &key, QObject *parent);
+    void update();
+
+    /// Stores \a value, converted to the type of the property.
+    virtual void convert(const QVariant &value) = 0;
+
+private Q_SLOTS:
+    void onValueChanged();
+
+private:
+    ContextProperty *myProperty; ///< The property we get the values from
+    bool myIsNull; ///< Whether the property has no value
+};
+
+template <typename T>
+class ContextTypedProperty : public ContextTypedPropertyBase
+{
+public:
+    /// Constructs a new property for \a key and subscribes to it.
+    explicit ContextTypedProperty(const QString &key, QObject *parent = 0)
+        : ContextTypedPropertyBase(key, parent), myValue()
+        {
+            update();
+        }
+
+    /// Returns the current value, or a default constructed T if the
+    /// property has no value.  The reference stays valid until the
+    /// next valueChanged() signal.
+    const T& value() const
+        {
+            return myValue;
+        }
+
+    /// Returns the current value, or \a def if the property has no
+    /// value.
+    T value(const T &def) const
+        {
+            return isNull() ? def : myValue;
+        }
+
+protected:
+    void convert(const QVariant &value)
+        {
+            myValue = value.isNull() ? T() : ContextValueConversion<T>::convert(value);
+        }
+
+private:
+    T myValue; ///< The current value, converted once when it was delivered
+};
+
+typedef ContextTypedProperty<bool> ContextBoolProperty;
+typedef ContextTypedProperty<int> ContextIntProperty;
+typedef ContextTypedProperty<double> ContextNumberProperty;
+typedef ContextTypedProperty<QString> ContextStringProperty;
+typedef ContextTypedProperty<QVariantList> ContextListProperty;
+typedef ContextTypedProperty<QVariantMap> ContextMapProperty;
+typedef ContextTypedProperty<Duration> ContextDurationProperty;
+
+#endif
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+#include "contexttypevalidator.h"
+#include "contexttypeinfo.h"
+#include "logging.h"
+#include "loggingfeatures.h"
+
+/*!
+  \class ContextTypeValidator
+
+  \brief Checks values against a type, prepared once for many checks.
+
+  The constructor resolves everything \c ContextTypeInfo::typeCheck()
+  needs from the type's AssocTree and the type registry: the
+  parametrized base type, the bounds, the enumerators and the
+  validators of list elements and map values.  \c check() then only
+  looks at the value.
+
+  The validator reflects the type definitions at the time it was
+  constructed; construct a new one when they change.
+*/
+
+/// Compiles \a typeInfo, and recursively the types it refers to.
+ContextTypeValidator::ContextTypeValidator(const ContextTypeInfo &typeInfo)
+    : typeName(typeInfo.name()), kind(Any), baseValidator(0),
+      hasMin(false), hasMax(false), min(0), max(0),
+      elementValidator(0), othersAllowed(false)
+{
+    // First compile the parametrized base type.
+    ContextTypeInfo baseType(typeInfo.base());
+    if (!baseType.isNull()) {
+        // Combine type instance parameters with default parameters of the
+        // base type.
+        if (baseType.type() != QVariant::List)
+            baseType = AssocTree(QVariantList() << baseType.name());
+        Q_FOREACH (AssocTree p, typeInfo.parameters()) {
+            baseType = baseType.filterOut(p.name());
+            baseType = AssocTree(baseType.toList() << p);
+        }
+        baseValidator = new ContextTypeValidator(baseType);
+    }
+
+    // Now let's see our hardwired knowledge about our types.
+    if (typeName == "bool")
+        kind = Bool;
+    else if (typeName == "number" || typeName == "list") {
+        kind = typeName == "number" ? Number : List;
+        QVariant minValue = typeInfo.parameterValue("min");
+        QVariant maxValue = typeInfo.parameterValue("max");
+        hasMin = !minValue.isNull();
+        hasMax = !maxValue.isNull();
+        if (kind == Number) {
+            min = minValue.toDouble();
+            max = maxValue.toDouble();
+        }
+        else {
+            min = minValue.toInt();
+            max = maxValue.toInt();
+            ContextTypeInfo elementType = typeInfo.parameterValue("type");
+            if (!elementType.isNull())
+                elementValidator = new ContextTypeValidator(elementType);
+        }
+    }
+    else if (typeName == "integer")
+        kind = Integer;
+    else if (typeName == "string")
+        kind = String;
+    else if (typeName == "map") {
+        kind = Map;
+        Q_FOREACH (ContextTypeInfo keyInfo, typeInfo.parameters()) {
+            QString keyName = keyInfo.name();
+            if (keyName == "allow-other-keys") {
+                othersAllowed = true;
+                continue;
+            }
+            ContextTypeInfo valueType = keyInfo.parameterValue("type");
+            delete keyValidators.value(keyName);
+            keyValidators.insert(keyName, valueType.isNull() ? 0 : new ContextTypeValidator(valueType));
+        }
+    }
+    else if (typeName == "string-enum") {
+        kind = StringEnum;
+        Q_FOREACH (AssocTree enumerator, typeInfo.parameters())
+            stringEnumerators.insert(enumerator.name());
+    }
+    else if (typeName == "int-enum") {
+        kind = IntEnum;
+        Q_FOREACH (AssocTree enumerator, typeInfo.parameters())
+            intEnumerators.insert(enumerator.value("value").toInt());
+    }
+}
+
+ContextTypeValidator::~ContextTypeValidator()
+{
+    delete baseValidator;
+    delete elementValidator;
+    qDeleteAll(keyValidators);
+}
+
+/// Returns the name of the type this validator checks.
+QString ContextTypeValidator::name() const
+{
+    return typeName;
+}
+
+/// Verifies if \a value is acceptable as a representative of the
+/// type.  The same as \c ContextTypeInfo::typeCheck().
+bool ContextTypeValidator::check(const QVariant &value) const
+{
+    if (baseValidator && !baseValidator->check(value))
+        return false;
+    return checkOwn(value);
+}
+
+/// Checks \a value against our hardwired knowledge of the type,
+/// without the base type.
+bool ContextTypeValidator::checkOwn(const QVariant &value) const
+{
+    QVariant::Type vtype = value.type();
+    switch (kind) {
+    case Any:
+        return true;
+    case Bool: {
+        bool ok = vtype == QVariant::Bool;
+        if (!ok)
+            contextWarning() << F_TYPES << value << "is not a bool";
+        return ok;
+    }
+    case Number: {
+        if (!value.canConvert(QVariant::Double)) {
+            contextWarning() << F_TYPES << value << "is not a number";
+            return false;
+        }
+        double v = value.toDouble();
+        if (hasMin && v < min) {
+            contextWarning() << F_TYPES << v << "below minimum:" << min;
+            return false;
+        }
+        if (hasMax && max < v) {
+            contextWarning() << F_TYPES << v << "above maximum:" << max;
+            return false;
+        }
+        return true;
+    }
+    case Integer: {
+        bool ok = (vtype == QVariant::Int ||
+                   vtype == QVariant::UInt ||
+                   vtype == QVariant::LongLong ||
+                   vtype == QVariant::ULongLong);
+        if (!ok)
+            contextWarning() << F_TYPES << value << "is not an integer type";
+        return ok;
+    }
+    case String: {
+        bool ok = vtype == QVariant::String;
+        if (!ok)
+            contextWarning() << F_TYPES << value << "is not a string";
+        return ok;
+    }
+    case List: {
+        if (vtype != QVariant::List) {
+            contextWarning() << F_TYPES << value << "is not a list";
+            return false;
+        }
+        const QVariantList vl = value.toList();
+        if (hasMin && vl.size() < min) {
+            contextWarning() << F_TYPES << value << "shorter than minimum";
+            return false;
+        }
+        if (hasMax && vl.size() > max) {
+            contextWarning() << F_TYPES << value << "length over maximum";
+            return false;
+        }
+        if (elementValidator)
+            Q_FOREACH (const QVariant &el, vl)
+                if (!elementValidator->check(el)) {
+                    contextWarning() << F_TYPES << "element" << el
+                                     << "is of incorrect type";
+                    return false;
+                }
+        return true;
+    }
+    case Map: {
+        if (vtype != QVariant::Map) {
+            contextWarning() << F_TYPES << value << "is not a map";
+            return false;
+        }
+        if (keyValidators.isEmpty())
+            return true;
+        const QVariantMap map = value.toMap();
+        for (QVariantMap::const_iterator it = map.constBegin(); it != map.constEnd(); ++it) {
+            QHash<QString, ContextTypeValidator*>::const_iterator allowed = keyValidators.constFind(it.key());
+            if (allowed != keyValidators.constEnd()) {
+                if (*allowed && !(*allowed)->check(it.value())) {
+                    contextWarning() << F_TYPES << "value for" << it.key()
+                                     << "(" << it.value() << ")"
+                                     << "is of incorrect type";
+                    return false;
+                }
+            } else if (!othersAllowed) {
+                contextWarning() << F_TYPES << "unknown key" << it.key();
+                return false;
+            }
+        }
+        return true;
+    }
+    case StringEnum: {
+        bool ok = stringEnumerators.contains(value.toString());
+        if (!ok)
+            contextWarning() << F_TYPES
+                             << value << "is not valid in this string-enum";
+        return ok;
+    }
+    case IntEnum: {
+        bool ok = intEnumerators.contains(value.toInt());
+        if (!ok)
+            contextWarning() << F_TYPES << value << "is not valid in this int-enum";
+        return ok;
+    }
+    }
+    return true;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+#ifndef CONTEXTTYPEVALIDATOR_H
+#define CONTEXTTYPEVALIDATOR_H
+
+#include <QVariant>
+#include <QString>
+#include <QHash>
+#include <QSet>
+
+class ContextTypeInfo;
+
+class ContextTypeValidator
+{
+public:
+    explicit ContextTypeValidator(const ContextTypeInfo &typeInfo);
+    ~ContextTypeValidator();
+
+    bool check(const QVariant &value) const;
+    QString name() const;
+
+private:
+    Q_DISABLE_COPY(ContextTypeValidator)
+
+    /// The types we have hardwired knowledge about
+    enum Kind {
+        Any,
+        Bool,
+        Number,
+        Integer,
+        String,
+        List,
+        Map,
+        StringEnum,
+        IntEnum
+    };
+
+    bool checkOwn(const QVariant &value) const;
+
+    QString typeName; ///< Name of the type we were compiled from
+    Kind kind;
+    ContextTypeValidator *baseValidator; ///< Validator of the parametrized base type, or 0
+    bool hasMin; ///< Whether min is set
+    bool hasMax; ///< Whether max is set
+    double min; ///< Lower bound of a number, or of the length of a list
+    double max; ///< Upper bound of a number, or of the length of a list
+    ContextTypeValidator *elementValidator; ///< Validator of the list elements, or 0
+    QHash<QString, ContextTypeValidator*> keyValidators; ///< Allowed keys of a map, with validators or 0
+    bool othersAllowed; ///< Whether a map can have other keys than keyValidators
+    QSet<QString> stringEnumerators; ///< Valid values of a string-enum
+    QSet<int> intEnumerators; ///< Valid values of an int-enum
+};
+
+#endif
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+#include "deliverymailbox.h"
+#include "propertyhandle.h"
+#include "contextproperty.h"
+
+#include <QThread>
+#include <QEvent>
+#include <QCoreApplication>
+
+namespace ContextSubscriber {
+
+/*!
+  \class DeliveryMailbox
+
+  \brief Delivers the value changes of \c PropertyHandle objects to the
+  \c ContextProperty objects of one thread.
+
+  Each thread having \c ContextProperty objects has one mailbox.  When
+  a handle changes, it posts itself to the mailboxes interested in it;
+  the first post after a delivery wakes up the thread with one event,
+  and the later ones are only recorded.  When the event is handled,
+  each changed handle is looked at once, and its current value is
+  given to all the attached properties.  Thus a burst of changes costs
+  one event per thread instead of one per property and change, and
+  only the latest value of each key is delivered.
+
+  \c post() can be called from any thread; everything else is called
+  in the thread of the mailbox.  A property moved to another thread
+  detaches itself and attaches to the mailbox of the new thread.
+*/
+
+QMutex DeliveryMailbox::instancesLock;
+QHash<QThread*, DeliveryMailbox*> DeliveryMailbox::instances;
+
+DeliveryMailbox::DeliveryMailbox()
+    : attachedCount(0), deliveryDepth(0), needsCompaction(false), wakeupPosted(false)
+{
+}
+
+QEvent::Type DeliveryMailbox::deliveryEvent()
+{
+    static const QEvent::Type type = static_cast<QEvent::Type>(QEvent::registerEventType());
+    return type;
+}
+
+/// Starts delivering the changes of \a handle to \a property in the
+/// current thread.  Returns the mailbox of the current thread, which
+/// is created if needed, and stays alive as long as there are
+/// properties attached to it.
+DeliveryMailbox* DeliveryMailbox::attach(PropertyHandle *handle, ContextProperty *property)
+{
+    QMutexLocker locker(&instancesLock);
+    QThread *thread = QThread::currentThread();
+    DeliveryMailbox *mailbox = instances.value(thread, 0);
+    if (mailbox == 0) {
+        mailbox = new DeliveryMailbox();
+        instances.insert(thread, mailbox);
+    }
+
+    QMutexLocker receiversLocker(&mailbox->receiversLock);
+    QList<ContextProperty*> &list = mailbox->receivers[handle];
+    if (list.isEmpty())
+        handle->addMailbox(mailbox);
+    list.append(property);
+    ++mailbox->attachedCount;
+    return mailbox;
+}
+
+/// Stops delivering the changes of \a handle to \a property.  When
+/// the last property is detached, the mailbox is deleted.
+void DeliveryMailbox::detach(PropertyHandle *handle, ContextProperty *property)
+{
+    {
+        QMutexLocker locker(&receiversLock);
+        QHash<PropertyHandle*, QList<ContextProperty*> >::iterator it = receivers.find(handle);
+        if (it == receivers.end())
+            return;
+        int index = it->indexOf(property);
+        if (index < 0)
+            return;
+        --attachedCount;
+        if (deliveryDepth > 0) {
+            // deliver() is iterating the list; compact it afterwards.
+            (*it)[index] = 0;
+            needsCompaction = true;
+            return;
+        }
+        it->removeAt(index);
+        if (it->isEmpty()) {
+            receivers.erase(it);
+            handle->removeMailbox(this);
+        }
+        if (attachedCount > 0)
+            return;
+    }
+    release();
+}
+
+/// Records that \a handle has changed, and wakes up the thread of the
+/// mailbox if it isn't already going to deliver.  Can be called from
+/// any thread.
+void DeliveryMailbox::post(PropertyHandle *handle)
+{
+    QMutexLocker locker(&pendingLock);
+    if (pendingSet.contains(handle))
+        return;
+    pendingSet.insert(handle);
+    pending.append(handle);
+    if (!wakeupPosted) {
+        wakeupPosted = true;
+        QCoreApplication::postEvent(this, new QEvent(deliveryEvent()));
+    }
+}
+
+bool DeliveryMailbox::event(QEvent *event)
+{
+    if (event->type() == deliveryEvent()) {
+        deliver();
+        return true;
+    }
+    return QObject::event(event);
+}
+
+/// Gives the current values of the changed handles to the attached
+/// properties.  The properties may attach and detach, and even run
+/// nested event loops, while being delivered to.
+void DeliveryMailbox::deliver()
+{
+    QList<PropertyHandle*> handles;
+    {
+        QMutexLocker locker(&pendingLock);
+        handles.swap(pending);
+        pendingSet.clear();
+        wakeupPosted = false;
+    }
+
+    QMutexLocker locker(&receiversLock);
+    ++deliveryDepth;
+    Q_FOREACH (PropertyHandle *handle, handles) {
+        if (!receivers.contains(handle))
+            continue;
+        QVariant value = handle->value();
+        // Properties attached during the delivery don't get this
+        // value; they were created after the change.
+        const int count = receivers[handle].size();
+        for (int i = 0; i < count; ++i) {
+            ContextProperty *property = receivers[handle].at(i);
+            if (property == 0)
+                continue;
+            locker.unlock();
+            property->deliver(value);
+            locker.relock();
+        }
+    }
+    --deliveryDepth;
+
+    if (deliveryDepth == 0 && needsCompaction) {
+        compact();
+        if (attachedCount == 0) {
+            locker.unlock();
+            release();
+        }
+    }
+}
+
+/// Removes the entries of the properties detached during deliveries.
+void DeliveryMailbox::compact()
+{
+    needsCompaction = false;
+    QHash<PropertyHandle*, QList<ContextProperty*> >::iterator it = receivers.begin();
+    while (it != receivers.end()) {
+        it->removeAll(0);
+        if (it->isEmpty()) {
+            it.key()->removeMailbox(this);
+            it = receivers.erase(it);
+        }
+        else
+            ++it;
+    }
+}
+
+/// Deletes the mailbox after the last property has been detached.
+/// The deletion is deferred, since we might be inside event().
+void DeliveryMailbox::release()
+{
+    {
+        QMutexLocker locker(&instancesLock);
+        // A property might have attached in the meantime.
+        QMutexLocker receiversLocker(&receiversLock);
+        if (attachedCount > 0)
+            return;
+        if (instances.value(thread(), 0) == this)
+            instances.remove(thread());
+    }
+    deleteLater();
+}
+
+} // end namespace
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+#ifndef DELIVERYMAILBOX_H
+#define DELIVERYMAILBOX_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QMutex>
+#include <QVariant>
+
+class QThread;
+class ContextProperty;
+
+namespace ContextSubscriber {
+
+class PropertyHandle;
+
+class DeliveryMailbox : public QObject
+{
+    Q_OBJECT
+
+public:
+    static DeliveryMailbox* attach(PropertyHandle *handle, ContextProperty *property);
+
+    void detach(PropertyHandle *handle, ContextProperty *property);
+    void post(PropertyHandle *handle);
+
+protected:
+    bool event(QEvent *event);
+
+private:
+    DeliveryMailbox();
+    void deliver();
+    void compact();
+    void release();
+
+    static QEvent::Type deliveryEvent();
+
+    /// The ContextProperty objects attached to each handle.  Entries
+    /// of detached properties are set to 0 during a delivery and
+    /// removed after it.
+    QHash<PropertyHandle*, QList<ContextProperty*> > receivers;
+    QMutex receiversLock; ///< Protects receivers, attachedCount and deliveryDepth
+    int attachedCount; ///< Number of attached ContextProperty objects
+    int deliveryDepth; ///< Number of nested deliver() calls running
+    bool needsCompaction; ///< Some entries of receivers are 0
+
+    QMutex pendingLock; ///< Protects pending, pendingSet and wakeupPosted
+    QList<PropertyHandle*> pending; ///< Handles changed since the last delivery
+    QSet<PropertyHandle*> pendingSet; ///< The same as pending, for lookups
+    bool wakeupPosted; ///< A delivery event is on its way
+
+    static QMutex instancesLock;
+    static QHash<QThread*, DeliveryMailbox*> instances; ///< The mailbox of each thread
+};
+
+} // end namespace
+
+#endif
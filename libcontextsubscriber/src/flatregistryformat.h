@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef FLATREGISTRYFORMAT_H
+#define FLATREGISTRYFORMAT_H
+
+#include <QtGlobal>
+
+/* Layout of the flat registry cache (cache.flat), the second format
+   of the registry cache.  The file is written by FlatRegistryWriter
+   and mapped read-only by FlatRegistryReader.
+
+   All the integers are 32 bit, in the byte order of the machine which
+   wrote the file; a reader on a machine of the other byte order
+   doesn't recognize the magic number.  All the offsets are from the
+   beginning of the file, and all the tables are 4-byte aligned.
+
+     Header
+     KeyRecord[keyCount]            in the order of the perfect hash
+     qint32[keyCount]               displacements of the perfect hash
+     ProviderRecord[providerCount]  each distinct provider once
+     quint32[providerRefCount]      provider indices of the keys
+     char[stringsSize]              UTF-8 strings, referred to by StringRef
+     char[blobsSize]                type infos, QDataStream serialized,
+                                    each distinct one once
+
+   The perfect hash is "hash and displace": the key is hashed with
+   seed 0 to pick a displacement d.  If d is negative, the key is at
+   slot -d-1; otherwise at hash(d, key) modulo keyCount.  The name in
+   the KeyRecord at the slot tells whether the key is there at all.
+
+   The generation in the header is the same string the cdb database
+   written in the same run has in its GENERATION record; the readers
+   use the flat cache only if the two match. */
+
+namespace FlatRegistry {
+
+const quint32 Magic = 0x47455243; ///< "CREG" when written little endian
+const quint32 Version = 3;
+
+/// A string in the string table.
+struct StringRef {
+    quint32 offset;
+    quint32 length; ///< In bytes, without terminator
+};
+
+struct Header {
+    quint32 magic;
+    quint32 version;
+    quint32 fileSize;
+    StringRef compatibility; ///< BACKEND_COMPATIBILITY_NAMESPACE of the writer
+    StringRef generation; ///< GENERATION of the cdb database written with this file
+    quint32 keyCount;
+    quint32 keysOffset;
+    quint32 displacementsOffset;
+    quint32 providerCount;
+    quint32 providersOffset;
+    quint32 providerRefCount;
+    quint32 providerRefsOffset;
+    quint32 stringsOffset;
+    quint32 stringsSize;
+    quint32 blobsOffset;
+    quint32 blobsSize;
+};
+
+enum KeyFlag {
+    KeyDeprecated = 1
+};
+
+struct KeyRecord {
+    StringRef name;
+    StringRef doc;
+    StringRef mergePolicy;
+    quint32 flags; ///< KeyFlag values or'd together
+    quint32 firstProvider; ///< Index of the first provider index of the key in the provider refs
+    quint32 providerCount;
+    quint32 typeInfoOffset; ///< Offset of the serialized type info in the blobs
+    quint32 typeInfoLength; ///< 0 if the key has no type info
+};
+
+struct ProviderRecord {
+    StringRef plugin;
+    StringRef constructionString;
+};
+
+/// Hashes the \a length bytes at \a data with \a seed (FNV-1 based).
+inline quint32 hash(quint32 seed, const char *data, int length)
+{
+    quint32 h = seed ? seed : 0x811c9dc5;
+    for (int i = 0; i < length; ++i)
+        h = (h * 0x01000193) ^ (uchar) data[i];
+    return h;
+}
+
+/// Returns the slot of the key \a data of \a length bytes, among \a
+/// count slots with the given \a displacements.
+inline quint32 slotFor(const qint32 *displacements, quint32 count, const char *data, int length)
+{
+    qint32 d = displacements[hash(0, data, length) % count];
+    if (d < 0)
+        return -d - 1;
+    return hash(d, data, length) % count;
+}
+
+}
+
+#endif
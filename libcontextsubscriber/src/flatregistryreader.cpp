@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "flatregistryreader.h"
+#include "flatregistryformat.h"
+#include "logging.h"
+#include "loggingfeatures.h"
+#include <QByteArray>
+#include <QDataStream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+using namespace FlatRegistry;
+
+/*!
+    \class FlatRegistryReader
+
+    \brief Reads the flat registry cache written by FlatRegistryWriter.
+
+    This class is not a part of the public API.  The file is mapped
+    read-only and shared, so all the processes reading the registry
+    share the same pages.  It is validated once when opened; after
+    that, looking up a key costs one hash of its name and one
+    comparison, and the key data is read straight from the mapping.
+    Only the type infos are serialized, and they are decoded when
+    asked for.
+
+    The keys are addressed by their index, from 0 to keyCount() - 1;
+    indexOf() returns the index of a key.  The indices are valid until
+    the reader is closed or reopened.
+*/
+
+/// Constructs a new reader of the cache at \a path, and opens it.
+FlatRegistryReader::FlatRegistryReader(const QString &path)
+    : path(path), map(0), mapSize(0), header(0)
+{
+    contextDebug() << F_CDB << "flat registry reader created for:" << path;
+    reopen();
+}
+
+/// Destroys the object, unmapping the file.
+FlatRegistryReader::~FlatRegistryReader()
+{
+    close();
+}
+
+/// Unmaps the file.
+void FlatRegistryReader::close()
+{
+    if (map)
+        munmap((void *) map, mapSize);
+    map = 0;
+    mapSize = 0;
+    header = 0;
+}
+
+/// Maps the file again, closing the current mapping first.
+void FlatRegistryReader::reopen()
+{
+    close();
+
+    int fd = open(path.toLocal8Bit().constData(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat buffer;
+    if (fstat(fd, &buffer) == 0 && buffer.st_size >= (off_t) sizeof(Header)) {
+        void *p = mmap(0, buffer.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            map = (const uchar *) p;
+            mapSize = buffer.st_size;
+        }
+    }
+    // The mapping stays valid after closing the file.
+    ::close(fd);
+
+    if (map && validate())
+        header = (const Header *) map;
+    else if (map)
+        contextWarning() << F_CDB << "Invalid registry cache:" << path;
+}
+
+/// Returns true if the file is mapped and valid.
+bool FlatRegistryReader::isReadable() const
+{
+    return header != 0;
+}
+
+/// Checks that the header is ours and all the tables and references
+/// are inside the file, so that they don't have to be checked when
+/// read.
+bool FlatRegistryReader::validate() const
+{
+    const Header *h = (const Header *) map;
+    if (h->magic != Magic || h->version != Version || h->fileSize != mapSize)
+        return false;
+
+    // The tables, in the order they are in the file
+    quint64 end = sizeof(Header);
+    const quint64 tables[][3] = {
+        { h->keysOffset, h->keyCount, sizeof(KeyRecord) },
+        { h->displacementsOffset, h->keyCount, sizeof(qint32) },
+        { h->providersOffset, h->providerCount, sizeof(ProviderRecord) },
+        { h->providerRefsOffset, h->providerRefCount, sizeof(quint32) },
+        { h->stringsOffset, h->stringsSize, 1 },
+        { h->blobsOffset, h->blobsSize, 1 }
+    };
+    for (unsigned i = 0; i < sizeof(tables) / sizeof(tables[0]); ++i) {
+        if (tables[i][0] < end || tables[i][0] % 4 != 0)
+            return false;
+        end = tables[i][0] + tables[i][1] * tables[i][2];
+        if (end > mapSize)
+            return false;
+    }
+
+    if (!validString(h->compatibility) || !validString(h->generation))
+        return false;
+
+    const qint32 *displacements = (const qint32 *) (map + h->displacementsOffset);
+    for (quint32 i = 0; i < h->keyCount; ++i) {
+        if (displacements[i] < 0 && (quint32) (-(qint64) displacements[i] - 1) >= h->keyCount)
+            return false;
+    }
+
+    const KeyRecord *keys = (const KeyRecord *) (map + h->keysOffset);
+    for (quint32 i = 0; i < h->keyCount; ++i) {
+        const KeyRecord &k = keys[i];
+        if (!validString(k.name) || !validString(k.doc) || !validString(k.mergePolicy) ||
+            (quint64) k.firstProvider + k.providerCount > h->providerRefCount ||
+            (quint64) k.typeInfoOffset + k.typeInfoLength > h->blobsSize)
+            return false;
+    }
+
+    const quint32 *providerRefs = (const quint32 *) (map + h->providerRefsOffset);
+    for (quint32 i = 0; i < h->providerRefCount; ++i) {
+        if (providerRefs[i] >= h->providerCount)
+            return false;
+    }
+
+    const ProviderRecord *providers = (const ProviderRecord *) (map + h->providersOffset);
+    for (quint32 i = 0; i < h->providerCount; ++i) {
+        if (!validString(providers[i].plugin) || !validString(providers[i].constructionString))
+            return false;
+    }
+
+    return true;
+}
+
+/// Returns true if \a ref is inside the string table.  Uses the
+/// mapping, as it's called before the header is accepted.
+bool FlatRegistryReader::validString(const StringRef &ref) const
+{
+    const Header *h = (const Header *) map;
+    return (quint64) ref.offset + ref.length <= h->stringsSize;
+}
+
+/// Returns the string at \a ref; a null string if it's empty, like the
+/// cdb backend returns for the records it doesn't have.
+QString FlatRegistryReader::string(const StringRef &ref) const
+{
+    if (ref.length == 0)
+        return QString();
+    return QString::fromUtf8((const char *) map + header->stringsOffset + ref.offset, ref.length);
+}
+
+const KeyRecord *FlatRegistryReader::key(int index) const
+{
+    return (const KeyRecord *) (map + header->keysOffset) + index;
+}
+
+/// Returns the compatibility string the file was written with.
+QString FlatRegistryReader::compatibility() const
+{
+    return header ? string(header->compatibility) : QString();
+}
+
+/// Returns the generation the file was written with: the GENERATION
+/// of the cdb database written in the same run.
+QString FlatRegistryReader::generation() const
+{
+    return header ? string(header->generation) : QString();
+}
+
+/// Returns the number of keys in the file.
+int FlatRegistryReader::keyCount() const
+{
+    return header ? header->keyCount : 0;
+}
+
+/// Returns the index of \a key, or -1 if it's not in the file.
+int FlatRegistryReader::indexOf(const QString &key) const
+{
+    if (!header || header->keyCount == 0)
+        return -1;
+
+    const QByteArray name = key.toUtf8();
+    const qint32 *displacements = (const qint32 *) (map + header->displacementsOffset);
+    quint32 slot = slotFor(displacements, header->keyCount, name.constData(), name.size());
+    const StringRef &ref = this->key(slot)->name;
+    if (ref.length == (quint32) name.size() &&
+        memcmp(map + header->stringsOffset + ref.offset, name.constData(), ref.length) == 0)
+        return slot;
+    return -1;
+}
+
+/// Returns the name of the key at \a index.
+QString FlatRegistryReader::keyName(int index) const
+{
+    return string(key(index)->name);
+}
+
+/// Returns the type info of the key at \a index, decoding it.
+QVariant FlatRegistryReader::typeInfo(int index) const
+{
+    const QByteArray view = rawTypeInfo(index);
+    if (view.isEmpty())
+        return QVariant();
+
+    QDataStream ds(view);
+    QVariant typeInfo;
+    ds >> typeInfo;
+    return typeInfo;
+}
+
+/// Returns the type info of the key at \a index as it's stored in the
+/// file, serialized with QDataStream, or an empty array if the key has
+/// none.  The returned array refers to the mapping and is valid only
+/// until the reader is closed or reopened.
+QByteArray FlatRegistryReader::rawTypeInfo(int index) const
+{
+    const KeyRecord *k = key(index);
+    if (k->typeInfoLength == 0)
+        return QByteArray();
+
+    return QByteArray::fromRawData((const char *) map + header->blobsOffset + k->typeInfoOffset,
+                                   k->typeInfoLength);
+}
+
+/// Returns the documentation of the key at \a index.
+QString FlatRegistryReader::doc(int index) const
+{
+    return string(key(index)->doc);
+}
+
+/// Returns true if the key at \a index is deprecated.
+bool FlatRegistryReader::deprecated(int index) const
+{
+    return key(index)->flags & KeyDeprecated;
+}
+
+/// Returns the merge policy of the key at \a index, or an empty string.
+QString FlatRegistryReader::mergePolicy(int index) const
+{
+    return string(key(index)->mergePolicy);
+}
+
+/// Returns the providers of the key at \a index.
+QList<ContextProviderInfo> FlatRegistryReader::providers(int index) const
+{
+    const KeyRecord *k = key(index);
+    const quint32 *refs = (const quint32 *) (map + header->providerRefsOffset) + k->firstProvider;
+    const ProviderRecord *providers = (const ProviderRecord *) (map + header->providersOffset);
+
+    QList<ContextProviderInfo> result;
+    for (quint32 i = 0; i < k->providerCount; ++i) {
+        const ProviderRecord &provider = providers[refs[i]];
+        result << ContextProviderInfo(string(provider.plugin), string(provider.constructionString));
+    }
+    return result;
+}
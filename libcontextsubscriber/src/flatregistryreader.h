@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef FLATREGISTRYREADER_H
+#define FLATREGISTRYREADER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QList>
+#include "contextproviderinfo.h"
+
+namespace FlatRegistry {
+struct Header;
+struct KeyRecord;
+struct StringRef;
+}
+
+class FlatRegistryReader
+{
+public:
+    explicit FlatRegistryReader(const QString &path);
+    ~FlatRegistryReader();
+
+    void close();
+    void reopen();
+    bool isReadable() const;
+
+    QString compatibility() const;
+    QString generation() const;
+    int keyCount() const;
+    int indexOf(const QString &key) const;
+    QString keyName(int index) const;
+    QVariant typeInfo(int index) const;
+    QByteArray rawTypeInfo(int index) const;
+    QString doc(int index) const;
+    bool deprecated(int index) const;
+    QString mergePolicy(int index) const;
+    QList<ContextProviderInfo> providers(int index) const;
+
+private:
+    Q_DISABLE_COPY(FlatRegistryReader)
+
+    bool validate() const;
+    bool validString(const FlatRegistry::StringRef &ref) const;
+    QString string(const FlatRegistry::StringRef &ref) const;
+    const FlatRegistry::KeyRecord *key(int index) const;
+
+    QString path; ///< Path pointing to the cache file.
+    const uchar *map; ///< The mapped file, or 0
+    size_t mapSize; ///< The size of the mapping
+    const FlatRegistry::Header *header; ///< Header of the mapped file, if it's valid; 0 otherwise
+};
+
+#endif
@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "flatregistrywriter.h"
+#include "flatregistryformat.h"
+#include "logging.h"
+#include "loggingfeatures.h"
+#include <QDataStream>
+#include <QVector>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+
+using namespace FlatRegistry;
+
+/*!
+    \class FlatRegistryWriter
+
+    \brief Writes the flat registry cache.
+
+    This class is not a part of the public API.  The keys are collected
+    with addKey(), and data() lays them out in the format described in
+    flatregistryformat.h: fixed-size key records placed by a minimal
+    perfect hash, the providers and the type infos shared by many keys
+    stored once, and all the strings in one table.  The result is read
+    by FlatRegistryReader.
+*/
+
+/// Constructs a writer for a file marked with the \a compatibility
+/// string of the backend and the \a generation of the cdb database
+/// written together with it.
+FlatRegistryWriter::FlatRegistryWriter(const QString &compatibility, const QString &generation)
+    : compatibility(compatibility), generation(generation)
+{
+}
+
+/// Adds \a key with its type info, documentation, deprecation flag,
+/// merge policy and providers.
+void FlatRegistryWriter::addKey(const QString &key, const QVariant &typeInfo, const QString &doc,
+                                bool deprecated, const QString &mergePolicy,
+                                const QList<ContextProviderInfo> &providers)
+{
+    Key k;
+    k.name = key;
+    if (!typeInfo.isNull()) {
+        QDataStream ds(&k.typeInfo, QIODevice::WriteOnly);
+        ds << typeInfo;
+    }
+    k.doc = doc;
+    k.deprecated = deprecated;
+    k.mergePolicy = mergePolicy;
+    Q_FOREACH (const ContextProviderInfo &provider, providers) {
+        QString id = provider.plugin + QChar(0) + provider.constructionString;
+        QHash<QString, quint32>::const_iterator it = providerIndex.constFind(id);
+        if (it == providerIndex.constEnd()) {
+            it = providerIndex.insert(id, providerList.size());
+            providerList << provider;
+        }
+        k.providers << it.value();
+    }
+    keys << k;
+}
+
+namespace {
+
+/// Collects the strings and blobs of the file, storing each distinct
+/// one once.
+class Table
+{
+public:
+    StringRef add(const QByteArray &bytes)
+    {
+        StringRef ref;
+        ref.length = bytes.size();
+        if (bytes.isEmpty()) {
+            ref.offset = 0;
+            return ref;
+        }
+        QHash<QByteArray, quint32>::const_iterator it = offsets.constFind(bytes);
+        if (it == offsets.constEnd()) {
+            it = offsets.insert(bytes, data.size());
+            data += bytes;
+        }
+        ref.offset = it.value();
+        return ref;
+    }
+    StringRef add(const QString &string)
+    {
+        return add(string.toUtf8());
+    }
+
+    QByteArray data;
+
+private:
+    QHash<QByteArray, quint32> offsets;
+};
+
+bool biggerBucket(const QList<int> *a, const QList<int> *b)
+{
+    return a->size() > b->size();
+}
+
+void align(QByteArray &data)
+{
+    while (data.size() % 4)
+        data += '\0';
+}
+
+}
+
+/// Returns the contents of the file, or an empty array if the
+/// perfect hash cannot be built.
+QByteArray FlatRegistryWriter::data() const
+{
+    const quint32 n = keys.size();
+    QList<QByteArray> names;
+    Q_FOREACH (const Key &k, keys)
+        names << k.name.toUtf8();
+
+    // Build the perfect hash: bucket the keys by their hash with seed
+    // 0, then find a displacement for the buckets, biggest first,
+    // which puts all of their keys to free slots.
+    QVector<qint32> displacements(n, 0);
+    QVector<int> slotKeys(n, -1); // slot -> index in keys
+    if (n > 0) {
+        QVector<QList<int> > buckets(n);
+        for (quint32 i = 0; i < n; ++i)
+            buckets[hash(0, names.at(i).constData(), names.at(i).size()) % n] << i;
+        QList<QList<int> *> order;
+        for (quint32 b = 0; b < n; ++b)
+            order << &buckets[b];
+        std::stable_sort(order.begin(), order.end(), biggerBucket);
+
+        int freeSlot = 0;
+        Q_FOREACH (QList<int> *bucket, order) {
+            if (bucket->isEmpty())
+                break;
+            const int b = bucket - buckets.data();
+            if (bucket->size() == 1) {
+                // Singletons go to any free slot, directly.
+                while (slotKeys[freeSlot] != -1)
+                    ++freeSlot;
+                slotKeys[freeSlot] = bucket->first();
+                displacements[b] = -freeSlot - 1;
+                continue;
+            }
+            for (qint32 d = 1; ; ++d) {
+                if (d == 0x1000000) {
+                    contextWarning() << F_CDB << "Cannot build the perfect hash of the registry";
+                    return QByteArray();
+                }
+                QList<quint32> taken;
+                Q_FOREACH (int i, *bucket) {
+                    quint32 slot = hash(d, names.at(i).constData(), names.at(i).size()) % n;
+                    if (slotKeys[slot] != -1 || taken.contains(slot))
+                        break;
+                    taken << slot;
+                }
+                if (taken.size() != bucket->size())
+                    continue;
+                for (int j = 0; j < taken.size(); ++j)
+                    slotKeys[taken.at(j)] = bucket->at(j);
+                displacements[b] = d;
+                break;
+            }
+        }
+    }
+
+    Table strings;
+    Table blobs;
+    Header header;
+    header.magic = Magic;
+    header.version = Version;
+    header.compatibility = strings.add(compatibility);
+    header.generation = strings.add(generation);
+    header.keyCount = n;
+    header.providerCount = providerList.size();
+
+    QVector<KeyRecord> keyRecords(n);
+    QVector<quint32> providerRefs;
+    for (quint32 slot = 0; slot < n; ++slot) {
+        const Key &k = keys.at(slotKeys[slot]);
+        KeyRecord &record = keyRecords[slot];
+        record.name = strings.add(names.at(slotKeys[slot]));
+        record.doc = strings.add(k.doc);
+        record.mergePolicy = strings.add(k.mergePolicy);
+        record.flags = k.deprecated ? KeyDeprecated : 0;
+        record.firstProvider = providerRefs.size();
+        record.providerCount = k.providers.size();
+        Q_FOREACH (quint32 provider, k.providers)
+            providerRefs << provider;
+        StringRef typeInfo = blobs.add(k.typeInfo);
+        record.typeInfoOffset = typeInfo.offset;
+        record.typeInfoLength = typeInfo.length;
+    }
+    header.providerRefCount = providerRefs.size();
+
+    QVector<ProviderRecord> providerRecords;
+    Q_FOREACH (const ContextProviderInfo &provider, providerList) {
+        ProviderRecord record;
+        record.plugin = strings.add(provider.plugin);
+        record.constructionString = strings.add(provider.constructionString);
+        providerRecords << record;
+    }
+
+    // Lay out the file
+    QByteArray file(sizeof(Header), '\0');
+    header.keysOffset = file.size();
+    file.append((const char *) keyRecords.constData(), n * sizeof(KeyRecord));
+    header.displacementsOffset = file.size();
+    file.append((const char *) displacements.constData(), n * sizeof(qint32));
+    header.providersOffset = file.size();
+    file.append((const char *) providerRecords.constData(), providerRecords.size() * sizeof(ProviderRecord));
+    header.providerRefsOffset = file.size();
+    file.append((const char *) providerRefs.constData(), providerRefs.size() * sizeof(quint32));
+    header.stringsOffset = file.size();
+    header.stringsSize = strings.data.size();
+    file.append(strings.data);
+    align(file);
+    header.blobsOffset = file.size();
+    header.blobsSize = blobs.data.size();
+    file.append(blobs.data);
+    align(file);
+    header.fileSize = file.size();
+    memcpy(file.data(), &header, sizeof(Header));
+
+    return file;
+}
+
+/// Writes the file to \a fd.  Returns false on failure.
+bool FlatRegistryWriter::write(int fd) const
+{
+    const QByteArray file = data();
+    if (file.isEmpty())
+        return false;
+
+    const char *p = file.constData();
+    qint64 left = file.size();
+    while (left > 0) {
+        ssize_t written = ::write(fd, p, left);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            contextWarning() << F_CDB << "Cannot write the registry cache:" << strerror(errno);
+            return false;
+        }
+        p += written;
+        left -= written;
+    }
+    return true;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef FLATREGISTRYWRITER_H
+#define FLATREGISTRYWRITER_H
+
+#include <QString>
+#include <QVariant>
+#include <QList>
+#include <QHash>
+#include <QByteArray>
+#include "contextproviderinfo.h"
+
+class FlatRegistryWriter
+{
+public:
+    explicit FlatRegistryWriter(const QString &compatibility, const QString &generation = QString());
+
+    void addKey(const QString &key, const QVariant &typeInfo, const QString &doc,
+                bool deprecated, const QString &mergePolicy,
+                const QList<ContextProviderInfo> &providers);
+    QByteArray data() const;
+    bool write(int fd) const;
+
+private:
+    /// What we know about a key until the file is laid out
+    struct Key {
+        QString name;
+        QByteArray typeInfo;
+        QString doc;
+        bool deprecated;
+        QString mergePolicy;
+        QList<quint32> providers; ///< Indices in providerList
+    };
+
+    QString compatibility; ///< Written in the header, see BACKEND_COMPATIBILITY_NAMESPACE
+    QString generation; ///< Written in the header, the GENERATION of the matching cdb
+    QList<Key> keys;
+    QList<ContextProviderInfo> providerList; ///< The distinct providers
+    QHash<QString, quint32> providerIndex; ///< Plugin and construction string -> index in providerList
+};
+
+#endif
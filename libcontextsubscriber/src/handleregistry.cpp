@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "handleregistry.h"
+#include "atomics.h"
+
+#include <QHash>
+
+namespace ContextSubscriber {
+
+/*!
+  \class HandleRegistry
+
+  \brief Maps keys to their \c PropertyHandle.
+
+  Lookups never take a lock.  This works because handles are never
+  deleted, so the registry only ever grows: entries are published with
+  release stores into an open addressed table, and when the table gets
+  too full a bigger copy is published in its place.  The outgrown
+  tables are kept around, since a concurrent reader might still be
+  probing them; their total size is bounded by the size of the current
+  table.
+
+  Writers have to hold \c writeLock() around \c insert().
+*/
+
+HandleRegistry::Table::Table(int capacity)
+    : capacity(capacity), buckets(new QAtomicPointer<Entry>[capacity])
+{
+}
+
+HandleRegistry::HandleRegistry()
+    : table(new Table(64)), count(0)
+{
+}
+
+/// Returns the handle registered for \a key, or 0 if there is none
+/// yet.  Can be called from any thread without locking.
+PropertyHandle* HandleRegistry::find(const QString &key) const
+{
+    const uint hash = qHash(key);
+    const Table *t = loadAcquire(table);
+    const int mask = t->capacity - 1;
+
+    // The table is never more than half full, so this terminates.
+    for (int i = hash & mask; ; i = (i + 1) & mask) {
+        const Entry *entry = loadAcquire(t->buckets[i]);
+        if (entry == 0)
+            return 0;
+        if (entry->hash == hash && entry->key == key)
+            return entry->handle;
+    }
+}
+
+QMutex* HandleRegistry::writeLock()
+{
+    return &lock;
+}
+
+/// Registers \a handle for \a key.  The caller must hold \c
+/// writeLock() and must have checked that \a key is not registered
+/// yet.
+void HandleRegistry::insert(const QString &key, PropertyHandle *handle)
+{
+    ++count;
+
+    Table *t = loadAcquire(table);
+    if (count * 2 > t->capacity) {
+        Table *bigger = new Table(t->capacity * 2);
+        for (int i = 0; i < t->capacity; ++i) {
+            Entry *entry = loadAcquire(t->buckets[i]);
+            if (entry)
+                insertInto(bigger, entry);
+        }
+        storeRelease(table, bigger);
+        retiredTables << t;
+        t = bigger;
+    }
+    insertInto(t, new Entry(key, qHash(key), handle));
+}
+
+void HandleRegistry::insertInto(Table *table, Entry *entry)
+{
+    const int mask = table->capacity - 1;
+    int i = entry->hash & mask;
+    while (loadAcquire(table->buckets[i]) != 0)
+        i = (i + 1) & mask;
+    storeRelease(table->buckets[i], entry);
+}
+
+} // end namespace
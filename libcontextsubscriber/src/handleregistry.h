@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef HANDLEREGISTRY_H
+#define HANDLEREGISTRY_H
+
+#include <QString>
+#include <QList>
+#include <QMutex>
+#include <QAtomicPointer>
+
+namespace ContextSubscriber {
+
+class PropertyHandle;
+
+class HandleRegistry
+{
+public:
+    HandleRegistry();
+
+    PropertyHandle* find(const QString &key) const;
+
+    QMutex* writeLock();
+    void insert(const QString &key, PropertyHandle *handle);
+
+private:
+    struct Entry
+    {
+        Entry(const QString &key, uint hash, PropertyHandle *handle)
+            : key(key), hash(hash), handle(handle)
+            { }
+        const QString key;
+        const uint hash;
+        PropertyHandle * const handle;
+    };
+
+    struct Table
+    {
+        explicit Table(int capacity);
+        const int capacity; ///< Always a power of two
+        QAtomicPointer<Entry> *buckets;
+    };
+
+    static void insertInto(Table *table, Entry *entry);
+
+    QMutex lock; ///< Serializes the writers; readers never take it
+    QAtomicPointer<Table> table; ///< Open addressed key -> handle table
+    QList<Table*> retiredTables; ///< Outgrown tables, readers might still probe them
+    int count; ///< Number of handles inserted so far
+};
+
+} // end namespace
+
+#endif
@@ -21,6 +21,7 @@
 
 #include "handlesignalrouter.h"
 #include "propertyhandle.h"
+#include "provider.h"
 
 namespace ContextSubscriber {
 
@@ -33,6 +34,11 @@ namespace ContextSubscriber {
 
   This is an optimization, so we don't have to connect all of the
   providers to all of the <tt>PropertyHandle</tt>s of that provider.
+
+  New values are not signalled but handed over directly: the \c
+  Provider already knows the handle from the key's \c ProviderSlot, so
+  there is nothing to look up.  The slot itself is passed on, so that
+  the handle only has to look at the value which changed.
 */
 
 
@@ -47,10 +53,9 @@ HandleSignalRouter* HandleSignalRouter::instance()
     return &myInstance;
 }
 
-void HandleSignalRouter::onValueChanged(QString key)
+void HandleSignalRouter::onValueChanged(ProviderSlot *slot)
 {
-    PropertyHandle* handle = PropertyHandle::instance(key);
-    handle->onValueChanged();
+    slot->handle->onValueChanged(slot);
 }
 
 void HandleSignalRouter::onSubscribeFinished(Provider *provider, QString key)
@@ -29,15 +29,17 @@
 namespace ContextSubscriber {
 
 class Provider;
+class PropertyHandle;
+struct ProviderSlot;
 
 class HandleSignalRouter : public QObject
 {
     Q_OBJECT
 public:
     static HandleSignalRouter* instance();
+    void onValueChanged(ProviderSlot *slot);
 
 public Q_SLOTS:
-    void onValueChanged(QString key);
     void onSubscribeFinished(Provider *provider, QString key);
 
 private:
@@ -22,7 +22,11 @@
 #include "infobackend.h"
 #include "infoxmlbackend.h"
 #include "infocdbbackend.h"
+#include "infoflatbackend.h"
 #include <QMutex>
+#include <QSet>
+#include <QDataStream>
+#include <QCryptographicHash>
 #include <QDebug>
 #include <QCoreApplication>
 #include <QMutexLocker>
@@ -50,7 +54,9 @@ InfoBackend::InfoBackend(QObject *parent) : QObject(parent)
 
 /// Returns the actual singleton instance, creates it on first access. Mutex-protected.
 /// ContextRegistryInfo and ContextPropertyInfo use this method to access the backend.
-/// The optional \a backendName specifies the backend to force, ie: 'xml' or 'cdb'.
+/// The optional \a backendName specifies the backend to force, ie: 'xml', 'cdb' or
+/// 'flat'.  Otherwise the flat cache is used if it matches the cdb database, then
+/// the cdb database, then the xml files.
 InfoBackend* InfoBackend::instance(const QString &backendName)
 {
     static QMutex mutex;
@@ -62,8 +68,12 @@ InfoBackend* InfoBackend::instance(const QString &backendName)
             backendInstance = new InfoXmlBackend;
         else if (backendName == "cdb")
             backendInstance = new InfoCdbBackend;
+        else if (backendName == "flat")
+            backendInstance = new InfoFlatBackend;
         else {
-            if (InfoCdbBackend::databaseExists())
+            if (InfoFlatBackend::databaseUsable())
+                backendInstance = new InfoFlatBackend;
+            else if (InfoCdbBackend::databaseExists())
                 backendInstance = new InfoCdbBackend;
             else
                 backendInstance = new InfoXmlBackend;
@@ -93,9 +103,10 @@ InfoBackend* InfoBackend::instance(const QString &backendName)
 void InfoBackend::checkAndEmitKeysAdded(const QStringList &currentKeys,
                                         const QStringList &oldKeys)
 {
+    const QSet<QString> oldSet = oldKeys.toSet();
     QStringList addedKeys;
-    Q_FOREACH (QString key, currentKeys) {
-        if (! oldKeys.contains(key))
+    Q_FOREACH (const QString &key, currentKeys) {
+        if (! oldSet.contains(key))
             addedKeys << key;
     }
 
@@ -109,10 +120,10 @@ void InfoBackend::checkAndEmitKeysAdded(const QStringList &currentKeys,
 void InfoBackend::checkAndEmitKeysRemoved(const QStringList &currentKeys,
                                           const QStringList &oldKeys)
 {
-
+    const QSet<QString> currentSet = currentKeys.toSet();
     QStringList removedKeys;
-    Q_FOREACH (QString key, oldKeys) {
-        if (! currentKeys.contains(key))
+    Q_FOREACH (const QString &key, oldKeys) {
+        if (! currentSet.contains(key))
             removedKeys << key;
     }
     if (removedKeys.size() > 0)
@@ -124,14 +135,92 @@ void InfoBackend::checkAndEmitKeysRemoved(const QStringList &currentKeys,
 void InfoBackend::checkAndEmitKeyChanged(const QStringList &currentKeys,
                                          const QStringList &oldKeys)
 {
-    Q_FOREACH(QString key, oldKeys) {
-        Q_EMIT keyChanged(key);
+    Q_FOREACH(const QString &key, oldKeys) {
+        emitKeyChanged(key);
+    }
+
+    const QSet<QString> oldSet = oldKeys.toSet();
+    Q_FOREACH(const QString &key, currentKeys) {
+        if (! oldSet.contains(key))
+            emitKeyChanged(key);
+    }
+}
+
+/// Emits keyChanged for \a key, both from the backend and from the
+/// notifier of the key, if somebody asked for one.
+void InfoBackend::emitKeyChanged(const QString &key)
+{
+    Q_EMIT keyChanged(key);
+
+    InfoKeyNotifier *notifier;
+    {
+        QMutexLocker locker(&notifiersLock);
+        notifier = notifiers.value(key);
     }
+    if (notifier)
+        Q_EMIT notifier->keyChanged(key);
+}
 
-    Q_FOREACH(QString key, currentKeys) {
-        if (! oldKeys.contains(key))
-            Q_EMIT keyChanged(key);
+/// Returns an object which emits \c keyChanged(QString) only when the
+/// data/info of \a key changes.  ContextPropertyInfo instances connect
+/// to this instead of the keyChanged signal of the backend, so that a
+/// registry change is delivered only to the ones interested in it.
+/// The notifier is owned by the backend, and it's shared by everybody
+/// asking for the same key.
+QObject *InfoBackend::keyNotifier(const QString &key)
+{
+    QMutexLocker locker(&notifiersLock);
+    InfoKeyNotifier *notifier = notifiers.value(key);
+    if (!notifier) {
+        notifier = new InfoKeyNotifier(this);
+        notifiers.insert(key, notifier);
     }
+    return notifier;
+}
+
+/// Given the \a currentDigests and \a oldDigests (see keyDigests()),
+/// emit a keyChanged signal for the keys which were added, removed, or
+/// whose registry records differ.  Keys whose records are the same in
+/// both don't get a signal, so their properties won't refetch their
+/// providers.
+void InfoBackend::checkAndEmitKeyChanged(const QHash<QString, QByteArray> &currentDigests,
+                                         const QHash<QString, QByteArray> &oldDigests)
+{
+    QHash<QString, QByteArray>::const_iterator it;
+    for (it = oldDigests.constBegin(); it != oldDigests.constEnd(); ++it) {
+        QHash<QString, QByteArray>::const_iterator current = currentDigests.constFind(it.key());
+        if (current == currentDigests.constEnd() || current.value() != it.value())
+            emitKeyChanged(it.key());
+    }
+
+    for (it = currentDigests.constBegin(); it != currentDigests.constEnd(); ++it) {
+        if (! oldDigests.contains(it.key()))
+            emitKeyChanged(it.key());
+    }
+}
+
+/// Returns a digest of everything the registry says about \a key: two
+/// registries describe the key the same way if and only if the digests
+/// are equal.  The default implementation hashes the decoded
+/// information; backends which can do it cheaper reimplement this.
+QByteArray InfoBackend::keyDigest(const QString &key) const
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << typeInfoForKey(key).dump() << docForKey(key)
+           << keyDeprecated(key) << mergePolicyForKey(key);
+    Q_FOREACH (const ContextProviderInfo &info, providersForKey(key))
+        stream << info.plugin << info.constructionString;
+    return QCryptographicHash::hash(data, QCryptographicHash::Md5);
+}
+
+/// Returns the keyDigest() of each key in the registry.
+QHash<QString, QByteArray> InfoBackend::keyDigests() const
+{
+    QHash<QString, QByteArray> digests;
+    Q_FOREACH (const QString &key, listKeys())
+        digests.insert(key, keyDigest(key));
+    return digests;
 }
 
 /* Protected */
@@ -177,3 +266,45 @@ void __attribute__((destructor)) library_dtor()
     qRemovePostRoutine(InfoBackend::destroyInstance);
     InfoBackend::destroyInstance();
 }
+
+/*!
+    \class InfoKeyNotifier
+
+    \brief Emits the keyChanged signal of InfoBackend for one key.
+
+    This class is not exported in the public API. The instances are
+    created by InfoBackend::keyNotifier() and live in the thread of the
+    backend.  The connections to a notifier count as connections to the
+    backend, so that the backend doesn't skip computing the changes
+    when only notifiers are listened to.
+*/
+
+/// Constructs a notifier of \a backend, in the thread of the backend.
+InfoKeyNotifier::InfoKeyNotifier(InfoBackend *backend)
+    : backend(backend)
+{
+    moveToThread(backend->thread());
+    setParent(backend);
+}
+
+/// Counts the connection as a connection to the backend.
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+void InfoKeyNotifier::connectNotify(const char *signal)
+#else
+void InfoKeyNotifier::connectNotify(const QMetaMethod &signal)
+#endif
+{
+    QObject::connectNotify(signal);
+    backend->connectCount++;
+}
+
+/// Counts the disconnection as a disconnection from the backend.
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+void InfoKeyNotifier::disconnectNotify(const char *signal)
+#else
+void InfoKeyNotifier::disconnectNotify(const QMetaMethod &signal)
+#endif
+{
+    QObject::disconnectNotify(signal);
+    backend->connectCount--;
+}
@@ -24,7 +24,10 @@
 
 #include <QVariant>
 #include <QStringList>
+#include <QHash>
+#include <QByteArray>
 #include <QObject>
+#include <QMutex>
 #include <QMetaMethod>
 
 #include "contextproviderinfo.h"
@@ -32,6 +35,34 @@
 
 #define BACKEND_COMPATIBILITY_NAMESPACE "http://contextkit.freedesktop.org/Provider"
 
+class InfoBackend;
+
+class InfoKeyNotifier : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit InfoKeyNotifier(InfoBackend *backend);
+
+Q_SIGNALS:
+    /// Emitted when the data/info of the key of this notifier changes.
+    void keyChanged(const QString& key);
+
+protected:
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+    virtual void connectNotify(const char *signal);
+    virtual void disconnectNotify(const char *signal);
+#else
+    virtual void connectNotify(const QMetaMethod &signal);
+    virtual void disconnectNotify(const QMetaMethod &signal);
+#endif
+
+private:
+    InfoBackend *backend; ///< The backend owning this notifier.
+
+    friend class InfoBackend;
+};
+
 class InfoBackend : public QObject
 {
     Q_OBJECT
@@ -59,9 +90,17 @@ public:
     /// Returns true if the given key is deprecated.
     virtual bool keyDeprecated(QString key) const = 0;
 
+    /// Returns the merge policy of the given \a key, or an empty string.
+    virtual QString mergePolicyForKey(QString key) const = 0;
+
     /// Returns a list of providers for the given key.
     virtual const QList<ContextProviderInfo> providersForKey(QString key) const = 0;
 
+    virtual QByteArray keyDigest(const QString &key) const;
+    QHash<QString, QByteArray> keyDigests() const;
+
+    QObject *keyNotifier(const QString &key);
+
 Q_SIGNALS:
     /// Emitted when key list changes. ContextRegistryInfo listens on that.
     void keysChanged(const QStringList& currentKeys);
@@ -89,6 +128,8 @@ protected:
 
 private:
     int connectCount; ///< Number of connections to signals. Used to optimized signal emission when 0.
+    QMutex notifiersLock; ///< Protects notifiers
+    QHash<QString, InfoKeyNotifier*> notifiers; ///< The notifiers returned by keyNotifier(), by key
 
     InfoBackend(QObject *parent = 0);
 
@@ -98,14 +139,19 @@ private:
     void checkAndEmitKeysAdded(const QStringList &currentKeys, const QStringList &oldKeys);
     void checkAndEmitKeysRemoved(const QStringList &currentKeys, const QStringList &oldKeys);
     void checkAndEmitKeyChanged(const QStringList &currentKeys, const QStringList &oldKeys);
+    void checkAndEmitKeyChanged(const QHash<QString, QByteArray> &currentDigests,
+                                const QHash<QString, QByteArray> &oldDigests);
+    void emitKeyChanged(const QString &key);
 
     /// Private operator. Do not use.
     InfoBackend& operator=(const InfoBackend&);
 
     static InfoBackend* backendInstance; ///< Holds a pointer to the instance of the singleton.
 
+    friend class InfoKeyNotifier;
     friend class InfoXmlBackend;
     friend class InfoCdbBackend;
+    friend class InfoFlatBackend;
     friend class InfoTestBackend;
     friend class InfoXmlBackendUnitTest;
     friend class InfoCdbBackendUnitTest;
@@ -23,6 +23,7 @@
 #include <QDebug>
 #include <QFile>
 #include <QHash>
+#include <QCryptographicHash>
 #include <sys/stat.h>
 #include <stdlib.h>
 #include "sconnect.h"
@@ -36,22 +37,33 @@
 
     \brief Implements the InfoBackend for reading data from a cdb database.
 
-    This class is not exported in the public API. It does not cache any data
-    to optimize the memory consumption. It's assumed that most data is anyways
-    cached (as needed) in the ContextPropertyInfo and the cdb key-based access
-    (no enumetation) is fast anyways. It observers the \c cache.cdb
-    with a file system watcher.
+    This class is not exported in the public API. Everything except the
+    key list is read from the database on each call: most data is cached
+    (as needed) in the ContextPropertyInfo anyways, and the cdb key-based
+    access is fast. The key list is decoded once for each generation of
+    the database and kept for listKeys(), and for keyDeclared() on old
+    databases. It observes the \c cache.cdb with a file system watcher.
+
+    Databases written by newer versions of \c update-contextkit-providers
+    have a \c KEY:KEYDECLARED record for each key, and keyDeclared() looks
+    that up without decoding anything.  With older databases, it looks the
+    key up in the cached key list.
 */
 
-InfoCdbBackend::InfoCdbBackend(QObject *parent)
-    : InfoBackend(parent), reader(InfoCdbBackend::databasePath()), lastInode(0)
+/// Constructs the backend.  Unless \a watching is false, the database
+/// is reopened when it changes; InfoFlatBackend uses a backend which
+/// isn't watching as its fallback, and replaces it instead.
+InfoCdbBackend::InfoCdbBackend(QObject *parent, bool watching)
+    : InfoBackend(parent), watcher(0), reader(InfoCdbBackend::databasePath()), keyRecords(false),
+      lastInode(0), keysCached(false)
 {
-    watcher = new QFileSystemWatcher();
     contextDebug() << F_CDB << "Initializing cdb backend with database:" << InfoCdbBackend::databasePath();
 
-    sconnect(watcher, SIGNAL(directoryChanged(QString)), this, SLOT(onDatabaseDirectoryChanged(QString)));
-
-    watcher->addPath(InfoCdbBackend::databaseDirectory());
+    if (watching) {
+        watcher = new QFileSystemWatcher();
+        sconnect(watcher, SIGNAL(directoryChanged(QString)), this, SLOT(onDatabaseDirectoryChanged(QString)));
+        watcher->addPath(InfoCdbBackend::databaseDirectory());
+    }
 
     checkCompatibility();
 
@@ -83,12 +95,25 @@ QStringList InfoCdbBackend::variantListToStringList(const QVariantList &l)
     return ret;
 }
 
-QStringList InfoCdbBackend::listKeys() const
+/// Decodes the KEYS records of the database, if not done since it was
+/// opened.
+void InfoCdbBackend::cacheKeys() const
 {
+    if (keysCached)
+        return;
     if (databaseCompatible)
-        return variantListToStringList(reader.valuesForKey("KEYS"));
+        cachedKeys = variantListToStringList(reader.valuesForKey("KEYS"));
     else
-        return QStringList();
+        cachedKeys.clear();
+    cachedKeySet = cachedKeys.toSet();
+    keysCached = true;
+}
+
+QStringList InfoCdbBackend::listKeys() const
+{
+    QMutexLocker locker(&keysLock);
+    cacheKeys();
+    return cachedKeys;
 }
 
 QString InfoCdbBackend::docForKey(QString key) const
@@ -103,10 +128,12 @@ bool InfoCdbBackend::keyDeclared(QString key) const
 {
     if (!databaseCompatible)
         return false;
-    else if (reader.valuesForKey("KEYS").contains(key))
-        return true;
-    else
-        return false;
+    else if (keyRecords)
+        return reader.contains(key + ":KEYDECLARED");
+
+    QMutexLocker locker(&keysLock);
+    cacheKeys();
+    return cachedKeySet.contains(key);
 }
 
 bool InfoCdbBackend::keyDeprecated(QString key) const
@@ -117,6 +144,14 @@ bool InfoCdbBackend::keyDeprecated(QString key) const
         return false;
 }
 
+QString InfoCdbBackend::mergePolicyForKey(QString key) const
+{
+    if (databaseCompatible)
+        return reader.valueForKey(key + ":KEYMERGE").toString();
+    else
+        return "";
+}
+
 /// Returns true if the database file is present.
 bool InfoCdbBackend::databaseExists()
 {
@@ -124,6 +159,17 @@ bool InfoCdbBackend::databaseExists()
     return file.exists();
 }
 
+/// Returns the GENERATION record of the database, which is also in
+/// the flat cache written together with it, or an empty string if the
+/// database doesn't have one or can't be read.
+QString InfoCdbBackend::databaseGeneration()
+{
+    CDBReader reader(databasePath());
+    if (!reader.isReadable())
+        return QString();
+    return reader.valueForKey("GENERATION").toString();
+}
+
 /// Returns the full path to the database.
 /// Takes the \c CONTEXT_PROVIDERS env variable into account.
 QString InfoCdbBackend::databasePath()
@@ -161,6 +207,7 @@ void InfoCdbBackend::checkCompatibility()
         } else
             databaseCompatible = true;
     }
+    keyRecords = databaseCompatible && reader.contains("KEYDECLARED");
 }
 
 /* Slots */
@@ -183,6 +230,12 @@ void InfoCdbBackend::onDatabaseDirectoryChanged(const QString &path)
         lastInode = inode;
 
         QStringList oldKeys = listKeys();
+        // Digest the records of the old database while it's still
+        // open, so that only the keys which really changed get a
+        // keyChanged signal.
+        QHash<QString, QByteArray> oldDigests;
+        if (connectCount != 0)
+            oldDigests = keyDigests();
 
         contextDebug() << F_CDB << InfoCdbBackend::databasePath() << "File changed, re-opening database.";
 
@@ -192,6 +245,11 @@ void InfoCdbBackend::onDatabaseDirectoryChanged(const QString &path)
         if (reader.isReadable())
             checkCompatibility();
 
+        {
+            QMutexLocker locker(&keysLock);
+            keysCached = false;
+        }
+
         // If nobody is watching us anyways, drop out now and skip
         // the further processing. This could be made more granular
         // (ie. in many cases nobody will be watching on added/removed)
@@ -206,22 +264,24 @@ void InfoCdbBackend::onDatabaseDirectoryChanged(const QString &path)
         Q_EMIT keysChanged(listKeys()); // DEPRECATED emission
 
         Q_EMIT listChanged();
-        checkAndEmitKeyChanged(currentKeys, oldKeys);
+        checkAndEmitKeyChanged(keyDigests(), oldDigests);
     }
 
 }
 
 const QList<ContextProviderInfo> InfoCdbBackend::providersForKey(QString key) const
 {
-    QVariant providers = reader.valueForKey(key + ":PROVIDERS");
     QList<ContextProviderInfo> lst;
 
     if (!databaseCompatible)
         return lst;
 
-    Q_FOREACH (QVariant variant, providers.toList())
-        lst << ContextProviderInfo(variant.toHash().value("plugin").toString(),
-                                   variant.toHash().value("constructionString").toString());
+    const QVariantList providers = reader.valueForKey(key + ":PROVIDERS").toList();
+    Q_FOREACH (const QVariant &variant, providers) {
+        const QHash<QString, QVariant> provider = variant.toHash();
+        lst << ContextProviderInfo(provider.value("plugin").toString(),
+                                   provider.value("constructionString").toString());
+    }
 
     return lst;
 }
@@ -230,3 +290,28 @@ ContextTypeInfo InfoCdbBackend::typeInfoForKey(QString key) const
 {
     return ContextTypeInfo(reader.valueForKey(key + ":KEYTYPEINFO"));
 }
+
+/// Hashes the records of \a key as they are stored in the database,
+/// without decoding them.  The providers are decoded though, because
+/// the order of the serialized provider hashes is not stable.
+QByteArray InfoCdbBackend::keyDigest(const QString &key) const
+{
+    if (!databaseCompatible)
+        return QByteArray();
+
+    static const char *records[] = { ":KEYTYPEINFO", ":KEYDOC", ":KEYDEPRECATED", ":KEYMERGE" };
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    for (unsigned i = 0; i < sizeof(records) / sizeof(records[0]); ++i) {
+        const QByteArray raw = reader.rawValueForKey(key + records[i]);
+        const quint32 size = raw.isNull() ? 0xffffffff : raw.size();
+        hash.addData((const char *) &size, sizeof(size));
+        hash.addData(raw);
+    }
+    Q_FOREACH (const ContextProviderInfo &info, providersForKey(key)) {
+        hash.addData(info.plugin.toUtf8());
+        hash.addData("", 1);
+        hash.addData(info.constructionString.toUtf8());
+        hash.addData("", 1);
+    }
+    return hash.result();
+}
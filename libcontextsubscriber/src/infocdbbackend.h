@@ -26,6 +26,8 @@
 #include <QStringList>
 #include <QObject>
 #include <QString>
+#include <QSet>
+#include <QMutex>
 #include "cdbreader.h"
 #include "infobackend.h"
 #include "contextproviderinfo.h"
@@ -35,28 +37,37 @@ class InfoCdbBackend : public InfoBackend
     Q_OBJECT
 
 public:
-    explicit InfoCdbBackend(QObject *parent = 0);
+    explicit InfoCdbBackend(QObject *parent = 0, bool watching = true);
     ~InfoCdbBackend();
     virtual QString name() const;
     virtual QStringList listKeys() const;
     virtual QString docForKey(QString key) const;
     virtual bool keyDeclared(QString key) const;
     virtual bool keyDeprecated(QString key) const;
+    virtual QString mergePolicyForKey(QString key) const;
     virtual const QList<ContextProviderInfo> providersForKey(QString key) const;
     virtual ContextTypeInfo typeInfoForKey(QString key) const;
+    virtual QByteArray keyDigest(const QString &key) const;
 
     static QString databaseDirectory();
     static QString databasePath();
     static bool databaseExists();
+    static QString databaseGeneration();
 
 private:
     QFileSystemWatcher *watcher; ///< A watched object obsering the database file. Delivers synced notifications.
     CDBReader reader; ///< The cdb reader object used to access the cdb database.
     bool databaseCompatible; ///< If the currently open database is compatible (versions match).
+    bool keyRecords; ///< If the currently open database has a KEYDECLARED record for each key.
     quint64 lastInode;
+    mutable QMutex keysLock; ///< Protects the cached key list
+    mutable bool keysCached; ///< If cachedKeys and cachedKeySet are filled in
+    mutable QStringList cachedKeys; ///< The KEYS of the currently open database
+    mutable QSet<QString> cachedKeySet; ///< cachedKeys, for lookups
     void watch();
     static QStringList variantListToStringList(const QVariantList &l);
     void checkCompatibility();
+    void cacheKeys() const;
 
 private Q_SLOTS:
     void onDatabaseDirectoryChanged(const QString &path);
@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QMutexLocker>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <sys/stat.h>
+#include "sconnect.h"
+#include "infoflatbackend.h"
+#include "infocdbbackend.h"
+#include "logging.h"
+#include "loggingfeatures.h"
+
+/*!
+    \class InfoFlatBackend
+
+    \brief Implements the InfoBackend for reading data from the flat
+    registry cache.
+
+    This class is not exported in the public API. The flat cache
+    (\c cache.flat, written by \c update-contextkit-providers next to
+    \c cache.cdb) is mapped to memory by a FlatRegistryReader and read
+    in place; only the list of keys is cached, decoded once for each
+    version of the file. It's preferred over the cdb backend when the
+    file matches the cdb database, and observes both files with a file
+    system watcher like InfoCdbBackend does.
+
+    The cache is used only while its generation is the same as the
+    one of \c cache.cdb.  When it's missing, or left behind by an
+    update which replaced only the database, the questions are
+    answered by an InfoCdbBackend instead, until a matching cache
+    appears.  The mapping is replaced under a write lock, so the
+    readers in other threads never see it unmapped.
+*/
+
+InfoFlatBackend::InfoFlatBackend(QObject *parent)
+    : InfoBackend(parent), reader(new FlatRegistryReader(InfoFlatBackend::databasePath())),
+      fallback(0), keysCached(false)
+{
+    watcher = new QFileSystemWatcher();
+    contextDebug() << F_CDB << "Initializing flat backend with cache:" << InfoFlatBackend::databasePath();
+
+    sconnect(watcher, SIGNAL(directoryChanged(QString)), this, SLOT(onDatabaseDirectoryChanged(QString)));
+
+    watcher->addPath(InfoCdbBackend::databaseDirectory());
+
+    if (!isUsable(*reader)) {
+        reader->close();
+        fallback = new InfoCdbBackend(0, false);
+    }
+
+    lastInode = inodeOf(InfoFlatBackend::databasePath());
+    lastCdbInode = inodeOf(InfoCdbBackend::databasePath());
+}
+
+InfoFlatBackend::~InfoFlatBackend()
+{
+    if (QCoreApplication::instance() != 0)
+        delete(watcher);
+    delete fallback;
+    delete reader;
+}
+
+/// Returns 'flat'.
+QString InfoFlatBackend::name() const
+{
+    return QString("flat");
+}
+
+QStringList InfoFlatBackend::listKeys() const
+{
+    QReadLocker locker(&lock);
+    if (fallback)
+        return fallback->listKeys();
+
+    QMutexLocker keysLocker(&keysLock);
+    if (!keysCached) {
+        cachedKeys.clear();
+        for (int i = 0; i < reader->keyCount(); ++i)
+            cachedKeys << reader->keyName(i);
+        keysCached = true;
+    }
+    return cachedKeys;
+}
+
+QString InfoFlatBackend::docForKey(QString key) const
+{
+    QReadLocker locker(&lock);
+    if (fallback)
+        return fallback->docForKey(key);
+    int index = reader->indexOf(key);
+    return index < 0 ? QString() : reader->doc(index);
+}
+
+bool InfoFlatBackend::keyDeclared(QString key) const
+{
+    QReadLocker locker(&lock);
+    if (fallback)
+        return fallback->keyDeclared(key);
+    return reader->indexOf(key) >= 0;
+}
+
+bool InfoFlatBackend::keyDeprecated(QString key) const
+{
+    QReadLocker locker(&lock);
+    if (fallback)
+        return fallback->keyDeprecated(key);
+    int index = reader->indexOf(key);
+    return index < 0 ? false : reader->deprecated(index);
+}
+
+QString InfoFlatBackend::mergePolicyForKey(QString key) const
+{
+    QReadLocker locker(&lock);
+    if (fallback)
+        return fallback->mergePolicyForKey(key);
+    int index = reader->indexOf(key);
+    return index < 0 ? QString("") : reader->mergePolicy(index);
+}
+
+const QList<ContextProviderInfo> InfoFlatBackend::providersForKey(QString key) const
+{
+    QReadLocker locker(&lock);
+    if (fallback)
+        return fallback->providersForKey(key);
+    int index = reader->indexOf(key);
+    return index < 0 ? QList<ContextProviderInfo>() : reader->providers(index);
+}
+
+ContextTypeInfo InfoFlatBackend::typeInfoForKey(QString key) const
+{
+    QReadLocker locker(&lock);
+    if (fallback)
+        return fallback->typeInfoForKey(key);
+    int index = reader->indexOf(key);
+    return index < 0 ? ContextTypeInfo() : ContextTypeInfo(reader->typeInfo(index));
+}
+
+/// Hashes the record of \a key straight from the mapping; the type
+/// info is hashed without decoding it.
+QByteArray InfoFlatBackend::keyDigest(const QString &key) const
+{
+    QReadLocker locker(&lock);
+    if (fallback)
+        return fallback->keyDigest(key);
+    int index = reader->indexOf(key);
+    if (index < 0)
+        return QByteArray();
+
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << reader->rawTypeInfo(index) << reader->doc(index)
+           << reader->deprecated(index) << reader->mergePolicy(index);
+    Q_FOREACH (const ContextProviderInfo &info, reader->providers(index))
+        stream << info.plugin << info.constructionString;
+    return QCryptographicHash::hash(data, QCryptographicHash::Md5);
+}
+
+/// Returns true if the cache file is present.
+bool InfoFlatBackend::databaseExists()
+{
+    QFile file(databasePath());
+    return file.exists();
+}
+
+/// Returns true if the cache file is valid, compatible, and was
+/// written together with the current cdb database.
+bool InfoFlatBackend::databaseUsable()
+{
+    FlatRegistryReader reader(databasePath());
+    return isUsable(reader);
+}
+
+/// Returns the full path to the cache file, next to the cdb database.
+/// Takes the \c CONTEXT_PROVIDERS env variable into account.
+QString InfoFlatBackend::databasePath()
+{
+    return QDir(InfoCdbBackend::databaseDirectory()).filePath("cache.flat");
+}
+
+/* Private */
+
+/// Returns true if \a reader has a valid and compatible cache, with the
+/// same generation as the cdb database.
+bool InfoFlatBackend::isUsable(const FlatRegistryReader &reader)
+{
+    if (!reader.isReadable())
+        return false;
+
+    QString version = reader.compatibility();
+    if (version != BACKEND_COMPATIBILITY_NAMESPACE) {
+        contextWarning() << F_CDB << "Incompatible registry cache version:" << version;
+        return false;
+    }
+
+    // A cache without a generation was written before the database had
+    // one; a different one is left behind by an update which replaced
+    // only the database.
+    QString generation = reader.generation();
+    if (generation.isEmpty() || generation != InfoCdbBackend::databaseGeneration()) {
+        contextDebug() << F_CDB << "Registry cache doesn't match the database:" << generation;
+        return false;
+    }
+    return true;
+}
+
+/// Returns the inode of the file at \a path, or 0 if it doesn't exist.
+quint64 InfoFlatBackend::inodeOf(const QString &path)
+{
+    struct stat buffer;
+    if (!stat(path.toUtf8(), &buffer))
+        return buffer.st_ino;
+    return 0;
+}
+
+/// Returns the keyDigest() of each key as InfoBackend computes it from
+/// the decoded information.  Unlike the cheap digests, these are the
+/// same whether the cache or the cdb database answers.
+QHash<QString, QByteArray> InfoFlatBackend::decodedKeyDigests() const
+{
+    QHash<QString, QByteArray> digests;
+    Q_FOREACH (const QString &key, listKeys())
+        digests.insert(key, InfoBackend::keyDigest(key));
+    return digests;
+}
+
+/* Slots */
+
+/// Called when the database directory changes. Remaps the cache, or
+/// switches to the cdb database if the cache doesn't match it, and
+/// emits the change signals if the inode of either file has been
+/// modified.
+void InfoFlatBackend::onDatabaseDirectoryChanged(const QString &path)
+{
+    Q_UNUSED(path);
+    contextDebug() << F_CDB << InfoCdbBackend::databaseDirectory() << "Directory changed.";
+
+    quint64 inode = inodeOf(InfoFlatBackend::databasePath());
+    quint64 cdbInode = inodeOf(InfoCdbBackend::databasePath());
+    if (lastInode == inode && lastCdbInode == cdbInode)
+        return;
+    lastInode = inode;
+    lastCdbInode = cdbInode;
+
+    contextDebug() << F_CDB << InfoFlatBackend::databasePath() << "File changed, re-mapping cache.";
+
+    // Open the new cache (or the database) before dropping the old
+    // one, so that the readers always have one of them.
+    FlatRegistryReader *newReader = new FlatRegistryReader(InfoFlatBackend::databasePath());
+    InfoCdbBackend *newFallback = 0;
+    if (!isUsable(*newReader)) {
+        newReader->close();
+        newFallback = new InfoCdbBackend(0, false);
+    }
+
+    // The cheap digests of the cache and of the database differ, so
+    // compare the decoded records when switching between them.
+    const bool switching = (fallback == 0) != (newFallback == 0);
+
+    QStringList oldKeys = listKeys();
+    // Digest the records of the old cache while it's still
+    // mapped, so that only the keys which really changed get a
+    // keyChanged signal.
+    QHash<QString, QByteArray> oldDigests;
+    if (connectCount != 0)
+        oldDigests = switching ? decodedKeyDigests() : keyDigests();
+
+    FlatRegistryReader *oldReader;
+    InfoCdbBackend *oldFallback;
+    {
+        QWriteLocker locker(&lock);
+        oldReader = reader;
+        oldFallback = fallback;
+        reader = newReader;
+        fallback = newFallback;
+
+        QMutexLocker keysLocker(&keysLock);
+        keysCached = false;
+    }
+    // Nobody is reading them anymore
+    delete oldReader;
+    delete oldFallback;
+
+    // If nobody is watching us anyways, drop out now and skip
+    // the further processing.
+    if (connectCount == 0)
+        return;
+
+    QStringList currentKeys = listKeys();
+    // Emissions
+    checkAndEmitKeysAdded(currentKeys, oldKeys); // DEPRECATED emission
+    checkAndEmitKeysRemoved(currentKeys, oldKeys); // DEPRECATED emission
+    Q_EMIT keysChanged(currentKeys); // DEPRECATED emission
+
+    Q_EMIT listChanged();
+    checkAndEmitKeyChanged(switching ? decodedKeyDigests() : keyDigests(), oldDigests);
+}
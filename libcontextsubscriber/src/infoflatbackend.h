@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef INFOFLATBACKEND_H
+#define INFOFLATBACKEND_H
+
+#include <QFileSystemWatcher>
+#include <QStringList>
+#include <QObject>
+#include <QString>
+#include <QMutex>
+#include <QReadWriteLock>
+#include "flatregistryreader.h"
+#include "infobackend.h"
+#include "contextproviderinfo.h"
+
+class InfoCdbBackend;
+
+class InfoFlatBackend : public InfoBackend
+{
+    Q_OBJECT
+
+public:
+    explicit InfoFlatBackend(QObject *parent = 0);
+    ~InfoFlatBackend();
+    virtual QString name() const;
+    virtual QStringList listKeys() const;
+    virtual QString docForKey(QString key) const;
+    virtual bool keyDeclared(QString key) const;
+    virtual bool keyDeprecated(QString key) const;
+    virtual QString mergePolicyForKey(QString key) const;
+    virtual const QList<ContextProviderInfo> providersForKey(QString key) const;
+    virtual ContextTypeInfo typeInfoForKey(QString key) const;
+    virtual QByteArray keyDigest(const QString &key) const;
+
+    static QString databasePath();
+    static bool databaseExists();
+    static bool databaseUsable();
+
+private:
+    QFileSystemWatcher *watcher; ///< A watched object obsering the database directory.
+    FlatRegistryReader *reader; ///< The reader of the mapped cache file.
+    InfoCdbBackend *fallback; ///< Answers instead of the reader if the cache is not usable; 0 otherwise
+    mutable QReadWriteLock lock; ///< Protects reader and fallback from being replaced while read
+    quint64 lastInode;
+    quint64 lastCdbInode;
+    mutable QMutex keysLock; ///< Protects the cached key list
+    mutable bool keysCached; ///< If cachedKeys is filled in
+    mutable QStringList cachedKeys; ///< The keys of the currently open cache
+    QHash<QString, QByteArray> decodedKeyDigests() const;
+    static bool isUsable(const FlatRegistryReader &reader);
+    static quint64 inodeOf(const QString &path);
+
+private Q_SLOTS:
+    void onDatabaseDirectoryChanged(const QString &path);
+};
+
+#endif // INFOFLATBACKEND_H
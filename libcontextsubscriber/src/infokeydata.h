@@ -40,6 +40,7 @@ struct InfoKeyData
     ContextTypeInfo typeInfo; ///< Type information of the key.
     QString doc; ///< Doc for the key.
     bool deprecated; ///< Whether the key is deprecated.
+    QString mergePolicy; ///< How the values of several providers are merged.
 };
 
 #endif // INFOKEYDATA_H
@@ -115,6 +115,14 @@ bool InfoXmlBackend::keyDeprecated(QString key) const
     return keyDataHash.value(key).deprecated;
 }
 
+QString InfoXmlBackend::mergePolicyForKey(QString key) const
+{
+    if (! keyDataHash.contains(key))
+        return "";
+
+    return keyDataHash.value(key).mergePolicy;
+}
+
 /// Returns the full path to the registry directory. Takes the
 /// \c CONTEXT_PROVIDERS env variable into account.
 QString InfoXmlBackend::registryPath()
@@ -149,6 +157,7 @@ void InfoXmlBackend::onFileChanged(const QString &path)
     contextDebug() << F_XML << path << "changed.";
 
     QStringList oldKeys = listKeys();
+    QHash<QString, QByteArray> oldDigests = keyDigests();
     regenerateKeyDataList();
     QStringList currentKeys = listKeys();
 
@@ -162,7 +171,7 @@ void InfoXmlBackend::onFileChanged(const QString &path)
     Q_EMIT keysChanged(listKeys()); // DEPRECATED emission
 
     Q_EMIT listChanged();
-    checkAndEmitKeyChanged(currentKeys, oldKeys);
+    checkAndEmitKeyChanged(keyDigests(), oldDigests);
 }
 
 /// Called when the registry directory changed (ie. file removed or added).
@@ -186,6 +195,7 @@ void InfoXmlBackend::onDirectoryChanged(const QString &path)
     contextDebug() << F_XML << registryPath() << "directory changed.";
 
     QStringList oldKeys = listKeys();
+    QHash<QString, QByteArray> oldDigests = keyDigests();
     regenerateKeyDataList();
     QStringList currentKeys = listKeys();
 
@@ -199,7 +209,7 @@ void InfoXmlBackend::onDirectoryChanged(const QString &path)
     Q_EMIT keysChanged(listKeys()); // DEPRECATED emission
 
     Q_EMIT listChanged();
-    checkAndEmitKeyChanged(currentKeys, oldKeys);
+    checkAndEmitKeyChanged(keyDigests(), oldDigests);
 }
 
 /* Private */
@@ -260,6 +270,7 @@ void InfoXmlBackend::parseKey(const AssocTree &keyTree, const AssocTree &provide
     QString constructionString = providerTree.value("constructionString").toString();
     QString doc = keyTree.value("doc").toString();
     QVariant deprecated_node = keyTree.node("deprecated");
+    QString mergePolicy = keyTree.value("merge").toString();
 
     ContextTypeInfo typeInfo = keyTree.value("type");
     typeInfo = typeInfo.ensureNewTypes(); // Make sure to get rid of old names (INTEGER...)
@@ -268,12 +279,16 @@ void InfoXmlBackend::parseKey(const AssocTree &keyTree, const AssocTree &provide
     if (keyDataHash.contains(key)) {
         if (typeInfo.name() != "" && typeInfo != keyDataHash[key].typeInfo)
             contextWarning() << F_XML << key << ": type mismatch in core property list and provider property list";
+        // The merge policy can come from any of the declarations
+        if (mergePolicy != "" && keyDataHash[key].mergePolicy == "")
+            keyDataHash[key].mergePolicy = mergePolicy;
     } else {
         InfoKeyData keyData;
         keyData.name = key;
         keyData.typeInfo = typeInfo;
         keyData.doc = doc;
         keyData.deprecated = deprecated_node.isValid();
+        keyData.mergePolicy = mergePolicy;
 
         contextDebug() << F_XML << "Adding new key" << key << "with type:" << keyData.typeInfo.name();
         keyDataHash.insert(key, keyData);
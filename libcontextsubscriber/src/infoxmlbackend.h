@@ -46,6 +46,7 @@ public:
     virtual QString docForKey(QString key) const;
     virtual bool keyDeclared(QString key) const;
     virtual bool keyDeprecated(QString key) const;
+    virtual QString mergePolicyForKey(QString key) const;
     virtual const QList<ContextProviderInfo> providersForKey(QString key) const;
     virtual ContextTypeInfo typeInfoForKey(QString key) const;
 
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "pluginloader.h"
+#include "logging.h"
+#include "loggingfeatures.h"
+#include "infobackend.h"
+#include "contextproviderinfo.h"
+#include <QMutexLocker>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QLibrary>
+#include <QSet>
+#include <stdlib.h>
+
+namespace ContextSubscriber {
+
+/*!
+  \class PluginLoader
+  \brief Loads the dynamic provider plugins, once per process.
+
+  The plugins named with an absolute path in the registry are loaded
+  from the directory given by \c CONTEXT_SUBSCRIBER_PLUGINS (or the
+  default plugin directory), and their \c pluginFactory is resolved.
+  The result is kept for the lifetime of the process, so the Provider
+  objects using the same plugin load it only once.
+
+  Loading a plugin means reading and relocating a shared library, so
+  it is worth taking off the startup path: preload() does it in a
+  background thread, and factory() then only looks the result up.  The
+  library is loaded without holding the lock, so looking up a plugin
+  isn't blocked by loading another one; if the plugin asked for is
+  being loaded, factory() waits for it.  A plugin which fails to load is tried again the next time
+  it is asked for, e.g. after it has been installed.
+*/
+
+QMutex PluginLoader::lock;
+QHash<QString, PluginFactoryFunc> PluginLoader::factories;
+QSet<QString> PluginLoader::loading;
+QWaitCondition PluginLoader::loaded;
+QThreadPool *PluginLoader::preloadPool = 0;
+
+/// Loads the plugins given to PluginLoader::preload(), or all the
+/// dynamic plugins named in the registry if none are given.
+class PluginPreloader : public QRunnable
+{
+public:
+    PluginPreloader(const QStringList &plugins = QStringList()) : plugins(plugins) {}
+
+    void run()
+    {
+        QThread::currentThread()->setPriority(QThread::LowPriority);
+        if (plugins.isEmpty())
+            plugins = registryPlugins();
+        Q_FOREACH (const QString &plugin, plugins)
+            PluginLoader::factory(plugin);
+    }
+
+private:
+    /// Returns the dynamic plugins of all the keys in the registry.
+    static QStringList registryPlugins()
+    {
+        QSet<QString> plugins;
+        InfoBackend *backend = InfoBackend::instance();
+        Q_FOREACH (const QString &key, backend->listKeys()) {
+            Q_FOREACH (const ContextProviderInfo &info, backend->providersForKey(key)) {
+                if (info.plugin.startsWith("/"))
+                    plugins.insert(info.plugin);
+            }
+        }
+        contextDebug() << F_PLUGINS << "Preloading from the registry" << plugins;
+        return plugins.toList();
+    }
+
+    QStringList plugins;
+};
+
+/// Returns the factory function of the dynamic \a plugin, loading the
+/// plugin first if it hasn't been loaded yet.  Returns 0 if the plugin
+/// cannot be loaded.  Thread safe.
+PluginFactoryFunc PluginLoader::factory(const QString &plugin)
+{
+    QMutexLocker locker(&lock);
+    while (loading.contains(plugin))
+        loaded.wait(&lock);
+    QHash<QString, PluginFactoryFunc>::const_iterator it = factories.constFind(plugin);
+    if (it != factories.constEnd())
+        return it.value();
+
+    // Mark the plugin, so that the other threads asking for it wait
+    // for us instead of loading it too.
+    loading.insert(plugin);
+    locker.unlock();
+    PluginFactoryFunc func = resolve(plugin);
+    locker.relock();
+    loading.remove(plugin);
+    if (func)
+        factories.insert(plugin, func);
+    loaded.wakeAll();
+    return func;
+}
+
+/// Starts loading the dynamic \a plugins which haven't been loaded
+/// yet, in a background thread.  Returns immediately.
+void PluginLoader::preload(const QStringList &plugins)
+{
+    QStringList missing;
+    QMutexLocker locker(&lock);
+    Q_FOREACH (const QString &plugin, plugins)
+        if (plugin.startsWith("/") && !factories.contains(plugin) &&
+            !loading.contains(plugin) && !missing.contains(plugin))
+            missing << plugin;
+    if (missing.isEmpty())
+        return;
+
+    contextDebug() << F_PLUGINS << "Preloading" << missing;
+    startPreloader(new PluginPreloader(missing));
+}
+
+/// Starts loading all the dynamic plugins named in the registry, in a
+/// background thread.  Returns immediately; the registry is read in
+/// the background thread too.
+void PluginLoader::preloadRegistry()
+{
+    QMutexLocker locker(&lock);
+    startPreloader(new PluginPreloader);
+}
+
+/// Runs \a preloader in the preloading thread.  Called with the lock
+/// held.
+void PluginLoader::startPreloader(QRunnable *preloader)
+{
+    if (preloadPool == 0) {
+        // Preloading is off the startup path, so one thread is
+        // enough; it exits when it has been idle for a while.
+        preloadPool = new QThreadPool;
+        preloadPool->setMaxThreadCount(1);
+    }
+    // The pool deletes the preloader when it's done.
+    preloadPool->start(preloader);
+}
+
+/// Loads \a plugin and resolves its pluginFactory.  Called without
+/// the lock, with \a plugin marked as loading.
+PluginFactoryFunc PluginLoader::resolve(const QString &plugin)
+{
+    // Enable overriding the plugin location with an environment variable
+    const char *pluginPath = getenv("CONTEXT_SUBSCRIBER_PLUGINS");
+    if (! pluginPath)
+        pluginPath = DEFAULT_CONTEXT_SUBSCRIBER_PLUGINS;
+
+    QString pluginFilename(pluginPath);
+    // Allow pluginPath to have a trailing / or not
+    if (pluginFilename.endsWith("/")) {
+        pluginFilename.chop(1);
+    }
+
+    pluginFilename.append(plugin);
+
+    // The library stays loaded after the QLibrary is destroyed.
+    QLibrary library(pluginFilename);
+    library.load();
+
+    if (!library.isLoaded()) {
+        contextCritical() << "Error loading plugin" << pluginFilename << ":" << library.errorString();
+        return 0;
+    }
+
+    PluginFactoryFunc factory = (PluginFactoryFunc) library.resolve("pluginFactory");
+    if (factory)
+        contextDebug() << "Resolved factory function";
+    else
+        contextCritical() << "Error resolving function pluginFactory from plugin" << pluginFilename;
+    return factory;
+}
+
+} // end namespace
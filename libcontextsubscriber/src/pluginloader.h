@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef PLUGINLOADER_H
+#define PLUGINLOADER_H
+
+#include "iproviderplugin.h"
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QWaitCondition>
+
+class QThreadPool;
+class QRunnable;
+
+namespace ContextSubscriber {
+
+class PluginLoader
+{
+public:
+    static PluginFactoryFunc factory(const QString &plugin);
+    static void preload(const QStringList &plugins);
+    static void preloadRegistry();
+
+private:
+    static PluginFactoryFunc resolve(const QString &plugin);
+    static void startPreloader(QRunnable *preloader);
+
+    static QMutex lock; ///< Protects factories, loading and preloadPool
+    /// Plugin name -> its resolved pluginFactory.  The plugins which
+    /// cannot be loaded are not remembered, and are tried again.
+    static QHash<QString, PluginFactoryFunc> factories;
+    static QSet<QString> loading; ///< The plugins being loaded, without the lock
+    static QWaitCondition loaded; ///< Woken when a plugin is taken off loading
+    static QThreadPool *preloadPool; ///< Runs the preloading, created by the first preload()
+};
+
+} // end namespace
+
+#endif
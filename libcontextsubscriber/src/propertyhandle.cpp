@@ -24,9 +24,12 @@
 #include "sconnect.h"
 #include "contextpropertyinfo.h"
 #include "contexttypeinfo.h"
+#include "contexttypevalidator.h"
 #include "contextregistryinfo.h"
 #include "contextproviderinfo.h"
 #include "dbusnamelistener.h"
+#include "deliverymailbox.h"
+#include "contextthread.h"
 #include "logging.h"
 #include "loggingfeatures.h"
 
@@ -34,9 +37,9 @@
 #include <QDebug>
 #include <QMutex>
 #include <QMutexLocker>
+#include <QTime>
+#include <QTimer>
 #include <QCoreApplication>
-#include <QReadLocker>
-#include <QWriteLocker>
 
 #include <stdlib.h>
 
@@ -46,12 +49,14 @@ static const QDBusConnection::BusType commanderDBusType = QDBusConnection::Sessi
 static const QString commanderDBusName = "org.freedesktop.ContextKit.Commander";
 const ContextProviderInfo PropertyHandle::commanderInfo("contextkit-dbus", "session:org.freedesktop.ContextKit.Commander");
 
-DBusNameListener* PropertyHandle::commanderListener = new DBusNameListener(commanderDBusType, commanderDBusName);
+DBusNameListener* PropertyHandle::commanderListener = 0;
+QMutex PropertyHandle::commanderLock;
 bool PropertyHandle::commandingEnabled = true;
 
-// If type check is ever enabled by default, the ContextPropertyInfo needs to be
-// changed so that the type info is cached.
+// The type of each key is compiled into a ContextTypeValidator when the first
+// value is checked, so enabling type checks only costs the check itself.
 bool PropertyHandle::typeCheckEnabled = false;
+int PropertyHandle::lingerTime = 0;
 
 /*!
   \class PropertyHandle
@@ -73,14 +78,26 @@ bool PropertyHandle::typeCheckEnabled = false;
   they stick around until the process is terminated.
 
   All of the PropertyHandle instances and Property provider instances
-  are always created with the \c QCoreApplication's thread as the
-  thread where they live.  This is needed, because user threads can go
-  away and we would like to have only one DBus connection.
+  are always moved to the context thread (see \c ContextThread), which
+  is the \c QCoreApplication's thread unless the dedicated thread is
+  enabled.  This is needed, because user threads can go away and we
+  would like to have only one DBus connection.
+
+  When the last ContextProperty unsubscribes, the handle can linger
+  for a while (see \c setLingerTime()): it stays subscribed at the
+  providers and keeps its value, so that a ContextProperty created
+  again soon doesn't cost an unsubscribe and a subscribe on the wire.
 */
 
 PropertyHandle::PropertyHandle(const QString& key)
-    : myInfo(0), subscribeCount(0), myKey(key)
+    : mergePolicy(MergeNewest), winner(0), winnerTime(0), arrivalCount(0), typeValidator(0), myInfo(0),
+      subscribeCount(0), lingering(false), myKey(key)
 {
+    lingerTimer = new QTimer(this);
+    lingerTimer->setSingleShot(true);
+    sconnect(lingerTimer, SIGNAL(timeout()),
+             this, SLOT(onLingerTimeout()));
+
     // Read the information about the provider. This needs to be
     // done before calling updateProvider.
     myInfo = new ContextPropertyInfo(myKey, this);
@@ -103,7 +120,17 @@ PropertyHandle::PropertyHandle(const QString& key)
 
     if (commandingEnabled) {
         // Start listening for the context commander, and also initiate a
-        // NameHasOwner check.
+        // NameHasOwner check.  The listener lives in the context thread,
+        // so that the commander presence becomes known even while the
+        // thread of the application waits for a subscription.
+        {
+            QMutexLocker locker(&commanderLock);
+            if (commanderListener == 0) {
+                commanderListener = new DBusNameListener(commanderDBusType, commanderDBusName);
+                commanderListener->startListening(true);
+                commanderListener->moveToThread(ContextThread::thread());
+            }
+        }
 
         // Because of the waitForSubscription() feature, we immediately need to
         // subscribe to the real providers when the commander presence becomes
@@ -113,8 +140,6 @@ PropertyHandle::PropertyHandle(const QString& key)
         sconnect(commanderListener, SIGNAL(nameDisappeared()),
                  this, SLOT(updateProvider()));
 
-        commanderListener->startListening(true);
-
         // Check if commander is already there:
         DBusNameListener::ServicePresence commanderPresence = commanderListener->isServicePresent();
         if (commanderPresence != DBusNameListener::Unknown) {
@@ -131,8 +156,8 @@ PropertyHandle::PropertyHandle(const QString& key)
         updateProvider();
     }
 
-    // Move the PropertyHandle (and all children) to main thread.
-    moveToThread(QCoreApplication::instance()->thread());
+    // Move the PropertyHandle (and all children) to the context thread.
+    moveToThread(ContextThread::thread());
 }
 
 void PropertyHandle::ignoreCommander()
@@ -145,12 +170,22 @@ void PropertyHandle::setTypeCheck(bool typeCheck)
     typeCheckEnabled = typeCheck;
 }
 
+/// Sets the time the handles stay subscribed at their providers after
+/// the last ContextProperty unsubscribed, to \a msecs milliseconds.
+/// Subscribing again within that time costs nothing, and the last
+/// value is kept meanwhile.  Zero (the default) unsubscribes at once.
+void PropertyHandle::setLingerTime(int msecs)
+{
+    lingerTime = msecs > 0 ? msecs : 0;
+}
+
 /// Decides who is the current provider of this property and sets up
 /// \c myProvider accordingly.  If the provider has changed then
 /// renews the subscriptions.
 void PropertyHandle::updateProvider()
 {
     QList<Provider*> newProviders;
+    QList<ProviderSlot*> newSlots;
     contextDebug() << F_PLUGINS;
 
     if (commandingEnabled && commanderListener->isServicePresent() == DBusNameListener::Present) {
@@ -166,27 +201,101 @@ void PropertyHandle::updateProvider()
             newProviders << Provider::instance(info);
         contextDebug() << newProviders.size() << "providers for" << myKey;
     }
-    if (subscribeCount > 0) {
-        // Unsubscribe from old providers and subscribe to the new ones.
+    // The providers deliver the values of myKey straight to us.
+    Q_FOREACH (Provider *newprovider, newProviders)
+        newSlots << newprovider->attach(myKey, this);
+
+    QString policyName = myInfo->mergePolicy();
+    MergePolicy newPolicy = MergeNewest;
+    if (policyName == "priority")
+        newPolicy = MergePriority;
+    else if (policyName == "first")
+        newPolicy = MergeFirst;
+    else if (policyName != "" && policyName != "newest")
+        contextWarning() << "Unknown merge policy" << policyName << "for" << myKey;
+    {
+        QMutexLocker locker(&mergeLock);
+        if (newProviders != myProviders || newPolicy != mergePolicy) {
+            // Start the merging from scratch with the new providers.
+            Q_FOREACH (ProviderSlot *slot, mySlots)
+                slot->rank = -1;
+            for (int i = 0; i < newSlots.size(); ++i)
+                newSlots[i]->rank = i;
+            // The slots we keep remember when their values arrived.
+            Q_FOREACH (ProviderSlot *slot, mySlots)
+                if (slot->rank < 0)
+                    slot->arrival = 0;
+            mergePolicy = newPolicy;
+            winner = 0;
+            winnerTime = 0;
+        }
+        // The type might have changed, too.
+        delete typeValidator;
+        typeValidator = 0;
+    }
+    if (subscribeCount > 0 || lingering) {
+        // Unsubscribe from the providers which are gone and subscribe
+        // to the new ones; the subscriptions to the providers we keep
+        // stay as they are.
+        const QSet<Provider*> oldSet = myProviders.toSet();
+        const QSet<Provider*> newSet = newProviders.toSet();
         Q_FOREACH (Provider *oldprovider, myProviders)
-            oldprovider->unsubscribe(myKey);
-        pendingSubscriptions.clear();
+            if (!newSet.contains(oldprovider))
+                oldprovider->unsubscribe(myKey);
+        {
+            QMutexLocker locker(&pendingLock);
+            pendingSubscriptions.intersect(newSet);
+        }
+        QList<Provider*> addedProviders;
         Q_FOREACH (Provider *newprovider, newProviders)
-            if (newprovider->subscribe(myKey))
-                pendingSubscriptions << newprovider;
+            if (!oldSet.contains(newprovider))
+                addedProviders << newprovider;
+        subscribeProviders(addedProviders);
     }
     myProviders = newProviders;
+    mySlots = newSlots;
     // If all subscriptions succeeded immediately, then we have to trigger
     // recomputing the value now.  Otherwise we rely on the
     // subscribeFinished signal.
-    if (subscribeCount > 0 && pendingSubscriptions.empty())
+    bool pending;
+    {
+        QMutexLocker locker(&pendingLock);
+        pending = !pendingSubscriptions.empty();
+        // The commander presence might have become known.
+        subscribeCondition.wakeAll();
+    }
+    Q_EMIT subscriptionFinished();
+    if ((subscribeCount > 0 || lingering) && !pending)
         onValueChanged();
 }
 
-/// Sets \c subscribePending to false.
+/// Subscribes to the key through \a providers, and records the ones
+/// which didn't finish immediately in \c pendingSubscriptions.
+void PropertyHandle::subscribeProviders(const QList<Provider*> &providers)
+{
+    // Mark the providers pending before subscribing, so that a
+    // subscription finishing in the main thread meanwhile is not lost.
+    {
+        QMutexLocker locker(&pendingLock);
+        pendingSubscriptions.unite(providers.toSet());
+    }
+    Q_FOREACH (Provider *provider, providers)
+        if (!provider->subscribe(myKey))
+            setSubscribeFinished(provider);
+}
+
+/// Removes \a provider from \c pendingSubscriptions, and wakes up the
+/// threads waiting for the subscription.
 void PropertyHandle::setSubscribeFinished(Provider *provider)
 {
-    pendingSubscriptions.remove(provider);
+    {
+        QMutexLocker locker(&pendingLock);
+        pendingSubscriptions.remove(provider);
+        if (!pendingSubscriptions.isEmpty())
+            return;
+        subscribeCondition.wakeAll();
+    }
+    Q_EMIT subscriptionFinished();
 }
 
 /// Increase the \c subscribeCount of this context property and
@@ -198,25 +307,59 @@ void PropertyHandle::subscribe()
     QMutexLocker locker(&subscribeCountLock);
     ++subscribeCount;
     if (subscribeCount == 1) {
-        pendingSubscriptions.clear();
-        Q_FOREACH (Provider *provider, myProviders)
-            if (provider->subscribe(myKey))
-                pendingSubscriptions << provider;
+        if (lingering)
+            // Still subscribed since the last time, and the value is
+            // still there.
+            lingering = false;
+        else
+            subscribeProviders(myProviders);
     }
 }
 
 /// Decrease the \c subscribeCount of this context property and
 /// unsubscribe from it through the \c myProvider instance if
-/// neccessary.
+/// neccessary.  If a linger time is set, the unsubscription happens
+/// only when it has passed without anybody subscribing again.
 void PropertyHandle::unsubscribe()
 {
     QMutexLocker locker(&subscribeCountLock);
     --subscribeCount;
     if (subscribeCount == 0) {
+        if (lingerTime > 0) {
+            lingering = true;
+            // The timer lives in our thread, restart it there.
+            QMetaObject::invokeMethod(lingerTimer, "start", Qt::QueuedConnection,
+                                      Q_ARG(int, lingerTime));
+        }
+        else
+            unsubscribeProviders();
+        locker.unlock();
+        Q_EMIT subscriptionFinished();
+    }
+}
+
+/// Unsubscribes if nobody has subscribed since the linger time
+/// started.
+void PropertyHandle::onLingerTimeout()
+{
+    QMutexLocker locker(&subscribeCountLock);
+    if (!lingering || subscribeCount > 0)
+        return;
+    lingering = false;
+    unsubscribeProviders();
+}
+
+/// Cancels the pending subscriptions and unsubscribes from all of our
+/// providers.  Called with \c subscribeCountLock held.
+void PropertyHandle::unsubscribeProviders()
+{
+    {
+        QMutexLocker pendingLocker(&pendingLock);
         pendingSubscriptions.clear();
-        Q_FOREACH (Provider *provider, myProviders)
-            provider->unsubscribe(myKey);
+        subscribeCondition.wakeAll();
     }
+    Q_FOREACH (Provider *provider, myProviders)
+        provider->unsubscribe(myKey);
 }
 
 QString PropertyHandle::key() const
@@ -224,69 +367,201 @@ QString PropertyHandle::key() const
     return myKey;
 }
 
+/// Returns the current value.  Can be called from any thread, and
+/// never waits for the thread updating the value.  The value is kept
+/// as a CompactValue internally and converted to a QVariant here.
 QVariant PropertyHandle::value() const
 {
-    QReadLocker lock(&valueLock);
-    return myValue;
+    return myValue.read().toVariant();
 }
 
 bool PropertyHandle::isSubscribePending() const
+{
+    QMutexLocker locker(&pendingLock);
+    return subscribePending();
+}
+
+/// Waits until the subscription is no longer pending, or until \a
+/// timeout milliseconds have passed; a negative \a timeout means no
+/// limit.  Returns true if the subscription finished.  Must not be
+/// called in the context thread, since the subscription is completed
+/// there.
+bool PropertyHandle::waitForSubscription(int timeout) const
+{
+    QTime elapsed;
+    elapsed.start();
+    QMutexLocker locker(&pendingLock);
+    while (subscribePending()) {
+        if (timeout < 0) {
+            subscribeCondition.wait(&pendingLock);
+            continue;
+        }
+        int remaining = timeout - elapsed.elapsed();
+        if (remaining <= 0)
+            return false;
+        subscribeCondition.wait(&pendingLock, remaining);
+    }
+    return true;
+}
+
+/// The implementation of \c isSubscribePending(); the caller must
+/// hold \c pendingLock.
+bool PropertyHandle::subscribePending() const
 {
     // We wait until commander presence is unknown ...
     if (commandingEnabled &&
         commanderListener->isServicePresent() == DBusNameListener::Unknown)
         return true;
     // ... or until we get some value ...
-    if (!myValue.isNull())
+    if (!myValue.read().isNull())
         return false;
     // ... or all pending subscriptions finished.
     return pendingSubscriptions.size() != 0;
 }
 
 /// Used by the \c HandleSignalRouter to change the value of the
-/// property.  Before changing the value it checks the type if type
-/// checks are enabled.  The verification errors are signalled on the
-/// stderr.  After the check it updates the value and emits the
-/// valueChanged() signal.
-void PropertyHandle::onValueChanged()
+/// property.  The new value of \a changed is merged with the value of
+/// the provider currently winning, according to the merge policy of
+/// the key, so only the winner's value has to be remembered; all the
+/// providers are consulted only when the winner loses its value, or
+/// when \a changed is 0.  If type checks are enabled, a value of the
+/// wrong type is treated as if the provider had no value, see
+/// checked().  Then it updates the value and emits the valueChanged()
+/// signal.
+void PropertyHandle::onValueChanged(const ProviderSlot *changed)
 {
-    bool found = false;
-    TimedValue latest = QVariant();
-
-    Q_FOREACH (Provider *provider, myProviders) {
-        TimedValue current = provider->get(myKey);
-        if (current.value.isNull())
-            continue;
-        if (!found) {
-            found = true;
-            latest = current;
-        } else if (latest < current)
-            latest = current;
-    }
-    QVariant newValue;
-    if (found)
-        newValue = latest.value;
-
-    if (typeCheckEnabled && !newValue.isNull()) {
-        ContextTypeInfo typeInfo = myInfo->typeInfo();
-        if (!typeInfo.typeCheck(newValue)) {
-            contextCritical() << F_TYPES << "Type check failed for" << myKey
-                              << "wanted:" << typeInfo.name();
-            return;
+    CompactValue newValue;
+    {
+        QMutexLocker locker(&mergeLock);
+        if (changed == 0)
+            newValue = mergeAll();
+        else {
+            // Only the value of changed is read, unless the winner
+            // lost its value.
+            if (changed->rank < 0)
+                // Not one of our providers anymore.
+                return;
+            TimedCompactValue current = changed->value.read();
+            current.value = checked(current.value);
+            noteArrival(changed, current.value);
+            if (changed == winner) {
+                if (current.value.isNull() ||
+                    (mergePolicy == MergeNewest && current.time < winnerTime))
+                    newValue = mergeAll();
+                else {
+                    winnerTime = current.time;
+                    newValue = current.value;
+                }
+            }
+            else if (!current.value.isNull() && wins(changed, current.time)) {
+                winner = changed;
+                winnerTime = current.time;
+                newValue = current.value;
+            }
+            else
+                // The value of a losing provider doesn't matter.
+                return;
         }
     }
 
-    QWriteLocker lock(&valueLock);
-    // Since QVariant(QVariant::Int) == QVariant(0), it's not enough to check
-    // whether myValue and newValue are unequal.  Also, for completeness we
-    // don't want to lose a valueChanged signal if the type changes.
-    if (myValue != newValue ||
-        myValue.isNull() != newValue.isNull() ||
-        myValue.type() != newValue.type())
-    {
-        myValue = newValue;
+    // CompactValues of different types are unequal, so a valueChanged
+    // signal is not lost if only the type or the nullness changes.
+    if (myValue.read() != newValue) {
+        myValue.write(newValue);
+        if (!newValue.isNull()) {
+            // Having a value completes the subscription.
+            QMutexLocker locker(&pendingLock);
+            subscribeCondition.wakeAll();
+        }
         Q_EMIT valueChanged();
+        if (!newValue.isNull())
+            Q_EMIT subscriptionFinished();
+
+        QMutexLocker locker(&mailboxLock);
+        Q_FOREACH (DeliveryMailbox *mailbox, myMailboxes)
+            mailbox->post(this);
+    }
+}
+
+/// Returns true if the value of \a slot, received at \a time, beats
+/// the value of the current winner.  Called with \c mergeLock held.
+bool PropertyHandle::wins(const ProviderSlot *slot, quint64 time) const
+{
+    if (winner == 0)
+        return true;
+    switch (mergePolicy) {
+    case MergePriority:
+        return slot->rank < winner->rank;
+    case MergeFirst:
+        return slot->arrival < winner->arrival;
+    default:
+        return winnerTime < time;
+    }
+}
+
+/// Records the order in which the values of our slots arrive, for
+/// the "first" merge policy: \a slot keeps its arrival as long as it
+/// has a \a value.  Called with \c mergeLock held.
+void PropertyHandle::noteArrival(const ProviderSlot *slot, const CompactValue &value)
+{
+    if (value.isNull())
+        slot->arrival = 0;
+    else if (slot->arrival == 0)
+        slot->arrival = ++arrivalCount;
+}
+
+/// Returns \a value, or a null value if type checks are enabled and
+/// \a value doesn't match the type of the key.  The failures are
+/// signalled on the stderr.  Called with \c mergeLock held.
+CompactValue PropertyHandle::checked(const CompactValue &value)
+{
+    if (!typeCheckEnabled || value.isNull())
+        return value;
+    // The type is compiled once, and again only when the registry
+    // changes.
+    if (typeValidator == 0)
+        typeValidator = new ContextTypeValidator(myInfo->typeInfo());
+    if (typeValidator->check(value.toVariant()))
+        return value;
+    contextCritical() << F_TYPES << "Type check failed for" << myKey
+                      << "wanted:" << typeValidator->name();
+    return CompactValue();
+}
+
+/// Finds the winner among all of our slots and returns its value.
+/// Called with \c mergeLock held.
+CompactValue PropertyHandle::mergeAll()
+{
+    CompactValue merged;
+    winner = 0;
+    winnerTime = 0;
+    Q_FOREACH (const ProviderSlot *slot, mySlots) {
+        TimedCompactValue current = slot->value.read();
+        current.value = checked(current.value);
+        noteArrival(slot, current.value);
+        if (!current.value.isNull() && wins(slot, current.time)) {
+            winner = slot;
+            winnerTime = current.time;
+            merged = current.value;
+        }
     }
+    return merged;
+}
+
+/// Starts posting our changes to \a mailbox.  Called by
+/// DeliveryMailbox, from any thread.
+void PropertyHandle::addMailbox(DeliveryMailbox *mailbox)
+{
+    QMutexLocker locker(&mailboxLock);
+    myMailboxes.append(mailbox);
+}
+
+/// Stops posting our changes to \a mailbox.  After this returns, \a
+/// mailbox is not touched any more.
+void PropertyHandle::removeMailbox(DeliveryMailbox *mailbox)
+{
+    QMutexLocker locker(&mailboxLock);
+    myMailboxes.removeOne(mailbox);
 }
 
 void PropertyHandle::blockUntilSubscribed()
@@ -295,7 +570,9 @@ void PropertyHandle::blockUntilSubscribed()
     // Making the call might or might not result in removing the provider from
     // pendingSubscriptions (depending on whether some events on the way are
     // queued or not), so make no assumptions on that.
+    pendingLock.lock();
     QSet<Provider*> pendingSubscriptionsCopy = pendingSubscriptions;
+    pendingLock.unlock();
     while (pendingSubscriptionsCopy.size() > 0) {
         Provider* provider = *(pendingSubscriptionsCopy.constBegin());
         provider->blockUntilSubscribed(myKey);
@@ -308,23 +585,31 @@ const ContextPropertyInfo* PropertyHandle::info() const
     return myInfo;
 }
 
-PropertyHandle* PropertyHandle::instance(const QString& key)
+HandleRegistry* PropertyHandle::registry()
 {
     // Container for singletons
-    static QMap<QString, PropertyHandle*> handleInstances;
-
-    // Protect the handleInstances. Documentation of QMap doesn't tell
-    // if it can be read concurrently, so, read-write locking might
-    // not be enough.
+    static HandleRegistry handleInstances;
+    return &handleInstances;
+}
 
-    static QMutex handleInstancesLock;
-    QMutexLocker locker(&handleInstancesLock);
-    if (!handleInstances.contains(key)) {
-        // The handle does not exist, so create it
-        handleInstances.insert(key, new PropertyHandle(key));
+/// Returns the handle for \a key, creating it if needed.  Looking up
+/// an existing handle doesn't take any locks.
+PropertyHandle* PropertyHandle::instance(const QString& key)
+{
+    HandleRegistry *handles = registry();
+    PropertyHandle *handle = handles->find(key);
+    if (handle)
+        return handle;
+
+    // The handle does not exist (or it is being created right now by
+    // another thread), so check again with the writers serialized.
+    QMutexLocker locker(handles->writeLock());
+    handle = handles->find(key);
+    if (!handle) {
+        handle = new PropertyHandle(key);
+        handles->insert(key, handle);
     }
-
-    return handleInstances[key];
+    return handle;
 }
 
 } // end namespace
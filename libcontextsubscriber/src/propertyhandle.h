@@ -22,19 +22,27 @@
 #ifndef PROPERTYHANDLE_H
 #define PROPERTYHANDLE_H
 
+#include "handleregistry.h"
+#include "concurrentvalue.h"
+#include "compactvalue.h"
+
 #include <QObject>
 #include <QString>
 #include <QVariant>
 #include <QSet>
-#include <QReadWriteLock>
 #include <QMutex>
+#include <QWaitCondition>
 
+class QTimer;
 class ContextPropertyInfo;
+class ContextTypeValidator;
 class ContextProviderInfo;
 
 namespace ContextSubscriber {
 
 class Provider;
+struct ProviderSlot;
+class DeliveryMailbox;
 class DBusNameListener;
 
 class PropertyHandle : public QObject
@@ -48,38 +56,75 @@ public:
     QString key() const;
     QVariant value() const;
     bool isSubscribePending() const;
+    bool waitForSubscription(int timeout) const;
     const ContextPropertyInfo* info() const;
 
     static PropertyHandle* instance(const QString& key);
     static const ContextProviderInfo commanderInfo;
 
-    void onValueChanged();
+    void onValueChanged(const ProviderSlot *changed = 0);
     void setSubscribeFinished(Provider *provider);
     static void ignoreCommander();
     static void setTypeCheck(bool typeCheck);
+    static void setLingerTime(int msecs);
 
     void blockUntilSubscribed();
 
+    void addMailbox(DeliveryMailbox *mailbox);
+    void removeMailbox(DeliveryMailbox *mailbox);
+
 Q_SIGNALS:
     void valueChanged();
+    void subscriptionFinished(); ///< The subscription might have stopped being pending
 
 private Q_SLOTS:
     void updateProvider();
+    void onLingerTimeout();
 
 private:
     PropertyHandle(const QString& key);
-
-        QSet<Provider*> pendingSubscriptions; ///< Providers pending subscription
+    static HandleRegistry* registry();
+    void subscribeProviders(const QList<Provider*> &providers);
+    bool subscribePending() const;
+    bool wins(const ProviderSlot *slot, quint64 time) const;
+    void noteArrival(const ProviderSlot *slot, const CompactValue &value);
+    CompactValue checked(const CompactValue &value);
+    CompactValue mergeAll();
+    void unsubscribeProviders();
+
+    QSet<Provider*> pendingSubscriptions; ///< Providers pending subscription
+    mutable QMutex pendingLock; ///< Protects pendingSubscriptions
+    mutable QWaitCondition subscribeCondition; ///< Signalled when the subscription may have finished
     QList<Provider*> myProviders; ///< Providers of this property
+    QList<ProviderSlot*> mySlots; ///< Our slots in myProviders, in the same order
+
+    /// How the values of several providers are merged, see
+    /// ContextPropertyInfo::mergePolicy()
+    enum MergePolicy {
+        MergeNewest,
+        MergePriority,
+        MergeFirst
+    };
+    MergePolicy mergePolicy;
+    const ProviderSlot *winner; ///< The slot myValue comes from, or 0
+    quint64 winnerTime; ///< The time of the winner's value
+    quint64 arrivalCount; ///< The last arrival handed out to our slots
+    ContextTypeValidator *typeValidator; ///< The compiled type of the key, or 0 if not compiled yet
+    QMutex mergeLock; ///< Protects mergePolicy, winner, winnerTime, arrivalCount, typeValidator and the rank and arrival of our slots
     ContextPropertyInfo *myInfo; ///< Metadata for this property
     unsigned int subscribeCount; ///< Number of subscribed ContextProperty objects subscribed to this property
-    QMutex subscribeCountLock;
+    QMutex subscribeCountLock; ///< Protects subscribeCount and lingering
+    bool lingering; ///< Still subscribed at the providers, although subscribeCount is 0
+    QTimer *lingerTimer; ///< Ends the lingering
     QString myKey; ///< Key of this property
-    mutable QReadWriteLock valueLock;
-    QVariant myValue; ///< Current value of this property
-    static DBusNameListener *commanderListener; ///< Listener for ContextCommander's (dis)appearance
+    ConcurrentValue<CompactValue> myValue; ///< Current value of this property, readable from any thread
+    QList<DeliveryMailbox*> myMailboxes; ///< Mailboxes of the threads having ContextProperty objects for us
+    QMutex mailboxLock; ///< Protects myMailboxes
+    static DBusNameListener *commanderListener; ///< Listener for ContextCommander's (dis)appearance, in the context thread
+    static QMutex commanderLock; ///< Protects creating commanderListener
     static bool commandingEnabled; ///< Whether the properties can be directed to ContextCommander
     static bool typeCheckEnabled; ///< Whether we check the type of the value received from the provider
+    static int lingerTime; ///< Milliseconds to stay subscribed after the last unsubscribe
 };
 
 } // end namespace
@@ -24,13 +24,17 @@
 #include "handlesignalrouter.h"
 #include "sconnect.h"
 #include "contextkitplugin.h"
+#include "atomics.h"
 #include "logging.h"
 #include "loggingfeatures.h"
+#include "contextthread.h"
+#include "pluginloader.h"
 #include <QTimer>
 #include <QMutexLocker>
+#include <QReadLocker>
+#include <QWriteLocker>
 #include <QCoreApplication>
 #include <QThread>
-#include <QLibrary>
 
 namespace ContextSubscriber {
 
@@ -84,8 +88,8 @@ namespace ContextSubscriber {
 
   An implementation of this interface doesn't have to care about
   threads at all, all of the methods, starting from the constructor
-  will be only called from inside the Qt event loop of the main
-  thread.  This means that neither the constructor nor the \c
+  will be only called from inside the Qt event loop of the context
+  thread (see \c ContextThread).  This means that neither the constructor nor the \c
   subscribe, \c unsubscribe calls should block.  They have to finish
   as soon as possible and signal the results later via signals.
 
@@ -97,24 +101,34 @@ namespace ContextSubscriber {
   value changes of the properties belonging to the provider on the
   other end of the channel.
 
-  This class is thread safe, the \c instance, \c subscribe and \c
-  unsubscribe methods can be called from any threads.  However this
-  class also guarantees that the signal \c subscribeFinished and \c
-  valueChanged will be always emitted from inside the main thread's
-  main loop.
+  This class is thread safe, the \c instance, \c attach, \c subscribe
+  and \c unsubscribe methods can be called from any threads.  However
+  this class also guarantees that the signal \c subscribeFinished will
+  be always emitted, and the new values will be always delivered, from
+  inside the context thread's main loop.
+
+  Each key has a \c ProviderSlot, which knows the \c PropertyHandle of
+  the key.  New values are stored in the slot and delivered straight to
+  that handle, so a value update costs one lookup in this provider's
+  own slot table.
+
+  The subscription bookkeeping is protected by \c subscribeLock, and
+  the slot table by the separate \c slotsLock.  Storing a new value
+  only takes the latter, for reading, and the values in the slots can
+  be read from any thread without locking.
 
   \fn void Provider::subscribeFinished(QSet<QString> keys)
   \brief Emitted when the subscription procedure for \c keys finished
   (either succeeded, either failed) */
 
 /// Stores the passed plugin name and construction paramater, then
-/// moves into the main thread and queues a constructPlugin call.
+/// moves into the context thread and queues a constructPlugin call.
 Provider::Provider(const ContextProviderInfo& providerInfo)
     : plugin(0), pluginState(INITIALIZING), providerInfo(providerInfo),
       subscribeLock(QMutex::Recursive), pluginConstructed(false)
 {
-    // Move the PropertyHandle (and all children) to main thread.
-    moveToThread(QCoreApplication::instance()->thread());
+    // Move the Provider (and all children) to the context thread.
+    moveToThread(ContextThread::thread());
 
     queueOnce("constructPlugin");
 }
@@ -122,8 +136,8 @@ Provider::Provider(const ContextProviderInfo& providerInfo)
 /// Decides which plugin to instantiate based on the \c plugin passed
 /// to the constructor.  Always called in the main loop after the
 /// constructor is finished.  Each plugin library implements a
-/// function which can create new instances of that plugin (TODO: come
-/// up with the name of the function).
+/// function called pluginFactory which can create new instances of
+/// that plugin; the libraries are loaded by PluginLoader.
 void Provider::constructPlugin()
 {
     if (pluginConstructed)
@@ -134,46 +148,31 @@ void Provider::constructPlugin()
     if (providerInfo.plugin == "contextkit-dbus") {
         plugin = contextKitPluginFactory(providerInfo.constructionString);
     }
+    else if (providerInfo.plugin == "contextkit-shm") {
+        plugin = contextKitSharedPluginFactory(providerInfo.constructionString);
+    }
+    else if (providerInfo.plugin == "contextkit-direct") {
+        plugin = contextKitDirectPluginFactory(providerInfo.constructionString);
+    }
     else if (providerInfo.plugin.startsWith("/")) {
         // Dynamically loaded plugins have to start with a '/', otherwise we consider them internal.
-        // Enable overriding the plugin location with an environment variable
-        const char *pluginPath = getenv("CONTEXT_SUBSCRIBER_PLUGINS");
-        if (! pluginPath)
-            pluginPath = DEFAULT_CONTEXT_SUBSCRIBER_PLUGINS;
-
-        QString pluginFilename(pluginPath);
-        // Allow pluginPath to have a trailing / or not
-        if (pluginFilename.endsWith("/")) {
-            pluginFilename.chop(1);
-        }
-
-        pluginFilename.append(providerInfo.plugin);
-
-        QLibrary library(pluginFilename);
-        library.load();
-
-        if (library.isLoaded()) {
-            PluginFactoryFunc factory = (PluginFactoryFunc) library.resolve("pluginFactory");
-            if (factory) {
-                contextDebug() << "Resolved factory function";
-                plugin = factory(providerInfo.constructionString);
-            } else {
-                contextCritical() << "Error resolving function pluginFactory from plugin" << pluginFilename;
-            }
-        }
-        else {
-            contextCritical() << "Error loading plugin" << pluginFilename << ":" << library.errorString();
-        }
+        // The plugin is usually loaded already, see Provider::instance().
+        PluginFactoryFunc factory = PluginLoader::factory(providerInfo.plugin);
+        if (factory)
+            plugin = factory(providerInfo.constructionString);
     }
     else {
         contextCritical() << "Illegal plugin name" << providerInfo.plugin << ", doesn't start with /";
     }
 
     // Connect the subscribeFinished signal early enough; if plugin loading has
-    // failed, we still need to send it.
+    // failed, we still need to send it.  The router is a static object living
+    // in the main thread, so force a direct connection also when we are in
+    // the context thread.
     HandleSignalRouter* handleSignalRouter = HandleSignalRouter::instance();
     sconnect(this, SIGNAL(subscribeFinished(Provider *,QString)),
-             handleSignalRouter, SLOT(onSubscribeFinished(Provider *,QString)));
+             handleSignalRouter, SLOT(onSubscribeFinished(Provider *,QString)),
+             Qt::DirectConnection);
 
     if (plugin == 0) {
         pluginState = FAILED;
@@ -186,8 +185,6 @@ void Provider::constructPlugin()
              this, SLOT(onPluginValueChanged(QString, TimedValue)));
     sconnect(plugin, SIGNAL(valueChanged(QString, QVariant)),
              this, SLOT(onPluginValueChanged(QString, QVariant)));
-    sconnect(this, SIGNAL(valueChanged(QString)),
-             handleSignalRouter, SLOT(onValueChanged(QString)));
 
     // Ready and failed are supposed to be handled immediately; not
     // queued. The plugin should also emit them as soon as possible
@@ -234,7 +231,9 @@ void Provider::onPluginReady()
 /// provider instance is (re)connected to the commander.
 void Provider::clearValues()
 {
-    values.clear();
+    QReadLocker lock(&slotsLock);
+    Q_FOREACH (ProviderSlot *slot, keySlots)
+        slot->value.write(TimedCompactValue());
 }
 
 /// Updates \c pluginState to \c FAILED and signals subscribeFinished
@@ -296,6 +295,28 @@ void Provider::onPluginSubscribeFailed(QString key, QString error)
     signalSubscribeFinished(key);
 }
 
+/// Returns the slot of \a key, creating it if needed.  The new values
+/// of \a key will be stored in the slot and delivered to \a handle.
+ProviderSlot* Provider::attach(const QString &key, PropertyHandle *handle)
+{
+    QMutexLocker lock(&subscribeLock);
+    QWriteLocker slotsLocker(&slotsLock);
+    ProviderSlot *slot = keySlots.value(key);
+    if (slot == 0) {
+        slot = new ProviderSlot(handle);
+        storeRelease(slot->subscribed, subscribedKeys.contains(key));
+        keySlots.insert(key, slot);
+    }
+    return slot;
+}
+
+/// Returns the slot of \a key, or 0 if the key was never attached.
+ProviderSlot* Provider::findSlot(const QString &key) const
+{
+    QReadLocker lock(&slotsLock);
+    return keySlots.value(key);
+}
+
 /// Schedules a property to be subscribed to.  Returns true if and
 /// only if the main loop has to run for the subscription to be
 /// finalized.
@@ -304,6 +325,8 @@ bool Provider::subscribe(const QString &key)
     QMutexLocker lock(&subscribeLock);
     // Note: the intention is saved in all cases; whether we can really subscribe or not.
     subscribedKeys.insert(key);
+    if (ProviderSlot *slot = findSlot(key))
+        storeRelease(slot->subscribed, 1);
 
     // If the key was scheduled to be unsubscribed then remove that
     // scheduling, and return false.
@@ -330,6 +353,8 @@ void Provider::unsubscribe(const QString &key)
     QMutexLocker lock(&subscribeLock);
     // Save the intention of the higher level
     subscribedKeys.remove(key);
+    if (ProviderSlot *slot = findSlot(key))
+        storeRelease(slot->subscribed, 0);
 
     // Schedule the key to be unsubscribed from
     if (toSubscribe.contains(key)) {
@@ -381,16 +406,7 @@ void Provider::handleSubscribes()
 /// the upper layers via \c HandleSignalRouter.
 void Provider::onPluginValueChanged(QString key, TimedValue newValue)
 {
-    QMutexLocker lock(&subscribeLock);
-    if (subscribedKeys.contains(key)) {
-        // FIXME: try out if everything works with lock.unlock() here
-        values.insert(key, newValue);
-        Q_EMIT valueChanged(key);
-    }
-    else
-        // Plugins are allowed to send values which are not subscribed to, but
-        // only if they get them for free.
-        contextDebug() << "Received a property not subscribed to:" << key;
+    storeValue(key, newValue);
 }
 
 /// Deprecated: plugins should use the variant taking a TimedValue.
@@ -398,11 +414,20 @@ void Provider::onPluginValueChanged(QString key, TimedValue newValue)
 /// the upper layers via \c HandleSignalRouter.
 void Provider::onPluginValueChanged(QString key, QVariant newValue)
 {
-    QMutexLocker lock(&subscribeLock);
-    if (subscribedKeys.contains(key)) {
-        // FIXME: try out if everything works with lock.unlock() here
-        values.insert(key, TimedValue(newValue));
-        Q_EMIT valueChanged(key);
+    storeValue(key, TimedValue(newValue));
+}
+
+/// Stores \c newValue in the slot of \c key and hands the slot's
+/// PropertyHandle to the \c HandleSignalRouter.
+void Provider::storeValue(const QString &key, const TimedValue &newValue)
+{
+    // Slots are never deleted, so the slot can be used without holding
+    // any of our locks.
+    ProviderSlot *slot = findSlot(key);
+    if (slot && loadAcquire(slot->subscribed)) {
+        // This is the only place the value is converted from QVariant.
+        slot->value.write(TimedCompactValue(newValue));
+        HandleSignalRouter::instance()->onValueChanged(slot);
     }
     else
         // Plugins are allowed to send values which are not subscribed to, but
@@ -445,11 +470,6 @@ void Provider::blockUntilSubscribed(const QString& key)
     }
 }
 
-TimedValue Provider::get(const QString &key) const
-{
-    return values.value(key, TimedValue(QVariant()));
-}
-
 /// Returns a singleton for the named \c plugin with the \c constructionString.
 Provider* Provider::instance(const ContextProviderInfo& providerInfo)
 {
@@ -459,8 +479,12 @@ Provider* Provider::instance(const ContextProviderInfo& providerInfo)
 
     static QMutex providerInstancesLock;
     QMutexLocker locker(&providerInstancesLock);
-    if (!providerInstances.contains(providerInfo))
+    if (!providerInstances.contains(providerInfo)) {
+        // Load a dynamic plugin while the Provider waits for the
+        // context thread to construct it.
+        PluginLoader::preload(QStringList() << providerInfo.plugin);
         providerInstances.insert(providerInfo, new Provider(providerInfo));
+    }
 
     contextDebug() << "Returning provider instance for" << providerInfo.plugin
                    << ":" << providerInfo.constructionString;
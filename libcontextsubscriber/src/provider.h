@@ -25,11 +25,16 @@
 #include "queuedinvoker.h"
 #include "contextproviderinfo.h"
 #include "timedvalue.h"
+#include "concurrentvalue.h"
+#include "compactvalue.h"
 
 #include <QObject>
 #include <QDBusConnection>
 #include <QSet>
+#include <QHash>
 #include <QMutex>
+#include <QReadWriteLock>
+#include <QAtomicInt>
 
 class ContextPropertyInfo;
 
@@ -41,22 +46,36 @@ class DBusNameListener;
 class ManagerInterface;
 class IProviderPlugin;
 
+/// The state a Provider keeps about one key: the value it last got for
+/// it and the PropertyHandle the updates have to be delivered to.
+/// Slots are created by \c Provider::attach and never deleted.
+struct ProviderSlot
+{
+    ProviderSlot(PropertyHandle *handle)
+        : handle(handle), rank(-1), arrival(0), subscribed(0)
+        { }
+    PropertyHandle * const handle;
+    int rank; ///< Position of this provider among the handle's providers, -1 if none; maintained by the handle
+    mutable quint64 arrival; ///< When the value of this slot arrived relative to the others, 0 if it has none; maintained by the handle for the "first" merge policy
+    QAtomicInt subscribed; ///< Whether the key should currently be subscribed to
+    ConcurrentValue<TimedCompactValue> value; ///< The value received from the plugin
+};
+
 class Provider : public QueuedInvoker
 {
     Q_OBJECT
 
 public:
     static Provider* instance(const ContextProviderInfo& providerInfo);
+    ProviderSlot* attach(const QString &key, PropertyHandle *handle);
     bool subscribe(const QString &key);
     void unsubscribe(const QString &key);
-    TimedValue get(const QString &key) const;
     void clearValues();
 
     void blockUntilSubscribed(const QString& key);
 
 Q_SIGNALS:
     void subscribeFinished(Provider *provider, QString key);
-    void valueChanged(QString key);
 
 private Q_SLOTS:
     void onPluginReady();
@@ -73,19 +92,22 @@ private:
     Q_INVOKABLE void handleSubscribes();
     Q_INVOKABLE void constructPlugin();
     void signalSubscribeFinished(QString key);
+    void storeValue(const QString &key, const TimedValue &newValue);
+    ProviderSlot* findSlot(const QString &key) const;
 
     IProviderPlugin* plugin; ///< Plugin instance communicating with the concrete provider.
     PluginState pluginState;
     ContextProviderInfo providerInfo;  ///< Parameters used to initialize the plugin.
 
-    QMutex subscribeLock;
+    QMutex subscribeLock; ///< Protects the subscription bookkeeping below
     QSet<QString> toSubscribe; ///< Keys pending for subscription
     QSet<QString> toUnsubscribe; ///< Keys pending for unsubscription
 
     // FIXME: rename this to something which contains the word intention in it
     QSet<QString> subscribedKeys; ///< The keys that should be currently subscribed to
 
-    QMap<QString, TimedValue> values; ///< A cache of values already received from the plugin
+    mutable QReadWriteLock slotsLock; ///< Protects keySlots; the slots themselves need no locking
+    QHash<QString, ProviderSlot*> keySlots; ///< Per-key state, including the cache of values received from the plugin
     bool pluginConstructed;
 };
 
@@ -5,6 +5,8 @@ equals(QT_MAJOR_VERSION, 5): TARGET = contextsubscriber5
 VERSION = 0.0.0 # force to match to autofoo soversion
 
 SOURCES = contextproperty.cpp \
+          contextsubscriptionwatcher.cpp \
+          contexttypedproperty.cpp \
           propertyhandle.cpp \
           provider.cpp \
           subscriberinterface.cpp \
@@ -15,18 +17,41 @@ SOURCES = contextproperty.cpp \
           cdbwriter.cpp cdbreader.cpp \
           infocdbbackend.cpp \
           dbusnamelistener.cpp handlesignalrouter.cpp \
+          handleregistry.cpp \
+          deliverymailbox.cpp \
+          compactvalue.cpp \
+          contextthread.cpp \
+          pluginloader.cpp \
           queuedinvoker.cpp \
           contextkitplugin.cpp \
           nanoxml.cpp \
           asyncdbusinterface.cpp \
           contexttypeinfo.cpp \
+          contexttypevalidator.cpp \
+          valuedecoder.cpp \
+          flatregistryreader.cpp \
+          flatregistrywriter.cpp \
+          infoflatbackend.cpp \
           contexttyperegistryinfo.cpp \
           assoctree.cpp \
           duration.cpp
 
 HEADERS = queuedinvoker.h \
           handlesignalrouter.h \
+          handleregistry.h \
+          deliverymailbox.h \
+          contextthread.h \
+          pluginloader.h \
+          atomics.h \
+          concurrentvalue.h \
+          compactvalue.h \
           contexttypeinfo.h \
+          contexttypevalidator.h \
+          valuedecoder.h \
+          flatregistryformat.h \
+          flatregistryreader.h \
+          flatregistrywriter.h \
+          infoflatbackend.h \
           timedvalue.h \
           iproviderplugin.h \
           contextproviderinfo.h \
@@ -41,6 +66,8 @@ HEADERS = queuedinvoker.h \
           infocdbbackend.h \
           infoxmlbackend.h \
           contextproperty.h \
+          contextsubscriptionwatcher.h \
+          contexttypedproperty.h \
           propertyhandle.h \
           provider.h \
           safedbuspendingcallwatcher.h \
@@ -56,7 +83,8 @@ equals(QT_MAJOR_VERSION, 5): libcs.path = /usr/include/contextsubscriber5
 libcs.files = \
     contextpropertyinfo.h contextregistryinfo.h iproviderplugin.h \
     contextproviderinfo.h asyncdbusinterface.h timedvalue.h \
-    contexttypeinfo.h contextproperty.h \
+    contexttypeinfo.h contextproperty.h contextsubscriptionwatcher.h \
+    contexttypedproperty.h \
     contexttyperegistryinfo.h assoctree.h duration.h contextjson.h
 INSTALLS += libcs
 
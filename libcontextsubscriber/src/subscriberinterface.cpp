@@ -47,10 +47,10 @@
 #include "safedbuspendingcallwatcher.h"
 #include "sconnect.h"
 #include "logging.h"
-#include "contextkitplugin.h"
 #include <QDebug>
 #include <QDBusConnection>
 #include <QDBusPendingReply>
+#include <QSet>
 
 namespace ContextSubscriber {
 
@@ -105,15 +105,13 @@ void SubscriberInterface::unsubscribe(QSet<QString> keys)
 }
 
 /// Processes the results of the Changed signal which comes over DBus.
+/// The values are passed on as QtDBus demarshalled them; the plugin
+/// decodes them knowing the types of the keys.
 void SubscriberInterface::onChanged(const QMap<QString, QVariant> &values, const QStringList& unknownKeys)
 {
-    QMapIterator<QString, QVariant> it(values);
-    QMap<QString, QVariant> copy;
-    while (it.hasNext()) {
-        it.next();
-        copy.insert(it.key(), demarshallValue(it.value()));
-    }
-    Q_EMIT valuesChanged(mergeNullsWithMap(copy, unknownKeys));
+    // Shares the data of values unless there are unknown keys to add.
+    QMap<QString, QVariant> merged = values;
+    Q_EMIT valuesChanged(mergeNullsWithMap(merged, unknownKeys));
 }
 
 /// A helper function. Sets the values of given keys to a null QVariant in a QMap.
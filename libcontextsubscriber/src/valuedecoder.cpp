@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "valuedecoder.h"
+#include "logging.h"
+#include <QDBusArgument>
+#include <QDBusMetaType>
+
+/*!
+  \class ValueDecoder
+
+  \brief Turns the values coming from D-Bus into their final form.
+
+  QtDBus demarshalls the basic types carried in variants, but leaves
+  lists and maps as QDBusArgument objects.  decodeAny() walks such an
+  argument, asking it the type of each element.  On the wire every
+  element of a value is a variant of its own, so knowing the type of
+  the key beforehand wouldn't save any of this work.
+
+  decodeMaybe() reads the Maybe_Variant wrapper of the value in the
+  same pass, without building the intermediate list.
+*/
+
+/// Returns the value wrapped in the Maybe_Variant \a maybe, decoded,
+/// or a null QVariant if \a maybe is empty.
+QVariant ValueDecoder::decodeMaybe(const QVariant &maybe)
+{
+    if (maybe.userType() != qMetaTypeId<QDBusArgument>()) {
+        const QVariantList list = maybe.toList();
+        return list.isEmpty() ? QVariant() : decodeAny(list.first());
+    }
+
+    const QDBusArgument arg = maybe.value<QDBusArgument>();
+    if (arg.currentType() != QDBusArgument::ArrayType) {
+        contextWarning() << "got something unexpected: Maybe_Variant of type"
+                         << arg.currentType();
+        return QVariant();
+    }
+    QVariant result;
+    arg.beginArray();
+    if (!arg.atEnd()) {
+        QVariant v;
+        arg >> v;
+        result = decodeAny(v);
+    }
+    arg.endArray();
+    return result;
+}
+
+// QDBus doesn't unmarshall non-basic types inside QVariants (since it cannot
+// know the intention), but leaves them as QDBusArguments.  Here we walk the
+// structure and unpack lists and maps.
+QVariant ValueDecoder::decodeAny(const QVariant &v)
+{
+    if (v.userType() != qMetaTypeId<QDBusArgument>())
+        return v;
+    const QDBusArgument &dba = v.value<QDBusArgument>();
+    switch (dba.currentType()) {
+    case QDBusArgument::ArrayType: {
+        QVariantList vl;
+        dba.beginArray();
+        while (!dba.atEnd()) {
+            QVariant v;
+            dba >> v;
+            vl << decodeAny(v);
+        }
+        dba.endArray();
+        return QVariant(vl);
+        break;
+    }
+    case QDBusArgument::MapType: {
+        dba.beginMap();
+        QVariantMap vm;
+        while (!dba.atEnd()) {
+            QString k;
+            QVariant v;
+            dba.beginMapEntry();
+            dba >> k >> v;
+            dba.endMapEntry();
+            v = decodeAny(v);
+            vm.insert(k, v);
+        }
+        dba.endMap();
+        return QVariant(vm);
+        break;
+    }
+    default:
+        // Shouldn't reach this.
+        contextWarning() << "got something unexpected: QDBusArgument of type"
+                         << dba.currentType();
+        return QVariant();
+        break;
+    }
+}
@@ -100,6 +100,8 @@ void CDBUnitTest::readingFromBad()
     QVERIFY(reader.fileDescriptor() <= 0);
     QVariant v = reader.valueForKey("SOMETHING");
     QCOMPARE(v, QVariant());
+    QCOMPARE(reader.contains("SOMETHING"), false);
+    QVERIFY(reader.rawValueForKey("SOMETHING").isNull());
 }
 
 void CDBUnitTest::reading()
@@ -109,6 +111,17 @@ void CDBUnitTest::reading()
     QVERIFY(reader.fileDescriptor() > 0);
 
     QCOMPARE(reader.valueForKey("KEY1"), QVariant("KEY1Value"));
+    QCOMPARE(reader.contains("KEY1"), true);
+    QCOMPARE(reader.contains("KEYS"), true);
+    QCOMPARE(reader.contains("KEY2"), false);
+
+    QByteArray raw = reader.rawValueForKey("KEY1");
+    QVERIFY(!raw.isNull());
+    QDataStream ds(raw);
+    QVariant rawValue;
+    ds >> rawValue;
+    QCOMPARE(rawValue, QVariant("KEY1Value"));
+    QVERIFY(reader.rawValueForKey("KEY2").isNull());
 
     QVariantList reslist = reader.valuesForKey("KEYS");
     QCOMPARE(reslist.size(), 3);
@@ -0,0 +1,4 @@
+include(../../test.pri)
+TARGET = testcompactvalue
+
+SOURCES = testcompactvalue.cpp
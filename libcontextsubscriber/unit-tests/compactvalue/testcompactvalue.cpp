@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+#include <QObject>
+#include <QObject>
+#include <QtTest/QtTest>
+#include <QVariant>
+#include <QStringList>
+
+#include "compactvalue.h" // Class to be tested
+
+using namespace ContextSubscriber;
+
+class CompactValueUnitTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    // Tests
+    void roundTrip_data();
+    void roundTrip();
+    void inlineValues();
+    void compare();
+    void copy();
+};
+
+void CompactValueUnitTest::roundTrip_data()
+{
+    QTest::addColumn<QVariant>("value");
+    QTest::newRow("null") << QVariant();
+    QTest::newRow("typed null") << QVariant(QVariant::Int);
+    QTest::newRow("bool") << QVariant(true);
+    QTest::newRow("int") << QVariant(-42);
+    QTest::newRow("uint") << QVariant(42u);
+    QTest::newRow("longlong") << QVariant(Q_INT64_C(-12345678901));
+    QTest::newRow("ulonglong") << QVariant(Q_UINT64_C(12345678901));
+    QTest::newRow("double") << QVariant(4.5);
+    QTest::newRow("empty string") << QVariant(QString(""));
+    QTest::newRow("short string") << QVariant(QString("short"));
+    QTest::newRow("long string") << QVariant(QString("a string which is not short"));
+    QTest::newRow("list") << QVariant(QStringList() << "a" << "b");
+}
+
+void CompactValueUnitTest::roundTrip()
+{
+    QFETCH(QVariant, value);
+    QVariant result = CompactValue(value).toVariant();
+    QCOMPARE(result, value);
+    QCOMPARE(result.type(), value.type());
+    QCOMPARE(result.isNull(), value.isNull());
+    QCOMPARE(CompactValue(value).isNull(), value.isNull());
+}
+
+void CompactValueUnitTest::inlineValues()
+{
+    QVERIFY(CompactValue(QVariant(42)).isInline());
+    QVERIFY(CompactValue(QVariant(4.5)).isInline());
+    QVERIFY(CompactValue(QVariant(QString(CompactValue::MaxInlineString, QLatin1Char('x')))).isInline());
+    QVERIFY(!CompactValue(QVariant(QString(CompactValue::MaxInlineString + 1, QLatin1Char('x')))).isInline());
+    QVERIFY(!CompactValue(QVariant(QVariant::Int)).isInline());
+    QVERIFY(!CompactValue(QVariant(QStringList())).isInline());
+}
+
+void CompactValueUnitTest::compare()
+{
+    QVERIFY(CompactValue(QVariant(42)) == CompactValue(QVariant(42)));
+    QVERIFY(CompactValue(QVariant(42)) != CompactValue(QVariant(43)));
+    QVERIFY(CompactValue(QVariant("abc")) == CompactValue(QVariant("abc")));
+    QVERIFY(CompactValue(QVariant("abc")) != CompactValue(QVariant("abd")));
+    QVERIFY(CompactValue(QVariant("abc")) != CompactValue(QVariant("abcd")));
+    QVERIFY(CompactValue() == CompactValue(QVariant()));
+
+    // Unlike QVariant, values of different types differ
+    QVERIFY(CompactValue(QVariant(0)) != CompactValue(QVariant(QVariant::Int)));
+    QVERIFY(CompactValue(QVariant(1)) != CompactValue(QVariant(1.0)));
+    QVERIFY(CompactValue(QVariant(1)) != CompactValue(QVariant(1u)));
+    QVERIFY(CompactValue(QVariant(true)) != CompactValue(QVariant(1)));
+
+    // A NaN doesn't look like a change every time it arrives
+    double nan = qQNaN();
+    QVERIFY(CompactValue(QVariant(nan)) == CompactValue(QVariant(nan)));
+
+    QStringList list = QStringList() << "a" << "b";
+    QVERIFY(CompactValue(QVariant(list)) == CompactValue(QVariant(list)));
+    QVERIFY(CompactValue(QVariant(list)) != CompactValue(QVariant(QStringList() << "a")));
+}
+
+void CompactValueUnitTest::copy()
+{
+    CompactValue a(QVariant(QString("a string which is not short")));
+    CompactValue b(QVariant(42));
+    CompactValue c(a);
+    QCOMPARE(c.toVariant(), a.toVariant());
+
+    c = b;
+    QCOMPARE(c.toVariant(), QVariant(42));
+    b = a;
+    QCOMPARE(b.toVariant(), QVariant(QString("a string which is not short")));
+    b = b;
+    QVERIFY(b == a);
+
+    c = CompactValue();
+    QVERIFY(c.isNull());
+}
+
+QTEST_MAIN(CompactValueUnitTest);
+#include "testcompactvalue.moc"
@@ -0,0 +1,4 @@
+include(../../test.pri)
+TARGET = testconcurrentvalue
+
+SOURCES = testconcurrentvalue.cpp
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+#include <QObject>
+#include <QtTest/QtTest>
+#include <QThread>
+#include <QVariant>
+
+#include "concurrentvalue.h" // Class to be tested
+
+using namespace ContextSubscriber;
+
+class ConcurrentValueUnitTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    // Tests
+    void readWrite();
+    void concurrentReaders();
+};
+
+// Reads the value in a loop and counts the values which were not
+// written by the writer.
+class ReaderThread : public QThread
+{
+public:
+    ReaderThread(const ConcurrentValue<QVariant> &value)
+        : value(value), stop(0), badReads(0)
+        { }
+    void run()
+        {
+            while (loadAcquire(stop) == 0) {
+                QVariant v = value.read();
+                if (!v.isNull() && !v.toString().startsWith("value"))
+                    ++badReads;
+            }
+        }
+    const ConcurrentValue<QVariant> &value;
+    QAtomicInt stop;
+    int badReads;
+};
+
+void ConcurrentValueUnitTest::readWrite()
+{
+    ConcurrentValue<QVariant> value;
+    QCOMPARE(value.read(), QVariant());
+
+    value.write(QVariant(42));
+    QCOMPARE(value.read(), QVariant(42));
+
+    // Both instances are kept up to date, whichever the readers see
+    value.write(QVariant("string"));
+    QCOMPARE(value.read(), QVariant("string"));
+    value.write(QVariant(true));
+    QCOMPARE(value.read(), QVariant(true));
+}
+
+void ConcurrentValueUnitTest::concurrentReaders()
+{
+    ConcurrentValue<QVariant> value;
+    QList<ReaderThread*> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers << new ReaderThread(value);
+        readers.last()->start();
+    }
+
+    // Heap allocated strings, so that a reader copying a freed value
+    // would be noticed
+    for (int i = 0; i < 100000; ++i)
+        value.write(QVariant(QString("value%1").arg(i)));
+
+    Q_FOREACH (ReaderThread *reader, readers) {
+        reader->stop.fetchAndStoreOrdered(1);
+        reader->wait();
+        QCOMPARE(reader->badReads, 0);
+        delete reader;
+    }
+    QCOMPARE(value.read(), QVariant(QString("value99999")));
+}
+
+QTEST_MAIN(ConcurrentValueUnitTest);
+#include "testconcurrentvalue.moc"
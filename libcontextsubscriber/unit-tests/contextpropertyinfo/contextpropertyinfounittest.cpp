@@ -91,6 +91,11 @@ bool InfoBackend::keyDeprecated(QString key) const
     return false;
 }
 
+QString InfoBackend::mergePolicyForKey(QString key) const
+{
+    return QString();
+}
+
 const QList<ContextProviderInfo> InfoBackend::providersForKey(QString key)
 {
     QList<ContextProviderInfo> lst;
@@ -100,6 +105,11 @@ const QList<ContextProviderInfo> InfoBackend::providersForKey(QString key)
     return lst;
 }
 
+QObject *InfoBackend::keyNotifier(const QString &key)
+{
+    return this;
+}
+
 void InfoBackend::connectNotify(const char *signal)
 {
 }
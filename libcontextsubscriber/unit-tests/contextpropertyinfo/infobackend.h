@@ -38,8 +38,10 @@ public:
     QString docForKey(QString key) const;
     bool keyDeclared(QString key) const;
     bool keyDeprecated(QString key) const;
+    QString mergePolicyForKey(QString key) const;
     const QList<ContextProviderInfo> providersForKey(QString key);
     ContextTypeInfo typeInfoForKey(QString key) const;
+    QObject *keyNotifier(const QString &key);
 
     void connectNotify(const char *signal);
     void disconnectNotify(const char *signal);
@@ -0,0 +1,5 @@
+include(../../test.pri)
+TARGET = contextsubscriptionwatcher-unit-tests
+
+SOURCES = testcontextsubscriptionwatcher.cpp
+HEADERS = propertyhandle.h contextproperty.h
@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+#include <QObject>
+#include <QtTest/QtTest>
+#include <QHash>
+
+// Mock header files
+#include "propertyhandle.h"
+#include "contextproperty.h"
+
+#include "contextsubscriptionwatcher.h" // Class to be tested
+
+using namespace ContextSubscriber;
+
+Q_DECLARE_METATYPE(ContextProperty*);
+
+// Mock implementation of PropertyHandle
+
+QHash<QString, PropertyHandle*> mockHandles;
+
+PropertyHandle::PropertyHandle()
+    : pending(true)
+{
+}
+
+PropertyHandle* PropertyHandle::instance(const QString& key)
+{
+    if (!mockHandles.contains(key))
+        mockHandles.insert(key, new PropertyHandle());
+    return mockHandles.value(key);
+}
+
+bool PropertyHandle::isSubscribePending() const
+{
+    return pending;
+}
+
+void PropertyHandle::finishSubscription()
+{
+    pending = false;
+    Q_EMIT subscriptionFinished();
+}
+
+// Mock implementation of ContextProperty
+
+ContextProperty::ContextProperty(const QString &key, QObject *parent)
+    : QObject(parent), myKey(key), subscribeCount(0)
+{
+}
+
+ContextProperty::~ContextProperty()
+{
+}
+
+QString ContextProperty::key() const
+{
+    return myKey;
+}
+
+void ContextProperty::subscribe() const
+{
+    ++subscribeCount;
+}
+
+class ContextSubscriptionWatcherUnitTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanup();
+
+    // Tests
+    void alreadySubscribed();
+    void groupFinishes();
+    void deadline();
+    void propertyDestroyed();
+};
+
+void ContextSubscriptionWatcherUnitTest::initTestCase()
+{
+    qRegisterMetaType<ContextProperty*>("ContextProperty*");
+}
+
+void ContextSubscriptionWatcherUnitTest::cleanup()
+{
+    qDeleteAll(mockHandles);
+    mockHandles.clear();
+}
+
+void ContextSubscriptionWatcherUnitTest::alreadySubscribed()
+{
+    // Setup: a property whose subscription is complete
+    ContextProperty property("Test.Ready");
+    PropertyHandle::instance("Test.Ready")->pending = false;
+
+    // Test: watch it
+    ContextSubscriptionWatcher watcher(&property);
+    QSignalSpy subscribedSpy(&watcher, SIGNAL(propertySubscribed(ContextProperty*)));
+    QSignalSpy finishedSpy(&watcher, SIGNAL(finished()));
+
+    // Expected results: the property was subscribed, and the signals
+    // come from the event loop, not the constructor
+    QCOMPARE(property.subscribeCount, 1);
+    QCOMPARE(finishedSpy.count(), 0);
+    QCoreApplication::processEvents();
+    QCOMPARE(subscribedSpy.count(), 1);
+    QCOMPARE(finishedSpy.count(), 1);
+    QVERIFY(watcher.isFinished());
+    QVERIFY(!watcher.isTimedOut());
+}
+
+void ContextSubscriptionWatcherUnitTest::groupFinishes()
+{
+    // Setup: two pending properties, one of them twice in the group
+    ContextProperty one("Test.One");
+    ContextProperty two("Test.Two");
+    QList<ContextProperty*> properties;
+    properties << &one << &two << &one;
+
+    // Test: watch them and finish the subscriptions one by one
+    ContextSubscriptionWatcher watcher(properties, 5000);
+    QSignalSpy subscribedSpy(&watcher, SIGNAL(propertySubscribed(ContextProperty*)));
+    QSignalSpy finishedSpy(&watcher, SIGNAL(finished()));
+    QCoreApplication::processEvents();
+    QCOMPARE(subscribedSpy.count(), 0);
+    QCOMPARE(watcher.pendingProperties().size(), 2);
+
+    PropertyHandle::instance("Test.Two")->finishSubscription();
+    QCoreApplication::processEvents();
+
+    // Expected results: only the finished property is reported
+    QCOMPARE(subscribedSpy.count(), 1);
+    QCOMPARE(subscribedSpy.at(0).at(0).value<ContextProperty*>(), &two);
+    QCOMPARE(finishedSpy.count(), 0);
+    QCOMPARE(watcher.pendingProperties(), QList<ContextProperty*>() << &one);
+
+    PropertyHandle::instance("Test.One")->finishSubscription();
+    QCoreApplication::processEvents();
+
+    // Expected results: the group is finished
+    QCOMPARE(subscribedSpy.count(), 2);
+    QCOMPARE(finishedSpy.count(), 1);
+    QVERIFY(!watcher.isTimedOut());
+}
+
+void ContextSubscriptionWatcherUnitTest::deadline()
+{
+    // Setup: a pending property
+    ContextProperty property("Test.Slow");
+
+    // Test: watch it with a short deadline
+    ContextSubscriptionWatcher watcher(&property, 10);
+    QSignalSpy timedOutSpy(&watcher, SIGNAL(timedOut()));
+    QSignalSpy finishedSpy(&watcher, SIGNAL(finished()));
+    QTest::qWait(100);
+
+    // Expected results: the watcher gave up
+    QCOMPARE(timedOutSpy.count(), 1);
+    QCOMPARE(finishedSpy.count(), 1);
+    QVERIFY(watcher.isTimedOut());
+    QCOMPARE(watcher.pendingProperties(), QList<ContextProperty*>() << &property);
+
+    // Test: the subscription finishes later
+    QSignalSpy subscribedSpy(&watcher, SIGNAL(propertySubscribed(ContextProperty*)));
+    PropertyHandle::instance("Test.Slow")->finishSubscription();
+    QCoreApplication::processEvents();
+
+    // Expected results: nothing more is reported
+    QCOMPARE(subscribedSpy.count(), 0);
+    QCOMPARE(finishedSpy.count(), 1);
+}
+
+void ContextSubscriptionWatcherUnitTest::propertyDestroyed()
+{
+    // Setup: a pending property
+    ContextProperty *property = new ContextProperty("Test.Deleted");
+    ContextSubscriptionWatcher watcher(property);
+    QSignalSpy finishedSpy(&watcher, SIGNAL(finished()));
+
+    // Test: destroy the property
+    delete property;
+    QCoreApplication::processEvents();
+
+    // Expected results: the watcher has nothing left to wait for
+    QCOMPARE(finishedSpy.count(), 1);
+    QVERIFY(watcher.pendingProperties().isEmpty());
+}
+
+QTEST_MAIN(ContextSubscriptionWatcherUnitTest);
+#include "testcontextsubscriptionwatcher.moc"
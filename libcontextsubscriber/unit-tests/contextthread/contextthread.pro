@@ -0,0 +1,4 @@
+include(../../test.pri)
+TARGET = contextthread-unit-tests
+
+SOURCES = testcontextthread.cpp
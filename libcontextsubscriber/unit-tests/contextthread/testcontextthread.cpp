@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+#include <QObject>
+#include <QtTest/QtTest>
+#include <QThread>
+#include <QCoreApplication>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "contextthread.h" // Class to be tested
+#include "contextproperty.h"
+
+using ContextSubscriber::ContextThread;
+
+/// Runs \a check in a child process and returns true if it passed.
+/// The thread is chosen once per process, so each case needs a fresh
+/// one.
+static bool inChild(bool (*check)())
+{
+    pid_t pid = fork();
+    if (pid == 0)
+        _exit(check() ? 0 : 1);
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid)
+        return false;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static bool isMainThread()
+{
+    return !ContextThread::isEnabled() &&
+        ContextThread::thread() == QCoreApplication::instance()->thread();
+}
+
+static bool isOwnThread()
+{
+    QThread *thread = ContextThread::thread();
+    return ContextThread::isEnabled() && thread != 0 &&
+        thread != QCoreApplication::instance()->thread() && thread->isRunning() &&
+        ContextThread::thread() == thread;
+}
+
+static bool byDefault()
+{
+    unsetenv("CONTEXT_SUBSCRIBER_THREAD");
+    return isMainThread();
+}
+
+static bool byEnvironment()
+{
+    setenv("CONTEXT_SUBSCRIBER_THREAD", "1", 1);
+    return isOwnThread();
+}
+
+static bool disabledByEnvironment()
+{
+    setenv("CONTEXT_SUBSCRIBER_THREAD", "0", 1);
+    return isMainThread();
+}
+
+static bool bySetEnabled()
+{
+    unsetenv("CONTEXT_SUBSCRIBER_THREAD");
+    ContextProperty::setContextThreadEnabled(true);
+    return isOwnThread();
+}
+
+static bool setEnabledTooLate()
+{
+    unsetenv("CONTEXT_SUBSCRIBER_THREAD");
+    if (!isMainThread())
+        return false;
+    // The choice has been made already
+    ContextProperty::setContextThreadEnabled(true);
+    return isMainThread();
+}
+
+static bool disabledTooLate()
+{
+    unsetenv("CONTEXT_SUBSCRIBER_THREAD");
+    ContextThread::setEnabled(true);
+    if (!isOwnThread())
+        return false;
+    ContextThread::setEnabled(false);
+    return isOwnThread();
+}
+
+class ContextThreadUnitTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    // Tests
+    void defaults();
+    void environment();
+    void setEnabled();
+};
+
+void ContextThreadUnitTest::defaults()
+{
+    // Test and expected results:
+    // Without asking, the internals live in the main thread
+    QVERIFY(inChild(byDefault));
+}
+
+void ContextThreadUnitTest::environment()
+{
+    // Test and expected results:
+    // CONTEXT_SUBSCRIBER_THREAD=1 starts the context thread, and 0
+    // doesn't
+    QVERIFY(inChild(byEnvironment));
+    QVERIFY(inChild(disabledByEnvironment));
+}
+
+void ContextThreadUnitTest::setEnabled()
+{
+    // Test and expected results:
+    // setContextThreadEnabled() starts the context thread if called
+    // before the choice is made, and has no effect afterwards
+    QVERIFY(inChild(bySetEnabled));
+    QVERIFY(inChild(setEnabledTooLate));
+    QVERIFY(inChild(disabledTooLate));
+}
+
+QTEST_MAIN(ContextThreadUnitTest);
+#include "testcontextthread.moc"
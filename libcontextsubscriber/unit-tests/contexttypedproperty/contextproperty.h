@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+// This is a mock implementation
+
+#ifndef CONTEXTPROPERTY_H
+#define CONTEXTPROPERTY_H
+
+#include <QObject>
+#include <QString>
+#include <QVariant>
+
+class ContextPropertyInfo;
+
+class ContextProperty : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ContextProperty(const QString &key, QObject *parent = 0);
+    virtual ~ContextProperty();
+
+    QString key() const;
+    QVariant value() const;
+    const ContextPropertyInfo* info() const;
+
+    void subscribe() const;
+    void unsubscribe() const;
+    void waitForSubscription() const;
+
+    // For tests.  The library allocates the objects, so the mock can't
+    // have data members of its own; the values are kept in
+    // mockValues, keyed by the object.
+    void setValue(const QVariant &value);
+    static int valueCount;
+
+Q_SIGNALS:
+    void valueChanged();
+};
+
+#endif
@@ -0,0 +1,5 @@
+include(../../test.pri)
+TARGET = contexttypedproperty-unit-tests
+
+SOURCES = testcontexttypedproperty.cpp
+HEADERS = contextproperty.h
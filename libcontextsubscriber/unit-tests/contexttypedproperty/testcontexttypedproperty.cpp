@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+#include <QObject>
+#include <QtTest/QtTest>
+#include <QHash>
+
+// Mock header files
+#include "contextproperty.h"
+
+#include "contexttypedproperty.h" // Class to be tested
+
+// Mock implementation of ContextProperty
+
+QHash<const ContextProperty*, QString> mockKeys;
+QHash<const ContextProperty*, QVariant> mockValues;
+QHash<QString, QVariant> mockSubscriptionValues; // The values arriving with the subscription
+int ContextProperty::valueCount = 0;
+
+ContextProperty::ContextProperty(const QString &key, QObject *parent)
+    : QObject(parent)
+{
+    mockKeys.insert(this, key);
+}
+
+ContextProperty::~ContextProperty()
+{
+    mockKeys.remove(this);
+    mockValues.remove(this);
+}
+
+QString ContextProperty::key() const
+{
+    return mockKeys.value(this);
+}
+
+QVariant ContextProperty::value() const
+{
+    ++valueCount;
+    return mockValues.value(this);
+}
+
+const ContextPropertyInfo* ContextProperty::info() const
+{
+    return 0;
+}
+
+void ContextProperty::subscribe() const
+{
+}
+
+void ContextProperty::unsubscribe() const
+{
+}
+
+void ContextProperty::waitForSubscription() const
+{
+    // The value is there after the wait, but the valueChanged signal
+    // is still on its way.
+    if (mockSubscriptionValues.contains(key()))
+        mockValues.insert(this, mockSubscriptionValues.value(key()));
+}
+
+void ContextProperty::setValue(const QVariant &value)
+{
+    mockValues.insert(this, value);
+    Q_EMIT valueChanged();
+}
+
+class ContextTypedPropertyUnitTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+    void initialValue();
+    void convertOnDelivery();
+    void aggregates();
+    void nullValue();
+    void waitForSubscription();
+};
+
+void ContextTypedPropertyUnitTest::init()
+{
+    ContextProperty::valueCount = 0;
+    mockSubscriptionValues.clear();
+}
+
+void ContextTypedPropertyUnitTest::initialValue()
+{
+    // Test:
+    // Create a typed property for a key without a value
+    ContextIntProperty property("Test.Int");
+
+    // Expected results:
+    // The value is null and default constructed
+    QCOMPARE(property.key(), QString("Test.Int"));
+    QVERIFY(property.isNull());
+    QCOMPARE(property.value(), 0);
+    QCOMPARE(property.value(42), 42);
+}
+
+void ContextTypedPropertyUnitTest::convertOnDelivery()
+{
+    // Setup:
+    ContextIntProperty property("Test.Int");
+    QSignalSpy spy(&property, SIGNAL(valueChanged()));
+
+    // Test:
+    // Deliver a new value and read it many times
+    property.property()->setValue(QVariant(QString("17")));
+    ContextProperty::valueCount = 0;
+    for (int i = 0; i < 10; ++i)
+        QCOMPARE(property.value(), 17);
+
+    // Expected results:
+    // The value was converted once, when it was delivered
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(ContextProperty::valueCount, 0);
+    QVERIFY(!property.isNull());
+    QCOMPARE(property.value(42), 17);
+}
+
+void ContextTypedPropertyUnitTest::aggregates()
+{
+    // Setup:
+    ContextMapProperty map("Test.Map");
+    ContextTypedProperty<QStringList> list("Test.List");
+    ContextDurationProperty duration("Test.Duration");
+
+    // Test:
+    QVariantMap value;
+    value.insert("latitude", 60.17);
+    map.property()->setValue(value);
+    list.property()->setValue(QStringList() << "foo" << "bar");
+    duration.property()->setValue(QVariant(Duration::NANOSECS_PER_MIN));
+
+    // Expected results:
+    // The references point to the converted values
+    const QVariantMap &mapRef = map.value();
+    QCOMPARE(mapRef.value("latitude").toDouble(), 60.17);
+    QCOMPARE(list.value(), QStringList() << "foo" << "bar");
+    QCOMPARE(duration.value().minutes(), 1);
+}
+
+void ContextTypedPropertyUnitTest::nullValue()
+{
+    // Setup:
+    ContextStringProperty property("Test.String");
+    property.property()->setValue(QVariant(QString("hello")));
+    QCOMPARE(property.value(), QString("hello"));
+
+    // Test:
+    // The property loses its value
+    property.property()->setValue(QVariant());
+
+    // Expected results:
+    // The value is reset
+    QVERIFY(property.isNull());
+    QCOMPARE(property.value(), QString());
+    QCOMPARE(property.value(QString("default")), QString("default"));
+}
+
+void ContextTypedPropertyUnitTest::waitForSubscription()
+{
+    // Setup:
+    mockSubscriptionValues.insert("Test.Wait", QVariant(5));
+    ContextIntProperty property("Test.Wait");
+    QSignalSpy spy(&property, SIGNAL(valueChanged()));
+    QVERIFY(property.isNull());
+
+    // Test:
+    property.waitForSubscription();
+
+    // Expected results:
+    // The value is available right after the wait, without waiting
+    // for the valueChanged signal
+    QCOMPARE(spy.count(), 0);
+    QVERIFY(!property.isNull());
+    QCOMPARE(property.value(), 5);
+}
+
+QTEST_MAIN(ContextTypedPropertyUnitTest);
+#include "testcontexttypedproperty.moc"
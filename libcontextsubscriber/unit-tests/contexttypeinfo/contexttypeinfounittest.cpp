@@ -23,6 +23,7 @@
 #include <QtCore>
 #include "fileutils.h"
 #include "contexttypeinfo.h"
+#include "contexttypevalidator.h"
 #include "contexttyperegistryinfo.h"
 
 class ContextTypeInfoUnitTest : public QObject
@@ -42,6 +43,7 @@ private Q_SLOTS:
     void parameterNode();
     void parameters();
     void typeCheck();
+    void validator();
 };
 
 void ContextTypeInfoUnitTest::initTestCase()
@@ -237,6 +239,46 @@ void ContextTypeInfoUnitTest::typeCheck()
     }
 }
 
+void ContextTypeInfoUnitTest::validator()
+{
+    {
+        ContextTypeValidator validator(TI(LIST("string-enum" <<
+                                               LIST("foo") <<
+                                               LIST("bar"))));
+        QCOMPARE(validator.name(), QString("string-enum"));
+        QVERIFY(validator.check(QVariant("foo")));
+        QVERIFY(validator.check(QVariant("bar")));
+        QVERIFY(!validator.check(QVariant("baz")));
+    }
+
+    {
+        ContextTypeValidator validator(TI(LIST("int-enum" <<
+                                               LIST("one" << LIST("value" << "1")) <<
+                                               LIST("two" << LIST("value" << "2")))));
+        QVERIFY(validator.check(QVariant(1)));
+        QVERIFY(validator.check(QVariant(2)));
+        QVERIFY(!validator.check(QVariant(3)));
+    }
+
+    {
+        ContextTypeValidator validator(TI(LIST("list" <<
+                                               LIST("max" << "2") <<
+                                               LIST("type" <<
+                                                    LIST("map" <<
+                                                         LIST("foo" <<
+                                                              LIST("type" << "string")))))));
+        QVariantMap good;
+        good.insert("foo", "a string");
+        QVariantMap bad;
+        bad.insert("foo", 23);
+        QVERIFY(validator.check(QVariantList() << good << good));
+        QVERIFY(!validator.check(QVariantList() << good << bad));
+        QVERIFY(!validator.check(QVariantList() << good << good << good));
+        // The validator can be used again and again
+        QVERIFY(validator.check(QVariantList() << good));
+    }
+}
+
 #undef TI
 #undef LIST
 
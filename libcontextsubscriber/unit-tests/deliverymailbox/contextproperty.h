@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+// This is a mock implementation
+
+#ifndef CONTEXTPROPERTY_H
+#define CONTEXTPROPERTY_H
+
+#include <QObject>
+#include <QVariant>
+#include <QList>
+#include <QMutex>
+
+class QThread;
+
+namespace ContextSubscriber {
+class PropertyHandle;
+class DeliveryMailbox;
+}
+
+class ContextProperty : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ContextProperty(ContextSubscriber::PropertyHandle *handle);
+    void deliver(const QVariant &value);
+
+    // For tests
+    ContextSubscriber::PropertyHandle *handle;
+    ContextSubscriber::DeliveryMailbox *mailbox;
+    ContextProperty *detachOnDelivery; ///< Detached when we get a value
+    QList<QVariant> delivered;
+    QList<QThread*> deliveredThreads;
+    QMutex deliveredLock;
+
+public Q_SLOTS:
+    void attach();
+    void detach();
+};
+
+#endif
@@ -0,0 +1,5 @@
+include(../../test.pri)
+TARGET = deliverymailbox-unit-tests
+
+SOURCES = testdeliverymailbox.cpp
+HEADERS = propertyhandle.h contextproperty.h
@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+#include <QObject>
+#include <QtTest/QtTest>
+#include <QThread>
+#include <QCoreApplication>
+
+// Mock header files
+#include "propertyhandle.h"
+#include "contextproperty.h"
+
+#include "deliverymailbox.h" // Class to be tested
+
+using namespace ContextSubscriber;
+
+// Mock implementation of PropertyHandle
+
+PropertyHandle::PropertyHandle()
+{
+}
+
+QVariant PropertyHandle::value()
+{
+    return myValue;
+}
+
+void PropertyHandle::addMailbox(DeliveryMailbox *mailbox)
+{
+    QMutexLocker locker(&mailboxLock);
+    mailboxes.append(mailbox);
+}
+
+void PropertyHandle::removeMailbox(DeliveryMailbox *mailbox)
+{
+    QMutexLocker locker(&mailboxLock);
+    mailboxes.removeOne(mailbox);
+}
+
+// Mock implementation of ContextProperty
+
+ContextProperty::ContextProperty(PropertyHandle *handle)
+    : handle(handle), mailbox(0), detachOnDelivery(0)
+{
+}
+
+void ContextProperty::deliver(const QVariant &value)
+{
+    {
+        QMutexLocker locker(&deliveredLock);
+        delivered << value;
+        deliveredThreads << QThread::currentThread();
+    }
+    if (detachOnDelivery)
+        detachOnDelivery->detach();
+}
+
+/// Attaches to the mailbox of the current thread, like the real
+/// ContextProperty does when subscribed or moved to another thread.
+void ContextProperty::attach()
+{
+    mailbox = DeliveryMailbox::attach(handle, this);
+}
+
+void ContextProperty::detach()
+{
+    if (mailbox)
+        mailbox->detach(handle, this);
+    mailbox = 0;
+}
+
+class DeliveryMailboxUnitTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    // Tests
+    void coalescing();
+    void detachDuringDelivery();
+    void detachSelfDuringDelivery();
+    void moveToThread();
+};
+
+void DeliveryMailboxUnitTest::coalescing()
+{
+    // Setup:
+    PropertyHandle handle;
+    ContextProperty property(&handle);
+    ContextProperty other(&handle);
+    property.attach();
+    other.attach();
+
+    // Expected results:
+    // The properties of one thread share one mailbox
+    QVERIFY(property.mailbox != 0);
+    QVERIFY(property.mailbox == other.mailbox);
+    QCOMPARE(handle.mailboxes.size(), 1);
+
+    // Test:
+    // The handle changes many times before the thread gets to run
+    for (int i = 1; i <= 10; ++i) {
+        handle.myValue = i;
+        property.mailbox->post(&handle);
+    }
+
+    // Expected results:
+    // Nothing is delivered until the event loop runs, and then only
+    // the latest value, once
+    QVERIFY(property.delivered.isEmpty());
+    QCoreApplication::processEvents();
+    QCOMPARE(property.delivered, QList<QVariant>() << QVariant(10));
+    QCOMPARE(other.delivered, QList<QVariant>() << QVariant(10));
+
+    // Test:
+    // Another change after the delivery
+    handle.myValue = 11;
+    property.mailbox->post(&handle);
+    QCoreApplication::processEvents();
+
+    // Expected results:
+    // It's delivered too
+    QCOMPARE(property.delivered, QList<QVariant>() << QVariant(10) << QVariant(11));
+
+    // Test:
+    // The last properties detach
+    property.detach();
+    other.detach();
+
+    // Expected results:
+    // The handle doesn't post to the mailbox any more
+    QVERIFY(handle.mailboxes.isEmpty());
+    QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+}
+
+void DeliveryMailboxUnitTest::detachDuringDelivery()
+{
+    // Setup:
+    // The first property detaches the second one when it gets a value
+    PropertyHandle handle;
+    ContextProperty first(&handle);
+    ContextProperty second(&handle);
+    ContextProperty third(&handle);
+    first.attach();
+    second.attach();
+    third.attach();
+    first.detachOnDelivery = &second;
+
+    // Test:
+    handle.myValue = 1;
+    first.mailbox->post(&handle);
+    QCoreApplication::processEvents();
+
+    // Expected results:
+    // The detached property doesn't get the value, the others do
+    QCOMPARE(first.delivered.size(), 1);
+    QCOMPARE(second.delivered.size(), 0);
+    QCOMPARE(third.delivered.size(), 1);
+
+    // Test:
+    // The next change
+    first.detachOnDelivery = 0;
+    handle.myValue = 2;
+    first.mailbox->post(&handle);
+    QCoreApplication::processEvents();
+
+    // Expected results:
+    // The detached property stays detached
+    QCOMPARE(first.delivered.size(), 2);
+    QCOMPARE(second.delivered.size(), 0);
+    QCOMPARE(third.delivered.size(), 2);
+
+    first.detach();
+    third.detach();
+    QVERIFY(handle.mailboxes.isEmpty());
+    QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+}
+
+void DeliveryMailboxUnitTest::detachSelfDuringDelivery()
+{
+    // Setup:
+    // The only property detaches itself when it gets a value
+    PropertyHandle handle;
+    ContextProperty property(&handle);
+    property.attach();
+    property.detachOnDelivery = &property;
+
+    // Test:
+    handle.myValue = 1;
+    property.mailbox->post(&handle);
+    QCoreApplication::processEvents();
+
+    // Expected results:
+    // The value was delivered, and the mailbox was released afterwards
+    QCOMPARE(property.delivered.size(), 1);
+    QVERIFY(handle.mailboxes.isEmpty());
+    QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+}
+
+void DeliveryMailboxUnitTest::moveToThread()
+{
+    // Setup:
+    PropertyHandle handle;
+    ContextProperty property(&handle);
+    property.attach();
+    QThread worker;
+    worker.start();
+
+    // Test:
+    // Move the property like ContextProperty does: detach from the
+    // mailbox of the old thread, attach to the one of the new thread
+    property.detach();
+    property.moveToThread(&worker);
+    QMetaObject::invokeMethod(&property, "attach", Qt::BlockingQueuedConnection);
+    handle.myValue = 1;
+    QCOMPARE(handle.mailboxes.size(), 1);
+    handle.mailboxes.at(0)->post(&handle);
+
+    // Expected results:
+    // The value is delivered in the new thread
+    for (int i = 0; i < 500 && property.delivered.isEmpty(); ++i)
+        QTest::qWait(10);
+    {
+        QMutexLocker locker(&property.deliveredLock);
+        QCOMPARE(property.delivered, QList<QVariant>() << QVariant(1));
+        QCOMPARE(property.deliveredThreads.at(0), &worker);
+    }
+
+    QMetaObject::invokeMethod(&property, "detach", Qt::BlockingQueuedConnection);
+    QVERIFY(handle.mailboxes.isEmpty());
+    worker.quit();
+    QVERIFY(worker.wait(5000));
+}
+
+QTEST_MAIN(DeliveryMailboxUnitTest);
+#include "testdeliverymailbox.moc"
@@ -32,6 +32,7 @@
 namespace ContextSubscriber {
 
 class Provider;
+struct ProviderSlot;
 
 class PropertyHandle : public QObject
 {
@@ -39,7 +40,7 @@ class PropertyHandle : public QObject
 
 public:
     static PropertyHandle* instance(const QString& key);
-    void onValueChanged();
+    void onValueChanged(const ProviderSlot *changed = 0);
     void setSubscribeFinished(Provider *);
 
 Q_SIGNALS:
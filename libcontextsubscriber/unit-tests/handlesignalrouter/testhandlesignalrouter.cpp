@@ -27,6 +27,7 @@
 
 // Header file of the class to be tested
 #include "handlesignalrouter.h"
+#include "provider.h"
 
 #include <QtTest/QtTest>
 #include <QDebug>
@@ -80,7 +81,7 @@ PropertyHandle::PropertyHandle(const QString& key)
 {
 }
 
-void PropertyHandle::onValueChanged()
+void PropertyHandle::onValueChanged(const ProviderSlot *)
 {
     Q_EMIT onValueChangedCalled(myKey);
 }
@@ -162,7 +163,8 @@ void HandleSignalRouterUnitTests::routingSignals()
 
     // Test:
     // Send a signal to the HandleSignalRouter
-    handleSignalRouter->onValueChanged("Property.One");
+    ProviderSlot slotOne(mockHandleOne);
+    handleSignalRouter->onValueChanged(&slotOne);
     handleSignalRouter->onSubscribeFinished(0, "Property.One");
 
     // Expected results:
@@ -185,7 +187,8 @@ void HandleSignalRouterUnitTests::routingSignals()
 
     // Test:
     // Send a signal to the HandleSignalRouter
-    handleSignalRouter->onValueChanged("Property.Two");
+    ProviderSlot slotTwo(mockHandleTwo);
+    handleSignalRouter->onValueChanged(&slotTwo);
     handleSignalRouter->onSubscribeFinished(0, "Property.Two");
 
     // Expected results:
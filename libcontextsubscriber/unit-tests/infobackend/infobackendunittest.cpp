@@ -86,6 +86,11 @@ public:
         return false;
     }
 
+    QString mergePolicyForKey(QString key) const
+    {
+        return QString();
+    }
+
     const QList<ContextProviderInfo> providersForKey(QString key) const
     {
         return QList<ContextProviderInfo> ();
@@ -103,7 +108,9 @@ private Q_SLOTS:
     void checkAndEmitKeysAdded();
     void checkAndEmitKeysRemoved();
     void checkAndEmitKeyChanged();
+    void checkAndEmitKeyChangedDigests();
     void connectNotify();
+    void keyNotifier();
     void instance();
     void cleanupTestCase();
 };
@@ -169,6 +176,30 @@ void InfoBackendUnitTest::checkAndEmitKeyChanged()
     QCOMPARE(spy.count(), 3);
 }
 
+void InfoBackendUnitTest::checkAndEmitKeyChangedDigests()
+{
+    QSignalSpy spy(backend, SIGNAL(keyChanged(QString)));
+
+    QHash<QString, QByteArray> currentDigests;
+    QHash<QString, QByteArray> oldDigests;
+
+    currentDigests.insert("Key.Same", "aaaa");
+    currentDigests.insert("Key.Changed", "bbbb");
+    currentDigests.insert("Key.Added", "cccc");
+    oldDigests.insert("Key.Same", "aaaa");
+    oldDigests.insert("Key.Changed", "dddd");
+    oldDigests.insert("Key.Removed", "eeee");
+
+    backend->checkAndEmitKeyChanged(currentDigests, oldDigests);
+
+    QCOMPARE(spy.count(), 3);
+    QStringList keys;
+    while (spy.count() > 0)
+        keys << spy.takeFirst().at(0).toString();
+    keys.sort();
+    QCOMPARE(keys, QStringList() << "Key.Added" << "Key.Changed" << "Key.Removed");
+}
+
 void InfoBackendUnitTest::connectNotify()
 {
     QCOMPARE(backend->connectCount, 0);
@@ -178,6 +209,34 @@ void InfoBackendUnitTest::connectNotify()
     QCOMPARE(backend->connectCount, 0);
 }
 
+void InfoBackendUnitTest::keyNotifier()
+{
+    QObject *notifier1 = backend->keyNotifier("Key.One");
+    QObject *notifier2 = backend->keyNotifier("Key.Two");
+    QVERIFY(notifier1 != notifier2);
+    QCOMPARE(backend->keyNotifier("Key.One"), notifier1);
+
+    QSignalSpy spy1(notifier1, SIGNAL(keyChanged(QString)));
+    QSignalSpy spy2(notifier2, SIGNAL(keyChanged(QString)));
+    QSignalSpy spy(backend, SIGNAL(keyChanged(QString)));
+
+    QHash<QString, QByteArray> currentDigests;
+    QHash<QString, QByteArray> oldDigests;
+    currentDigests.insert("Key.One", "aaaa");
+    currentDigests.insert("Key.Two", "bbbb");
+    currentDigests.insert("Key.Three", "cccc");
+    oldDigests.insert("Key.One", "dddd");
+    oldDigests.insert("Key.Two", "bbbb");
+
+    backend->checkAndEmitKeyChanged(currentDigests, oldDigests);
+
+    // The notifiers get only the changes of their own key
+    QCOMPARE(spy1.count(), 1);
+    QCOMPARE(spy1.takeFirst().at(0).toString(), QString("Key.One"));
+    QCOMPARE(spy2.count(), 0);
+    QCOMPARE(spy.count(), 2);
+}
+
 void InfoBackendUnitTest::instance()
 {
     InfoBackend::destroyInstance();
@@ -199,6 +258,13 @@ void InfoBackendUnitTest::instance()
     InfoBackend::destroyInstance();
     QVERIFY(InfoBackend::backendInstance == NULL);
 
+    InfoBackend::backendInstance = NULL;
+    instance = InfoBackend::instance("flat");
+    QCOMPARE(instance, InfoBackend::backendInstance);
+    QCOMPARE(instance->name(), QString("flat"));
+    InfoBackend::destroyInstance();
+    QVERIFY(InfoBackend::backendInstance == NULL);
+
     InfoBackend::backendInstance = new InfoTestBackend();
     InfoBackend::destroyInstance();
     QVERIFY(InfoBackend::backendInstance == NULL);
@@ -65,6 +65,7 @@ private Q_SLOTS:
     void docForKey();
     void keyDeclared();
     void keyDeprecated();
+    void mergePolicyForKey();
     void providersForKey();
     void dynamics();
     void removed();
@@ -86,6 +87,7 @@ void InfoCdbBackendUnitTest::createBaseDatabase(QString path)
     writer.add("Internet.BytesOut:KEYTYPEINFO", ContextTypeInfo(QString("int64")));
     writer.add("Battery.Charging:KEYDOC", "doc1");
     writer.add("Key.Deprecated:KEYDEPRECATED", true);
+    writer.add("Internet.BytesOut:KEYMERGE", "priority");
 
     QVariantList providers1;
     QHash <QString, QVariant> provider1;
@@ -114,6 +116,11 @@ void InfoCdbBackendUnitTest::createAlternateDatabase(QString path)
     writer.add("KEYS", "Battery.Charging");
     writer.add("KEYS", "Battery.Capacity");
     writer.add("KEYS", "Key.Deprecated");
+    // Written like update-contextkit-providers does it
+    writer.add("KEYDECLARED", true);
+    writer.add("Battery.Charging:KEYDECLARED", true);
+    writer.add("Battery.Capacity:KEYDECLARED", true);
+    writer.add("Key.Deprecated:KEYDECLARED", true);
     writer.add("Battery.Charging:KEYTYPEINFO", ContextTypeInfo(QString("int64")));
     writer.add("Battery.Charging:KEYDOC", "doc1");
     writer.add("Battery.Capacity:KEYTYPEINFO", ContextTypeInfo(QString("int64")));
@@ -228,6 +235,13 @@ void InfoCdbBackendUnitTest::keyDeprecated()
     QCOMPARE(backend->keyDeprecated("Key.Deprecated"), true);
 }
 
+void InfoCdbBackendUnitTest::mergePolicyForKey()
+{
+    QCOMPARE(backend->mergePolicyForKey("Battery.Charging"), QString());
+    QCOMPARE(backend->mergePolicyForKey("Key.does.not.exist"), QString());
+    QCOMPARE(backend->mergePolicyForKey("Internet.BytesOut"), QString("priority"));
+}
+
 void InfoCdbBackendUnitTest::providersForKey()
 {
     QList <ContextProviderInfo> list1 = backend->providersForKey("Battery.Charging");
@@ -261,6 +275,10 @@ void InfoCdbBackendUnitTest::dynamics()
     QVERIFY(backend->listKeys().contains("Battery.Capacity"));
     QCOMPARE(backend->typeInfoForKey("Battery.Charging").name(), QString("int64"));
     QCOMPARE(backend->docForKey("Battery.Charging"), QString("doc1"));
+    QCOMPARE(backend->keyDeclared("Battery.Capacity"), true);
+    QCOMPARE(backend->keyDeclared("Key.Deprecated"), true);
+    QCOMPARE(backend->keyDeclared("Internet.BytesOut"), false);
+    QCOMPARE(backend->keyDeclared("Does.Not.Exist"), false);
 
     // Check providers
     QList <ContextProviderInfo> list1 = backend->providersForKey("Battery.Charging");
@@ -286,7 +304,15 @@ void InfoCdbBackendUnitTest::dynamics()
     QCOMPARE(args2.at(0).toStringList().at(0), QString("Battery.Charging"));
     QCOMPARE(args2.at(0).toStringList().at(1), QString("Battery.Capacity"));
 
-    QCOMPARE(spy3.count(), 4);
+    // Key.Deprecated is described the same way in both databases
+    QCOMPARE(spy3.count(), 3);
+    QStringList changedKeys;
+    while (spy3.count() > 0)
+        changedKeys << spy3.takeFirst().at(0).toString();
+    QVERIFY(changedKeys.contains("Battery.Charging"));
+    QVERIFY(changedKeys.contains("Battery.Capacity"));
+    QVERIFY(changedKeys.contains("Internet.BytesOut"));
+    QVERIFY(!changedKeys.contains("Key.Deprecated"));
 
     QCOMPARE(spy4.count(), 1);
     QList<QVariant> args4 = spy4.takeFirst();
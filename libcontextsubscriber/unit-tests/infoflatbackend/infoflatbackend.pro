@@ -0,0 +1,6 @@
+include(../../test.pri)
+TARGET = infoflatbackendunittest
+
+SOURCES = infoflatbackendunittest.cpp
+
+INCLUDEPATH += ../util
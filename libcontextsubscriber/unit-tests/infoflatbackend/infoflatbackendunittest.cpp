@@ -0,0 +1,384 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <QtTest/QtTest>
+#include <QtCore>
+#include <fcntl.h>
+#include "fileutils.h"
+#include "infoflatbackend.h"
+#include "flatregistrywriter.h"
+#include "flatregistryreader.h"
+#include "cdbwriter.h"
+
+class InfoFlatBackendUnitTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    void writeCache(const QString &path, const FlatRegistryWriter &writer);
+    void writeDatabase(const QString &path, const QString &generation,
+                       const QString &chargingDoc = "doc1");
+    FlatRegistryWriter *baseWriter(const QString &compatibility = BACKEND_COMPATIBILITY_NAMESPACE,
+                                   const QString &generation = "gen1");
+
+private Q_SLOTS:
+    void initTestCase();
+    void reader();
+    void manyKeys();
+    void invalidFiles();
+    void backend();
+    void dynamics();
+    void incompatible();
+    void stale();
+    void handover();
+    void cleanupTestCase();
+};
+
+void InfoFlatBackendUnitTest::writeCache(const QString &path, const FlatRegistryWriter &writer)
+{
+    int fd = open(path.toLocal8Bit().constData(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    QVERIFY(fd >= 0);
+    QVERIFY(writer.write(fd));
+    close(fd);
+}
+
+/// Writes a cdb database with the keys of baseWriter(), the same
+/// way update-contextkit-providers writes it.
+void InfoFlatBackendUnitTest::writeDatabase(const QString &path, const QString &generation,
+                                            const QString &chargingDoc)
+{
+    CDBWriter writer(path);
+    QVERIFY(writer.isWritable());
+    writer.add("VERSION", BACKEND_COMPATIBILITY_NAMESPACE);
+    writer.add("GENERATION", generation);
+    writer.add("KEYDECLARED", true);
+
+    QHash<QString, QVariant> provider1;
+    provider1.insert("plugin", "contextkit-dbus");
+    provider1.insert("constructionString", "system:org.freedesktop.ContextKit.contextd1");
+    QHash<QString, QVariant> provider2;
+    provider2.insert("plugin", "contextkit-dbus");
+    provider2.insert("constructionString", "session:org.freedesktop.ContextKit.contextd2");
+
+    writer.add("KEYS", "Battery.Charging");
+    writer.add("Battery.Charging:KEYDECLARED", true);
+    writer.add("Battery.Charging:KEYTYPEINFO", QVariant("bool"));
+    writer.add("Battery.Charging:KEYDOC", chargingDoc);
+    writer.add("Battery.Charging:KEYDEPRECATED", false);
+    writer.add("Battery.Charging:PROVIDERS", QVariantList() << QVariant(provider1));
+
+    writer.add("KEYS", "Internet.BytesOut");
+    writer.add("Internet.BytesOut:KEYDECLARED", true);
+    writer.add("Internet.BytesOut:KEYTYPEINFO", QVariant(QVariantList() << "int64"));
+    writer.add("Internet.BytesOut:KEYDEPRECATED", false);
+    writer.add("Internet.BytesOut:KEYMERGE", "priority");
+    writer.add("Internet.BytesOut:PROVIDERS", QVariantList() << QVariant(provider2) << QVariant(provider1));
+
+    writer.add("KEYS", "Key.Deprecated");
+    writer.add("Key.Deprecated:KEYDECLARED", true);
+    writer.add("Key.Deprecated:KEYDEPRECATED", true);
+    writer.add("Key.Deprecated:PROVIDERS", QVariantList());
+    writer.close();
+}
+
+FlatRegistryWriter *InfoFlatBackendUnitTest::baseWriter(const QString &compatibility,
+                                                        const QString &generation)
+{
+    FlatRegistryWriter *writer = new FlatRegistryWriter(compatibility, generation);
+    QList<ContextProviderInfo> providers1;
+    providers1 << ContextProviderInfo("contextkit-dbus", "system:org.freedesktop.ContextKit.contextd1");
+    QList<ContextProviderInfo> providers2;
+    providers2 << ContextProviderInfo("contextkit-dbus", "session:org.freedesktop.ContextKit.contextd2");
+    providers2 << ContextProviderInfo("contextkit-dbus", "system:org.freedesktop.ContextKit.contextd1");
+
+    writer->addKey("Battery.Charging", QVariant("bool"), "doc1", false, "", providers1);
+    writer->addKey("Internet.BytesOut", QVariant(QVariantList() << "int64"), "", false, "priority", providers2);
+    writer->addKey("Key.Deprecated", QVariant(), "", true, "", QList<ContextProviderInfo>());
+    return writer;
+}
+
+void InfoFlatBackendUnitTest::initTestCase()
+{
+    utilSetEnv("CONTEXT_PROVIDERS", "./");
+    QFile::remove("cache.flat");
+    QFile::remove("cache.cdb");
+}
+
+void InfoFlatBackendUnitTest::reader()
+{
+    FlatRegistryWriter *writer = baseWriter();
+    writeCache("reader.flat", *writer);
+    delete writer;
+
+    FlatRegistryReader reader("reader.flat");
+    QVERIFY(reader.isReadable());
+    QCOMPARE(reader.compatibility(), QString(BACKEND_COMPATIBILITY_NAMESPACE));
+    QCOMPARE(reader.generation(), QString("gen1"));
+    QCOMPARE(reader.keyCount(), 3);
+    QCOMPARE(reader.indexOf("Does.Not.Exist"), -1);
+
+    int charging = reader.indexOf("Battery.Charging");
+    QVERIFY(charging >= 0);
+    QCOMPARE(reader.keyName(charging), QString("Battery.Charging"));
+    QCOMPARE(reader.typeInfo(charging), QVariant("bool"));
+    QCOMPARE(reader.doc(charging), QString("doc1"));
+    QCOMPARE(reader.deprecated(charging), false);
+    QCOMPARE(reader.mergePolicy(charging), QString());
+    QCOMPARE(reader.providers(charging).size(), 1);
+    QCOMPARE(reader.providers(charging).at(0).constructionString,
+             QString("system:org.freedesktop.ContextKit.contextd1"));
+
+    int bytesOut = reader.indexOf("Internet.BytesOut");
+    QVERIFY(bytesOut >= 0 && bytesOut != charging);
+    QCOMPARE(reader.typeInfo(bytesOut), QVariant(QVariantList() << "int64"));
+    QCOMPARE(reader.mergePolicy(bytesOut), QString("priority"));
+    QList<ContextProviderInfo> providers = reader.providers(bytesOut);
+    QCOMPARE(providers.size(), 2);
+    QCOMPARE(providers.at(0).plugin, QString("contextkit-dbus"));
+    QCOMPARE(providers.at(0).constructionString, QString("session:org.freedesktop.ContextKit.contextd2"));
+    QCOMPARE(providers.at(1).constructionString, QString("system:org.freedesktop.ContextKit.contextd1"));
+
+    int deprecated = reader.indexOf("Key.Deprecated");
+    QVERIFY(deprecated >= 0);
+    QCOMPARE(reader.deprecated(deprecated), true);
+    QVERIFY(reader.typeInfo(deprecated).isNull());
+    QCOMPARE(reader.providers(deprecated).size(), 0);
+}
+
+void InfoFlatBackendUnitTest::manyKeys()
+{
+    FlatRegistryWriter writer(BACKEND_COMPATIBILITY_NAMESPACE);
+    for (int i = 0; i < 3000; ++i)
+        writer.addKey(QString("Some.Key%1").arg(i), QVariant("integer"), QString::number(i), false, "",
+                      QList<ContextProviderInfo>() << ContextProviderInfo("contextkit-dbus", "session:a"));
+    writeCache("many.flat", writer);
+
+    FlatRegistryReader reader("many.flat");
+    QVERIFY(reader.isReadable());
+    QCOMPARE(reader.keyCount(), 3000);
+    QSet<int> indices;
+    for (int i = 0; i < 3000; ++i) {
+        int index = reader.indexOf(QString("Some.Key%1").arg(i));
+        QVERIFY(index >= 0 && index < 3000);
+        QCOMPARE(reader.doc(index), QString::number(i));
+        indices.insert(index);
+    }
+    QCOMPARE(indices.size(), 3000);
+    QCOMPARE(reader.indexOf("Some.Key3000"), -1);
+    QCOMPARE(reader.indexOf("Some.Key"), -1);
+}
+
+void InfoFlatBackendUnitTest::invalidFiles()
+{
+    FlatRegistryWriter *writer = baseWriter();
+    QByteArray data = writer->data();
+    delete writer;
+
+    // Truncated
+    QFile truncated("invalid.flat");
+    QVERIFY(truncated.open(QIODevice::WriteOnly));
+    truncated.write(data.left(data.size() - 4));
+    truncated.close();
+    QVERIFY(!FlatRegistryReader("invalid.flat").isReadable());
+
+    // Not ours
+    QFile garbage("invalid.flat");
+    QVERIFY(garbage.open(QIODevice::WriteOnly));
+    garbage.write(QByteArray(data.size(), 'x'));
+    garbage.close();
+    QVERIFY(!FlatRegistryReader("invalid.flat").isReadable());
+
+    QVERIFY(!FlatRegistryReader("does-not-exist.flat").isReadable());
+    QCOMPARE(FlatRegistryReader("does-not-exist.flat").indexOf("Battery.Charging"), -1);
+}
+
+void InfoFlatBackendUnitTest::backend()
+{
+    FlatRegistryWriter *writer = baseWriter();
+    writeCache("cache.flat", *writer);
+    delete writer;
+    writeDatabase("cache.cdb", "gen1");
+
+    QCOMPARE(InfoFlatBackend::databaseExists(), true);
+    QCOMPARE(InfoFlatBackend::databaseUsable(), true);
+    InfoFlatBackend backend;
+    QCOMPARE(backend.name(), QString("flat"));
+
+    QStringList keys = backend.listKeys();
+    QCOMPARE(keys.count(), 3);
+    QVERIFY(keys.contains("Battery.Charging"));
+    QVERIFY(keys.contains("Internet.BytesOut"));
+    QVERIFY(keys.contains("Key.Deprecated"));
+
+    QCOMPARE(backend.keyDeclared("Battery.Charging"), true);
+    QCOMPARE(backend.keyDeclared("Does.Not.Exist"), false);
+    QCOMPARE(backend.typeInfoForKey("Battery.Charging").name(), QString("bool"));
+    QCOMPARE(backend.typeInfoForKey("Internet.BytesOut").name(), QString("int64"));
+    QVERIFY(backend.typeInfoForKey("Does.Not.Exist").isNull());
+    QCOMPARE(backend.docForKey("Battery.Charging"), QString("doc1"));
+    QCOMPARE(backend.docForKey("Does.Not.Exist"), QString());
+    QCOMPARE(backend.keyDeprecated("Key.Deprecated"), true);
+    QCOMPARE(backend.keyDeprecated("Battery.Charging"), false);
+    QCOMPARE(backend.mergePolicyForKey("Internet.BytesOut"), QString("priority"));
+    QCOMPARE(backend.mergePolicyForKey("Battery.Charging"), QString());
+    QCOMPARE(backend.providersForKey("Internet.BytesOut").size(), 2);
+    QCOMPARE(backend.providersForKey("Does.Not.Exist").size(), 0);
+}
+
+void InfoFlatBackendUnitTest::dynamics()
+{
+    FlatRegistryWriter *writer = baseWriter();
+    writeCache("cache.flat", *writer);
+    delete writer;
+    writeDatabase("cache.cdb", "gen1");
+    InfoFlatBackend backend;
+    QCOMPARE(backend.listKeys().count(), 3);
+    QHash<QString, QByteArray> oldDigests = backend.keyDigests();
+    QCOMPARE(oldDigests.size(), 3);
+    QVERIFY(oldDigests.value("Battery.Charging") != oldDigests.value("Key.Deprecated"));
+
+    FlatRegistryWriter next(BACKEND_COMPATIBILITY_NAMESPACE, "gen2");
+    next.addKey("Battery.Capacity", QVariant("integer"), "doc3", false, "",
+                QList<ContextProviderInfo>() << ContextProviderInfo("contextkit-dbus", "session:a"));
+    next.addKey("Battery.Charging", QVariant("bool"), "doc2", false, "",
+                QList<ContextProviderInfo>() << ContextProviderInfo("contextkit-dbus", "system:org.freedesktop.ContextKit.contextd1"));
+    next.addKey("Key.Deprecated", QVariant(), "", true, "", QList<ContextProviderInfo>());
+    writeCache("cache-next.flat", next);
+    writeDatabase("cache-next.cdb", "gen2");
+    // Replaced atomically, like update-contextkit-providers does it
+    QVERIFY(rename("cache-next.cdb", "cache.cdb") == 0);
+    QVERIFY(rename("cache-next.flat", "cache.flat") == 0);
+    QTest::qWait(DEFAULT_WAIT_PERIOD);
+
+    QCOMPARE(backend.listKeys().count(), 3);
+    QCOMPARE(backend.keyDeclared("Battery.Capacity"), true);
+    QCOMPARE(backend.keyDeclared("Internet.BytesOut"), false);
+    QCOMPARE(backend.docForKey("Battery.Capacity"), QString("doc3"));
+
+    // Only the keys whose records changed have a different digest
+    QHash<QString, QByteArray> digests = backend.keyDigests();
+    QCOMPARE(digests.value("Key.Deprecated"), oldDigests.value("Key.Deprecated"));
+    QVERIFY(digests.value("Battery.Charging") != oldDigests.value("Battery.Charging"));
+    QVERIFY(!digests.value("Battery.Capacity").isEmpty());
+}
+
+void InfoFlatBackendUnitTest::incompatible()
+{
+    FlatRegistryWriter *writer = baseWriter("bull");
+    writeCache("cache.flat", *writer);
+    delete writer;
+
+    // Without a database, there's nothing to read
+    QFile::remove("cache.cdb");
+    QCOMPARE(InfoFlatBackend::databaseUsable(), false);
+    InfoFlatBackend backend;
+    QCOMPARE(backend.listKeys().count(), 0);
+    QCOMPARE(backend.keyDeclared("Battery.Charging"), false);
+    QVERIFY(backend.typeInfoForKey("Battery.Charging").isNull());
+    QCOMPARE(backend.providersForKey("Battery.Charging").size(), 0);
+}
+
+void InfoFlatBackendUnitTest::stale()
+{
+    // The cache was left behind by an update which replaced only the
+    // database
+    FlatRegistryWriter *writer = baseWriter();
+    writeCache("cache.flat", *writer);
+    delete writer;
+    writeDatabase("cache.cdb", "gen2", "doc2");
+
+    QCOMPARE(InfoFlatBackend::databaseExists(), true);
+    QCOMPARE(InfoFlatBackend::databaseUsable(), false);
+
+    // The database answers instead of the cache
+    InfoFlatBackend backend;
+    QCOMPARE(backend.listKeys().count(), 3);
+    QCOMPARE(backend.keyDeclared("Battery.Charging"), true);
+    QCOMPARE(backend.docForKey("Battery.Charging"), QString("doc2"));
+    QCOMPARE(backend.typeInfoForKey("Internet.BytesOut").name(), QString("int64"));
+    QCOMPARE(backend.providersForKey("Internet.BytesOut").size(), 2);
+}
+
+void InfoFlatBackendUnitTest::handover()
+{
+    FlatRegistryWriter *writer = baseWriter();
+    writeCache("cache.flat", *writer);
+    delete writer;
+    writeDatabase("cache.cdb", "gen1");
+    InfoFlatBackend backend;
+    QSignalSpy spy(&backend, SIGNAL(keyChanged(QString)));
+    QCOMPARE(backend.docForKey("Battery.Charging"), QString("doc1"));
+
+    // Test:
+    // Only the database is replaced
+    writeDatabase("cache-next.cdb", "gen2", "doc2");
+    QVERIFY(rename("cache-next.cdb", "cache.cdb") == 0);
+    QTest::qWait(DEFAULT_WAIT_PERIOD);
+
+    // Expected results:
+    // The database answers, and only the key whose records changed is
+    // signalled
+    QCOMPARE(backend.listKeys().count(), 3);
+    QCOMPARE(backend.docForKey("Battery.Charging"), QString("doc2"));
+    QCOMPARE(backend.mergePolicyForKey("Internet.BytesOut"), QString("priority"));
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.at(0).at(0).toString(), QString("Battery.Charging"));
+    spy.clear();
+
+    // Test:
+    // The cache is removed
+    QVERIFY(QFile::remove("cache.flat"));
+    QTest::qWait(DEFAULT_WAIT_PERIOD);
+
+    // Expected results:
+    // The registry doesn't go empty
+    QCOMPARE(backend.listKeys().count(), 3);
+    QCOMPARE(backend.keyDeclared("Key.Deprecated"), true);
+    QCOMPARE(spy.count(), 0);
+
+    // Test:
+    // The matching cache appears
+    writer = baseWriter(BACKEND_COMPATIBILITY_NAMESPACE, "gen2");
+    writer->addKey("Battery.Capacity", QVariant("integer"), "doc3", false, "",
+                   QList<ContextProviderInfo>());
+    writeCache("cache-next.flat", *writer);
+    delete writer;
+    QVERIFY(rename("cache-next.flat", "cache.flat") == 0);
+    QTest::qWait(DEFAULT_WAIT_PERIOD);
+
+    // Expected results:
+    // The cache answers again
+    QCOMPARE(backend.listKeys().count(), 4);
+    QCOMPARE(backend.docForKey("Battery.Capacity"), QString("doc3"));
+    QCOMPARE(backend.docForKey("Battery.Charging"), QString("doc1"));
+}
+
+void InfoFlatBackendUnitTest::cleanupTestCase()
+{
+    QFile::remove("cache.flat");
+    QFile::remove("cache.cdb");
+    QFile::remove("reader.flat");
+    QFile::remove("many.flat");
+    QFile::remove("invalid.flat");
+}
+
+#include "infoflatbackendunittest.moc"
+QTEST_MAIN(InfoFlatBackendUnitTest);
@@ -60,6 +60,7 @@ private Q_SLOTS:
     void docForKey();
     void keyDeclared();
     void keyDeprecated();
+    void mergePolicyForKey();
     void providersForKey();
     void dynamics();
     void cleanupTestCase();
@@ -164,6 +165,13 @@ void InfoXmlBackendUnitTest::keyDeprecated()
     QCOMPARE(backend->keyDeprecated("Key.Deprecated"), true);
 }
 
+void InfoXmlBackendUnitTest::mergePolicyForKey()
+{
+    QCOMPARE(backend->mergePolicyForKey("Key.With.bool"), QString());
+    QCOMPARE(backend->mergePolicyForKey("Key.does.not.exist"), QString());
+    QCOMPARE(backend->mergePolicyForKey("Key.With.integer"), QString("priority"));
+}
+
 void InfoXmlBackendUnitTest::paths()
 {
     QVERIFY(InfoXmlBackend::registryPath() == QString("./") ||
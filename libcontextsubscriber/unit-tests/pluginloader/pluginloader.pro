@@ -0,0 +1,7 @@
+include(../../test.pri)
+TARGET = testpluginloader
+
+SOURCES = testpluginloader.cpp
+
+# Built by testplugin/testplugin.pro
+DEFINES += TEST_PLUGIN=\\\"$$OUT_PWD/testplugin/pluginloadertest.so\\\"
@@ -0,0 +1,8 @@
+QT = core
+TEMPLATE = lib
+CONFIG += plugin no_plugin_name_prefix
+TARGET = pluginloadertest
+
+SOURCES = testplugin.cpp
+
+INCLUDEPATH += ../../../src
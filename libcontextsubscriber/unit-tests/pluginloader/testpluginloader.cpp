@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+#include <QObject>
+#include <QtTest/QtTest>
+#include <QThread>
+#include <QDir>
+#include <QFile>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pluginloader.h" // Class to be tested
+
+using ContextSubscriber::PluginLoader;
+using ContextSubscriber::PluginFactoryFunc;
+
+/// Asks PluginLoader for a plugin from a thread of its own.
+class FactoryCaller : public QThread
+{
+public:
+    FactoryCaller(const QString &plugin) : plugin(plugin), func(0) {}
+    QString plugin;
+    PluginFactoryFunc func;
+
+protected:
+    void run()
+    {
+        func = PluginLoader::factory(plugin);
+    }
+};
+
+class PluginLoaderUnitTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    // Init and cleanup helper functions
+    void initTestCase();
+    void cleanupTestCase();
+
+    // Tests
+    void factory();
+    void failureNotCached();
+    void concurrentFactory();
+    void preload();
+    void preloadRetries();
+
+private:
+    void install(const QString &name);
+    bool isLoaded(const QString &name) const;
+    bool waitForLoaded(const QString &name) const;
+
+    QDir pluginDir;
+};
+
+void PluginLoaderUnitTest::initTestCase()
+{
+    QVERIFY(QFile::exists(TEST_PLUGIN));
+    pluginDir = QDir::temp();
+    QString name = QString("pluginloadertest-%1").arg(getpid());
+    QVERIFY(pluginDir.mkpath(name));
+    QVERIFY(pluginDir.cd(name));
+    setenv("CONTEXT_SUBSCRIBER_PLUGINS", pluginDir.absolutePath().toUtf8().constData(), 1);
+}
+
+void PluginLoaderUnitTest::cleanupTestCase()
+{
+    Q_FOREACH (const QString &file, pluginDir.entryList(QDir::Files))
+        pluginDir.remove(file);
+    QString name = pluginDir.dirName();
+    pluginDir.cdUp();
+    pluginDir.rmdir(name);
+}
+
+/// Installs a copy of the test plugin as the plugin "/" + \a name.
+void PluginLoaderUnitTest::install(const QString &name)
+{
+    QVERIFY(QFile::copy(TEST_PLUGIN, pluginDir.absoluteFilePath(name + ".so")));
+}
+
+/// Returns true if the plugin "/" + \a name is mapped into our
+/// process.
+bool PluginLoaderUnitTest::isLoaded(const QString &name) const
+{
+    QFile maps("/proc/self/maps");
+    if (!maps.open(QIODevice::ReadOnly))
+        return false;
+    return maps.readAll().contains(pluginDir.absoluteFilePath(name + ".so").toUtf8());
+}
+
+/// Waits for the background loading of the plugin "/" + \a name.
+bool PluginLoaderUnitTest::waitForLoaded(const QString &name) const
+{
+    for (int i = 0; i < 500 && !isLoaded(name); ++i)
+        QTest::qWait(10);
+    return isLoaded(name);
+}
+
+void PluginLoaderUnitTest::factory()
+{
+    // Setup:
+    install("cached");
+    QVERIFY(!isLoaded("cached"));
+
+    // Test:
+    PluginFactoryFunc func = PluginLoader::factory("/cached");
+
+    // Expected results:
+    // The plugin is loaded, and its factory remembered
+    QVERIFY(func != 0);
+    QVERIFY(isLoaded("cached"));
+    QVERIFY(PluginLoader::factory("/cached") == func);
+    QVERIFY(func("") == 0);
+}
+
+void PluginLoaderUnitTest::failureNotCached()
+{
+    // Test:
+    // Ask for a plugin which is not installed yet
+    PluginFactoryFunc func = PluginLoader::factory("/late");
+
+    // Expected results:
+    QVERIFY(func == 0);
+
+    // Test:
+    // Install it and ask again
+    install("late");
+    func = PluginLoader::factory("/late");
+
+    // Expected results:
+    // The failure wasn't remembered
+    QVERIFY(func != 0);
+}
+
+void PluginLoaderUnitTest::concurrentFactory()
+{
+    // Setup:
+    install("concurrent");
+    QList<FactoryCaller*> callers;
+    for (int i = 0; i < 8; ++i)
+        callers << new FactoryCaller("/concurrent");
+
+    // Test:
+    Q_FOREACH (FactoryCaller *caller, callers)
+        caller->start();
+    Q_FOREACH (FactoryCaller *caller, callers)
+        QVERIFY(caller->wait(5000));
+
+    // Expected results:
+    // All the threads get the same factory
+    QVERIFY(callers.at(0)->func != 0);
+    Q_FOREACH (FactoryCaller *caller, callers)
+        QVERIFY(caller->func == callers.at(0)->func);
+    QVERIFY(PluginLoader::factory("/concurrent") == callers.at(0)->func);
+    qDeleteAll(callers);
+}
+
+void PluginLoaderUnitTest::preload()
+{
+    // Setup:
+    install("preloaded");
+    QVERIFY(!isLoaded("preloaded"));
+
+    // Test:
+    // Internal plugins are skipped, and duplicates loaded once
+    PluginLoader::preload(QStringList() << "/preloaded" << "contextkit-dbus" << "/preloaded");
+
+    // Expected results:
+    // The plugin gets loaded in the background
+    QVERIFY(waitForLoaded("preloaded"));
+    QVERIFY(PluginLoader::factory("/preloaded") != 0);
+
+    // Test:
+    // Preloading a loaded plugin
+    PluginLoader::preload(QStringList() << "/preloaded");
+
+    // Expected results:
+    // The factory stays the same
+    QVERIFY(PluginLoader::factory("/preloaded") != 0);
+}
+
+void PluginLoaderUnitTest::preloadRetries()
+{
+    // Test:
+    // Preload a plugin which is not installed, then install it and
+    // preload it again
+    for (int i = 0; i < 20; ++i)
+        PluginLoader::preload(QStringList() << "/retried");
+    QTest::qWait(100);
+    QVERIFY(!isLoaded("retried"));
+    install("retried");
+    PluginLoader::preload(QStringList() << "/retried");
+
+    // Expected results:
+    // The plugin is loaded
+    QVERIFY(waitForLoaded("retried"));
+    QVERIFY(PluginLoader::factory("/retried") != 0);
+}
+
+QTEST_MAIN(PluginLoaderUnitTest);
+#include "testpluginloader.moc"
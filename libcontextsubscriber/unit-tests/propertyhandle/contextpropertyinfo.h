@@ -45,6 +45,7 @@ public:
     bool declared() const;
     bool deprecated() const;
     QList<ContextProviderInfo> providers() const;
+    QString mergePolicy() const;
 
 Q_SIGNALS:
     void changed(QString);
@@ -52,6 +53,8 @@ Q_SIGNALS:
 public:
     // For the test program
     QString myType;
+    QList<ContextProviderInfo> myProviders;
+    QString myMergePolicy;
 };
 
 #endif // CONTEXTPROPERTYINFO_H
@@ -6,7 +6,8 @@
 struct ContextTypeInfo
 {
     static bool fail;
-    bool typeCheck(const QVariant &value) const { return !fail; }
+    static QVariant badValue;
+    bool typeCheck(const QVariant &value) const { return !fail && value != badValue; }
     QString name() const { return "PLASTIC"; }
 };
 #endif
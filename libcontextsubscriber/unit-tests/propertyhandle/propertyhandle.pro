@@ -4,6 +4,6 @@ TARGET = propertyhandle-unit-tests
 SOURCES = testpropertyhandle.cpp
 HEADERS = testpropertyhandle.h provider.h dbusnamelistener.h \
           contextpropertyinfo.h contextregistryinfo.h \
-          contexttypeinfo.h
+          contexttypeinfo.h contexttypevalidator.h
 
 LIBS += -lrt
@@ -26,6 +26,8 @@
 
 #include "contextproviderinfo.h"
 #include "timedvalue.h"
+#include "concurrentvalue.h"
+#include "compactvalue.h"
 
 #include <QObject>
 #include <QDBusConnection>
@@ -34,21 +36,33 @@
 
 namespace ContextSubscriber {
 
+class PropertyHandle;
+
+struct ProviderSlot
+{
+    ProviderSlot() : handle(0), subscribed(false), rank(-1), arrival(0)
+        { }
+    PropertyHandle *handle;
+    QAtomicInt subscribed;
+    int rank;
+    mutable quint64 arrival;
+    ConcurrentValue<TimedCompactValue> value;
+};
+
 class Provider : public QObject
 {
     Q_OBJECT
 
 public:
     static Provider* instance(const ContextProviderInfo& providerInfo);
+    ProviderSlot* attach(const QString &key, PropertyHandle *handle);
     bool subscribe(const QString &key);
     void unsubscribe(const QString &key);
-    TimedValue get(const QString &key) const;
     void clearValues();
     void blockUntilSubscribed(const QString& key);
 
 Q_SIGNALS:
     void subscribeFinished(QString key);
-    void valueChanged(QString key);
 
 public:
     // Logging
@@ -65,11 +79,14 @@ public:
     static QStringList unsubscribeKeys;
     static QStringList unsubscribeProviderNames; // provider name of the object
     // on which it was called
-    static TimedValue cachedValue; // setValue sets, get gets
+    static ProviderSlot cachedSlot; // setValue sets, attach gives it out
+    static ProviderSlot commanderSlot; // attach gives it out for the commander
 
     // For tests
     Provider(QString name); // public only in tests
     static void setValue(const QString &key, const QVariant &value);
+    static void setSlotValue(const QString &key, ProviderSlot *slot,
+                             const QVariant &value, quint64 time);
     static void resetLogs();
     QString myName;
 
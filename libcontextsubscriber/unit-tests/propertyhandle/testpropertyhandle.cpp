@@ -27,6 +27,7 @@
 #include "dbusnamelistener.h"
 #include "contextpropertyinfo.h"
 #include "contextregistryinfo.h"
+#include "contexttypevalidator.h"
 
 // Header file of the class to be tested
 #include "propertyhandle.h"
@@ -45,6 +46,7 @@ ContextPropertyInfo* mockContextPropertyInfo;
 ContextPropertyInfo::ContextPropertyInfo(const QString &key, QObject *parent)
     : myType("faketype")
 {
+    myProviders << ContextProviderInfo("fakeplugin", "fakeconstructionstring");
     // Store the object created by the class to be tested
     mockContextPropertyInfo = this;
 }
@@ -56,12 +58,33 @@ QString ContextPropertyInfo::type() const
 
 // set this to simulate failure/success of type matches
 bool ContextTypeInfo::fail = false;
+QVariant ContextTypeInfo::badValue;
 
 ContextTypeInfo ContextPropertyInfo::typeInfo() const
 {
     return ContextTypeInfo();
 }
 
+// Mock implementation of the ContextTypeValidator
+
+ContextTypeValidator::ContextTypeValidator(const ContextTypeInfo &typeInfo)
+{
+}
+
+ContextTypeValidator::~ContextTypeValidator()
+{
+}
+
+bool ContextTypeValidator::check(const QVariant &value) const
+{
+    return ContextTypeInfo().typeCheck(value);
+}
+
+QString ContextTypeValidator::name() const
+{
+    return ContextTypeInfo().name();
+}
+
 bool ContextPropertyInfo::provided() const
 {
     return true;
@@ -74,7 +97,12 @@ bool ContextPropertyInfo::deprecated() const
 
 QList<ContextProviderInfo> ContextPropertyInfo::providers() const
 {
-    return QList<ContextProviderInfo>() << ContextProviderInfo("fakeplugin", "fakeconstructionstring");
+    return myProviders;
+}
+
+QString ContextPropertyInfo::mergePolicy() const
+{
+    return myMergePolicy;
 }
 
 // Mock implementation of the ContextRegistryInfo
@@ -113,7 +141,7 @@ void myMessageOutput(QtMsgType type, const char *msg)
 // These will be created by the test program
 Provider* mockProvider;
 Provider* mockCommanderProvider;
-DBusNameListener* mockDBusNameListener;
+DBusNameListener* mockDBusNameListener = 0;
 
 // Mock implementation of the Provider
 int Provider::instanceCount = 0;
@@ -127,7 +155,8 @@ int Provider::unsubscribeCount = 0;
 QStringList Provider::unsubscribeKeys;
 QStringList Provider::unsubscribeProviderNames;
 
-TimedValue Provider::cachedValue = TimedValue(QVariant());
+ProviderSlot Provider::cachedSlot;
+ProviderSlot Provider::commanderSlot;
 
 Provider* Provider::instance(const ContextProviderInfo& providerInfo)
 {
@@ -168,18 +197,27 @@ void Provider::blockUntilSubscribed(const QString& key)
 
 void Provider::clearValues()
 {
-    cachedValue = TimedValue(QVariant());
+    cachedSlot.value.write(TimedCompactValue());
 }
 
 void Provider::setValue(const QString &key, const QVariant &value)
 {
-    cachedValue = TimedValue(value);
+    cachedSlot.value.write(TimedCompactValue(TimedValue(value)));
     PropertyHandle::instance(key)->onValueChanged();
 }
 
-TimedValue Provider::get(const QString &key) const
+void Provider::setSlotValue(const QString &key, ProviderSlot *slot,
+                            const QVariant &value, quint64 time)
+{
+    slot->value.write(TimedCompactValue(TimedValue(value, time)));
+    PropertyHandle::instance(key)->onValueChanged(slot);
+}
+
+ProviderSlot* Provider::attach(const QString &key, PropertyHandle *handle)
 {
-    return cachedValue;
+    if (this == mockCommanderProvider)
+        return &commanderSlot;
+    return &cachedSlot;
 }
 
 void Provider::resetLogs()
@@ -246,8 +284,10 @@ void PropertyHandleUnitTests::init()
     mockContextRegistryInfo = new ContextRegistryInfo();
     // Reset the logs
     Provider::resetLogs();
-    // Reset the DBusNameListener (it is created only once, by the class to be tested)
-    mockDBusNameListener->servicePresent = DBusNameListener::NotPresent;
+    // Reset the DBusNameListener (it is created only once, by the first
+    // handle created by the class to be tested)
+    if (mockDBusNameListener)
+        mockDBusNameListener->servicePresent = DBusNameListener::NotPresent;
 }
 
 // After each test
@@ -311,6 +351,25 @@ void PropertyHandleUnitTests::info()
     QCOMPARE(propertyHandle->info(), mockContextPropertyInfo);
 }
 
+void PropertyHandleUnitTests::instances()
+{
+    // Setup:
+    // Create the object to be tested
+    // Note: For each test, we need to create a separate instance.
+    // Otherwise the tests are dependent on each other.
+    QString key = "Property." + QString(__FUNCTION__);
+    propertyHandle = PropertyHandle::instance(key);
+    PropertyHandle *otherHandle = PropertyHandle::instance(key + "Other");
+
+    // Test and expected results:
+    // The same key always gives the same handle
+    QCOMPARE(PropertyHandle::instance(key), propertyHandle);
+    QCOMPARE(PropertyHandle::instance(key + "Other"), otherHandle);
+    // Each key has its own handle
+    QVERIFY(propertyHandle != otherHandle);
+    QCOMPARE(otherHandle->key(), key + "Other");
+}
+
 void PropertyHandleUnitTests::subscribe()
 {
     // Setup:
@@ -402,6 +461,50 @@ void PropertyHandleUnitTests::subscriptionPendingAndFinished()
     QCOMPARE(propertyHandle->isSubscribePending(), false);
 }
 
+// Waits for the subscription of a PropertyHandle in a separate thread.
+class SubscriptionWaiter : public QThread
+{
+public:
+    SubscriptionWaiter(PropertyHandle *handle) : handle(handle), result(false) {}
+    void run()
+    {
+        result = handle->waitForSubscription(-1);
+    }
+
+    PropertyHandle *handle;
+    bool result;
+};
+
+void PropertyHandleUnitTests::waitForSubscription()
+{
+    // Setup:
+    // Create the object to be tested
+    QString key = "Property." + QString(__FUNCTION__);
+    propertyHandle = PropertyHandle::instance(key);
+    propertyHandle->subscribe();
+
+    // Test:
+    // Wait with a timeout while the subscription is pending
+    // Expected results:
+    // The wait times out
+    QCOMPARE(propertyHandle->waitForSubscription(10), false);
+
+    // Test:
+    // Wait without a timeout in another thread, and finish the
+    // subscription
+    SubscriptionWaiter waiter(propertyHandle);
+    waiter.start();
+    QTest::qWait(10);
+    QVERIFY(waiter.isRunning());
+    propertyHandle->setSubscribeFinished(mockProvider);
+
+    // Expected results:
+    // The waiting thread wakes up and sees the subscription finished
+    QVERIFY(waiter.wait(5000));
+    QCOMPARE(waiter.result, true);
+    QCOMPARE(propertyHandle->waitForSubscription(0), true);
+}
+
 void PropertyHandleUnitTests::subscribeTwiceAndUnsubscribe()
 {
     // Setup:
@@ -456,6 +559,43 @@ void PropertyHandleUnitTests::subscribeTwiceAndUnsubscribeTwice()
     QCOMPARE(Provider::unsubscribeKeys.at(0), key);
 }
 
+void PropertyHandleUnitTests::lingerAfterUnsubscribe()
+{
+    // Setup:
+    // Create the object to be tested
+    QString key = "Property." + QString(__FUNCTION__);
+    propertyHandle = PropertyHandle::instance(key);
+    PropertyHandle::setLingerTime(100);
+
+    // Test:
+    // Subscribe, unsubscribe and subscribe again within the linger time
+    propertyHandle->subscribe();
+    propertyHandle->unsubscribe();
+    QTest::qWait(10);
+    propertyHandle->subscribe();
+    QTest::qWait(200);
+
+    // Expected results:
+    // The PropertyHandle calls the Provider::subscribe only once, and
+    // never unsubscribes.
+    QCOMPARE(Provider::subscribeCount, 1);
+    QCOMPARE(Provider::unsubscribeCount, 0);
+
+    // Test:
+    // Unsubscribe and let the linger time pass
+    propertyHandle->unsubscribe();
+    QTest::qWait(10);
+    QCOMPARE(Provider::unsubscribeCount, 0);
+    QTest::qWait(200);
+
+    // Expected results:
+    // The PropertyHandle calls the Provider::unsubscribe
+    QCOMPARE(Provider::unsubscribeCount, 1);
+    QCOMPARE(Provider::unsubscribeKeys.at(0), key);
+
+    PropertyHandle::setLingerTime(0);
+}
+
 void PropertyHandleUnitTests::onValueChangedWithoutTypeCheck()
 {
     // Setup:
@@ -655,10 +795,155 @@ void PropertyHandleUnitTests::onValueChangedWithTypeCheckAndIncorrectTypes()
     ContextTypeInfo::fail = false;
 
     // Expected results:
-    // The valueChanged signal was not emitted
-    QCOMPARE(spy.count(), 0);
-    // The value is still the old value
-    QCOMPARE(propertyHandle->value(), QVariant(4.2));
+    // The values are treated as null values: the property lost its
+    // value once
+    QCOMPARE(spy.count(), 1);
+    QVERIFY(propertyHandle->value().isNull());
+}
+
+// Creates a subscribed handle for key, provided by two providers: the
+// first one stores its values in Provider::cachedSlot, the second one
+// (which the mock Provider::instance thinks is the commander) in
+// Provider::commanderSlot.
+PropertyHandle* PropertyHandleUnitTests::twoProviderHandle(const QString &key,
+                                                           const QString &mergePolicy)
+{
+    PropertyHandle *handle = PropertyHandle::instance(key);
+    mockContextPropertyInfo->myProviders
+        << ContextProviderInfo("fakeplugin", "fakeCommanderconstructionstring");
+    mockContextPropertyInfo->myMergePolicy = mergePolicy;
+    Q_EMIT mockContextPropertyInfo->changed(key);
+    handle->subscribe();
+    return handle;
+}
+
+void PropertyHandleUnitTests::mergeNewest()
+{
+    // Setup:
+    // Create the object to be tested
+    QString key = "Property." + QString(__FUNCTION__);
+    propertyHandle = twoProviderHandle(key, "");
+
+    // Test:
+    // The providers get values one after another
+    Provider::setSlotValue(key, &Provider::commanderSlot, QVariant("second"), 10);
+    QCOMPARE(propertyHandle->value(), QVariant("second"));
+    Provider::setSlotValue(key, &Provider::cachedSlot, QVariant("first"), 20);
+    QCOMPARE(propertyHandle->value(), QVariant("first"));
+
+    // Test:
+    // A provider gets a value older than the current one
+    Provider::setSlotValue(key, &Provider::commanderSlot, QVariant("old"), 15);
+
+    // Expected results:
+    // The newest value still wins
+    QCOMPARE(propertyHandle->value(), QVariant("first"));
+
+    // Test:
+    // The winning provider loses its value
+    Provider::setSlotValue(key, &Provider::cachedSlot, QVariant(), 30);
+
+    // Expected results:
+    // The other provider's value takes over
+    QCOMPARE(propertyHandle->value(), QVariant("old"));
+}
+
+void PropertyHandleUnitTests::mergePriority()
+{
+    // Setup:
+    // Create the object to be tested
+    QString key = "Property." + QString(__FUNCTION__);
+    propertyHandle = twoProviderHandle(key, "priority");
+
+    // Test:
+    // The second provider gets a value, then the first one an older one
+    Provider::setSlotValue(key, &Provider::commanderSlot, QVariant("second"), 10);
+    QCOMPARE(propertyHandle->value(), QVariant("second"));
+    Provider::setSlotValue(key, &Provider::cachedSlot, QVariant("first"), 5);
+
+    // Expected results:
+    // The first provider wins, no matter how old its value is
+    QCOMPARE(propertyHandle->value(), QVariant("first"));
+    Provider::setSlotValue(key, &Provider::commanderSlot, QVariant("newer"), 20);
+    QCOMPARE(propertyHandle->value(), QVariant("first"));
+
+    // Test:
+    // The first provider loses its value
+    Provider::setSlotValue(key, &Provider::cachedSlot, QVariant(), 30);
+
+    // Expected results:
+    // The second provider's value takes over
+    QCOMPARE(propertyHandle->value(), QVariant("newer"));
+}
+
+void PropertyHandleUnitTests::mergeFirst()
+{
+    // Setup:
+    // Create the object to be tested
+    QString key = "Property." + QString(__FUNCTION__);
+    propertyHandle = twoProviderHandle(key, "first");
+
+    // Test:
+    // The second provider gets a value first, then both get new values
+    Provider::setSlotValue(key, &Provider::commanderSlot, QVariant("second"), 10);
+    Provider::setSlotValue(key, &Provider::cachedSlot, QVariant("first"), 20);
+    Provider::setSlotValue(key, &Provider::commanderSlot, QVariant("second2"), 30);
+
+    // Expected results:
+    // The second provider keeps winning
+    QCOMPARE(propertyHandle->value(), QVariant("second2"));
+
+    // Test:
+    // All the providers are consulted again
+    propertyHandle->onValueChanged();
+
+    // Expected results:
+    // The second provider still wins, although it's declared later
+    QCOMPARE(propertyHandle->value(), QVariant("second2"));
+
+    // Test:
+    // The second provider loses its value, then gets a new one
+    Provider::setSlotValue(key, &Provider::commanderSlot, QVariant(), 40);
+    QCOMPARE(propertyHandle->value(), QVariant("first"));
+    Provider::setSlotValue(key, &Provider::commanderSlot, QVariant("second3"), 50);
+    propertyHandle->onValueChanged();
+
+    // Expected results:
+    // The first provider's value took over and keeps winning
+    QCOMPARE(propertyHandle->value(), QVariant("first"));
+}
+
+void PropertyHandleUnitTests::mergeTypeCheck()
+{
+    // Setup:
+    // Create the object to be tested
+    QString key = "Property." + QString(__FUNCTION__);
+    propertyHandle = twoProviderHandle(key, "");
+    PropertyHandle::setTypeCheck(true);
+    ContextTypeInfo::badValue = QVariant("bad");
+    Provider::setSlotValue(key, &Provider::cachedSlot, QVariant("first"), 10);
+
+    // Test:
+    // The second provider gets a newer value of the wrong type
+    Provider::setSlotValue(key, &Provider::commanderSlot, QVariant("bad"), 20);
+
+    // Expected results:
+    // The value is ignored, and doesn't count as the newest one
+    QCOMPARE(propertyHandle->value(), QVariant("first"));
+    Provider::setSlotValue(key, &Provider::cachedSlot, QVariant("first2"), 15);
+    QCOMPARE(propertyHandle->value(), QVariant("first2"));
+
+    // Test:
+    // The winning provider gets a value of the wrong type
+    Provider::setSlotValue(key, &Provider::commanderSlot, QVariant("second"), 30);
+    QCOMPARE(propertyHandle->value(), QVariant("second"));
+    Provider::setSlotValue(key, &Provider::commanderSlot, QVariant("bad"), 40);
+
+    // Expected results:
+    // Like losing its value: the other provider's value takes over
+    QCOMPARE(propertyHandle->value(), QVariant("first2"));
+
+    ContextTypeInfo::badValue = QVariant();
 }
 
 void PropertyHandleUnitTests::commanderAppearsAndDisappears()
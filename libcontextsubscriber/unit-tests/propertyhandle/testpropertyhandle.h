@@ -33,6 +33,7 @@ class PropertyHandleUnitTests : public QObject
 
 private:
     PropertyHandle *propertyHandle;
+    PropertyHandle* twoProviderHandle(const QString &key, const QString &mergePolicy);
 
     // Tests
 private Q_SLOTS:
@@ -46,18 +47,25 @@ private Q_SLOTS:
     void initializing();
     void key();
     void info();
+    void instances();
 
     void subscribe();
     void subscribeAndUnsubscribe();
     void subscribeTwice();
     void subscribeTwiceAndUnsubscribe();
     void subscribeTwiceAndUnsubscribeTwice();
+    void lingerAfterUnsubscribe();
 
     void subscriptionPendingAndFinished();
+    void waitForSubscription();
 
     void onValueChangedWithoutTypeCheck();
     void onValueChangedWithTypeCheckAndCorrectTypes();
     void onValueChangedWithTypeCheckAndIncorrectTypes();
+    void mergeNewest();
+    void mergePriority();
+    void mergeFirst();
+    void mergeTypeCheck();
 
     void commanderAppearsAndDisappears();
     void commandingDisabled();
@@ -34,6 +34,8 @@
 
 extern "C" {
     ContextSubscriber::IProviderPlugin* contextKitPluginFactory(QString constructionString);
+    ContextSubscriber::IProviderPlugin* contextKitSharedPluginFactory(QString constructionString);
+    ContextSubscriber::IProviderPlugin* contextKitDirectPluginFactory(QString constructionString);
 }
 
 namespace ContextSubscriber {
@@ -37,9 +37,12 @@ class HandleSignalRouter : public QObject
     Q_OBJECT
 public:
     static HandleSignalRouter* instance();
+    void onValueChanged(ProviderSlot *slot);
+
+    // For tests
+    QList<PropertyHandle*> routedHandles;
 
 public Q_SLOTS:
-    void onValueChanged(QString key);
     void onSubscribeFinished(Provider *provider, QString key);
 };
 
@@ -71,8 +71,9 @@ HandleSignalRouter* HandleSignalRouter::instance()
     return mockHandleSignalRouter;
 }
 
-void HandleSignalRouter::onValueChanged(QString key)
+void HandleSignalRouter::onValueChanged(ProviderSlot *slot)
 {
+    routedHandles << slot->handle;
 }
 
 void HandleSignalRouter::onSubscribeFinished(Provider *provider, QString key)
@@ -122,6 +123,24 @@ ContextSubscriber::IProviderPlugin* contextKitPluginFactory(QString construction
     return pluginInstances[constructionString];
 }
 
+QMap<QString, ContextSubscriber::ContextKitPlugin*> sharedPluginInstances;
+
+ContextSubscriber::IProviderPlugin* contextKitSharedPluginFactory(QString constructionString)
+{
+    if (!sharedPluginInstances.contains(constructionString))
+        sharedPluginInstances[constructionString] = new ContextSubscriber::ContextKitPlugin();
+    return sharedPluginInstances[constructionString];
+}
+
+QMap<QString, ContextSubscriber::ContextKitPlugin*> directPluginInstances;
+
+ContextSubscriber::IProviderPlugin* contextKitDirectPluginFactory(QString constructionString)
+{
+    if (!directPluginInstances.contains(constructionString))
+        directPluginInstances[constructionString] = new ContextSubscriber::ContextKitPlugin();
+    return directPluginInstances[constructionString];
+}
+
 namespace ContextSubscriber {
 
 void ContextKitPlugin::subscribe(QSet<QString> keys)
@@ -165,6 +184,8 @@ void ProviderUnitTests::cleanupTestCase()
 void ProviderUnitTests::init()
 {
     pluginInstances.clear();
+    sharedPluginInstances.clear();
+    directPluginInstances.clear();
 }
 
 // After each test
@@ -191,6 +212,37 @@ void ProviderUnitTests::initializing()
     QCOMPARE(pluginInstances.keys()[0], conStr);
 }
 
+void ProviderUnitTests::sharedMemoryPlugin()
+{
+    // Test:
+    // Create a Provider for the contextkit-shm plugin
+    QString conStr = "session:Fake.Bus.Name." + QString(__FUNCTION__) + ":5";
+    Provider *provider = Provider::instance(ContextProviderInfo("contextkit-shm", conStr));
+    provider->callAllMethodsInQueue();
+
+    // Expected results:
+    // The plugin is constructed by the shared memory factory
+    QCOMPARE(pluginInstances.size(), 0);
+    QCOMPARE(sharedPluginInstances.size(), 1);
+    QCOMPARE(sharedPluginInstances.keys()[0], conStr);
+}
+
+void ProviderUnitTests::directPlugin()
+{
+    // Test:
+    // Create a Provider for the contextkit-direct plugin
+    QString conStr = "session:Fake.Bus.Name." + QString(__FUNCTION__);
+    Provider *provider = Provider::instance(ContextProviderInfo("contextkit-direct", conStr));
+    provider->callAllMethodsInQueue();
+
+    // Expected results:
+    // The plugin is constructed by the direct connection factory
+    QCOMPARE(pluginInstances.size(), 0);
+    QCOMPARE(sharedPluginInstances.size(), 0);
+    QCOMPARE(directPluginInstances.size(), 1);
+    QCOMPARE(directPluginInstances.keys()[0], conStr);
+}
+
 void ProviderUnitTests::pluginReadyHandled()
 {
     // Test:
@@ -320,18 +372,26 @@ void ProviderUnitTests::pluginValueChanges()
     Q_EMIT pluginInstances[conStr]->ready(); // set the plugin to ready
     provider->callAllMethodsInQueue();
 
+    // The handles are only passed through to the mock router, never
+    // dereferenced.
+    int fakeHandles[2];
+    PropertyHandle *handle1 = reinterpret_cast<PropertyHandle*>(&fakeHandles[0]);
+    PropertyHandle *handle2 = reinterpret_cast<PropertyHandle*>(&fakeHandles[1]);
+    ProviderSlot *slot1 = provider->attach("test.key1", handle1);
+    ProviderSlot *slot2 = provider->attach("test.key2", handle2);
+    QCOMPARE(provider->attach("test.key1", handle1), slot1);
+
     provider->subscribe("test.key1");
     provider->callAllMethodsInQueue();
     Q_EMIT pluginInstances[conStr]->subscribeFinished("test.key1");
 
-    QSignalSpy spy(provider, SIGNAL(valueChanged(QString)));
+    mockHandleSignalRouter->routedHandles.clear();
     Q_EMIT pluginInstances[conStr]->valueChanged("test.key1", QVariant(42));
     Q_EMIT pluginInstances[conStr]->valueChanged("test.key2", QVariant(4242));
 
-    QCOMPARE(spy.size(), 1);
-    QCOMPARE(spy.at(0).size(), 1);
-    QCOMPARE(spy.at(0).at(0).value<QString>(), QString("test.key1"));
-    QCOMPARE(provider->get("test.key1").value, QVariant(42));
+    QCOMPARE(mockHandleSignalRouter->routedHandles, QList<PropertyHandle*>() << handle1);
+    QCOMPARE(slot1->value.read().value.toVariant(), QVariant(42));
+    QCOMPARE(slot2->value.read().value.toVariant(), QVariant());
 }
 } // end namespace
 QTEST_MAIN(ContextSubscriber::ProviderUnitTests);
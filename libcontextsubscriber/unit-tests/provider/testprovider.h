@@ -42,6 +42,8 @@ private Q_SLOTS:
 
     // Test cases
     void initializing();
+    void sharedMemoryPlugin();
+    void directPlugin();
     void pluginReadyHandled();
     void pluginFailedHandled();
     void badPluginName();
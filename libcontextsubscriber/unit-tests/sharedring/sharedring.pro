@@ -0,0 +1,4 @@
+include(../../test.pri)
+TARGET = testsharedring
+
+SOURCES = testsharedring.cpp
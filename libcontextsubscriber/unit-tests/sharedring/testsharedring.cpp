@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+#include <QObject>
+#include <QObject>
+#include <QtTest/QtTest>
+#include <QVariant>
+#include <QStringList>
+
+#include "sharedring.h" // Class to be tested
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+class SharedRingUnitTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    // Tests
+    void init();
+    void cleanup();
+    void publishAndPoll();
+    void unknownKey();
+    void oversizedValue();
+    void overrun();
+    void readsOldRecords();
+    void badRing();
+    void permissions();
+
+private:
+    QString ringName;
+    SharedRingWriter *writer;
+};
+
+void SharedRingUnitTest::init()
+{
+    ringName = QString("/contextkit-test-%1").arg(getpid());
+    writer = new SharedRingWriter();
+    QVERIFY(writer->create(ringName, 8, 64));
+    QCOMPARE(writer->name(), ringName);
+}
+
+void SharedRingUnitTest::cleanup()
+{
+    delete writer;
+}
+
+void SharedRingUnitTest::publishAndPoll()
+{
+    SharedRingReader reader;
+    QVERIFY(reader.open(ringName));
+    QVERIFY(reader.isOpen());
+
+    QList<SharedRingRecord> records;
+    QStringList staleKeys;
+    QVERIFY(reader.poll(records, staleKeys));
+    QCOMPARE(records.size(), 0);
+
+    QVERIFY(writer->addKey("Sensor.X"));
+    QVERIFY(writer->addKey("Sensor.Y"));
+    QVERIFY(writer->publish("Sensor.X", QVariant(1.5), 100));
+    QVERIFY(writer->publish("Sensor.Y", QVariant(QString("up")), 101));
+    QVERIFY(writer->publish("Sensor.X", QVariant(), 102));
+
+    QVERIFY(reader.poll(records, staleKeys));
+    QCOMPARE(staleKeys.size(), 0);
+    QCOMPARE(records.size(), 3);
+    QCOMPARE(records[0].key, QString("Sensor.X"));
+    QCOMPARE(records[0].value, QVariant(1.5));
+    QCOMPARE(records[0].timestamp, Q_UINT64_C(100));
+    QCOMPARE(records[1].key, QString("Sensor.Y"));
+    QCOMPARE(records[1].value, QVariant(QString("up")));
+    QCOMPARE(records[2].key, QString("Sensor.X"));
+    QVERIFY(records[2].value.isNull());
+
+    // Nothing new
+    records.clear();
+    QVERIFY(reader.poll(records, staleKeys));
+    QCOMPARE(records.size(), 0);
+}
+
+void SharedRingUnitTest::unknownKey()
+{
+    QCOMPARE(writer->publish("Not.Added", QVariant(1), 1), false);
+    QCOMPARE(writer->addKey(QString(200, QLatin1Char('x'))), false);
+}
+
+void SharedRingUnitTest::oversizedValue()
+{
+    SharedRingReader reader;
+    QVERIFY(reader.open(ringName));
+    QVERIFY(writer->addKey("Big"));
+    QCOMPARE(writer->publish("Big", QVariant(QString(100, QLatin1Char('x'))), 1), false);
+
+    QList<SharedRingRecord> records;
+    QStringList staleKeys;
+    QVERIFY(reader.poll(records, staleKeys));
+    QCOMPARE(records.size(), 0);
+    QCOMPARE(staleKeys, QStringList() << "Big");
+}
+
+void SharedRingUnitTest::overrun()
+{
+    SharedRingReader reader;
+    QVERIFY(reader.open(ringName));
+    QVERIFY(writer->addKey("Sensor.X"));
+    for (int i = 0; i < 20; ++i)
+        writer->publish("Sensor.X", QVariant(i), i);
+
+    // Only the last 8 fit in the ring
+    QList<SharedRingRecord> records;
+    QStringList staleKeys;
+    QCOMPARE(reader.poll(records, staleKeys), false);
+    QCOMPARE(records.size(), 8);
+    QCOMPARE(records.last().value, QVariant(19));
+
+    records.clear();
+    writer->publish("Sensor.X", QVariant(20), 20);
+    QVERIFY(reader.poll(records, staleKeys));
+    QCOMPARE(records.size(), 1);
+}
+
+void SharedRingUnitTest::readsOldRecords()
+{
+    QVERIFY(writer->addKey("Sensor.X"));
+    writer->publish("Sensor.X", QVariant(1), 1);
+
+    // A new reader gets the records still in the ring
+    SharedRingReader reader;
+    QVERIFY(reader.open(ringName));
+    QList<SharedRingRecord> records;
+    QStringList staleKeys;
+    QVERIFY(reader.poll(records, staleKeys));
+    QCOMPARE(records.size(), 1);
+    QCOMPARE(records[0].value, QVariant(1));
+}
+
+void SharedRingUnitTest::badRing()
+{
+    SharedRingReader reader;
+    QCOMPARE(reader.open("/contextkit-test-nonexistent"), false);
+    QVERIFY(!reader.isOpen());
+
+    // The slot count must be a power of two
+    SharedRingWriter other;
+    QCOMPARE(other.create(ringName + "-other", 6, 64), false);
+
+    // Names are not reused
+    QCOMPARE(other.create(ringName, 8, 64), false);
+}
+
+void SharedRingUnitTest::permissions()
+{
+    // Only the processes of the same user can read the values
+    int fd = shm_open(ringName.toLocal8Bit().constData(), O_RDONLY, 0);
+    QVERIFY(fd >= 0);
+    struct stat buffer;
+    QCOMPARE(fstat(fd, &buffer), 0);
+    close(fd);
+    QCOMPARE(int(buffer.st_mode & 0777), 0600);
+}
+
+QTEST_MAIN(SharedRingUnitTest);
+#include "testsharedring.moc"
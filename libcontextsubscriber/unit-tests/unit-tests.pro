@@ -5,6 +5,7 @@ SUBDIRS = provider \
           cdb \
           infoxmlbackend \
           infocdbbackend \
+          infoflatbackend \
           contextregistryinfo \
           contextpropertyinfo \
           infobackend \
@@ -12,6 +13,17 @@ SUBDIRS = provider \
           assoctree \
           contexttypeinfo \
           duration \
+          concurrentvalue \
+          compactvalue \
+          sharedring \
+          valuepatch \
+          valuedecoder \
+          pluginloader/testplugin \
+          pluginloader \
+          contextsubscriptionwatcher \
+          deliverymailbox \
+          contextthread \
+          contexttypedproperty \
           contexttyperegistryinfo
 
 # SUBDIRS = $(SUBDIRSTESTS) util
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+#include <QObject>
+#include <QtTest/QtTest>
+#include <QVariant>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusVariant>
+
+#include "valuedecoder.h" // Class to be tested
+#include "valuepatch.h"
+
+#define LIST(args) QVariant(QVariantList() << args)
+
+/// Keeps the last value sent to it over D-Bus, as QtDBus
+/// demarshalled it.
+class Sink : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.maemo.contextkit.test.Sink")
+
+public:
+    QVariant received;
+
+public Q_SLOTS:
+    void Take(const QDBusVariant &value)
+    {
+        received = value.variant();
+    }
+};
+
+class ValueDecoderUnitTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    // Init and cleanup helper functions
+    void initTestCase();
+    void cleanupTestCase();
+
+    // Tests
+    void decodeAny();
+    void decodeDemarshalled();
+    void decodeMaybe();
+    void decodePatch();
+    void decodeReset();
+
+private:
+    QVariant roundTrip(const QVariant &value);
+    static QVariantList value();
+
+    Sink sink;
+};
+
+void ValueDecoderUnitTest::initTestCase()
+{
+    QVERIFY(QDBusConnection::sessionBus().registerObject("/Sink", &sink,
+                                                         QDBusConnection::ExportAllSlots));
+}
+
+void ValueDecoderUnitTest::cleanupTestCase()
+{
+    QDBusConnection::sessionBus().unregisterObject("/Sink");
+    QDBusConnection::disconnectFromBus("valuedecodertest");
+}
+
+/// Sends \a value in a variant over a separate connection, and
+/// returns it as it arrives: a QDBusArgument if it's a list or a
+/// map.  The argument can be read once only, so each decoding needs
+/// a new round trip.
+QVariant ValueDecoderUnitTest::roundTrip(const QVariant &value)
+{
+    QDBusConnection sender = QDBusConnection::connectToBus(QDBusConnection::SessionBus,
+                                                           "valuedecodertest");
+    QDBusMessage msg = QDBusMessage::createMethodCall(QDBusConnection::sessionBus().baseService(),
+                                                      "/Sink",
+                                                      "org.maemo.contextkit.test.Sink",
+                                                      "Take");
+    msg << QVariant::fromValue(QDBusVariant(value));
+    sink.received = QVariant();
+    // The sink is served by the event loop of this thread.
+    QDBusMessage reply = sender.call(msg, QDBus::BlockWithGui);
+    if (reply.type() != QDBusMessage::ReplyMessage)
+        qWarning() << "round trip failed:" << reply.errorMessage();
+    return sink.received;
+}
+
+QVariantList ValueDecoderUnitTest::value()
+{
+    QVariantMap map;
+    map.insert("foo", QVariantList() << "a string" << 42);
+    map.insert("bar", true);
+    QVariantList list;
+    list << map << map;
+    return list;
+}
+
+void ValueDecoderUnitTest::decodeAny()
+{
+    // Test and expected results:
+    // Lists and maps are unpacked, giving back the value sent
+    QCOMPARE(ValueDecoder::decodeAny(roundTrip(value())), QVariant(value()));
+    QCOMPARE(ValueDecoder::decodeAny(roundTrip(value().at(0))), value().at(0));
+
+    // Basic types are demarshalled by QtDBus already
+    QCOMPARE(ValueDecoder::decodeAny(roundTrip(QVariant(42))), QVariant(42));
+    QCOMPARE(ValueDecoder::decodeAny(roundTrip(QVariant("a string"))), QVariant("a string"));
+}
+
+void ValueDecoderUnitTest::decodeDemarshalled()
+{
+    // Test and expected results:
+    // Values demarshalled already come through as they are
+    QCOMPARE(ValueDecoder::decodeAny(value()), QVariant(value()));
+    QCOMPARE(ValueDecoder::decodeAny(QVariant(42)), QVariant(42));
+    QCOMPARE(ValueDecoder::decodeMaybe(LIST(QVariant(value()))), QVariant(value()));
+    QVERIFY(ValueDecoder::decodeMaybe(QVariantList()).isNull());
+}
+
+void ValueDecoderUnitTest::decodeMaybe()
+{
+    // Test and expected results:
+    // The Maybe_Variant wrapping is removed in the same pass
+    QVariant maybe = LIST(QVariant(value()));
+    QCOMPARE(ValueDecoder::decodeMaybe(roundTrip(maybe)), QVariant(value()));
+    QCOMPARE(ValueDecoder::decodeMaybe(roundTrip(LIST(42))), QVariant(42));
+
+    // An empty Maybe_Variant is a null value
+    QVERIFY(ValueDecoder::decodeMaybe(roundTrip(QVariantList())).isNull());
+}
+
+void ValueDecoderUnitTest::decodePatch()
+{
+    // Setup:
+    // A big map, so that the patch doesn't reset it
+    QVariantMap from;
+    for (int i = 0; i < 20; ++i)
+        from.insert(QString("key%1").arg(i), i);
+    from.insert("foo", QVariantList() << "a string");
+    QVariantMap to = from;
+    to.remove("key3");
+    to.insert("foo", QVariantList() << "another" << "string");
+    to.insert("bar", false);
+    QVariant patch = ValuePatch::make(from, to, 1, 2);
+
+    // Test:
+    QVariant decoded = ValueDecoder::decodeAny(roundTrip(patch));
+
+    // Expected results:
+    // The decoded patch applies
+    QVariant patched = from;
+    quint64 version = 1;
+    QCOMPARE(ValuePatch::apply(decoded, patched, version), ValuePatch::Applied);
+    QCOMPARE(patched, QVariant(to));
+    QCOMPARE(version, (quint64) 2);
+}
+
+void ValueDecoderUnitTest::decodeReset()
+{
+    // Setup:
+    QVariant patch = ValuePatch::reset(value(), 3);
+    QVariant nullPatch = ValuePatch::reset(QVariant(), 4);
+
+    // Test:
+    QVariant decoded = ValueDecoder::decodeAny(roundTrip(patch));
+    QVariant decodedNull = ValueDecoder::decodeAny(roundTrip(nullPatch));
+
+    // Expected results:
+    QVariant patched = QVariantList() << "old";
+    quint64 version = 1;
+    QCOMPARE(ValuePatch::apply(decoded, patched, version), ValuePatch::Applied);
+    QCOMPARE(patched, QVariant(value()));
+    QCOMPARE(ValuePatch::apply(decodedNull, patched, version), ValuePatch::Applied);
+    QVERIFY(patched.isNull());
+}
+
+#undef LIST
+
+QTEST_MAIN(ValueDecoderUnitTest);
+#include "testvaluedecoder.moc"
@@ -0,0 +1,4 @@
+include(../../test.pri)
+TARGET = testvaluedecoder
+
+SOURCES = testvaluedecoder.cpp
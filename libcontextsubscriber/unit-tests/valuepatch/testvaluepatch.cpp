@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2008, 2009 Nokia Corporation.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+#include <QObject>
+#include <QtTest/QtTest>
+#include <QVariant>
+#include <QStringList>
+
+#include "valuepatch.h" // Class to be tested
+
+class ValuePatchUnitTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    // Tests
+    void patchMap();
+    void patchList();
+    void resetWhenLarge();
+    void compose();
+    void versions();
+    void malformed();
+
+private:
+    static QVariantMap bigMap();
+};
+
+QVariantMap ValuePatchUnitTest::bigMap()
+{
+    QVariantMap map;
+    for (int i = 0; i < 20; ++i)
+        map.insert(QString("key%1").arg(i), i);
+    return map;
+}
+
+void ValuePatchUnitTest::patchMap()
+{
+    QVariantMap from = bigMap();
+    QVariantMap to = from;
+    to.remove("key3");
+    to.insert("key5", "changed");
+    to.insert("new", QStringList() << "a" << "b");
+
+    QVariant patch = ValuePatch::make(from, to, 1, 2);
+    // Only the changes are carried
+    QCOMPARE(patch.toList().at(2).toList().size(), 3);
+
+    QVariant value = from;
+    quint64 version = 1;
+    QCOMPARE(ValuePatch::apply(patch, value, version), ValuePatch::Applied);
+    QCOMPARE(value, QVariant(to));
+    QCOMPARE(version, (quint64)2);
+}
+
+void ValuePatchUnitTest::patchList()
+{
+    QVariantList from;
+    for (int i = 0; i < 20; ++i)
+        from << i;
+
+    QVariantList longer = from;
+    longer[4] = "four";
+    longer << 20 << 21;
+    QVariantList shorter = from.mid(0, 18);
+    shorter[0] = 100;
+
+    QVariant value = from;
+    quint64 version = 5;
+    QCOMPARE(ValuePatch::apply(ValuePatch::make(from, longer, 5, 6), value, version),
+             ValuePatch::Applied);
+    QCOMPARE(value, QVariant(longer));
+    QCOMPARE(ValuePatch::apply(ValuePatch::make(longer, shorter, 6, 7), value, version),
+             ValuePatch::Applied);
+    QCOMPARE(value, QVariant(shorter));
+    QCOMPARE(version, (quint64)7);
+}
+
+void ValuePatchUnitTest::resetWhenLarge()
+{
+    // Most of the elements change: the whole value is sent
+    QVariantMap from = bigMap();
+    QVariantMap to;
+    to.insert("other", 1);
+    QVariant patch = ValuePatch::make(from, to, 1, 2);
+
+    QVariant value = "something else";
+    quint64 version = 0;
+    QCOMPARE(ValuePatch::apply(patch, value, version), ValuePatch::Applied);
+    QCOMPARE(value, QVariant(to));
+    QCOMPARE(version, (quint64)2);
+
+    // Values which are not maps or lists are always sent whole
+    patch = ValuePatch::make(QVariant(1), QVariant(), 2, 3);
+    QCOMPARE(ValuePatch::apply(patch, value, version), ValuePatch::Applied);
+    QVERIFY(value.isNull());
+    QCOMPARE(version, (quint64)3);
+}
+
+void ValuePatchUnitTest::compose()
+{
+    QVariantMap v1 = bigMap();
+    QVariantMap v2 = v1;
+    v2.insert("key1", "one");
+    QVariantMap v3 = v2;
+    v3.remove("key2");
+
+    QVariant patch = ValuePatch::compose(ValuePatch::make(v1, v2, 1, 2),
+                                         ValuePatch::make(v2, v3, 2, 3));
+    QVariant value = v1;
+    quint64 version = 1;
+    QCOMPARE(ValuePatch::apply(patch, value, version), ValuePatch::Applied);
+    QCOMPARE(value, QVariant(v3));
+    QCOMPARE(version, (quint64)3);
+
+    // A reset replaces whatever came before it
+    patch = ValuePatch::compose(ValuePatch::make(v1, v2, 1, 2), ValuePatch::reset(v1, 3));
+    value = QVariant();
+    version = 0;
+    QCOMPARE(ValuePatch::apply(patch, value, version), ValuePatch::Applied);
+    QCOMPARE(value, QVariant(v1));
+}
+
+void ValuePatchUnitTest::versions()
+{
+    QVariantMap v1 = bigMap();
+    QVariantMap v2 = v1;
+    v2.insert("key1", "one");
+    QVariant patch = ValuePatch::make(v1, v2, 1, 2);
+
+    // Not our version
+    QVariant value = v1;
+    quint64 version = 0;
+    QCOMPARE(ValuePatch::apply(patch, value, version), ValuePatch::Mismatch);
+    QCOMPARE(value, QVariant(v1));
+
+    // Already applied
+    version = 2;
+    QCOMPARE(ValuePatch::apply(patch, value, version), ValuePatch::Stale);
+    QCOMPARE(value, QVariant(v1));
+
+    // An empty patch only refreshes
+    QCOMPARE(ValuePatch::apply(ValuePatch::make(v1, v1, 2, 2), value, version),
+             ValuePatch::Applied);
+    QCOMPARE(value, QVariant(v1));
+    QCOMPARE(version, (quint64)2);
+}
+
+void ValuePatchUnitTest::malformed()
+{
+    QVariant value = bigMap();
+    quint64 version = 1;
+    QCOMPARE(ValuePatch::apply(QVariant("junk"), value, version), ValuePatch::Malformed);
+
+    // A list operation on a map
+    QVariantList op;
+    op << 3 << 1;
+    QVariantList patch;
+    patch << (quint64)1 << (quint64)2 << QVariant(QVariantList() << QVariant(op));
+    QCOMPARE(ValuePatch::apply(patch, value, version), ValuePatch::Malformed);
+    QCOMPARE(version, (quint64)1);
+}
+
+QTEST_MAIN(ValuePatchUnitTest);
+#include "testvaluepatch.moc"
@@ -0,0 +1,4 @@
+include(../../test.pri)
+TARGET = testvaluepatch
+
+SOURCES = testvaluepatch.cpp
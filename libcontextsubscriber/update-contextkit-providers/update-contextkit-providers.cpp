@@ -21,12 +21,15 @@
 
 #include <QCoreApplication>
 #include <QDir>
+#include <QUuid>
 #include <stdlib.h>
+#include <unistd.h>
 #include <sys/stat.h>
 #include "contextregistryinfo.h"
 #include "contextpropertyinfo.h"
 #include "contextproviderinfo.h"
 #include "cdbwriter.h"
+#include "flatregistrywriter.h"
 #include "fcntl.h"
 #include "infobackend.h"
 #include <sys/stat.h>
@@ -61,7 +64,12 @@
    \endcode
 
    In this case the xml will be read from \c "/some/path/to/registry" and the resulting
-   database will be written to \c "/some/path/to/registry/cache.cdb" .
+   database will be written to \c "/some/path/to/registry/cache.cdb" .  The same data
+   is also written to \c "/some/path/to/registry/cache.flat" , a flat file which the
+   subscribers map to memory and read in place (see FlatRegistryReader); it's used
+   instead of \c cache.cdb when it was written together with it.  Both files carry
+   the same generation string, unique for each run, and a flat cache whose generation
+   differs from the one of \c cache.cdb is ignored.
 
    Lastly, the \c "CONTEXT_PROVIDERS" environment variable can be used to specify
    a directory containing the registry.
@@ -70,6 +78,8 @@
 
    To ensure the registry consistency the regeneration is done atomically: the
    new database is first written to a temp-named file and then moved over the old one.
+   The flat cache is written after the cdb database, the same way.  Between the two
+   renames the generations differ, and the subscribers read \c cache.cdb.
 */
 
 /* Make sure the given directory exists, is readable etc.
@@ -133,12 +143,25 @@ int main(int argc, char **argv)
     // Write the compatibility string
     writer.add("VERSION", BACKEND_COMPATIBILITY_NAMESPACE);
 
+    // Write the generation, which tells the readers if the flat cache
+    // belongs to this database
+    QString generation = QUuid::createUuid().toString();
+    writer.add("GENERATION", generation);
+
+    FlatRegistryWriter flatWriter(BACKEND_COMPATIBILITY_NAMESPACE, generation);
+
+    // Tell the readers that each key has a KEYDECLARED record
+    writer.add("KEYDECLARED", true);
+
     Q_FOREACH(const QString& key, context->listKeys()) {
         ContextPropertyInfo keyInfo(key);
 
         // Write value to list key
         writer.add("KEYS", key);
 
+        // Write the existence record, looked up without decoding KEYS
+        writer.replace(key + ":KEYDECLARED", true);
+
         // Write type
         writer.replace(key + ":KEYTYPEINFO", QVariant(keyInfo.typeInfo()));
 
@@ -148,6 +171,10 @@ int main(int argc, char **argv)
         // Write deprecated
         writer.replace(key + ":KEYDEPRECATED", keyInfo.deprecated());
 
+        // Write the merge policy
+        if (keyInfo.mergePolicy() != "")
+            writer.replace(key + ":KEYMERGE", keyInfo.mergePolicy());
+
         // Write the providers
         QVariantList providers;
         Q_FOREACH(const ContextProviderInfo info, keyInfo.providers()) {
@@ -159,23 +186,61 @@ int main(int argc, char **argv)
         }
 
         writer.add(key + ":PROVIDERS", QVariant(providers));
+
+        flatWriter.addKey(key, QVariant(keyInfo.typeInfo()), keyInfo.doc(), keyInfo.deprecated(),
+                          keyInfo.mergePolicy(), keyInfo.providers());
     }
 
     if (fsync(writer.fileDescriptor()) != 0) {
         printf("ERROR: failed to fsync data on writer to %s.\n", templ.constData());
+        unlink(templ.constData());
         exit(64);
     }
 
     writer.close();
 
+    // Write the flat cache before replacing either of the caches, so
+    // that a failure leaves the old caches in place, consistent with
+    // each other
+    QString finalFlatPath = dir.absoluteFilePath("cache.flat");
+    QByteArray flatTempl = dir.absoluteFilePath("cache-XXXXXX").toUtf8();
+    int flatFd = mkstemp(flatTempl.data());
+    if (flatFd < 0) {
+        printf("ERROR: %s is not writable. No permissions?\n", flatTempl.constData());
+        unlink(templ.constData());
+        exit(128);
+    }
+    fchmod(flatFd, 0644);
+    if (!flatWriter.write(flatFd) || fsync(flatFd) != 0) {
+        printf("ERROR: failed to write data to %s.\n", flatTempl.constData());
+        unlink(flatTempl.constData());
+        unlink(templ.constData());
+        exit(64);
+    }
+    close(flatFd);
+
     // Atomically rename
     if (rename(templ.constData(), finalDbPath.toUtf8().constData()) != 0) {
         printf("ERROR: failed to rename %s to %s.\n", templ.constData(), finalDbPath.toUtf8().constData());
+        unlink(flatTempl.constData());
+        unlink(templ.constData());
         exit(64);
     }
 
-    // All ok
     printf("Generated: '%s'\n", finalDbPath.toUtf8().constData());
+
+    if (rename(flatTempl.constData(), finalFlatPath.toUtf8().constData()) != 0) {
+        // The old flat cache doesn't match the new cdb anymore, and
+        // the readers ignore it because of its generation; remove it so
+        // that it isn't mapped for nothing.
+        printf("ERROR: failed to rename %s to %s.\n", flatTempl.constData(), finalFlatPath.toUtf8().constData());
+        unlink(flatTempl.constData());
+        unlink(finalFlatPath.toUtf8().constData());
+        exit(64);
+    }
+
+    // All ok
+    printf("Generated: '%s'\n", finalFlatPath.toUtf8().constData());
     return 0;
 }
 